@@ -18,5 +18,6 @@ const char *__strerrTable[] = {
     "Out of space on device", /* ENOSPACE */
     "Pipe has no reader", /* EPIPE */
     "Invalid executable format", /* ENOEXEC */
+    "Timed out", /* ETIMEDOUT */
 };
 const int __strerrTableSize = sizeof(__strerrTable) / sizeof(const char *);
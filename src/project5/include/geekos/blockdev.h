@@ -14,15 +14,18 @@
 #include <geekos/ktypes.h>
 #include <geekos/kthread.h>
 #include <geekos/list.h>
+#include <geekos/workqueue.h>
 #include <geekos/fileio.h>
 
 #ifdef GEEKOS
 
 /*
  * Type of block device request.
+ * A BLOCK_FLUSH request has no blocks: it returns once every
+ * completed write is on the medium, not just in a drive cache.
  */
 enum Request_Type {
-    BLOCK_READ, BLOCK_WRITE
+    BLOCK_READ, BLOCK_WRITE, BLOCK_FLUSH
 };
 
 /*
@@ -41,11 +44,14 @@ DEFINE_LIST(Block_Request_List, Block_Request);
 
 /*
  * An I/O request for a block device.
+ * A request covers numBlocks consecutive blocks starting
+ * at blockNum; buf must be large enough to hold all of them.
  */
 struct Block_Request {
     struct Block_Device *dev;
     enum Request_Type type;
     int blockNum;
+    int numBlocks;
     void *buf;
     volatile enum Request_State state;
     volatile int errorCode;
@@ -56,6 +62,22 @@ struct Block_Request {
 
 IMPLEMENT_LIST(Block_Request_List, Block_Request);
 
+/*
+ * Queue of requests for a driver.
+ * Requests are handed one at a time to the driver's Handle_Request
+ * function, which runs in a kernel worker thread while the
+ * queue is non-empty.  It returns 0 or an error code.
+ * A driver whose requests never wait for hardware sets direct,
+ * and Handle_Request is then called in the requesting thread.
+ */
+struct Block_Request_Queue {
+    struct Block_Request_List requests;
+    int (*Handle_Request)(struct Block_Request *request);
+    bool busy;			/* work item queued or running */
+    bool direct;		/* skip the queue and the worker */
+    struct Work_Item work;
+};
+
 struct Block_Device;
 struct Block_Device_Ops;
 
@@ -68,8 +90,7 @@ struct Block_Device {
     int unit;
     bool inUse;
     void *driverData;
-    struct Thread_Queue *waitQueue;
-    struct Block_Request_List *requestQueue;
+    struct Block_Request_Queue *requestQueue;
 
     DEFINE_LINK(Block_Device_List, Block_Device);
 };
@@ -87,16 +108,15 @@ struct Block_Device_Ops {
  * Low level block device API.
  * Only block device drivers need to use these functions.
  */
+void Init_Block_Request_Queue(struct Block_Request_Queue *requestQueue,
+    int (*handleRequest)(struct Block_Request *request));
 int Register_Block_Device(const char *name, struct Block_Device_Ops *ops,
-    int unit, void *driverData, struct Thread_Queue *waitQueue,
-    struct Block_Request_List *requestQueue);
+    int unit, void *driverData, struct Block_Request_Queue *requestQueue);
 int Open_Block_Device(const char *name, struct Block_Device **pDev);
 int Close_Block_Device(struct Block_Device *dev);
 struct Block_Request *Create_Request(struct Block_Device *dev, enum Request_Type type,
-    int blockNum, void *buf);
+    int blockNum, int numBlocks, void *buf);
 void Post_Request_And_Wait(struct Block_Request *request);
-struct Block_Request *Dequeue_Request(struct Block_Request_List *requestQueue,
-    struct Thread_Queue *waitQueue);
 void Notify_Request_Completion(struct Block_Request *request, enum Request_State state, int errorCode);
 
 /*
@@ -105,6 +125,9 @@ void Notify_Request_Completion(struct Block_Request *request, enum Request_State
  */
 int Block_Read(struct Block_Device *dev, int blockNum, void *buf);
 int Block_Write(struct Block_Device *dev, int blockNum, void *buf);
+int Block_Read_Multiple(struct Block_Device *dev, int blockNum, int numBlocks, void *buf);
+int Block_Write_Multiple(struct Block_Device *dev, int blockNum, int numBlocks, void *buf);
+int Block_Flush(struct Block_Device *dev);
 int Get_Num_Blocks(struct Block_Device *dev);
 
 /*
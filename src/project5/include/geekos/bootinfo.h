@@ -10,9 +10,30 @@
 #ifndef GEEKOS_BOOTINFO_H
 #define GEEKOS_BOOTINFO_H
 
+/*
+ * A region of the physical memory map, as reported by int 15h, E820h.
+ * Addresses and lengths are 64 bits wide.
+ */
+struct Boot_Memory_Region {
+    unsigned long baseLow, baseHigh;
+    unsigned long lengthLow, lengthHigh;
+    unsigned long type;
+};
+
+#define BOOT_MEM_USABLE 1	 /* region type of ordinary RAM */
+#define MAX_BOOT_MEM_REGIONS 32	 /* keep up to date with setup.asm */
+
 struct Boot_Info {
     int bootInfoSize;	 /* size of this struct; for versioning */
-    int memSizeKB;	 /* number of KB, as reported by int 15h */
+    int memSizeKB;	 /* number of KB, as reported by int 15h, 88h (at most 64MB) */
+    int loadTicks;	 /* BIOS ticks the boot sector spent loading */
+    int bootTicks;	 /* BIOS ticks from boot sector to setup's last BIOS call */
+    int numMemRegions;	 /* entries in memory map; 0 if the BIOS has no E820h */
+    struct Boot_Memory_Region *memRegions;
+    unsigned long setupTSC; /* low 32 bits of the TSC at setup's last BIOS call */
 };
 
+/* The BIOS timer ticks 18.2 times a second */
+#define BIOS_TICKS_TO_MS(ticks) ((ticks) * 10000 / 182)
+
 #endif  /* GEEKOS_BOOTINFO_H */
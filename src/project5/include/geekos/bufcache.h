@@ -32,6 +32,8 @@ struct FS_Buffer {
     ulong_t fsBlockNum;		/*!< Filesystem block number. */
     void *data;			/*!< In-memory data of block. May be out of sync with disk. */
     uint_t flags;		/*!< Flags representing state of buffer. */
+    uint_t pinCount;		/*!< Number of user mappings of the data page (see Mmap). */
+    struct FS_Buffer_Cache *cache;	/*!< Cache the buffer belongs to. */
     DEFINE_LINK(FS_Buffer_List, FS_Buffer);
 };
 
@@ -45,6 +47,7 @@ IMPLEMENT_LIST(FS_Buffer_List, FS_Buffer);
 struct FS_Buffer_Cache {
     struct Block_Device *dev;		/*!< Block device. */
     uint_t fsBlockSize;			/*!< Size of filesystem blocks. */
+    ulong_t numDevBlocks;		/*!< Size of the device, in sectors. */
     uint_t numCached;			/*!< Current number of buffers (cached blocks). */
     struct FS_Buffer_List bufferList;	/*!< List of buffers. */
     struct Mutex lock;			/*!< Lock for synchronization. */
@@ -56,9 +59,16 @@ int Sync_FS_Buffer_Cache(struct FS_Buffer_Cache *cache);
 int Destroy_FS_Buffer_Cache(struct FS_Buffer_Cache *cache);
 
 int Get_FS_Buffer(struct FS_Buffer_Cache *cache, ulong_t fsBlockNum, struct FS_Buffer **pBuf);
+int Get_New_FS_Buffer(struct FS_Buffer_Cache *cache, ulong_t fsBlockNum, struct FS_Buffer **pBuf);
 void Modify_FS_Buffer(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf);
 int Sync_FS_Buffer(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf);
 int Release_FS_Buffer(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf);
 bool Buf_In_Use(struct FS_Buffer *buf);
 
+void Pin_FS_Buffer(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf);
+void Unpin_FS_Buffer(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf, bool dirty);
+void Modify_Pinned_FS_Buffer(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf);
+
+bool Reclaim_FS_Buffer(struct FS_Buffer *buf);
+
 #endif /* GEEKOS_BUFCACHE_H */
@@ -33,5 +33,7 @@
 #define ENOSPACE		-16	 /* Out of space on device */
 #define EPIPE			-17	 /* Pipe has no reader */
 #define ENOEXEC			-18	 /* Invalid executable format */
+#define ETIMEDOUT		-19	 /* Timed out */
+#define EINTR			-20	 /* Interrupted by process exit */
 
 #endif  /* GEEKOS_ERRNO_H */
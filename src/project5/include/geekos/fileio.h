@@ -40,6 +40,12 @@
 #define O_WRITE         0x4	/* Open file for writing. */
 #define O_EXCL          0x8	/* Don't create file if it already exists. */
 
+/*
+ * Protection flags for Mmap().
+ */
+#define PROT_READ       0x1	/* Mapped pages may be read. */
+#define PROT_WRITE      0x2	/* Mapped pages may be written; changes go back to the file. */
+
 /*
  * An entry in an Access Control List (ACL).
  * Represents a set of permissions for a particular user id.
@@ -55,6 +61,7 @@ struct VFS_ACL_Entry {
  */
 struct VFS_File_Stat {
     int size;
+    int numBlocks;	/* SECTOR_SIZE units actually allocated; less than size for sparse files */
     int isDirectory:1;
     int isSetuid:1;
     struct VFS_ACL_Entry acls[VFS_MAX_ACL_ENTRIES];
@@ -0,0 +1,101 @@
+/*
+ * Submission/completion rings for batched file I/O
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_IORING_H
+#define GEEKOS_IORING_H
+
+#include <stddef.h>
+#include <geekos/ktypes.h>
+
+/*
+ * A ring lives in user memory and is shared with the kernel:
+ * an IO_Ring_Header, then numEntries submissions, then numEntries
+ * completions.  The process fills submissions and advances sqTail;
+ * the kernel consumes them (advancing sqHead), and posts one
+ * completion per submission at cqTail.  The process advances cqHead
+ * once it has looked at a completion.  Indices run freely and are
+ * masked with numEntries - 1, which must be a power of two.
+ */
+#define IO_RING_MAX_ENTRIES	256
+
+/* Operations */
+#define IO_OP_NOP	0
+#define IO_OP_READ	1	/* fd, buf, length, offset */
+#define IO_OP_WRITE	2	/* fd, buf, length, offset */
+#define IO_OP_OPEN	3	/* buf = path, length = path length, fd = mode */
+#define IO_OP_CLOSE	4	/* fd */
+#define IO_OP_FSYNC	5	/* fd */
+
+/* Offset meaning "at the current file position" */
+#define IO_NO_OFFSET	((ulong_t) -1)
+
+struct IO_Submission {
+    int opcode;
+    int fd;
+    ulong_t buf;	/* user address */
+    ulong_t length;
+    ulong_t offset;	/* seek here first, unless IO_NO_OFFSET */
+    ulong_t userData;	/* handed back in the completion */
+};
+
+struct IO_Completion {
+    ulong_t userData;
+    int result;		/* what the matching system call would return */
+};
+
+struct IO_Ring_Header {
+    volatile ulong_t sqHead;	/* written by kernel */
+    volatile ulong_t sqTail;	/* written by process */
+    volatile ulong_t cqHead;	/* written by process */
+    volatile ulong_t cqTail;	/* written by kernel */
+    ulong_t numEntries;
+};
+
+#define IO_RING_SIZE(numEntries) (sizeof(struct IO_Ring_Header) + \
+    (numEntries) * (sizeof(struct IO_Submission) + sizeof(struct IO_Completion)))
+#define IO_RING_SUBMISSIONS(ring) \
+    ((struct IO_Submission*) ((char*) (ring) + sizeof(struct IO_Ring_Header)))
+#define IO_RING_COMPLETIONS(ring) \
+    ((struct IO_Completion*) (IO_RING_SUBMISSIONS(ring) + (ring)->numEntries))
+
+#ifdef GEEKOS
+
+#include <geekos/kthread.h>
+
+struct User_Context;
+
+/* Number of kernel threads carrying out each ring's submissions */
+#define IO_RING_THREADS	4
+
+/*
+ * Kernel side of a ring.  Each ring has IO_RING_THREADS kernel threads,
+ * attached to the process's user context, which carry out the
+ * submissions (see ioring.c).
+ */
+struct IO_Ring {
+    ulong_t userAddr;			/* user address of the IO_Ring_Header */
+    ulong_t numEntries;
+    int numThreads;			/* ring threads started */
+    struct Thread_Queue submitWaitQueue;	/* ring threads wait for work */
+    struct Thread_Queue completeWaitQueue;	/* Enter_IO_Ring waits for completions */
+    bool kicked;			/* Enter_IO_Ring ran since a ring thread last looked */
+    bool fetching;			/* a ring thread is taking a submission */
+    bool posting;			/* a ring thread is posting a completion */
+    bool barrier;			/* an open, close or sync is waiting or running */
+    bool closing;			/* ring threads are quitting */
+    ulong_t numInFlight;		/* submissions taken but not completed */
+    ulong_t numCompleted;		/* completions posted so far */
+};
+
+int Setup_IO_Ring(struct User_Context *context, ulong_t ringAddr, ulong_t numEntries);
+int Enter_IO_Ring(struct User_Context *context, ulong_t minComplete);
+void Kick_IO_Ring(struct User_Context *context);
+void Destroy_IO_Ring(struct User_Context *context);
+
+#endif  /* GEEKOS */
+
+#endif  /* GEEKOS_IORING_H */
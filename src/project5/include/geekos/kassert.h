@@ -25,6 +25,7 @@ do {							\
 		__func__, #cond, __FILE__, __LINE__,	\
 		(ulong_t) __builtin_return_address(0),	\
 		g_currentThread);			\
+	Flush_Kernel_Log();				\
 	while (1)					\
 	   ; 						\
     }							\
@@ -34,6 +35,7 @@ do {							\
 do {							\
     Set_Current_Attr(ATTRIB(BLUE, GRAY|BRIGHT));	\
     Print("Unimplemented feature: %s\n", (message));	\
+    Flush_Kernel_Log();					\
     while (1)						\
 	;						\
 } while (0)
@@ -75,6 +77,7 @@ do {					\
 do {						\
     Set_Current_Attr(ATTRIB(RED, GRAY|BRIGHT));	\
     Print(args);				\
+    Flush_Kernel_Log();				\
     while (1) ;					\
 } while (0)
 
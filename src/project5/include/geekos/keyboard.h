@@ -126,6 +126,9 @@ void Init_Keyboard(void);
 bool Read_Key(Keycode* keycode);
 Keycode Wait_For_Key(void);
 
+struct File;
+int Open_Console(struct File **pFile);
+
 #endif  /* GEEKOS */
 
 #endif  /* GEEKOS_KEYBOARD_H */
@@ -12,6 +12,7 @@
 
 #include <geekos/ktypes.h>
 #include <geekos/list.h>
+#include <geekos/timer.h>
 
 struct Kernel_Thread;
 struct User_Context;
@@ -50,6 +51,12 @@ struct Kernel_Thread {
     struct Thread_Queue joinQueue;
     int exitCode;
 
+    /*
+     * Process whose threads may join this one (see Sys_CreateThread);
+     * the process holds a reference on the thread until then.
+     */
+    struct User_Context* joinContext;
+
     /* The kernel thread id; also used as process id */
     int pid;
 
@@ -67,6 +74,24 @@ struct Kernel_Thread {
     int currentReadyQueue;
     bool blocked;
 
+    /*
+     * Proportional share under SCHEDULING_STRIDE: the thread's pass
+     * (virtual time) advances by its stride, which is inversely
+     * proportional to its weight, for every tick it runs.
+     */
+    int weight;
+    ulong_t stride;
+    ulong_t pass;
+
+    /* Set while the thread sleeps in Wait_Interruptible() */
+    struct Thread_Queue *interruptibleQueue;
+
+    /* Set while the thread sleeps in Wait_Timeout() */
+    struct Thread_Queue *timedWaitQueue;
+    timerEvent waitTimer;
+    int waitTimerId;
+    bool waitTimedOut;
+
 #define MAX_SEMAPHORES_REFS 8
 #define REF_TO_NO_SEMAPHORE -1
     volatile uint_t registeredSemaphores;
@@ -117,6 +142,8 @@ struct Kernel_Thread* Start_Kernel_Thread(
     bool detached
 );
 struct Kernel_Thread* Start_User_Thread(struct User_Context* userContext, bool detached);
+struct Kernel_Thread* Start_User_Thread_At(struct User_Context* userContext,
+    ulong_t entryAddr, ulong_t stackPointerAddr, bool detached);
 void Make_Runnable(struct Kernel_Thread* kthread);
 void Make_Runnable_Atomic(struct Kernel_Thread* kthread);
 struct Kernel_Thread* Get_Current(void);
@@ -125,7 +152,11 @@ void Schedule(void);
 void Yield(void);
 void Exit(int exitCode) __attribute__ ((noreturn));
 int Join(struct Kernel_Thread* kthread);
+bool Join_Timeout(struct Kernel_Thread* kthread, int ticks, int *pExitCode);
 struct Kernel_Thread* Lookup_Thread(int pid);
+int Join_User_Thread(int tid);
+void Reap_Unjoined_Threads(struct User_Context* userContext);
+struct Kernel_Thread* Get_Next_Thread(struct Kernel_Thread* kthread);
 
 /*
  * Thread context switch function, defined in lowlevel.asm
@@ -136,6 +167,10 @@ void Switch_To_Thread(struct Kernel_Thread*);
  * Wait queue functions.
  */
 void Wait(struct Thread_Queue* waitQueue);
+bool Wait_Timeout(struct Thread_Queue* waitQueue, int ticks);
+bool Wait_Interruptible(struct Thread_Queue* waitQueue);
+bool Exit_Requested(void);
+void Interrupt_Process_Threads(struct User_Context* userContext);
 void Wake_Up(struct Thread_Queue* waitQueue);
 void Wake_Up_One(struct Thread_Queue* waitQueue);
 
@@ -150,9 +185,12 @@ extern struct Kernel_Thread* g_currentThread;
 extern int g_needReschedule;
 
 /*
- * Boolean flag indicating that preemption should be disabled.
+ * Preemption is disabled while this count is non-zero.
  */
-extern volatile int g_preemptionDisabled;
+extern volatile int g_preemptCount;
+
+void Disable_Preemption(void);
+void Enable_Preemption(void);
 
 /*
  * Thread-local data information
@@ -162,11 +200,21 @@ extern volatile int g_preemptionDisabled;
 // Schedule policy
 #define SCHEDULING_RR 0
 #define SCHEDULING_MLFQ 1
+#define SCHEDULING_STRIDE 2
 #define DEFAULT_SCHEDULING_POLICY SCHEDULING_RR
 
+// Weights for SCHEDULING_STRIDE
+#define STRIDE_ONE (1UL << 20)
+#define MIN_WEIGHT 1
+#define MAX_WEIGHT 100
+#define DEFAULT_WEIGHT 10
+
 extern volatile int g_schedulingPolicy;
 
 void Move_Threads_To_0_Except_Idle(void);
+void Change_Scheduling_Policy(int policy);
+int Set_Thread_Weight(struct Kernel_Thread* kthread, int weight);
+void Update_Process_Strides(struct User_Context* userContext);
 
 typedef void (*tlocal_destructor_t)(void *);
 typedef unsigned int tlocal_key_t;
@@ -24,9 +24,14 @@ struct listTypeName {					\
 /*
  * Define members of a struct to be used as link fields for
  * membership in given list type.
+ * The owner field records the list the node is on (0 if none),
+ * so membership can be checked in constant time.  Link fields
+ * must be zeroed before a node is added to a list for the first
+ * time (e.g., by clearing the node after allocating it).
  */
 #define DEFINE_LINK(listTypeName, nodeTypeName) \
-    struct nodeTypeName * prev##listTypeName, * next##listTypeName
+    struct nodeTypeName * prev##listTypeName, * next##listTypeName; \
+    struct listTypeName * owner##listTypeName
 
 /*
  * Define inline list manipulation and access functions.
@@ -36,13 +41,7 @@ static __inline__ void Clear_##LType(struct LType *listPtr) {					\
     listPtr->head = listPtr->tail = 0;								\
 }												\
 static __inline__ bool Is_Member_Of_##LType(struct LType *listPtr, struct NType *nodePtr) {	\
-    struct NType *cur = listPtr->head;								\
-    while (cur != 0) {										\
-	if (cur == nodePtr)									\
-	    return true;									\
-	cur = cur->next##LType;									\
-    }												\
-    return false;										\
+    return nodePtr->owner##LType == listPtr;							\
 }												\
 static __inline__ struct NType * Get_Front_Of_##LType(struct LType *listPtr) {			\
     return listPtr->head;									\
@@ -63,7 +62,8 @@ static __inline__ void Set_Prev_In_##LType(struct NType *nodePtr, struct NType *
     nodePtr->prev##LType = value;								\
 }												\
 static __inline__ void Add_To_Front_Of_##LType(struct LType *listPtr, struct NType *nodePtr) {	\
-    KASSERT(!Is_Member_Of_##LType(listPtr, nodePtr));						\
+    KASSERT(nodePtr->owner##LType == 0);							\
+    nodePtr->owner##LType = listPtr;								\
     nodePtr->prev##LType = 0;									\
     if (listPtr->head == 0) {									\
 	listPtr->head = listPtr->tail = nodePtr;						\
@@ -75,7 +75,8 @@ static __inline__ void Add_To_Front_Of_##LType(struct LType *listPtr, struct NTy
     }												\
 }												\
 static __inline__ void Add_To_Back_Of_##LType(struct LType *listPtr, struct NType *nodePtr) {	\
-    KASSERT(!Is_Member_Of_##LType(listPtr, nodePtr));						\
+    KASSERT(nodePtr->owner##LType == 0);							\
+    nodePtr->owner##LType = listPtr;								\
     nodePtr->next##LType = 0;									\
     if (listPtr->tail == 0) {									\
 	listPtr->head = listPtr->tail = nodePtr;						\
@@ -88,6 +89,9 @@ static __inline__ void Add_To_Back_Of_##LType(struct LType *listPtr, struct NTyp
     }												\
 }												\
 static __inline__ void Append_##LType(struct LType *listToModify, struct LType *listToAppend) {	\
+    struct NType *cur;										\
+    for (cur = listToAppend->head; cur != 0; cur = cur->next##LType)				\
+	cur->owner##LType = listToModify;							\
     if (listToAppend->head != 0) {								\
 	if (listToModify->head == 0) {								\
 	    listToModify->head = listToAppend->head;						\
@@ -106,6 +110,7 @@ static __inline__ struct NType * Remove_From_Front_Of_##LType(struct LType *list
     struct NType *nodePtr;									\
     nodePtr = listPtr->head;									\
     KASSERT(nodePtr != 0);									\
+    nodePtr->owner##LType = 0;									\
     listPtr->head = listPtr->head->next##LType;							\
     if (listPtr->head == 0)									\
 	listPtr->tail = 0;									\
@@ -115,6 +120,7 @@ static __inline__ struct NType * Remove_From_Front_Of_##LType(struct LType *list
 }												\
 static __inline__ void Remove_From_##LType(struct LType *listPtr, struct NType *nodePtr) {	\
     KASSERT(Is_Member_Of_##LType(listPtr, nodePtr));						\
+    nodePtr->owner##LType = 0;									\
     if (nodePtr->prev##LType != 0)								\
 	nodePtr->prev##LType->next##LType = nodePtr->next##LType;				\
     else											\
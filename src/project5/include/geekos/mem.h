@@ -17,6 +17,8 @@
 #include <geekos/paging.h>
 
 struct Boot_Info;
+struct FS_Buffer;
+struct User_Context;
 
 /*
  * Page flags
@@ -29,6 +31,8 @@ struct Boot_Info;
 #define PAGE_HEAP      0x0010	 /* page is in kernel heap */
 #define PAGE_PAGEABLE  0x0020	 /* page can be paged out */
 #define PAGE_LOCKED    0x0040    /* page is taken should not be freed */
+#define PAGE_FILE      0x0080    /* page holds buffer cache data, reclaimable when clean */
+#define PAGE_REFERENCED 0x0100   /* file page used since the clock hand last passed */
 
 /*
  * PC memory map
@@ -42,6 +46,13 @@ struct Boot_Info;
  */
 #define HIGHMEM_START (ISA_HOLE_END + 8192)
 
+/*
+ * Physical memory is identity mapped into the kernel's half of
+ * the address space, below USER_BASE_VADDR, so any RAM at or above
+ * this address can't be used.
+ */
+#define MAX_PHYS_MEM 0x80000000UL
+
 /*
  * Make the kernel heap this size
  */
@@ -61,18 +72,25 @@ DEFINE_LIST(Page_List, Page);
 struct Page {
     unsigned flags;			 /* Flags indicating state of page */
     DEFINE_LINK(Page_List, Page);	 /* Link fields for Page_List */
-    int clock;
     ulong_t vaddr;			 /* User virtual address where page is mapped */
     pte_t *entry;			 /* Page table entry referring to the page */
+    struct FS_Buffer *buffer;		 /* Buffer whose data is in the page (PAGE_FILE) */
+    struct User_Context *context;	 /* Process the page is counted against (PAGE_PAGEABLE) */
 };
 
 IMPLEMENT_LIST(Page_List, Page);
 
+extern uint_t g_numPages;
+
 void Init_Mem(struct Boot_Info* bootInfo);
 void Init_BSS(void);
 void* Alloc_Page(void);
-void* Alloc_Pageable_Page(pte_t *entry, ulong_t vaddr);
+void* Alloc_Pageable_Page(struct User_Context *context, pte_t *entry, ulong_t vaddr);
+bool Page_Out(struct Page *page);
 void Free_Page(void* pageAddr);
+void Add_File_Page(void* pageAddr, struct FS_Buffer *buf);
+void Remove_File_Page(void* pageAddr);
+void Touch_File_Page(void* pageAddr);
 
 /*
  * Determine if given address is a multiple of the page size.
@@ -111,10 +111,14 @@ static __inline__ ulong_t Get_Page_Fault_Address(void)
     return faultAddress;
 }
 
+struct Paging_Device;
+
+int Init_Paging_Device(struct Paging_Device *pagingDev);
 int Find_Space_On_Paging_File(void);
 void Free_Space_On_Paging_File(int pagefileIndex);
 void Write_To_Paging_File(void *paddr, ulong_t vaddr, int pagefileIndex);
 void Read_From_Paging_File(void *paddr, ulong_t vaddr, int pagefileIndex);
+void Dump_Paging_Devices(void);
 
 
 #endif
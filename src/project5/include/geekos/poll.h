@@ -0,0 +1,70 @@
+/*
+ * Waiting for readiness on several files at once
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_POLL_H
+#define GEEKOS_POLL_H
+
+#include <geekos/ktypes.h>
+
+/* Readiness events */
+#define POLL_IN		0x1	/* Read won't block */
+#define POLL_OUT	0x2	/* Write won't block */
+#define POLL_HUP	0x4	/* Other end of a pipe is gone; always reported */
+#define POLL_NVAL	0x8	/* Not an open file descriptor; always reported */
+
+/* Largest number of descriptors one Poll() may wait on */
+#define POLL_MAX_FDS	64
+
+struct Poll_Fd {
+    int fd;
+    int events;		/* events of interest */
+    int revents;	/* filled in by Poll() */
+};
+
+#ifdef GEEKOS
+
+#include <geekos/list.h>
+#include <geekos/kthread.h>
+
+struct File;
+struct User_Context;
+struct Poll_Table;
+struct Poll_Entry;
+
+DEFINE_LIST(Poll_Entry_List, Poll_Entry);
+
+/*
+ * Registration of a polling thread on one wait list of a file.
+ * An object that can become ready keeps a Poll_Entry_List,
+ * and calls Poll_Wake() on it whenever its readiness changes.
+ */
+struct Poll_Entry {
+    struct Poll_Table *table;
+    struct Poll_Entry_List *list;
+
+    DEFINE_LINK(Poll_Entry_List, Poll_Entry);
+};
+
+IMPLEMENT_LIST(Poll_Entry_List, Poll_Entry);
+
+/*
+ * State of one Poll() call.
+ */
+struct Poll_Table {
+    struct Thread_Queue waitQueue;	/* the polling thread sleeps here */
+    bool triggered;			/* some file became ready */
+    struct Poll_Entry *entries;
+    int numEntries, maxEntries;
+};
+
+void Poll_Wait(struct Poll_Table *table, struct Poll_Entry_List *list);
+void Poll_Wake(struct Poll_Entry_List *list);
+int Poll_Files(struct User_Context *context, struct Poll_Fd *fds, int numFds, int timeoutTicks);
+
+#endif  /* GEEKOS */
+
+#endif  /* GEEKOS_POLL_H */
@@ -0,0 +1,30 @@
+/*
+ * RAM disk driver
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_RAMDISK_H
+#define GEEKOS_RAMDISK_H
+
+#ifdef GEEKOS
+
+/*
+ * Size of the ram0 device, allocated at boot.
+ * Set to 0 to leave the device out.
+ */
+#define RAMDISK_SIZE_KB 2048
+
+/*
+ * Set to 1 to use all of ram0 as a paging device, ahead of the
+ * paging files on disk.  It is then not preloaded from an image.
+ */
+#define RAMDISK_PAGING 0
+
+void Init_Ram_Disk(void);
+int Preload_Ram_Disk(const char *path);
+
+#endif  /* GEEKOS */
+
+#endif  /* GEEKOS_RAMDISK_H */
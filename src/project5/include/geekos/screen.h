@@ -41,6 +41,15 @@
 #define CRT_CURSOR_LOC_HIGH_REG 0x0E
 #define CRT_CURSOR_LOC_LOW_REG 0x0F
 
+/*
+ * Kernel log (see Print()): size of the ring, the most the log
+ * thread writes out in one go, and how often it looks for text
+ * logged with interrupts disabled.
+ */
+#define KLOG_SIZE 16384
+#define KLOG_FLUSH_CHUNK 256
+#define KLOG_FLUSH_TICKS 2
+
 void Init_Screen(void);
 void Clear_Screen(void);
 void Get_Cursor(int* row, int* col);
@@ -51,6 +60,9 @@ void Put_Char(int c);
 void Put_String(const char* s);
 void Put_Buf(const char* buf, ulong_t length);
 void Print(const char* fmt, ...) __attribute__ ((format (printf, 1, 2)));
+void Init_Kernel_Log(void);
+void Flush_Kernel_Log(void);
+ulong_t Read_Kernel_Log(char *buf, ulong_t bufSize);
 
 #endif  /* GEEKOS */
 
@@ -0,0 +1,20 @@
+/*
+ * Serial port output
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_SERIAL_H
+#define GEEKOS_SERIAL_H
+
+#include <geekos/ktypes.h>
+
+/* COM1 */
+#define SERIAL_BASE_PORT 0x3F8
+
+void Init_Serial(void);
+bool Serial_Present(void);
+void Serial_Put_Buf(const char *buf, ulong_t length);
+
+#endif  /* GEEKOS_SERIAL_H */
@@ -0,0 +1,40 @@
+/*
+ * Deferred interrupt work (tasklets)
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_SOFTIRQ_H
+#define GEEKOS_SOFTIRQ_H
+
+#include <geekos/ktypes.h>
+#include <geekos/list.h>
+
+struct Interrupt_State;
+struct Tasklet;
+
+DEFINE_LIST(Tasklet_List, Tasklet);
+
+/*
+ * Work scheduled by an interrupt handler to run when the
+ * handler returns, with interrupts enabled.
+ * A tasklet runs on the stack of the interrupted thread,
+ * so it must not block.  A tasklet scheduled again before
+ * it has run still runs only once.
+ */
+struct Tasklet {
+    void (*func)(ulong_t arg);
+    ulong_t arg;
+
+    DEFINE_LINK(Tasklet_List, Tasklet);
+};
+
+IMPLEMENT_LIST(Tasklet_List, Tasklet);
+
+#define TASKLET_INITIALIZER(func, arg) { (func), (arg), 0, 0, 0 }
+
+void Schedule_Tasklet(struct Tasklet *tasklet);
+void Run_Softirqs(struct Interrupt_State *state);
+
+#endif  /* GEEKOS_SOFTIRQ_H */
@@ -0,0 +1,42 @@
+/*
+ * Compressed in-memory cache in front of the paging file
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_SWAPCACHE_H
+#define GEEKOS_SWAPCACHE_H
+
+#include <geekos/ktypes.h>
+
+/*
+ * Number of kernel pages set aside for compressed pages.
+ * Set to 0 to send every evicted page straight to disk.
+ */
+#define SWAP_CACHE_PAGES 64
+
+/*
+ * Counters, for working out the compression ratio
+ * (bytesIn / bytesOut) and the hit rate (hits / (hits + misses)).
+ */
+struct Swap_Cache_Stats {
+    ulong_t stores;		/* evicted pages kept in the pool */
+    ulong_t rejects;		/* evicted pages sent to disk: incompressible or pool full */
+    ulong_t hits;		/* page ins served from the pool */
+    ulong_t misses;		/* page ins read from disk */
+    ulong_t bytesIn;		/* uncompressed size of stored pages */
+    ulong_t bytesOut;		/* compressed size of stored pages */
+    ulong_t chunksUsed;		/* pool space in use, in chunks */
+};
+
+extern struct Swap_Cache_Stats g_swapCacheStats;
+
+void Init_Swap_Cache(int numSlots);
+void Grow_Swap_Cache(int numSlots);
+bool Swap_Cache_Store(void *paddr, int pagefileIndex);
+bool Swap_Cache_Load(void *paddr, int pagefileIndex);
+void Swap_Cache_Drop(int pagefileIndex);
+void Dump_Swap_Cache_Stats(void);
+
+#endif  /* GEEKOS_SWAPCACHE_H */
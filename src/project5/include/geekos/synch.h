@@ -31,10 +31,12 @@ struct Condition {
 
 void Mutex_Init(struct Mutex* mutex);
 void Mutex_Lock(struct Mutex* mutex);
+bool Mutex_Lock_Timeout(struct Mutex* mutex, int ticks);
 void Mutex_Unlock(struct Mutex* mutex);
 
 void Cond_Init(struct Condition* cond);
 void Cond_Wait(struct Condition* cond, struct Mutex* mutex);
+bool Cond_Timed_Wait(struct Condition* cond, struct Mutex* mutex, int ticks);
 void Cond_Signal(struct Condition* cond);
 void Cond_Broadcast(struct Condition* cond);
 
@@ -57,6 +59,7 @@ extern struct Semaphore g_allSemaphores[MAX_SEMAPHORE_NUM];
 
 int Init_Semaphore(char *name, uchar_t nameLen, int resource);
 int Semaphore_Acquire(uint_t id);
+int Semaphore_Acquire_Timeout(uint_t id, int ticks);
 int Semaphore_Release(uint_t id);
 int Destroy_Semaphore(uint_t id);
 void Register_Semaphore(uint_t id);
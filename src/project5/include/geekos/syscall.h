@@ -67,6 +67,25 @@ enum {
     SYS_CREATEDIR,	 /* Create directory system call  */
     SYS_SYNC,		 /* Sync filesystems system call  */
     SYS_FORMAT,		 /* Format filesystem system call  */
+    SYS_DUP2,		 /* Duplicate file descriptor system call  */
+    SYS_MMAP,		 /* Map file into memory system call  */
+    SYS_MUNMAP,		 /* Unmap file system call  */
+    SYS_FSYNC,		 /* Flush file to disk system call  */
+    SYS_SBRK,		 /* Grow or shrink heap system call  */
+    SYS_MAPANONYMOUS,	 /* Map zero-filled memory system call  */
+    SYS_CREATETHREAD,	 /* Start thread in current process system call  */
+    SYS_JOINTHREAD,	 /* Wait for thread system call  */
+    SYS_EXITTHREAD,	 /* Exit current thread system call  */
+    SYS_IORINGSETUP,	 /* Register I/O ring system call  */
+    SYS_IORINGENTER,	 /* Submit/wait on I/O ring system call  */
+    SYS_CREATEPIPE,	 /* Create pipe system call  */
+    SYS_POLL,		 /* Wait for file descriptors system call  */
+    SYS_PTIMEOUT,	 /* Timed semaphore acquire system call  */
+    SYS_WAITTIMEOUT,	 /* Timed wait for process system call  */
+    SYS_SETWEIGHT,	 /* Set stride scheduling weight system call  */
+    SYS_READKLOG,	 /* Read kernel log system call  */
+    SYS_OPENCONSOLE,	 /* Open console as a file system call  */
+    SYS_YIELD,		 /* Give up the CPU system call  */
 };
 
 /*
@@ -0,0 +1,35 @@
+/*
+ * Thrashing control
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_THRASH_H
+#define GEEKOS_THRASH_H
+
+#include <geekos/ktypes.h>
+
+struct User_Context;
+
+/*
+ * Length of a sampling window, in timer ticks (the timer
+ * runs at about 18 Hz, so this is about a second).
+ */
+#define PFF_WINDOW_TICKS 18
+
+/*
+ * Page-ins per window, over all processes, above which the system
+ * is thrashing and a process is suspended, and at or below which
+ * a suspended process may come back.
+ */
+#define PFF_HIGH_RATE 64
+#define PFF_LOW_RATE 8
+
+void Init_Thrash_Control(void);
+void Note_Page_In(struct User_Context *context);
+void Wait_While_Suspended(struct User_Context *context);
+void Resume_Process(struct User_Context *context);
+void Dump_Thrash_Stats(void);
+
+#endif  /* GEEKOS_THRASH_H */
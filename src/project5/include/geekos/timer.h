@@ -10,10 +10,16 @@
 #ifndef GEEKOS_TIMER_H
 #define GEEKOS_TIMER_H
 
+#include <geekos/ktypes.h>
+#include <geekos/list.h>
+
 #define TIMER_IRQ 0
 
 extern volatile ulong_t g_numTicks;
 
+/* TSC cycles per timer tick, measured by Init_Timer() */
+extern ulong_t g_tscPerTick;
+
 extern int g_Quantum;
 
 typedef void (*timerCallback)(int);
@@ -22,16 +28,30 @@ void Init_Timer(void);
 
 void Micro_Delay(int us);
 
-typedef struct {
+/*
+ * A pending timer event.  Events started with Start_Timer() come
+ * from a fixed pool; a caller which must not run out of timers
+ * provides its own event to Start_Timer_Event() instead.
+ * An event is one-shot: it is off the pending list by the time
+ * its callback runs.
+ */
+struct Timer_Event;
+DEFINE_LIST(Timer_Event_List, Timer_Event);
+typedef struct Timer_Event {
     int ticks;				 /* timer code decrements this */
     int id;				 /* unqiue id for this timer even */
     timerCallback callBack;		 /* Queue to wakeup on timer expire */
     int origTicks;
+    DEFINE_LINK(Timer_Event_List, Timer_Event);
 } timerEvent;
 
+IMPLEMENT_LIST(Timer_Event_List, Timer_Event);
+
 int Start_Timer(int ticks, timerCallback);
+int Start_Timer_Event(timerEvent *event, int ticks, timerCallback);
 int Get_Remaing_Timer_Ticks(int id);
 int Cancel_Timer(int id);
+void Cancel_Timer_Event(timerEvent *event);
 
 void Micro_Delay(int us);
 
@@ -0,0 +1,25 @@
+/*
+ * Memory-resident filesystem
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_TMPFS_H
+#define GEEKOS_TMPFS_H
+
+/*
+ * A tmpfs has no block device; mount it with
+ *   Mount("none", "t", "tmpfs")
+ * Everything in it is lost when the system goes down.
+ */
+
+/* Maximum length of a name in a directory */
+#define TMPFS_NAME_MAX 127
+
+/* Initial number of hash buckets in a directory */
+#define TMPFS_MIN_BUCKETS 8
+
+void Init_TMPFS(void);
+
+#endif /* GEEKOS_TMPFS_H */
@@ -0,0 +1,47 @@
+/*
+ * Kernel tracepoint log
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_TRACE_H
+#define GEEKOS_TRACE_H
+
+#include <geekos/ktypes.h>
+
+/*
+ * Kinds of trace records.
+ */
+enum Trace_Event {
+    TRACE_SCHED_LATENCY,	/* arg: cycles from reschedule request to thread switch */
+    TRACE_PREEMPT_OFF,		/* arg: cycles preemption stayed disabled */
+    TRACE_NUM_EVENTS
+};
+
+/*
+ * A record in the trace log.
+ * Times are the low 32 bits of the time stamp counter.
+ */
+struct Trace_Record {
+    ulong_t time;
+    ulong_t event;
+    ulong_t arg;
+};
+
+/* Worst values seen for each kind of record, in cycles. */
+extern ulong_t g_traceMax[TRACE_NUM_EVENTS];
+
+static __inline__ ulong_t Read_TSC(void)
+{
+    ulong_t low, high;
+    __asm__ __volatile__ ("rdtsc" : "=a" (low), "=d" (high));
+    return low;
+}
+
+void Trace(enum Trace_Event event, ulong_t arg);
+void Trace_Reschedule_Request(void);
+void Trace_Thread_Switch(void);
+void Dump_Trace_Log(void);
+
+#endif  /* GEEKOS_TRACE_H */
@@ -15,11 +15,45 @@
 #include <geekos/segment.h>
 #include <geekos/elf.h>
 #include <geekos/paging.h>
+#include <geekos/list.h>
 
 struct File;
 
-/* Number of files user process can have open. */
-#define USER_MAX_FILES		10
+/*
+ * Number of files user process can have open.
+ * The descriptor table starts with USER_INITIAL_FILES slots
+ * and doubles in size as needed, up to USER_MAX_FILES.
+ */
+#define USER_INITIAL_FILES	16
+#define USER_MAX_FILES		1024
+
+/*
+ * Range of user addresses where Mmap() and Map_Anonymous() place
+ * mappings.  The heap (see Sbrk) grows from the end of the
+ * program image up to USER_MMAP_START.
+ */
+#define USER_MMAP_START	0x40000000
+#define USER_MMAP_END	0x7F000000
+
+/*
+ * A file or anonymous memory mapped into a user address space
+ * (see Mmap and Map_Anonymous).
+ * Pages are mapped lazily by the page fault handler.
+ */
+struct Mmap_Region;
+DEFINE_LIST(Mmap_Region_List, Mmap_Region);
+struct Mmap_Region {
+    ulong_t start;		/* user address, page aligned */
+    ulong_t numPages;
+    struct File *file;		/* holds a reference on the file; 0 for anonymous memory */
+    ulong_t offset;		/* file offset of the first page */
+    int prot;			/* PROT_READ/PROT_WRITE */
+    void **pageCookies;		/* Map_Page() cookie of each mapped page, 0 for a zero-filled hole
+				   (file mappings only) */
+    DEFINE_LINK(Mmap_Region_List, Mmap_Region);
+};
+
+IMPLEMENT_LIST(Mmap_Region_List, Mmap_Region);
 
 /*
  * A user mode context which can be attached to a Kernel_Thread,
@@ -66,15 +100,44 @@ struct User_Context {
     /* Initial stack pointer */
     ulong_t stackPointerAddr;
 
-    /*
-     * May use this in future to allow multiple threads
-     * in the same user context
-     */
+    /* Number of threads sharing this context (see Sys_CreateThread) */
     int refCount;
 
+    /* Stride scheduling weight, shared out among the threads */
+    int weight;
+
+    /* Set by Sys_Exit; the other threads exit on their way back to user mode */
+    volatile bool exiting;
+    int exitCode;
+
     // File operation support
-    struct File *fdTable[USER_MAX_FILES];
+    struct File **fdTable;	/* fdTableSize slots, 0 if slot is free */
+    ulong_t *fdBitmap;		/* one bit per slot, set if slot in use */
+    int fdTableSize;
+    int fdFirstFree;		/* no free slot below this index */
     int numOpenedFiles;
+
+    /* Submission/completion ring for batched I/O, if registered */
+    struct IO_Ring *ioRing;
+
+    /* Memory mapped files and anonymous regions */
+    struct Mmap_Region_List mmapList;
+    ulong_t mmapGeneration;	/* bumped whenever a region is unmapped */
+
+    /* Heap: [heapStart, heapBreak) in user addresses, zero-filled on demand */
+    ulong_t heapStart;
+    ulong_t heapBreak;
+
+    /* Paging activity, for thrashing control (see thrash.c) */
+    int residentPages;		/* pageable pages in memory */
+    ulong_t pageIns;		/* pages brought back from the paging file */
+    int windowPageIns;		/* page-ins in the current sampling window */
+    int faultRate;		/* page-ins in the last complete window */
+    volatile bool suspended;	/* swapped out, threads wait in Wait_While_Suspended() */
+    ulong_t suspendTick;
+    int suspendedPages;		/* resident set when it was suspended */
+    ulong_t visitStamp;		/* last walk over the threads that counted it */
+    int pffPriority;		/* priority, as of the last sampling window */
 };
 
 struct Kernel_Thread;
@@ -89,6 +152,14 @@ void Detach_User_Context(struct Kernel_Thread* kthread);
 int Spawn(const char *program, const char *command, struct Kernel_Thread **pThread);
 void Switch_To_User_Context(struct Kernel_Thread* kthread, struct Interrupt_State* state);
 
+int Alloc_File_Descriptor(struct User_Context* context, struct File* file);
+struct File* Get_File_Descriptor(struct User_Context* context, ulong_t fd);
+struct File* Hold_File_Descriptor(struct User_Context* context, ulong_t fd);
+void Put_File(struct File* file);
+int Close_File_Descriptor(struct User_Context* context, ulong_t fd);
+int Dup_File_Descriptor(struct User_Context* context, ulong_t oldFd, ulong_t newFd);
+void Close_All_File_Descriptors(struct User_Context* context);
+
 /*
  * Implementation routines: these are in userseg.c or uservm.c
  */
@@ -101,6 +172,15 @@ bool Copy_From_User(void* destInKernel, ulong_t srcInUser, ulong_t bufSize);
 bool Copy_To_User(ulong_t destInUser, void* srcInKernel, ulong_t bufSize);
 void Switch_To_Address_Space(struct User_Context *userContext);
 
+int Mmap_File(struct User_Context *context, struct File *file, ulong_t offset,
+    ulong_t length, int prot);
+int Munmap_File(struct User_Context *context, ulong_t addr, ulong_t length);
+void Sync_Mapped_File(struct User_Context *context, struct File *file);
+int Map_Anonymous_Region(struct User_Context *context, ulong_t length);
+int Change_Heap_Break(struct User_Context *context, int increment);
+bool Handle_User_Memory_Fault(struct User_Context *context, ulong_t address, faultcode_t faultCode);
+int Swap_Out_User_Context(struct User_Context *context);
+
 #define USER_BASE_VADDR 0x80000000
 #define USER_SEG_LIMIT 0x80000000
 #define VA_END 0xFFFFFFFF
@@ -28,6 +28,7 @@ struct Mount_Point;
 struct File;
 struct Mount_Point_Ops;
 struct File_Ops;
+struct Poll_Table;
 
 /*
  * Operations providing support for formatting and mounting
@@ -75,6 +76,13 @@ struct File {
      */
     int mode;			 /* Mode (read vs. write). */
     struct Mount_Point *mountPoint; /* Mounted filesystem file is part of. */
+
+    /*
+     * Number of file descriptors referring to this file.
+     * Set to 1 by Allocate_File(); the file is only closed
+     * when the last descriptor (see Dup2) goes away.
+     */
+    int refCount;
 };
 
 /* Operations that can be performed on a File. */
@@ -85,6 +93,27 @@ struct File_Ops {
     int (*Seek)(struct File *file, ulong_t pos);
     int (*Close)(struct File *file);
     int (*Read_Entry)(struct File *dir, struct VFS_Dir_Entry *entry);  /* Read next directory entry. */
+
+    /*
+     * Optional: direct access to page-sized units of file data,
+     * used to implement memory mapped files (see Mmap).
+     * Map_Page returns the page at given (page aligned) offset
+     * and a cookie identifying it; the page stays valid until
+     * Unmap_Page is called.  Dirty_Page records a write through
+     * the mapping without unmapping the page.
+     */
+    int (*Map_Page)(struct File *file, ulong_t offset, bool forWrite, void **pPage, void **pCookie);
+    void (*Unmap_Page)(struct File *file, void *cookie, bool dirty);
+    void (*Dirty_Page)(struct File *file, void *cookie);
+
+    /*
+     * Optional: report which of POLL_IN, POLL_OUT and POLL_HUP
+     * (see <geekos/poll.h>) the file is ready for, and, if table is
+     * not null, register it with Poll_Wait() on the wait list the file
+     * will Poll_Wake() when that changes.  Called with interrupts
+     * disabled; must not block.  Files without it are always ready.
+     */
+    int (*Poll)(struct File *file, struct Poll_Table *table);
 };
 
 /*
@@ -92,14 +121,33 @@ struct File_Ops {
  * as a paging device.  The disk space in the paging file will be
  * used to store the data of pages that have been temporarily evicted
  * due to a memory shortage.
+ *
+ * There may be several paging devices.  Evicted pages go to the
+ * devices with the highest priority until they are full, spread
+ * round robin over the devices that share that priority.
  */
 struct Paging_Device {
     char *fileName;		 /* Name of paging file. */
     struct Block_Device *dev;	 /* Block device for paging file. */
     ulong_t startSector;	 /* Start sector of paging file. */
     ulong_t numSectors;		 /* Number of sectors in paging file. */
+    int priority;		 /* Higher priority devices are used first. */
+
+    /* Filled in by Register_Paging_Device(), see paging.c */
+    int firstSlot;		 /* Paging file index of the first page slot. */
+    int numSlots;		 /* Number of page slots. */
+    int usedSlots;
+    int nextSlot;		 /* Where to start looking for a free slot. */
+    void *slotMap;		 /* Bit set of used slots. */
+    ulong_t pageIns, pageOuts;	 /* Number of pages read and written. */
 };
 
+/* Paging device priorities */
+#define PAGING_PRIORITY_DISK	0
+#define PAGING_PRIORITY_RAM	10
+
+#define MAX_PAGING_DEVICES	8
+
 /*
  * VFS functions.
  */
@@ -112,8 +160,10 @@ int Mount(const char *devname, const char *pathPrefix, const char *fstype);
 /* Mount point operations. */
 int Open(const char *path, int mode, struct File **pFile);
 int Close(struct File *file);
+int Release_File(struct File *file);
 int Stat(const char *path, struct VFS_File_Stat *stat);
 int Sync(void);
+int Fsync(struct File *file);
 int Delete(const char *path);
 
 /* File operations. */
@@ -133,8 +183,8 @@ int Read_Entry(struct File *file, struct VFS_Dir_Entry *entry);
 /*
  * Paging device functions.
  */
-void Register_Paging_Device(struct Paging_Device *pagingDevice);
-struct Paging_Device *Get_Paging_Device(void);
+int Register_Paging_Device(struct Paging_Device *pagingDevice);
+struct Paging_Device *Get_Paging_Device(int n);
 
 #endif /* GEEKOS */
 
@@ -0,0 +1,43 @@
+/*
+ * Kernel worker thread pool
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_WORKQUEUE_H
+#define GEEKOS_WORKQUEUE_H
+
+#include <geekos/ktypes.h>
+#include <geekos/list.h>
+
+struct Work_Item;
+
+DEFINE_LIST(Work_Item_List, Work_Item);
+
+/*
+ * A function to be called in one of the worker threads.
+ * Unlike a tasklet, a work item may block, but only on hardware
+ * (as the block drivers do).  It must not wait for another work
+ * item to finish, since all the workers might be busy: so no file
+ * system, paging or block device calls, which wait for the drivers'
+ * work items.  Work that needs those gets its own thread, like
+ * the reaper.
+ */
+struct Work_Item {
+    void (*func)(ulong_t arg);
+    ulong_t arg;
+    bool dynamic;		/* allocated by Queue_Work(), freed after it runs */
+
+    DEFINE_LINK(Work_Item_List, Work_Item);
+};
+
+IMPLEMENT_LIST(Work_Item_List, Work_Item);
+
+#define WORK_ITEM_INITIALIZER(func, arg) { (func), (arg), false, 0, 0, 0 }
+
+void Init_Work_Queue(void);
+int Queue_Work(void (*func)(ulong_t arg), ulong_t arg);
+void Queue_Work_Item(struct Work_Item *item);
+
+#endif  /* GEEKOS_WORKQUEUE_H */
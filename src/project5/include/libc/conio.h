@@ -22,6 +22,8 @@ Keycode Get_Key(void);
 int Set_Attr(int attr);
 int Get_Cursor(int *row, int *col);
 int Put_Cursor(int row, int col);
+int Read_Kernel_Log(char *buf, size_t bufSize);
+int Open_Console(void);
 
 void Echo(bool enable);
 void Read_Line(char* buf, size_t bufSize);
@@ -12,6 +12,8 @@
 #define FILEIO_H
 
 #include <geekos/fileio.h>
+#include <geekos/ioring.h>
+#include <geekos/poll.h>
 
 int Stat(const char *path, struct VFS_File_Stat *stat);
 int FStat(int fd, struct VFS_File_Stat *stat);
@@ -27,6 +29,20 @@ int Format(const char *dev, const char *fstype);
 int Mount(const char *dev, const char *prefix, const char *fstype);
 int Seek(int fd, int pos);
 int Delete(const char *path);
+int Dup2(int oldfd, int newfd);
+int Mmap(int fd, ulong_t offset, ulong_t length, int prot);
+int Munmap(void *addr, ulong_t length);
+int Fsync(int fd);
+int Create_Pipe(int *readFd, int *writeFd);
+int Poll(struct Poll_Fd *fds, int numFds, int timeoutTicks);
+
+/* Batched I/O through a submission/completion ring */
+int IO_Ring_Setup(struct IO_Ring_Header *ring, ulong_t numEntries);
+int IO_Ring_Enter(ulong_t minComplete);
+struct IO_Submission *IO_Ring_Get_Submission(struct IO_Ring_Header *ring);
+void IO_Ring_Queue(struct IO_Ring_Header *ring);
+struct IO_Completion *IO_Ring_Get_Completion(struct IO_Ring_Header *ring);
+void IO_Ring_Completion_Seen(struct IO_Ring_Header *ring);
 
 #endif  /* FILEIO_H */
 
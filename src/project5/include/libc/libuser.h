@@ -6,4 +6,5 @@
 #include <sema.h>
 #include <sched.h>
 #include <fileio.h>
+#include <malloc.h>
 
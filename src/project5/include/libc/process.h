@@ -11,12 +11,27 @@
 #ifndef PROCESS_H
 #define PROCESS_H
 
+#include <geekos/ktypes.h>
+
 int Null(void);
 int Exit(int exitCode);
 int Spawn_Program(const char* program, const char* command);
 int Spawn_With_Path(const char *program, const char *command, const char *path);
 int Wait(int pid);
+int Wait_Timeout(int pid, int ticks);
 int Get_PID(void);
+int Sbrk(int increment);
+int Map_Anonymous(ulong_t length);
+
+/*
+ * Threads share the address space and open files of the process.
+ * A thread ends by returning from its entry function or calling
+ * Exit_Thread(); Exit() ends the whole process.  Any thread of the
+ * process may join a thread, once.
+ */
+int Create_User_Thread(int (*entry)(void *arg), void *stackTop, void *arg);
+int Join_Thread(int tid);
+int Exit_Thread(int exitCode);
 
 #endif  /* PROCESS_H */
 
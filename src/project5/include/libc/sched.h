@@ -13,6 +13,8 @@
 
 int Set_Scheduling_Policy(int policy, int quantum);
 int Get_Time_Of_Day(void);
+int Set_Weight(int pid, int weight);
+int Yield(void);
 
 #endif  /* SCHED_H */
 
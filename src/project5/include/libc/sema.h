@@ -13,6 +13,7 @@
 
 int Create_Semaphore(const char *name, int ival);
 int P(int sem);
+int P_Timeout(int sem, int ticks);
 int V(int sem);
 int Destroy_Semaphore(int sem);
 
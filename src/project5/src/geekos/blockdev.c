@@ -48,12 +48,16 @@ static struct Block_Device_List s_deviceList;
  * Perform a block IO request.
  * Returns 0 if successful, error code on failure.
  */
-static int Do_Request(struct Block_Device *dev, enum Request_Type type, int blockNum, void *buf)
+static int Do_Request(struct Block_Device *dev, enum Request_Type type,
+    int blockNum, int numBlocks, void *buf)
 {
     struct Block_Request *request;
     int rc;
 
-    request = Create_Request(dev, type, blockNum, buf);
+    if (numBlocks <= 0 && type != BLOCK_FLUSH)
+	return EINVALID;
+
+    request = Create_Request(dev, type, blockNum, numBlocks, buf);
     if (request == 0)
 	return ENOMEM;
     Post_Request_And_Wait(request);
@@ -62,10 +66,51 @@ static int Do_Request(struct Block_Device *dev, enum Request_Type type, int bloc
     return rc;
 }
 
+/*
+ * Work item body: hand queued requests to the driver
+ * until the queue is empty.
+ */
+static void Process_Block_Requests(ulong_t arg)
+{
+    struct Block_Request_Queue *requestQueue = (struct Block_Request_Queue*) arg;
+
+    while (true) {
+	struct Block_Request *request;
+	int rc;
+
+	Disable_Interrupts();
+	if (Is_Block_Request_List_Empty(&requestQueue->requests)) {
+	    requestQueue->busy = false;
+	    Enable_Interrupts();
+	    break;
+	}
+	request = Remove_From_Front_Of_Block_Request_List(&requestQueue->requests);
+	Enable_Interrupts();
+
+	Debug("Handling block device request [@%x]...\n", request);
+	rc = requestQueue->Handle_Request(request);
+	Notify_Request_Completion(request, rc == 0 ? COMPLETED : ERROR, rc);
+    }
+}
+
 /* ----------------------------------------------------------------------
  * Public functions
  * ---------------------------------------------------------------------- */
 
+/*
+ * Initialize the request queue of a driver.
+ * handleRequest performs one request and returns 0 or an error code;
+ * it is called from a worker thread, one request at a time.
+ */
+void Init_Block_Request_Queue(struct Block_Request_Queue *requestQueue,
+    int (*handleRequest)(struct Block_Request *request))
+{
+    memset(requestQueue, '\0', sizeof(*requestQueue));
+    requestQueue->Handle_Request = handleRequest;
+    requestQueue->work.func = Process_Block_Requests;
+    requestQueue->work.arg = (ulong_t) requestQueue;
+}
+
 /*
  * Register a block device.
  * This should be called by device drivers in their Init
@@ -73,25 +118,24 @@ static int Do_Request(struct Block_Device *dev, enum Request_Type type, int bloc
  * Returns 0 if successful, error code otherwise.
  */
 int Register_Block_Device(const char *name, struct Block_Device_Ops *ops,
-    int unit, void *driverData, struct Thread_Queue *waitQueue,
-    struct Block_Request_List *requestQueue)
+    int unit, void *driverData, struct Block_Request_Queue *requestQueue)
 {
     struct Block_Device *dev;
 
     KASSERT(ops != 0);
-    KASSERT(waitQueue != 0);
     KASSERT(requestQueue != 0);
+    KASSERT(requestQueue->Handle_Request != 0);
 
     dev = (struct Block_Device*) Malloc(sizeof(*dev));
     if (dev == 0)
 	return ENOMEM;
+    memset(dev, '\0', sizeof(*dev));
 
     strcpy(dev->name, name);
     dev->ops = ops;
     dev->unit = unit;
     dev->inUse = false;
     dev->driverData = driverData;
-    dev->waitQueue = waitQueue;
     dev->requestQueue = requestQueue;
 
     Mutex_Lock(&s_blockdevLock);
@@ -159,16 +203,21 @@ int Close_Block_Device(struct Block_Device *dev)
 }
 
 /*
- * Create a block device request to transfer a single block.
+ * Create a block device request to transfer numBlocks
+ * consecutive blocks.  Drivers are free to split the
+ * request internally, but the requesting thread is only
+ * woken once the whole transfer has completed.
  */
 struct Block_Request *Create_Request(struct Block_Device *dev, enum Request_Type type,
-    int blockNum, void *buf)
+    int blockNum, int numBlocks, void *buf)
 {
     struct Block_Request *request = Malloc(sizeof(*request));
     if (request != 0) {
+	memset(request, '\0', sizeof(*request));
 	request->dev = dev;
 	request->type = type;
 	request->blockNum = blockNum;
+	request->numBlocks = numBlocks;
 	request->buf = buf;
 	request->state = PENDING;
 	Clear_Thread_Queue(&request->waitQueue);
@@ -190,11 +239,21 @@ void Post_Request_And_Wait(struct Block_Request *request)
     dev = request->dev;
     KASSERT(dev != 0);
 
+    if (dev->requestQueue->direct) {
+	int rc = dev->requestQueue->Handle_Request(request);
+	request->state = rc == 0 ? COMPLETED : ERROR;
+	request->errorCode = rc;
+	return;
+    }
+
     /* Send request to the driver */
     Debug("Posting block device request [@%x]...\n", request);
     Disable_Interrupts();
-    Add_To_Back_Of_Block_Request_List(dev->requestQueue, request);
-    Wake_Up(dev->waitQueue);
+    Add_To_Back_Of_Block_Request_List(&dev->requestQueue->requests, request);
+    if (!dev->requestQueue->busy) {
+	dev->requestQueue->busy = true;
+	Queue_Work_Item(&dev->requestQueue->work);
+    }
     Enable_Interrupts();
 
     /* Wait for request to be processed */
@@ -207,24 +266,6 @@ void Post_Request_And_Wait(struct Block_Request *request)
     Enable_Interrupts();
 }
 
-/*
- * Wait for a block request to arrive.
- */
-struct Block_Request *Dequeue_Request(struct Block_Request_List *requestQueue,
-    struct Thread_Queue *waitQueue)
-{
-    struct Block_Request *request;
-
-    Disable_Interrupts();
-    while (Is_Block_Request_List_Empty(requestQueue))
-	Wait(waitQueue);
-    request = Get_Front_Of_Block_Request_List(requestQueue);
-    Remove_From_Front_Of_Block_Request_List(requestQueue);
-    Enable_Interrupts();
-
-    return request;
-}
-
 /*
  * Signal the completion of a block request.
  */
@@ -243,7 +284,7 @@ void Notify_Request_Completion(struct Block_Request *request, enum Request_State
  */
 int Block_Read(struct Block_Device *dev, int blockNum, void *buf)
 {
-    return Do_Request(dev, BLOCK_READ, blockNum, buf);
+    return Do_Request(dev, BLOCK_READ, blockNum, 1, buf);
 }
 
 /*
@@ -252,7 +293,37 @@ int Block_Read(struct Block_Device *dev, int blockNum, void *buf)
  */
 int Block_Write(struct Block_Device *dev, int blockNum, void *buf)
 {
-    return Do_Request(dev, BLOCK_WRITE, blockNum, buf);
+    return Do_Request(dev, BLOCK_WRITE, blockNum, 1, buf);
+}
+
+/*
+ * Read numBlocks consecutive blocks from given device
+ * using a single request.
+ * Return 0 if successful, error code on error.
+ */
+int Block_Read_Multiple(struct Block_Device *dev, int blockNum, int numBlocks, void *buf)
+{
+    return Do_Request(dev, BLOCK_READ, blockNum, numBlocks, buf);
+}
+
+/*
+ * Write numBlocks consecutive blocks to given device
+ * using a single request.
+ * Return 0 if successful, error code on error.
+ */
+int Block_Write_Multiple(struct Block_Device *dev, int blockNum, int numBlocks, void *buf)
+{
+    return Do_Request(dev, BLOCK_WRITE, blockNum, numBlocks, buf);
+}
+
+/*
+ * Wait until all writes done so far to given device
+ * have reached the medium.
+ * Return 0 if successful, error code on error.
+ */
+int Block_Flush(struct Block_Device *dev)
+{
+    return Do_Request(dev, BLOCK_FLUSH, 0, 0, 0);
 }
 
 /*
@@ -9,15 +9,20 @@
 
 #include <geekos/errno.h>
 #include <geekos/kassert.h>
+#include <geekos/int.h>
 #include <geekos/mem.h>
 #include <geekos/malloc.h>
+#include <geekos/string.h>
 #include <geekos/blockdev.h>
 #include <geekos/bufcache.h>
 
 /*
  * Maximum number of buffers that are cached per-filesystem.
+ * Below this limit the cache grows as long as there is free memory;
+ * the page allocator takes back clean buffers when memory runs short
+ * (see Reclaim_FS_Buffer()).
  */
-#define FS_BUFFER_CACHE_MAX_BLOCKS 128
+#define FS_BUFFER_CACHE_MAX_BLOCKS 512
 
 /* ----------------------------------------------------------------------
  * Private functions
@@ -40,26 +45,26 @@ static uint_t Get_Num_Sectors_Per_FS_Block(struct FS_Buffer_Cache *cache)
 
 /*
  * Read or write a filesystem buffer.
+ * The whole block is transferred with a single device request.
+ * A block running past the end of the device is cut short there;
+ * the rest of its buffer reads as zeroes.
  */
 static int Do_Buffer_IO(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf,
-    int (*IO_Func)(struct Block_Device *dev, int blockNum, void *buf))
+    int (*IO_Func)(struct Block_Device *dev, int blockNum, int numBlocks, void *buf))
 {
-    uint_t offset;
-    int sectorCount = 0;
-    int blockNum = buf->fsBlockNum * Get_Num_Sectors_Per_FS_Block(cache);
-    char *ptr = (char*) buf->data;
-
-    for (offset = 0; offset < cache->fsBlockSize; offset += SECTOR_SIZE) {
-        int rc = IO_Func(cache->dev, blockNum, ptr + offset);
-        if (rc != 0)
-            return rc;
-        ++sectorCount;
-        ++blockNum;
+    uint_t numSectors = Get_Num_Sectors_Per_FS_Block(cache);
+    ulong_t blockNum = buf->fsBlockNum * numSectors;
+
+    if (blockNum >= cache->numDevBlocks)
+	return EINVALID;
+    if (blockNum + numSectors > cache->numDevBlocks) {
+	numSectors = cache->numDevBlocks - blockNum;
+	if (IO_Func == Block_Read_Multiple)
+	    memset((char*) buf->data + numSectors * SECTOR_SIZE, '\0',
+		cache->fsBlockSize - numSectors * SECTOR_SIZE);
     }
-    KASSERT(offset == cache->fsBlockSize);
-    KASSERT(sectorCount == Get_Num_Sectors_Per_FS_Block(cache));
 
-    return 0;
+    return IO_Func(cache->dev, blockNum, numSectors, buf->data);
 }
 
 /*
@@ -72,7 +77,7 @@ static int Sync_Buffer(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf)
     KASSERT(IS_HELD(&cache->lock));
 
     if (buf->flags & FS_BUFFER_DIRTY) {
-        if ((rc = Do_Buffer_IO(cache, buf, Block_Write)) == 0)
+        if ((rc = Do_Buffer_IO(cache, buf, Block_Write_Multiple)) == 0)
             buf->flags &= ~(FS_BUFFER_DIRTY);
     }
 
@@ -91,9 +96,12 @@ static void Move_To_Front(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf)
 
 /*
  * Get buffer for given block, and mark it in use.
+ * If readData is false, the block is not read from disk;
+ * instead the buffer is zero-filled and marked dirty.
  * Must be called with cache mutex held.
  */
-static int Get_Buffer(struct FS_Buffer_Cache *cache, ulong_t fsBlockNum, struct FS_Buffer **pBuf)
+static int Get_Buffer(struct FS_Buffer_Cache *cache, ulong_t fsBlockNum,
+    bool readData, struct FS_Buffer **pBuf)
 {
     struct FS_Buffer *buf, *lru = 0;
     int rc;
@@ -102,24 +110,36 @@ static int Get_Buffer(struct FS_Buffer_Cache *cache, ulong_t fsBlockNum, struct
 
     KASSERT(IS_HELD(&cache->lock));
 
+retry:
     /*
      * Look for existing buffer.
      * As a side-effect, finds the least recently used
      * buffer that is not in use (if any).
      */
+    lru = 0;
     buf = Get_Front_Of_FS_Buffer_List(&cache->bufferList);
     while (buf != 0) {
         if (buf->fsBlockNum == fsBlockNum) {
-            /* If buffer is in use, wait until it is available. */
-            while (buf->flags & FS_BUFFER_INUSE) {
+            /*
+             * If buffer is in use, wait until it is available.
+             * The buffer may be reclaimed while we wait,
+             * so look it up again afterwards.
+             */
+            if (buf->flags & FS_BUFFER_INUSE) {
                 Debug("Waiting for block %lu\n", fsBlockNum);
                 Cond_Wait(&cache->cond, &cache->lock);
+                goto retry;
             }
+            Touch_File_Page(buf->data);
             goto done;
         }
 
-        /* If buffer isn't in use, it's a candidate for LRU. */
-        if (!(buf->flags & FS_BUFFER_INUSE))
+        /*
+         * If buffer isn't in use, it's a candidate for LRU.
+         * Pinned buffers are mapped into user address spaces,
+         * so their data page must stay put.
+         */
+        if (!(buf->flags & FS_BUFFER_INUSE) && buf->pinCount == 0)
             lru = buf;
 
         buf = Get_Next_In_FS_Buffer_List(buf);
@@ -132,13 +152,15 @@ static int Get_Buffer(struct FS_Buffer_Cache *cache, ulong_t fsBlockNum, struct
     if (cache->numCached < FS_BUFFER_CACHE_MAX_BLOCKS) {
         buf = (struct FS_Buffer*) Malloc(sizeof(*buf));
         if (buf != 0) {
+            memset(buf, '\0', sizeof(*buf));
             buf->data = Alloc_Page();
             if (buf->data == 0)
                 Free(buf);
             else {
                 /* Successful creation */
                 buf->fsBlockNum = fsBlockNum;
-                buf->flags = 0;
+                buf->cache = cache;
+                Add_File_Page(buf->data, buf);
                 Add_To_Front_Of_FS_Buffer_List(&cache->bufferList, buf);
                 ++cache->numCached;
                 goto readAndAcquire;
@@ -162,6 +184,8 @@ static int Get_Buffer(struct FS_Buffer_Cache *cache, ulong_t fsBlockNum, struct
     /* LRU buffer is clean, so we can steal it. */
     buf = lru;
     buf->flags = 0;
+    buf->fsBlockNum = fsBlockNum;
+    Touch_File_Page(buf->data);
     Move_To_Front(cache, buf);
 
 readAndAcquire:
@@ -174,10 +198,19 @@ readAndAcquire:
     KASSERT(Get_Front_Of_FS_Buffer_List(&cache->bufferList) == buf);
 
     /* Read block data into buffer. */
-    if ((rc = Do_Buffer_IO(cache, buf, Block_Read)) != 0)
+    if (readData && (rc = Do_Buffer_IO(cache, buf, Block_Read_Multiple)) != 0)
 	return rc;
 
 done:
+    /*
+     * A new block's old on-disk contents are garbage:
+     * there is no need to read them, only to overwrite them.
+     */
+    if (!readData) {
+        memset(buf->data, '\0', cache->fsBlockSize);
+        buf->flags |= FS_BUFFER_DIRTY;
+    }
+
     /* Buffer is now in use. */
     buf->flags |= FS_BUFFER_INUSE;
 
@@ -213,6 +246,8 @@ static int Sync_Cache(struct FS_Buffer_Cache *cache)
 static void Free_Buffer(struct FS_Buffer *buf)
 {
     KASSERT(!(buf->flags & (FS_BUFFER_DIRTY | FS_BUFFER_INUSE)));
+    KASSERT(buf->pinCount == 0);
+    Remove_File_Page(buf->data);
     Free_Page(buf->data);
     Free(buf);
 }
@@ -243,6 +278,7 @@ struct FS_Buffer_Cache *Create_FS_Buffer_Cache(struct Block_Device *dev, uint_t
 
     cache->dev = dev;
     cache->fsBlockSize = fsBlockSize;
+    cache->numDevBlocks = Get_Num_Blocks(dev);
     cache->numCached = 0;
     Clear_FS_Buffer_List(&cache->bufferList);
     Mutex_Init(&cache->lock);
@@ -310,7 +346,29 @@ int Get_FS_Buffer(
     int rc;
 
     Mutex_Lock(&cache->lock);
-    rc = Get_Buffer(cache, fsBlockNum, pBuf);
+    rc = Get_Buffer(cache, fsBlockNum, true, pBuf);
+    Mutex_Unlock(&cache->lock);
+
+    return rc;
+}
+
+/*
+ * Get a buffer for a filesystem block that has just been
+ * allocated.  Its previous contents are never read from disk:
+ * the buffer is returned zero-filled and already marked dirty,
+ * so blocks are zeroed lazily on first use rather than
+ * at format time.
+ */
+int Get_New_FS_Buffer(
+    struct FS_Buffer_Cache *cache,
+    ulong_t fsBlockNum,
+    struct FS_Buffer **pBuf
+)
+{
+    int rc;
+
+    Mutex_Lock(&cache->lock);
+    rc = Get_Buffer(cache, fsBlockNum, false, pBuf);
     Mutex_Unlock(&cache->lock);
 
     return rc;
@@ -373,3 +431,68 @@ bool Buf_In_Use(struct FS_Buffer *buf) {
     return buf != 0 && buf->flags & FS_BUFFER_INUSE;
 }
 
+/*
+ * Pin given buffer, which must be in use, so that its data page
+ * is never recycled for another block.  This lets the page
+ * be mapped directly into a user address space.
+ * The buffer may be released while it stays pinned.
+ */
+void Pin_FS_Buffer(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf)
+{
+    KASSERT(buf->flags & FS_BUFFER_INUSE);
+
+    Mutex_Lock(&cache->lock);
+    ++buf->pinCount;
+    Mutex_Unlock(&cache->lock);
+}
+
+/*
+ * Drop a pin on given buffer.
+ * If dirty is true, the data was modified through the mapping
+ * and must be written back to disk.
+ */
+void Unpin_FS_Buffer(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf, bool dirty)
+{
+    Mutex_Lock(&cache->lock);
+    KASSERT(buf->pinCount > 0);
+    --buf->pinCount;
+    if (dirty)
+        buf->flags |= FS_BUFFER_DIRTY;
+    Mutex_Unlock(&cache->lock);
+}
+
+/*
+ * Mark a pinned buffer as modified, keeping the pin.
+ */
+void Modify_Pinned_FS_Buffer(struct FS_Buffer_Cache *cache, struct FS_Buffer *buf)
+{
+    Mutex_Lock(&cache->lock);
+    KASSERT(buf->pinCount > 0);
+    buf->flags |= FS_BUFFER_DIRTY;
+    Mutex_Unlock(&cache->lock);
+}
+
+/*
+ * Called by the page allocator, with interrupts disabled, to take
+ * back the data page of a buffer.  Only a clean, unused, unpinned
+ * buffer of a cache whose lock is free can be reclaimed; it is
+ * removed from its cache and the caller becomes the owner of the page.
+ * Returns true if the buffer was reclaimed, false otherwise.
+ */
+bool Reclaim_FS_Buffer(struct FS_Buffer *buf)
+{
+    struct FS_Buffer_Cache *cache = buf->cache;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (cache->lock.state != MUTEX_UNLOCKED)
+        return false;
+    if ((buf->flags & (FS_BUFFER_DIRTY | FS_BUFFER_INUSE)) != 0 || buf->pinCount > 0)
+        return false;
+
+    Remove_From_FS_Buffer_List(&cache->bufferList, buf);
+    --cache->numCached;
+    Free(buf);
+
+    return true;
+}
@@ -61,161 +61,114 @@ after_move:
 	mov	ss, ax
 	mov	sp, (BOOTSEG << 4) + 512 - 2
 
+	; Note when loading starts, in BIOS timer ticks (18.2 per second).
+	xor	ah, ah
+	int	0x1a
+	mov	[start_ticks], dx
+
 load_setup:
 	; Load the setup code.
-	mov	ax, word [setupStart]
-	mov	word [sec_count], ax
-	add	ax, [setupSize]
-	mov	word [max_sector], ax
-.again:
-	mov	ax, [sec_count]
-	push	ax			; 1st param to ReadSector (log sec num)
-	push	word SETUPSEG		; 2nd param to ReadSector (seg base)
-	sub	ax, [setupStart]	; convert to 0-indexed
-	shl	ax, 9			; multiply by 512
-	push	ax			;  ...to get 3rd param (byte offset)
-
-	; read the sector from the floppy
-	call	ReadSector
-	add	sp, 6			; clear 3 word params
-
-	; on to next sector
-	inc	word [sec_count]
-
-	; are we done?
-	mov	bx, word [max_sector]
-	cmp	word [sec_count], bx
-	jl	.again
+	mov	ax, SETUPSEG
+	mov	es, ax
+	mov	ax, [setupStart]
+	mov	cx, [setupSize]
+	call	ReadSectors
 
 load_kernel:
-	; Load the kernel image from sectors KERN_START_SEC..n of the
-	; floppy into memory at KERNSEG.  Note that there are 128 sectors
-	; per 64K segment.  So, when figuring out which segment to
-	; load the sector into, we shift right by 7 bits (which is
-	; equivalent to dividing by 128).
-
-	; Figure out start sector and max sector
-	mov	ax, word [kernelStart]
-	mov	word [sec_count], ax
-	add	ax, word [kernelSize]
-	mov	word [max_sector], ax
-.again:
-	mov	ax, [sec_count]		; logical sector on the floppy
-	push	ax			; 1st param to ReadSector (log sec num)
-	sub	ax, [kernelStart]	; convert to 0-indexed
-	mov	cx, ax			; save in cx
-	shr	ax, 7			; divide by 128
-	shl	ax, 12			;  ...and multiply by 0x1000
-	add	ax, KERNSEG		;  ...to get base relative to KERNSEG
-	push	ax			; 2nd param to ReadSector (seg base)
-	and	cx, 0x7f		; mod sector by 128
-	shl	cx, 9			;  ...and multiply by 512
-	push	cx			; to get offset in segment (3rd parm)
-
-	; read the sector from the floppy
-	call	ReadSector
-	add	sp, 6			; clear 3 word params
-
-	; on to next sector
-	inc	word [sec_count]
-
-	; have we loaded all of the sectors?
-	mov	bx, word [max_sector]
-	cmp	word [sec_count], bx
-	jl	.again
+	; Load the kernel image from sectors kernelStart..n of the
+	; floppy into memory at KERNSEG.
+	mov	ax, KERNSEG
+	mov	es, ax
+	mov	ax, [kernelStart]
+	mov	cx, [kernelSize]
+	call	ReadSectors
 
 	; Now we've loaded the setup code and the kernel image.
+	; Tell the setup code when we started (in si), and how
+	; long loading took (in di), so it can go in the Boot_Info.
+	xor	ah, ah
+	int	0x1a
+	mov	si, [start_ticks]
+	mov	di, dx
+	sub	di, si
+
 	; Jump to setup code.
 	jmp	SETUPSEG:0
 
-; Read a sector from the floppy drive.
-; This code (and the rest of this boot sector) will have to
-; be re-written at some point so it reads more than one
-; sector at a time.
+; Read sectors from the floppy into consecutive memory.
+; Each BIOS call reads up to the end of the track, but stops
+; short of a 64K boundary, which floppy DMA cannot cross.
 ;
 ; Parameters:
-;     - "logical" sector number   [bp+8]
-;     - destination segment       [bp+6]
-;     - destination offset        [bp+4]
-ReadSector:
-	push	bp			; set up stack frame
-	mov	bp, sp			; "
-	pusha				; save all registers
-
-%if 0
-; debug params
-	mov	dx, [bp+8]
-	call	PrintHex
-	call	PrintNL
-	mov	dx, [bp+6]
-	call	PrintHex
-	call	PrintNL
-	mov	dx, [bp+4]
-	call	PrintHex
-	call	PrintNL
-%endif
+;     - ax: first "logical" sector number
+;     - cx: number of sectors
+;     - es: destination segment; data goes to es:0 onwards,
+;           and es is advanced past it
+ReadSectors:
+	jcxz	.done
+	pusha
 
 	; Sector = log_sec % SECTORS_PER_TRACK
 	; Head = (log_sec / SECTORS_PER_TRACK) % HEADS
-	mov	ax, [bp+8]		; get logical sector number from stack
+	; Track = log_sec / (SECTORS_PER_TRACK*HEADS)
 	xor	dx, dx			; dx is high part of dividend (== 0)
 	mov	bx, SECTORS_PER_TRACK	; divisor
 	div	bx			; do the division
-	mov	[sec], dx		; sector is the remainder
-	and	ax, 1			; same as mod by HEADS==2 (slight hack)
-	mov	[head], ax
-
-	; Track = log_sec / (SECTORS_PER_TRACK*HEADS)
-	mov	ax, [bp+8]		; get logical sector number again
-	xor	dx, dx			; dx is high part of dividend
-	mov	bx, SECTORS_PER_TRACK*2	; divisor
-	div	bx			; do the division
-	mov	[track], ax		; track is quotient
-
-%if 0
-; debugging code
-	mov	dx, [sec]
-	call	PrintHex
-	call	PrintNL
-	mov	dx, [head]
-	call	PrintHex
-	call	PrintNL
-	mov	dx, [track]
-	call	PrintHex
-	call	PrintNL
-%endif
-
-	; Now, try to actually read the sector from the floppy,
+	mov	[sec], dl		; sector is the remainder
+	mov	[head], al
+	and	byte [head], 1		; same as mod by HEADS==2 (slight hack)
+	shr	ax, 1
+	mov	[track], al
+
+	; Read the rest of the track, or what's left to read,
+	; whichever is less...
+	sub	bx, dx
+	cmp	cx, bx
+	jae	.to_boundary
+	mov	bx, cx
+.to_boundary:
+	; ...but no further than the next 64K boundary
+	; (32 paragraphs per sector).
+	mov	ax, es
+	and	ax, 0x0fff
+	neg	ax
+	add	ax, 0x1000
+	shr	ax, 5
+	cmp	bx, ax
+	jbe	.count_ok
+	mov	bx, ax
+.count_ok:
+	mov	[count], bl
+
+	; Now, try to actually read the sectors from the floppy,
 	; retrying up to 3 times.
-
 	mov	[num_retries], byte 0
 
 .again:
-	mov	ax, [bp+6]		; dest segment...
-	mov	es, ax			;   goes in es
-	mov	ax, (0x02 << 8) | 1	; function = 02h in ah,
-					;   # secs = 1 in al
-	mov	bx, [track]		; track number...
-	mov	ch, bl			;   goes in ch
-	mov	bx, [sec]		; sector number...
-	mov	cl, bl			;   goes in cl...
+	mov	ah, 0x02		; function = 02h in ah,
+	mov	al, [count]		;   # secs in al
+	mov	ch, [track]		; track number goes in ch
+	mov	cl, [sec]		; sector number goes in cl...
 	inc	cl			;   but it must be 1-based, not 0-based
-	mov	bx, [head]		; head number...
-	mov	dh, bl			;   goes in dh
+	mov	dh, [head]		; head number goes in dh
 	xor	dl, dl			; hard code drive=0
-	mov	bx, [bp+4]		; offset goes in bx
-					;   (es:bx points to buffer)
+	xor	bx, bx			; es:bx points to buffer
 
 	; Call the BIOS Read Diskette Sectors service
 	int	0x13
 
-	; If the carry flag is NOT set, then there was no error
-	; and we're done.
-	jnc	.done
+	; If the carry flag is NOT set, then there was no error.
+	jnc	.next
 
-	; Error - code stored in ah
+	; Error - code stored in ah.  Reset the controller, and
+	; retry a sector at a time, in case the BIOS can't do
+	; multi-sector reads.
 	mov	dx, ax
-	call PrintHex
+	call	PrintHex
+	xor	ax, ax
+	xor	dx, dx
+	int	0x13
+	mov	[count], byte 1
 	inc	byte [num_retries]
 	cmp	byte [num_retries], 3
 	jne	.again
@@ -225,9 +178,20 @@ ReadSector:
 	call	PrintHex
 .here:	jmp	.here
 
+.next:
+	; Move on past the sectors we read
+	popa
+	xor	bx, bx
+	mov	bl, [count]
+	add	ax, bx
+	sub	cx, bx
+	shl	bx, 5
+	mov	dx, es
+	add	dx, bx
+	mov	es, dx
+	jmp	ReadSectors
+
 .done:
-	popa				; restore all regisiters
-	pop	bp			; leave stack frame
 	ret
 
 ; Include utility routines
@@ -237,15 +201,15 @@ ReadSector:
 ; Variables
 ; ----------------------------------------------------------------------
 
-; These are used by ReadSector
-head: dw 0
-track: dw 0
-sec: dw 0
+; These are used by ReadSectors
+head: db 0
+track: db 0
+sec: db 0
+count: db 0
 num_retries: db 0
 
-; Used for loops reading sectors from floppy
-sec_count: dw 0
-max_sector: dw 0
+; BIOS tick count when we started loading
+start_ticks: dw 0
 
 ; Padding to make the PFAT Boot Record sit just before the BIOS signature.
 Pad_From_Symbol PFAT_BOOT_RECORD_OFFSET, BeginText
@@ -7,6 +7,7 @@
  * redistribute, and modify it as specified in the file "COPYING".
  */
 
+#include <geekos/errno.h>
 #include <geekos/screen.h>
 #include <geekos/string.h>
 #include <geekos/mem.h>
@@ -188,13 +189,12 @@ static uchar_t *s_transferBuf;
 /*
  * Queue of floppy block I/O requests.
  */
-static struct Block_Request_List s_floppyRequestQueue;
+static struct Block_Request_Queue s_floppyRequestQueue;
 
 /*
- * Thread queue where request processing thread sleeps waiting for
- * a request to arrive.
+ * Set once the controller has been reset and the DMA channel reserved.
  */
-static struct Thread_Queue s_floppyWaitQueue;
+static bool s_floppyReady;
 
 /* ----------------------------------------------------------------------
  * Private functions
@@ -277,7 +277,7 @@ static void Setup_Drive_Parameters(int drive, int type)
 
 	/* Register the block device. */
 	rc = Register_Block_Device(devname, &s_floppyDeviceOps, drive, 0,
-	    &s_floppyWaitQueue, &s_floppyRequestQueue);
+	    &s_floppyRequestQueue);
 	if (rc != 0)
 	    Print("  Error: could not create block device for %s\n", devname);
     }
@@ -566,34 +566,41 @@ static int Floppy_Write(int driveNum, int blockNum, char *buffer)
 }
 
 /*
- * This is the thread which processes floppy I/O requests.
+ * Perform a floppy I/O request.
+ * Called from a worker thread by the block device layer.
  */
-static void Floppy_Request_Thread(ulong_t arg)
+static int Floppy_Handle_Request(struct Block_Request *request)
 {
-    int rc;
+    int rc, i;
 
-    Debug("FRQ: Floppy request thread starting...\n");
+    Debug("FRQ: Got a floppy request [@%x]\n", request);
+    KASSERT(request->type == BLOCK_READ || request->type == BLOCK_WRITE ||
+	request->type == BLOCK_FLUSH);
 
-    for (;;) {
-	struct Block_Request *request;
+    /* There's no write cache, so nothing to flush */
+    if (request->type == BLOCK_FLUSH)
+	return 0;
 
-	/* Wait for an I/O request to arrive */
-	Debug("FRQ: Request thread waiting for a request\n");
-	request = Dequeue_Request(&s_floppyRequestQueue, &s_floppyWaitQueue);
-	Debug("FRQ: Got a floppy request [@%x]\n", request);
-	KASSERT(request->type == BLOCK_READ || request->type == BLOCK_WRITE);
+    if (!s_floppyReady)
+	return ENODEV;
 
-	/* Perform the I/O. */
+    /*
+     * Perform the I/O.
+     * The controller is driven one sector at a time through
+     * the DMA transfer buffer, so multi-block requests are
+     * split here.
+     */
+    rc = 0;
+    for (i = 0; i < request->numBlocks && rc == 0; ++i) {
+	char *buf = ((char *) request->buf) + i*SECTOR_SIZE;
 	if (request->type == BLOCK_READ)
-	    rc = Floppy_Read(request->dev->unit, request->blockNum, request->buf);
+	    rc = Floppy_Read(request->dev->unit, request->blockNum + i, buf);
 	else
-	    rc = Floppy_Write(request->dev->unit, request->blockNum, request->buf);
-
-	/* Notify the requesting thread of the outcome of the I/O. */
-	Debug("FRQ: Notifying requesting thread...\n");
-	Notify_Request_Completion(request, rc == 0 ? COMPLETED : ERROR, rc);
-	Debug("FRQ: Completed floppy request\n");
+	    rc = Floppy_Write(request->dev->unit, request->blockNum + i, buf);
     }
+
+    Debug("FRQ: Completed floppy request\n");
+    return rc;
 }
 
 /* ----------------------------------------------------------------------
@@ -611,6 +618,9 @@ void Init_Floppy(void)
 
     Print("Initializing floppy controller...\n");
 
+    /* Requests are handled in a worker thread once the controller is ready */
+    Init_Block_Request_Queue(&s_floppyRequestQueue, &Floppy_Handle_Request);
+
     /* Allocate memory for DMA transfers */
     s_transferBuf = (uchar_t*) Alloc_Page();
 
@@ -639,12 +649,9 @@ void Init_Floppy(void)
 	goto done;
     }
 
-    /*
-     * Driver is now ready for requests.
-     * Start the request processing thread.
-     */
+    /* Driver is now ready for requests. */
     ready = true;
-    Start_Kernel_Thread(Floppy_Request_Thread, 0, PRIORITY_NORMAL, true);
+    s_floppyReady = true;
 
 done:
     if (!ready)
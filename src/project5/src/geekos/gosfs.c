@@ -19,7 +19,6 @@
 #include <geekos/bufcache.h>
 #include <geekos/gosfs.h>
 #include <geekos/user.h>
-#include <libc/sched.h>
 
 int debugGOSFS = 0;
 #define Debug(args...) if (debugGOSFS) Print("GOSFS:"args)
@@ -431,7 +430,7 @@ int AddDirectoryEntryToInode(
                     goto finish;
                 }
                 Debug("AddDirectoryEntryToInode: found free directory 0 in block %ld\n", blockNum);
-                rc = Get_FS_Buffer(p_instance->buffercache,blockNum, &p_buff);
+                rc = Get_New_FS_Buffer(p_instance->buffercache,blockNum, &p_buff);
                 if (rc < 0) {
                     Debug("AddDirectoryEntryToInode: Failed to get buffer for new directory block\n");
                     goto finish;
@@ -806,10 +805,13 @@ ulong_t GetNewFreeBlock(struct GOSFS_Instance* p_instance)
         goto finish;
     }
     
-    rc = Get_FS_Buffer(p_instance->buffercache, freeBlock, &p_buff);
-    // format
-    memset(p_buff->data, '\0', GOSFS_FS_BLOCK_SIZE);
-    Modify_FS_Buffer(p_instance->buffercache,p_buff);
+    // 新块不从磁盘读取，直接得到清零的脏缓冲区 (lazy zeroing on first allocation)
+    rc = Get_New_FS_Buffer(p_instance->buffercache, freeBlock, &p_buff);
+    if (rc < 0) {
+        Debug("GetNewFreeBlock: Failed to get buffer for block %ld\n", freeBlock);
+        p_buff = 0;
+        goto finish;
+    }
     rc = Release_FS_Buffer(p_instance->buffercache, p_buff);
     p_buff = 0;
     Set_Bit(p_instance->superblock.bitSet, freeBlock);
@@ -854,12 +856,16 @@ int GetPhysicalBlockByLogical(struct GOSFS_Instance* p_instance, struct GOSFS_Di
         indirectBlock = inode->blockList[inodePtr];
         if (indirectBlock == 0)
         {
+            // 间接块未分配：整段都是空洞 (hole)
             Debug("indirect pointer not initialized\n");
-            rc = -1;
             goto finish;
         }
         
         rc = Get_FS_Buffer(p_instance->buffercache, indirectBlock, &p_buff);
+        if (rc < 0) {
+            p_buff = 0;
+            goto finish;
+        }
 
         memcpy(&phyBlock, p_buff->data + (indirectPtrOffset*sizeof(ulong_t)), sizeof(ulong_t));
 
@@ -886,18 +892,31 @@ int GetPhysicalBlockByLogical(struct GOSFS_Instance* p_instance, struct GOSFS_Di
         indirectBlock = inode->blockList[inodePtr];
         if (indirectBlock == 0)
         {
+            // 二次间接块未分配：整段都是空洞 (hole)
             Debug("indirect pointer not initialized\n");
-            rc = -1;
             goto finish;
         }
         
         rc = Get_FS_Buffer(p_instance->buffercache, indirectBlock, &p_buff);
+        if (rc < 0) {
+            p_buff = 0;
+            goto finish;
+        }
       
         memcpy(&phyIndBlock, p_buff->data + (indirectPtrOffset*sizeof(ulong_t)), sizeof(ulong_t));
 
         rc = Release_FS_Buffer(p_instance->buffercache, p_buff);
         p_buff = 0;
+        if (phyIndBlock == 0)
+        {
+            // 二级间接块中的指针未分配，也是空洞
+            goto finish;
+        }
         rc = Get_FS_Buffer(p_instance->buffercache, phyIndBlock, &p_buff);
+        if (rc < 0) {
+            p_buff = 0;
+            goto finish;
+        }
        
         memcpy(&phyBlock, p_buff->data + (indirect2xPtrOffset * sizeof(ulong_t)), sizeof(ulong_t));
 
@@ -913,6 +932,64 @@ finish:
     else return phyBlock;
 }
 
+/* 统计一个间接块中非零指针的个数 */
+static int CountIndirectEntries(struct GOSFS_Instance* p_instance, ulong_t indirectBlock, bool recurse)
+{
+    int rc = 0, count = 0;
+    ulong_t e, ptr;
+    struct FS_Buffer* p_buff = 0;
+
+    rc = Get_FS_Buffer(p_instance->buffercache, indirectBlock, &p_buff);
+    if (rc < 0)
+        return rc;
+
+    for (e = 0; e < GOSFS_NUM_INDIRECT_PTR_PER_BLOCK; e++)
+    {
+        memcpy(&ptr, p_buff->data + (e * sizeof(ulong_t)), sizeof(ulong_t));
+        if (ptr == 0) continue;
+        if (recurse)
+        {
+            // 二级间接块自身占一个块
+            rc = CountIndirectEntries(p_instance, ptr, false);
+            if (rc < 0) break;
+            count += rc + 1;
+        }
+        else
+            count++;
+    }
+
+    Release_FS_Buffer(p_instance->buffercache, p_buff);
+    return rc < 0 ? rc : count;
+}
+
+/*
+ * 统计文件实际分配的块数（数据块 + 间接块），空洞不计入。
+ * Count the filesystem blocks actually allocated to an inode,
+ * including indirect blocks. Holes are not counted, so a large
+ * mostly-empty file reports only the blocks that were written.
+ */
+int CountAllocatedBlocks(struct GOSFS_Instance* p_instance, struct GOSFS_Dir_Entry* inode)
+{
+    int i, rc, count = 0;
+
+    for (i = 0; i < GOSFS_NUM_DIRECT_BLOCKS; i++)
+        if (inode->blockList[i] != 0) count++;
+
+    for (i = GOSFS_NUM_DIRECT_BLOCKS; i < GOSFS_NUM_BLOCK_PTRS; i++)
+    {
+        if (inode->blockList[i] == 0) continue;
+        rc = CountIndirectEntries(
+            p_instance,
+            inode->blockList[i],
+            i >= GOSFS_NUM_DIRECT_BLOCKS + GOSFS_NUM_INDIRECT_BLOCKS
+        );
+        if (rc < 0) return rc;
+        count += rc + 1;
+    }
+
+    return count;
+}
+
 /* 写入间接块 */
 int WriteIndirectBlockEntry(struct GOSFS_Instance* p_instance, ulong_t numBlock, ulong_t offset, ulong_t freeBlock)
 {
@@ -1055,7 +1132,7 @@ finish:
 }
 
 /* 为inode创建第一个带有目录项的block */
-int CreateFirstDirectoryBlock(ulong_t thisInode, struct FS_Buffer* p_buff, char* name)
+int CreateFirstDirectoryBlock(ulong_t thisInode, void* blockData, char* name)
 {
     struct GOSFS_Directory dirEntry;
     int i;
@@ -1077,7 +1154,7 @@ int CreateFirstDirectoryBlock(ulong_t thisInode, struct FS_Buffer* p_buff, char*
             strcpy(dirEntry.filename, "\0");
         }
         
-        memcpy(p_buff->data + (i*sizeof(struct GOSFS_Directory)), &dirEntry, sizeof(struct GOSFS_Directory));
+        memcpy(blockData + (i*sizeof(struct GOSFS_Directory)), &dirEntry, sizeof(struct GOSFS_Directory));
     }
     
     return 0;
@@ -1096,7 +1173,12 @@ int WriteSuperblock(struct GOSFS_Instance* p_instance)
     for (i=0; i<numBlocks; i++)
     {
         
-        rc = Get_FS_Buffer(p_instance->buffercache, i, &p_buff);
+        // 超级块整块覆盖写，无需先读 (whole block is overwritten, skip the read)
+        rc = Get_New_FS_Buffer(p_instance->buffercache, i, &p_buff);
+        if (rc < 0) {
+            p_buff = 0;
+            goto finish;
+        }
         if ((p_instance->superblock.supersize - bwritten) < GOSFS_FS_BLOCK_SIZE)
         {
             memcpy(p_buff->data, ((void*)&(p_instance->superblock)) + bwritten, p_instance->superblock.supersize - bwritten);
@@ -1134,6 +1216,13 @@ static int GOSFS_FStat(struct File *file, struct VFS_File_Stat *stat)
     Mutex_Lock(&fileEntry->instance->lock);
     
     stat->size = fileEntry->inode->size;
+    rc = CountAllocatedBlocks(fileEntry->instance, fileEntry->inode);
+    if (rc < 0) {
+        Mutex_Unlock(&fileEntry->instance->lock);
+        return rc;
+    }
+    stat->numBlocks = rc * GOSFS_SECTORS_PER_FS_BLOCK;
+    rc = 0;
     
     if (fileEntry->inode->flags & GOSFS_DIRENTRY_ISDIRECTORY)
         stat->isDirectory = 1;
@@ -1186,24 +1275,27 @@ static int GOSFS_Read(struct File *file, void *buf, ulong_t numBytes)
     
     Debug ("GOSFS_Read: %ld, endpos: %ld\n", file->filePos, file->endPos);
     // 检查文件是否已经读完
-    if (file->filePos >= file->endPos)
+    if (file->filePos >= file->endPos || numBytes == 0)
     {
         bytesRead=0;
         goto finish;
-    }        
+    }
+    // 不读超过文件末尾的部分
+    if (numBytes > file->endPos - offset)
+    {
+        numBytes = file->endPos - offset;
+        readTo = offset + numBytes - 1;
+        endBlock = readTo / GOSFS_FS_BLOCK_SIZE;
+    }
     for (i=startBlock; i<=endBlock; i++)
     {
         //获取物理块
         phyBlock = GetPhysicalBlockByLogical(pFileEntry->instance, pFileEntry->inode, i);
-
-        if (phyBlock == 0)
+        if ((int) phyBlock < 0)
         {
-            Debug("GOSFS_Read: block not allocated\n");
-            rc = -1;
+            rc = phyBlock;
             goto finish;
         }
-        
-        rc = Get_FS_Buffer(pFileEntry->instance->buffercache,phyBlock,&p_buff);
      
         if (i == startBlock)
             readFrom = offset % GOSFS_FS_BLOCK_SIZE;
@@ -1212,8 +1304,22 @@ static int GOSFS_Read(struct File *file, void *buf, ulong_t numBytes)
         
         readNum = GOSFS_FS_BLOCK_SIZE - readFrom;
         if (bytesRead+readNum > numBytes) readNum = numBytes - bytesRead;
-        if (readNum + bytesRead + offset > file->endPos)
-            readNum = file->endPos - offset - bytesRead;
+
+        if (phyBlock == 0)
+        {
+            // 空洞：未分配的块读出全零，不访问磁盘
+            Debug("GOSFS_Read: block %ld is a hole\n", i);
+            memset(buf + bytesRead, '\0', readNum);
+            bytesRead = bytesRead + readNum;
+            continue;
+        }
+
+        rc = Get_FS_Buffer(pFileEntry->instance->buffercache,phyBlock,&p_buff);
+        if (rc < 0)
+        {
+            p_buff = 0;
+            goto finish;
+        }
         memcpy(buf + bytesRead, p_buff->data + readFrom, readNum);
         bytesRead = bytesRead + readNum;
 
@@ -1226,7 +1332,7 @@ static int GOSFS_Read(struct File *file, void *buf, ulong_t numBytes)
             goto finish;
         }
     }
-    file->filePos = file->filePos+numBytes;
+    file->filePos = file->filePos+bytesRead;
     
 finish:
     Debug ("GOSFS_Read: numBytesRead = %ld\n", bytesRead);
@@ -1285,10 +1391,13 @@ static int GOSFS_Write(struct File *file, void *buf, ulong_t numBytes)
         goto finish;
     }
     
-    // 计算需要写入的数据块
+    if (numBytes == 0)
+        goto finish;
+
+    // 计算需要写入的数据块; 文件末尾与 filePos 之间的块保持为空洞 (hole)
     startBlock = file->filePos / GOSFS_FS_BLOCK_SIZE;
     startBlockOffset = file->filePos % GOSFS_FS_BLOCK_SIZE;
-    endBlock = (file->filePos + numBytes) / GOSFS_FS_BLOCK_SIZE;
+    endBlock = (file->filePos + numBytes - 1) / GOSFS_FS_BLOCK_SIZE;
 
     Debug("GOSFS_Write: logical blocks %ld - %ld needed\n", startBlock, endBlock);
     
@@ -1393,6 +1502,87 @@ static int GOSFS_Close(struct File *file)
     return 0;
 }
 
+/*
+ * 为内存映射 (Mmap) 提供文件的一页数据
+ * Get the page holding the file data at given offset, for a memory mapping.
+ * The buffer holding the block is pinned in the buffer cache, so the page
+ * stays valid until GOSFS_Unmap_Page() is called with the returned cookie.
+ * A writable mapping allocates blocks for holes; for a read-only mapping
+ * of a hole, ENOTFOUND is returned and the caller maps a zero page instead.
+ */
+static int GOSFS_Map_Page(struct File *file, ulong_t offset, bool forWrite,
+    void **pPage, void **pCookie)
+{
+    int rc = 0;
+    int phyBlock;
+    ulong_t blockNum = offset / GOSFS_FS_BLOCK_SIZE;
+    struct GOSFS_File_Entry* pFileEntry = file->fsData;
+    struct GOSFS_Instance* p_instance = pFileEntry->instance;
+    struct FS_Buffer* p_buff = 0;
+
+    Mutex_Lock(&p_instance->lock);
+
+    phyBlock = GetPhysicalBlockByLogical(p_instance, pFileEntry->inode, blockNum);
+    if (phyBlock < 0)
+    {
+        rc = phyBlock;
+        goto finish;
+    }
+    if (phyBlock == 0)
+    {
+        // 空洞: 只读映射使用零页, 可写映射需要分配块
+        if (!forWrite)
+        {
+            rc = ENOTFOUND;
+            goto finish;
+        }
+        rc = CreateFileBlock(p_instance, pFileEntry->inode, blockNum);
+        if (rc < 0)
+            goto finish;
+        phyBlock = GetPhysicalBlockByLogical(p_instance, pFileEntry->inode, blockNum);
+        if (phyBlock <= 0)
+        {
+            rc = ENOSPACE;
+            goto finish;
+        }
+    }
+
+    rc = Get_FS_Buffer(p_instance->buffercache, phyBlock, &p_buff);
+    if (rc < 0)
+        goto finish;
+
+    Pin_FS_Buffer(p_instance->buffercache, p_buff);
+    *pPage = p_buff->data;
+    *pCookie = p_buff;
+
+finish:
+    if (p_buff != 0) Release_FS_Buffer(p_instance->buffercache, p_buff);
+    Mutex_Unlock(&p_instance->lock);
+    return rc;
+}
+
+/*
+ * 解除页映射
+ * Drop a page obtained from GOSFS_Map_Page().
+ * If dirty is true, the page was written through the mapping.
+ */
+static void GOSFS_Unmap_Page(struct File *file, void *cookie, bool dirty)
+{
+    struct GOSFS_File_Entry* pFileEntry = file->fsData;
+
+    Unpin_FS_Buffer(pFileEntry->instance->buffercache, (struct FS_Buffer*) cookie, dirty);
+}
+
+/*
+ * Record that a mapped page was written, keeping it mapped.
+ */
+static void GOSFS_Dirty_Page(struct File *file, void *cookie)
+{
+    struct GOSFS_File_Entry* pFileEntry = file->fsData;
+
+    Modify_Pinned_FS_Buffer(pFileEntry->instance->buffercache, (struct FS_Buffer*) cookie);
+}
+
 static struct File_Ops s_gosfsFileOps = {
     &GOSFS_FStat,
     &GOSFS_Read,
@@ -1400,6 +1590,9 @@ static struct File_Ops s_gosfsFileOps = {
     &GOSFS_Seek,
     &GOSFS_Close,
     0, /* Read_Entry */
+    &GOSFS_Map_Page,
+    &GOSFS_Unmap_Page,
+    &GOSFS_Dirty_Page,
 };
 
 /*
@@ -1411,6 +1604,7 @@ static int GOSFS_FStat_Directory(struct File *dir, struct VFS_File_Stat *stat)
     int rc=0;
     struct GOSFS_File_Entry* fileEntry = 0;
     stat->size=dir->endPos;
+    stat->numBlocks=0;
     stat->isDirectory=1;
     stat->isSetuid=0;
     
@@ -1463,6 +1657,13 @@ static int GOSFS_Read_Entry(struct File *dir, struct VFS_Dir_Entry *entry)
     strcpy(entry->name, directory->filename);
 
     entry->stats.size = inode->size;
+    Mutex_Lock(&((struct GOSFS_Instance*)(dir->mountPoint->fsData))->lock);
+    rc = CountAllocatedBlocks((struct GOSFS_Instance*)(dir->mountPoint->fsData), inode);
+    Mutex_Unlock(&((struct GOSFS_Instance*)(dir->mountPoint->fsData))->lock);
+    if (rc < 0)
+        return rc;
+    entry->stats.numBlocks = rc * GOSFS_SECTORS_PER_FS_BLOCK;
+    rc = 0;
     entry->stats.isDirectory = ((inode->flags & GOSFS_DIRENTRY_ISDIRECTORY) != 0);
     entry->stats.isSetuid = ((inode->flags & GOSFS_DIRENTRY_SETUID) != 0);
     memcpy (
@@ -1610,14 +1811,14 @@ static int GOSFS_Create_Directory(struct Mount_Point *mountPoint, const char *pa
         goto finish;
     }
 
-    rc = Get_FS_Buffer(p_instance->buffercache,freeBlock,&p_buff);
+    rc = Get_New_FS_Buffer(p_instance->buffercache,freeBlock,&p_buff);
     if (rc < 0 || !p_buff) {
         Debug("GOSFS_Create_Directory: Failed to get buffer for new directory block\n");
         rc = -1;
         goto finish;
     }
 
-    rc = CreateFirstDirectoryBlock(freeInode, p_buff, filename);
+    rc = CreateFirstDirectoryBlock(freeInode, p_buff->data, filename);
     if (rc < 0) {
         Debug("GOSFS_Create_Directory: Failed to create first directory block\n");
         goto finish;
@@ -1826,9 +2027,24 @@ static int GOSFS_Delete(struct Mount_Point *mountPoint, const char *path)
             }
 
             for (e = 0; e < GOSFS_NUM_INDIRECT_PTR_PER_BLOCK; e++) {
+                struct FS_Buffer *p_buff2 = 0;
+
                 memcpy(&block2Indirect, p_buff->data + e * sizeof(ulong_t), sizeof(ulong_t));
-                if (block2Indirect != 0)
-                    Clear_Bit(p_instance->superblock.bitSet, block2Indirect);
+                if (block2Indirect == 0)
+                    continue;
+
+                // 释放二级间接块指向的数据块（跳过空洞）
+                rc = Get_FS_Buffer(p_instance->buffercache, block2Indirect, &p_buff2);
+                if (rc < 0)
+                    goto finish;
+                for (f = 0; f < GOSFS_NUM_INDIRECT_PTR_PER_BLOCK; f++) {
+                    memcpy(&blockIndirect, p_buff2->data + f * sizeof(ulong_t), sizeof(ulong_t));
+                    if (blockIndirect != 0)
+                        Clear_Bit(p_instance->superblock.bitSet, blockIndirect);
+                }
+                Release_FS_Buffer(p_instance->buffercache, p_buff2);
+
+                Clear_Bit(p_instance->superblock.bitSet, block2Indirect);
             }
 
             Release_FS_Buffer(p_instance->buffercache, p_buff);
@@ -1888,6 +2104,12 @@ static int GOSFS_Stat(struct Mount_Point *mountPoint, const char *path, struct V
 
     memcpy (stat->acls, ((struct GOSFS_Instance*)mountPoint->fsData)->superblock.inodes[inode].acl,
             sizeof(struct VFS_ACL_Entry) * VFS_MAX_ACL_ENTRIES);
+
+    rc = CountAllocatedBlocks(p_instance, &p_instance->superblock.inodes[inode]);
+    if (rc < 0)
+        goto finish;
+    stat->numBlocks = rc * GOSFS_SECTORS_PER_FS_BLOCK;
+    rc = 0;
     
 finish:
     Mutex_Unlock(&p_instance->lock);
@@ -1909,6 +2131,8 @@ static int GOSFS_Sync(struct Mount_Point *mountPoint)
     Mutex_Lock(&p_instance->lock);
     
     rc = WriteSuperblock(p_instance);
+    if (rc == 0)
+        rc = Sync_FS_Buffer_Cache(p_instance->buffercache);
     
 finish:
     if (p_buff!=0)  Release_FS_Buffer(p_instance->buffercache, p_buff);
@@ -1928,30 +2152,46 @@ static struct Mount_Point_Ops s_gosfsMountPointOps = {
 
 /*
  *将挂载区域blockDev进行GOSFS格式化
+ *
+ * Only the superblock (with its bitmap) and the root directory block
+ * are written, as one contiguous image in a single multi-sector request.
+ * Every other block is left untouched on disk: data, directory and
+ * indirect blocks are zeroed lazily when they are first allocated
+ * (see GetNewFreeBlock), so format time does not depend on device size.
  */
 static int GOSFS_Format(struct Block_Device *blockDev)
 {
-    //TODO("GeekOS filesystem format operation");
-    struct FS_Buffer_Cache        *gosfs_cache=0;
-    struct FS_Buffer            *p_buff=0;
     struct GOSFS_Superblock        *superblock=0;
+    void *image=0;
     int rc=0;
-    uchar_t *bitset=0;
-    ulong_t bcopied=0;
     ulong_t i;
-        
     
     int numBlocks = Get_Num_Blocks(blockDev)/GOSFS_SECTORS_PER_FS_BLOCK;
     
     ulong_t byteCountSuperblock = sizeof(struct GOSFS_Superblock) + FIND_NUM_BYTES(numBlocks);
     // 需要块的数量
     ulong_t blockCountSuperblock = FindNumBlocks(byteCountSuperblock);
-    gosfs_cache = Create_FS_Buffer_Cache(blockDev, GOSFS_FS_BLOCK_SIZE);
+    // 超级块 + 根目录块
+    ulong_t blockCountImage = blockCountSuperblock + 1;
+
+    if (numBlocks <= 0 || (ulong_t) numBlocks < blockCountImage) {
+        Debug("GOSFS_Format: device too small (%d blocks)\n", numBlocks);
+        rc = ENOSPACE;
+        goto finish;
+    }
+
+    image = Malloc(blockCountImage * GOSFS_FS_BLOCK_SIZE);
+    if (image == 0) {
+        rc = ENOMEM;
+        goto finish;
+    }
+    // 未使用的 inode 必须为 0 (flags==0 表示空闲)
+    memset(image, '\0', blockCountImage * GOSFS_FS_BLOCK_SIZE);
     
     Debug("GOSFS_Format: About to create root-directory\n");
    
     // 建立超级块 
-    superblock = Malloc(byteCountSuperblock);
+    superblock = (struct GOSFS_Superblock*) image;
     superblock->magic = GOSFS_MAGIC;
     superblock->size = numBlocks;
     superblock->supersize = byteCountSuperblock;
@@ -1961,56 +2201,23 @@ static int GOSFS_Format(struct Block_Device *blockDev)
     // 初始化根目录 inode 0
     superblock->inodes[0].size = 1;
     superblock->inodes[0].flags = GOSFS_DIRENTRY_ISDIRECTORY | GOSFS_DIRENTRY_USED;
-    memset (superblock->inodes[0].acl, '\0', sizeof (struct VFS_ACL_Entry) * VFS_MAX_ACL_ENTRIES);
     superblock->inodes[0].blockList[0] = blockCountSuperblock;
 
     // 标记根目录块为已使用
     Set_Bit(superblock->bitSet, blockCountSuperblock);
 
-    rc = Get_FS_Buffer(gosfs_cache, blockCountSuperblock, &p_buff);
-    if (rc == 0) {
-        Debug("GOSFS_Format: CreateFirstDirectoryBlock for root directory\n");
-        CreateFirstDirectoryBlock(0, p_buff, "/");
-        Debug("GOSFS_Format: done CreateFirstDirectoryBlock for root directory\n");
-        Modify_FS_Buffer(gosfs_cache, p_buff);
-        Release_FS_Buffer(gosfs_cache, p_buff);
-    } else {
-        Debug("GOSFS_Format: Get_FS_Buffer failed\n");
-        rc = -1;
-        goto finish;
-    }
+    Debug("GOSFS_Format: CreateFirstDirectoryBlock for root directory\n");
+    CreateFirstDirectoryBlock(0, image + blockCountSuperblock * GOSFS_FS_BLOCK_SIZE, "/");
 
-    // 将超级块写入硬盘 
-    for (i=0; i<blockCountSuperblock; i++)
-    {
-        rc = Get_FS_Buffer(gosfs_cache, i, &p_buff) ;
-        if ((byteCountSuperblock-bcopied) < GOSFS_FS_BLOCK_SIZE)
-        {
-            memcpy(
-                p_buff->data, 
-                ((void*)superblock)+bcopied, 
-                byteCountSuperblock-bcopied
-            );
-            bcopied = bcopied+(byteCountSuperblock-bcopied);
-        }
-        else
-        {
-            memcpy(
-                p_buff->data, 
-                ((void*)superblock)+bcopied, 
-                GOSFS_FS_BLOCK_SIZE
-            );
-            bcopied = bcopied + GOSFS_FS_BLOCK_SIZE;
-        }
-        
-        Modify_FS_Buffer(gosfs_cache, p_buff);
-        Release_FS_Buffer(gosfs_cache, p_buff);
-        // Debug("GOSFS_Format:writing block %ld\n",i);
-    
+    // 超级块和根目录块一次写入硬盘 (one request for the whole image)
+    rc = Block_Write_Multiple(blockDev, 0,
+        blockCountImage * GOSFS_SECTORS_PER_FS_BLOCK, image);
+    if (rc != 0) {
+        Debug("GOSFS_Format: writing image failed (%d)\n", rc);
     }
 
 finish:
-    if (gosfs_cache != 0) Destroy_FS_Buffer_Cache(gosfs_cache);
+    if (image != 0) Free(image);
     return rc;
 }
 
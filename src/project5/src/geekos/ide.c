@@ -40,9 +40,15 @@
 #define IDE_COMMAND_REGISTER		0x1f7
 #define IDE_DEVICE_CONTROL_REGISTER	0x3F6
 
+/* In LBA mode the sector number and cylinder registers hold the address */
+#define IDE_LBA_LOW_REGISTER		IDE_SECTOR_NUMBER_REGISTER
+#define IDE_LBA_MID_REGISTER		IDE_CYLINDER_LOW_REGISTER
+#define IDE_LBA_HIGH_REGISTER		IDE_CYLINDER_HIGH_REGISTER
+
 /* Drives */
 #define IDE_DRIVE_0			0xa0
 #define IDE_DRIVE_1			0xb0
+#define IDE_DRIVE_LBA			0x40	/* address is LBA, not CHS */
 
 /* Commands */
 #define IDE_COMMAND_IDENTIFY_DRIVE	0xEC
@@ -53,6 +59,14 @@
 #define IDE_COMMAND_WRITE_BUFFER	0xE8
 #define IDE_COMMAND_DIAGNOSTIC		0x90
 #define IDE_COMMAND_ATAPI_IDENT_DRIVE	0xA1
+#define IDE_COMMAND_READ_SECTORS_EXT	0x24
+#define IDE_COMMAND_WRITE_SECTORS_EXT	0x34
+#define IDE_COMMAND_SET_FEATURES	0xEF
+#define IDE_COMMAND_FLUSH_CACHE		0xE7
+#define IDE_COMMAND_FLUSH_CACHE_EXT	0xEA
+
+/* SET FEATURES subcommands, written to the feature register */
+#define IDE_FEATURE_ENABLE_WRITE_CACHE	0x02
 
 /* Results words from Identify Drive Request */
 #define	IDE_INDENTIFY_NUM_CYLINDERS	0x01
@@ -60,6 +74,14 @@
 #define	IDE_INDENTIFY_NUM_BYTES_TRACK	0x04
 #define	IDE_INDENTIFY_NUM_BYTES_SECTOR	0x05
 #define	IDE_INDENTIFY_NUM_SECTORS_TRACK	0x06
+#define IDE_IDENTIFY_CAPABILITIES	49	/* bit 9: LBA supported */
+#define IDE_IDENTIFY_LBA28_SECTORS	60	/* two words, low word first */
+#define IDE_IDENTIFY_COMMAND_SET_1	82	/* bit 5: write cache supported */
+#define IDE_IDENTIFY_COMMAND_SET_2	83	/* bit 10: LBA48 supported */
+#define IDE_IDENTIFY_LBA48_SECTORS	100	/* four words, low word first */
+
+/* Highest sector count an LBA28 command can reach */
+#define IDE_LBA28_MAX_BLOCKS		0x10000000
 
 /* bits of Status Register */
 #define IDE_STATUS_DRIVE_BUSY		0x80
@@ -91,19 +113,25 @@
 
 #define IDE_MAX_DRIVES			2
 
+/* Largest transfer a single READ/WRITE SECTORS command can do */
+#define IDE_MAX_SECTORS_PER_COMMAND	256
+
 typedef struct {
     short num_Cylinders;
     short num_Heads;
     short num_SectorsPerTrack;
     short num_BytesPerSector;
+    int num_Blocks;		/* block numbers are ints, so at most 2^31-1 */
+    bool lba;			/* drive takes LBA28 addresses */
+    bool lba48;			/* ... and LBA48 addresses */
+    bool writeCache;		/* write cache is on; writes need a flush */
 } ideDisk;
 
 int ideDebug = 0;
 static int numDrives;
 static ideDisk drives[IDE_MAX_DRIVES];
 
-struct Thread_Queue s_ideWaitQueue;
-struct Block_Request_List s_ideRequestQueue;
+static struct Block_Request_Queue s_ideRequestQueue;
 
 /*
  * return the number of logical blocks for a particular drive.
@@ -115,159 +143,242 @@ static int IDE_getNumBlocks(int driveNum)
         return IDE_ERROR_BAD_DRIVE;
     }
 
-    return (drives[driveNum].num_Heads * 
-            drives[driveNum].num_SectorsPerTrack *
-	    drives[driveNum].num_Cylinders);
+    return drives[driveNum].num_Blocks;
 }
 
 /*
- * Read a block at the logical block number indicated.
+ * Program the task file for a transfer of count sectors
+ * (1..IDE_MAX_SECTORS_PER_COMMAND) starting at blockNum and
+ * issue the given command.
+ * LBA48 takes twice the register writes, so it is only used for
+ * transfers that go past what LBA28 can address.  Drives without
+ * LBA get cylinder, head and sector.
+ * The controller is only driven from the request handler, one
+ * request at a time, and PIO transfers do not use the IDE interrupt,
+ * so transfers need neither interrupts nor preemption disabled.
  */
-static int IDE_Read(int driveNum, int blockNum, char *buffer)
+static void IDE_Issue_Command(int driveNum, int blockNum, int count, int command)
 {
-    int i;
-    int head;
-    int sector;
-    int cylinder;
-    short *bufferW;
-    int reEnable = 0;
+    ideDisk *disk = &drives[driveNum];
+    int select = (driveNum == 0) ? IDE_DRIVE_0 : IDE_DRIVE_1;
+    ulong_t lba = blockNum;
+
+    KASSERT(count > 0 && count <= IDE_MAX_SECTORS_PER_COMMAND);
+
+    if (disk->lba48 && lba + count > IDE_LBA28_MAX_BLOCKS) {
+	if (ideDebug >= 2)
+	    Print("request to %s %d blocks at %lu (lba48)\n",
+		command == IDE_COMMAND_READ_SECTORS ? "read" : "write", count, lba);
+
+	/*
+	 * Each register keeps the previous byte written to it,
+	 * so the high order bytes go first.  Block numbers are ints,
+	 * so address bits 32-47 are always 0.
+	 */
+	Out_Byte(IDE_DRIVE_HEAD_REGISTER, select | IDE_DRIVE_LBA);
+	Out_Byte(IDE_SECTOR_COUNT_REGISTER, (count >> 8) & 0xff);
+	Out_Byte(IDE_LBA_LOW_REGISTER, (lba >> 24) & 0xff);
+	Out_Byte(IDE_LBA_MID_REGISTER, 0);
+	Out_Byte(IDE_LBA_HIGH_REGISTER, 0);
+	Out_Byte(IDE_SECTOR_COUNT_REGISTER, count & 0xff);
+	Out_Byte(IDE_LBA_LOW_REGISTER, lba & 0xff);
+	Out_Byte(IDE_LBA_MID_REGISTER, (lba >> 8) & 0xff);
+	Out_Byte(IDE_LBA_HIGH_REGISTER, (lba >> 16) & 0xff);
+
+	command = (command == IDE_COMMAND_READ_SECTORS)
+	    ? IDE_COMMAND_READ_SECTORS_EXT : IDE_COMMAND_WRITE_SECTORS_EXT;
+    } else if (disk->lba) {
+	if (ideDebug >= 2)
+	    Print("request to %s %d blocks at %lu (lba28)\n",
+		command == IDE_COMMAND_READ_SECTORS ? "read" : "write", count, lba);
+
+	/* Bits 24-27 of the address go in the drive/head register */
+	Out_Byte(IDE_DRIVE_HEAD_REGISTER, select | IDE_DRIVE_LBA | ((lba >> 24) & 0x0f));
+	/* A sector count of 0 means 256 sectors. */
+	Out_Byte(IDE_SECTOR_COUNT_REGISTER, count & 0xff);
+	Out_Byte(IDE_LBA_LOW_REGISTER, lba & 0xff);
+	Out_Byte(IDE_LBA_MID_REGISTER, (lba >> 8) & 0xff);
+	Out_Byte(IDE_LBA_HIGH_REGISTER, (lba >> 16) & 0xff);
+    } else {
+	int sector, cylinder, head;
+
+	/* now compute the head, cylinder, and sector */
+	sector = blockNum % disk->num_SectorsPerTrack + 1;
+	cylinder = blockNum / (disk->num_Heads * disk->num_SectorsPerTrack);
+	head = (blockNum / disk->num_SectorsPerTrack) % disk->num_Heads;
+
+	if (ideDebug >= 2) {
+	    Print ("request to %s %d blocks at %d\n",
+		command == IDE_COMMAND_READ_SECTORS ? "read" : "write", count, blockNum);
+	    Print ("    head %d\n", head);
+	    Print ("    cylinder %d\n", cylinder);
+	    Print ("    sector %d\n", sector);
+	}
+
+	Out_Byte(IDE_DRIVE_HEAD_REGISTER, select | head);
+	/* A sector count of 0 means 256 sectors. */
+	Out_Byte(IDE_SECTOR_COUNT_REGISTER, count & 0xff);
+	Out_Byte(IDE_SECTOR_NUMBER_REGISTER, sector);
+	Out_Byte(IDE_CYLINDER_LOW_REGISTER, LOW_BYTE(cylinder));
+	Out_Byte(IDE_CYLINDER_HIGH_REGISTER, HIGH_BYTE(cylinder));
+    }
+
+    Out_Byte(IDE_COMMAND_REGISTER, command);
+}
+
+/*
+ * Issue a command that transfers no data, and wait for it to finish.
+ */
+static int IDE_Do_Simple_Command(int driveNum, int feature, int command)
+{
+    Out_Byte(IDE_DRIVE_HEAD_REGISTER, (driveNum == 0) ? IDE_DRIVE_0 : IDE_DRIVE_1);
+    Out_Byte(IDE_FEATURE_REG, feature);
+    Out_Byte(IDE_COMMAND_REGISTER, command);
+
+    while (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_BUSY);
+
+    if (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_ERROR)
+	return IDE_ERROR_DRIVE_ERROR;
+    return IDE_ERROR_NO_ERROR;
+}
+
+/*
+ * Write everything in the drive's write cache to the disk.
+ * Without a write cache, writes are on the disk when they complete.
+ */
+static int IDE_Flush(int driveNum)
+{
+    int rc;
+
+    if (driveNum < 0 || driveNum > (numDrives-1))
+	return IDE_ERROR_BAD_DRIVE;
+    if (!drives[driveNum].writeCache)
+	return IDE_ERROR_NO_ERROR;
 
+    rc = IDE_Do_Simple_Command(driveNum, 0,
+	drives[driveNum].lba48 ? IDE_COMMAND_FLUSH_CACHE_EXT : IDE_COMMAND_FLUSH_CACHE);
+    if (rc != IDE_ERROR_NO_ERROR)
+	Print("ERROR: Got Flush %d\n", In_Byte(IDE_STATUS_REGISTER));
+    return rc;
+}
+
+/*
+ * Check that a transfer of numBlocks blocks starting at
+ * blockNum is within the bounds of the given drive.
+ */
+static int IDE_Check_Range(int driveNum, int blockNum, int numBlocks)
+{
     if (driveNum < 0 || driveNum > (numDrives-1)) {
 	if (ideDebug) Print("ide: invalid drive %d\n", driveNum);
         return IDE_ERROR_BAD_DRIVE;
     }
 
-    if (blockNum < 0 || blockNum >= IDE_getNumBlocks(driveNum)) {
-	if (ideDebug) Print("ide: invalid block %d\n", blockNum);
+    if (blockNum < 0 || numBlocks <= 0 ||
+	numBlocks > IDE_getNumBlocks(driveNum) - blockNum) {
+	if (ideDebug) Print("ide: invalid block range %d+%d\n", blockNum, numBlocks);
         return IDE_ERROR_INVALID_BLOCK;
     }
 
-    if (Interrupts_Enabled()) {
-	Disable_Interrupts();
-	reEnable = 1;
-    }
+    return IDE_ERROR_NO_ERROR;
+}
 
-    /* now compute the head, cylinder, and sector */
-    sector = blockNum % drives[driveNum].num_SectorsPerTrack + 1;
-    cylinder = blockNum / (drives[driveNum].num_Heads * 
-     	drives[driveNum].num_SectorsPerTrack);
-    head = (blockNum / drives[driveNum].num_SectorsPerTrack) % 
-        drives[driveNum].num_Heads;
-
-    if (ideDebug >= 2) {
-	Print ("request to read block %d\n", blockNum);
-	Print ("    head %d\n", head);
-	Print ("    cylinder %d\n", cylinder);
-	Print ("    sector %d\n", sector);
-    }
+/*
+ * Read numBlocks blocks starting at the logical block number indicated.
+ * Each READ SECTORS command transfers up to IDE_MAX_SECTORS_PER_COMMAND
+ * sectors; the drive advances the address by itself.
+ */
+static int IDE_Read(int driveNum, int blockNum, int numBlocks, char *buffer)
+{
+    int i;
+    short *bufferW = (short *) buffer;
+    int rc;
 
-    Out_Byte(IDE_SECTOR_COUNT_REGISTER, 1);
-    Out_Byte(IDE_SECTOR_NUMBER_REGISTER, sector);
-    Out_Byte(IDE_CYLINDER_LOW_REGISTER, LOW_BYTE(cylinder));
-    Out_Byte(IDE_CYLINDER_HIGH_REGISTER, HIGH_BYTE(cylinder));
-    if (driveNum == 0) {
-	Out_Byte(IDE_DRIVE_HEAD_REGISTER, IDE_DRIVE_0 | head);
-    } else if (driveNum == 1) {
-	Out_Byte(IDE_DRIVE_HEAD_REGISTER, IDE_DRIVE_1 | head);
-    }
+    if ((rc = IDE_Check_Range(driveNum, blockNum, numBlocks)) != IDE_ERROR_NO_ERROR)
+	return rc;
 
-    Out_Byte(IDE_COMMAND_REGISTER, IDE_COMMAND_READ_SECTORS);
+    while (numBlocks > 0) {
+	int count = numBlocks < IDE_MAX_SECTORS_PER_COMMAND
+	    ? numBlocks : IDE_MAX_SECTORS_PER_COMMAND;
+	int n;
 
-    if (ideDebug > 2) Print("About to wait for Read \n");
+	IDE_Issue_Command(driveNum, blockNum, count, IDE_COMMAND_READ_SECTORS);
 
-    /* wait for the drive */
-    while (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_BUSY);
+	if (ideDebug > 2) Print("About to wait for Read \n");
 
-    if (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_ERROR) {
-	Print("ERROR: Got Read %d\n", In_Byte(IDE_STATUS_REGISTER));
-	return IDE_ERROR_DRIVE_ERROR;
-    }
+	for (n = 0; n < count; ++n) {
+	    /* wait for the drive */
+	    while (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_BUSY);
 
-    if (ideDebug > 2) Print("got buffer \n");
+	    if (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_ERROR) {
+		Print("ERROR: Got Read %d\n", In_Byte(IDE_STATUS_REGISTER));
+		rc = IDE_ERROR_DRIVE_ERROR;
+		goto done;
+	    }
 
-    bufferW = (short *) buffer;
-    for (i=0; i < 256; i++) {
-        bufferW[i] = In_Word(IDE_DATA_REGISTER);
-    }
+	    for (i=0; i < 256; i++) {
+		*bufferW++ = In_Word(IDE_DATA_REGISTER);
+	    }
+	}
 
-    if (reEnable) Enable_Interrupts();
+	blockNum += count;
+	numBlocks -= count;
+    }
 
-    return IDE_ERROR_NO_ERROR;
+done:
+    return rc;
 }
 
 /*
- * Write a block at the logical block number indicated.
+ * Write numBlocks blocks starting at the logical block number indicated.
  */
-static int IDE_Write(int driveNum, int blockNum, char *buffer)
+static int IDE_Write(int driveNum, int blockNum, int numBlocks, char *buffer)
 {
     int i;
-    int head;
-    int sector;
-    int cylinder;
-    short *bufferW;
-    int reEnable = 0;
-
-    if (driveNum < 0 || driveNum > (numDrives-1)) {
-        return IDE_ERROR_BAD_DRIVE;
-    }
-
-    if (blockNum < 0 || blockNum >= IDE_getNumBlocks(driveNum)) {
-        return IDE_ERROR_INVALID_BLOCK;
-    }
+    short *bufferW = (short *) buffer;
+    int rc;
 
-    if (Interrupts_Enabled()) {
-	Disable_Interrupts();
-	reEnable = 1;
-    }
+    if ((rc = IDE_Check_Range(driveNum, blockNum, numBlocks)) != IDE_ERROR_NO_ERROR)
+	return rc;
 
-    /* now compute the head, cylinder, and sector */
-    sector = blockNum % drives[driveNum].num_SectorsPerTrack + 1;
-    cylinder = blockNum / (drives[driveNum].num_Heads * 
-     	drives[driveNum].num_SectorsPerTrack);
-    head = (blockNum / drives[driveNum].num_SectorsPerTrack) % 
-        drives[driveNum].num_Heads;
-
-    if (ideDebug) {
-	Print ("request to write block %d\n", blockNum);
-	Print ("    head %d\n", head);
-	Print ("    cylinder %d\n", cylinder);
-	Print ("    sector %d\n", sector);
-    }
+    while (numBlocks > 0) {
+	int count = numBlocks < IDE_MAX_SECTORS_PER_COMMAND
+	    ? numBlocks : IDE_MAX_SECTORS_PER_COMMAND;
+	int n;
 
-    Out_Byte(IDE_SECTOR_COUNT_REGISTER, 1);
-    Out_Byte(IDE_SECTOR_NUMBER_REGISTER, sector);
-    Out_Byte(IDE_CYLINDER_LOW_REGISTER, LOW_BYTE(cylinder));
-    Out_Byte(IDE_CYLINDER_HIGH_REGISTER, HIGH_BYTE(cylinder));
-    if (driveNum == 0) {
-	Out_Byte(IDE_DRIVE_HEAD_REGISTER, IDE_DRIVE_0 | head);
-    } else if (driveNum == 1) {
-	Out_Byte(IDE_DRIVE_HEAD_REGISTER, IDE_DRIVE_1 | head);
-    }
+	IDE_Issue_Command(driveNum, blockNum, count, IDE_COMMAND_WRITE_SECTORS);
 
-    Out_Byte(IDE_COMMAND_REGISTER, IDE_COMMAND_WRITE_SECTORS);
+	for (n = 0; n < count; ++n) {
+	    /* wait for the drive to ask for the next sector */
+	    while (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_BUSY);
 
+	    if (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_ERROR) {
+		Print("ERROR: Got Write %d\n", In_Byte(IDE_STATUS_REGISTER));
+		rc = IDE_ERROR_DRIVE_ERROR;
+		goto done;
+	    }
 
-    /* wait for the drive */
-    while (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_BUSY);
+	    for (i=0; i < 256; i++) {
+		Out_Word(IDE_DATA_REGISTER, *bufferW++);
+	    }
+	}
 
-    bufferW = (short *) buffer;
-    for (i=0; i < 256; i++) {
-        Out_Word(IDE_DATA_REGISTER, bufferW[i]);
-    }
+	if (ideDebug) Print("About to wait for Write \n");
 
-    if (ideDebug) Print("About to wait for Write \n");
+	/* wait for the drive */
+	while (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_BUSY);
 
-    /* wait for the drive */
-    while (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_BUSY);
+	if (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_ERROR) {
+	    Print("ERROR: Got Write %d\n", In_Byte(IDE_STATUS_REGISTER));
+	    rc = IDE_ERROR_DRIVE_ERROR;
+	    goto done;
+	}
 
-    if (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_ERROR) {
-	Print("ERROR: Got Read %d\n", In_Byte(IDE_STATUS_REGISTER));
-	return IDE_ERROR_DRIVE_ERROR;
+	blockNum += count;
+	numBlocks -= count;
     }
 
-    if (reEnable) Enable_Interrupts();
-
-    return IDE_ERROR_NO_ERROR;
+done:
+    return rc;
 }
 
 static int IDE_Open(struct Block_Device *dev)
@@ -293,24 +404,18 @@ static struct Block_Device_Ops s_ideDeviceOps = {
     IDE_Get_Num_Blocks,
 };
 
-static void IDE_Request_Thread(ulong_t arg)
+/*
+ * Perform an IDE I/O request.
+ * Called from a worker thread by the block device layer.
+ */
+static int IDE_Handle_Request(struct Block_Request *request)
 {
-    for (;;) {
-	struct Block_Request *request;
-	int rc;
-
-	/* Wait for a request to arrive */
-	request = Dequeue_Request(&s_ideRequestQueue, &s_ideWaitQueue);
-
-	/* Do the I/O */
-	if (request->type == BLOCK_READ)
-	    rc = IDE_Read(request->dev->unit, request->blockNum, request->buf);
-	else
-	    rc = IDE_Write(request->dev->unit, request->blockNum, request->buf);
-
-	/* Notify requesting thread of final status */
-	Notify_Request_Completion(request, rc == 0 ? COMPLETED : ERROR, rc);
-    }
+    if (request->type == BLOCK_FLUSH)
+	return IDE_Flush(request->dev->unit);
+    else if (request->type == BLOCK_READ)
+	return IDE_Read(request->dev->unit, request->blockNum, request->numBlocks, request->buf);
+    else
+	return IDE_Write(request->dev->unit, request->blockNum, request->numBlocks, request->buf);
 }
 
 static int readDriveConfig(int drive)
@@ -319,6 +424,8 @@ static int readDriveConfig(int drive)
     int status;
     short info[256];
     char devname[BLOCKDEV_MAX_NAME_LEN];
+    ideDisk *disk = &drives[drive];
+    ulong_t numBlocks;
     int rc;
 
     if (ideDebug > 1) Print("ide: about to read drive config for drive #%d\n", drive);
@@ -343,6 +450,27 @@ static int readDriveConfig(int drive)
 	drives[drive].num_Heads = info[IDE_INDENTIFY_NUM_HEADS];
 	drives[drive].num_SectorsPerTrack = info[IDE_INDENTIFY_NUM_SECTORS_TRACK];
 	drives[drive].num_BytesPerSector = info[IDE_INDENTIFY_NUM_BYTES_SECTOR];
+
+	/* Size: the LBA sector counts are worth more than the CHS geometry */
+	numBlocks = disk->num_Cylinders * disk->num_Heads * disk->num_SectorsPerTrack;
+	disk->lba = (info[IDE_IDENTIFY_CAPABILITIES] & (1 << 9)) != 0;
+	if (disk->lba)
+	    numBlocks = (ushort_t) info[IDE_IDENTIFY_LBA28_SECTORS] |
+		((ulong_t) (ushort_t) info[IDE_IDENTIFY_LBA28_SECTORS + 1] << 16);
+	disk->lba48 = disk->lba && (info[IDE_IDENTIFY_COMMAND_SET_2] & (1 << 10)) != 0;
+	if (disk->lba48) {
+	    numBlocks = (ushort_t) info[IDE_IDENTIFY_LBA48_SECTORS] |
+		((ulong_t) (ushort_t) info[IDE_IDENTIFY_LBA48_SECTORS + 1] << 16);
+	    if (info[IDE_IDENTIFY_LBA48_SECTORS + 2] != 0 || info[IDE_IDENTIFY_LBA48_SECTORS + 3] != 0)
+		numBlocks = ~0UL;
+	}
+	disk->num_Blocks = numBlocks > 0x7fffffffUL ? 0x7fffffff : numBlocks;
+
+	/* Let the drive buffer writes; Sync() flushes them */
+	if ((info[IDE_IDENTIFY_COMMAND_SET_1] & (1 << 5)) &&
+	    IDE_Do_Simple_Command(drive, IDE_FEATURE_ENABLE_WRITE_CACHE,
+		IDE_COMMAND_SET_FEATURES) == IDE_ERROR_NO_ERROR)
+	    disk->writeCache = true;
     } else {
        /* try for ATAPI */
        Out_Byte(IDE_FEATURE_REG, 0);		 /* disable dma & overlap */
@@ -355,12 +483,14 @@ static int readDriveConfig(int drive)
        return -1;
     }
 
-    Print("    ide%d: cyl=%d, heads=%d, sectors=%d\n", drive, drives[drive].num_Cylinders,
-	drives[drive].num_Heads, drives[drive].num_SectorsPerTrack);
+    Print("    ide%d: cyl=%d, heads=%d, sectors=%d, blocks=%d, %s%s\n", drive,
+	disk->num_Cylinders, disk->num_Heads, disk->num_SectorsPerTrack, disk->num_Blocks,
+	disk->lba48 ? "lba48" : disk->lba ? "lba28" : "chs",
+	disk->writeCache ? ", write cache" : "");
 
     /* Register the drive as a block device */
     snprintf(devname, sizeof(devname), "ide%d", drive);
-    rc = Register_Block_Device(devname, &s_ideDeviceOps, drive, 0, &s_ideWaitQueue, &s_ideRequestQueue);
+    rc = Register_Block_Device(devname, &s_ideDeviceOps, drive, 0, &s_ideRequestQueue);
     if (rc != 0)
 	Print("  Error: could not create block device for %s\n", devname);
 
@@ -396,14 +526,13 @@ void Init_IDE(void)
     errorCode = In_Byte(IDE_ERROR_REGISTER);
     if (ideDebug > 1) Print("ide: ide error register = %x\n", errorCode);
 
+    /* Requests are handled in a worker thread */
+    Init_Block_Request_Queue(&s_ideRequestQueue, &IDE_Handle_Request);
+
     /* Probe and register drives */
     if (readDriveConfig(0) == 0)
 	++numDrives;
     if (readDriveConfig(1) == 0)
 	++numDrives;
     if (ideDebug) Print("Found %d IDE drives\n", numDrives);
-
-    /* Start request thread */
-    if (numDrives > 0)
-	Start_Kernel_Thread(IDE_Request_Thread, 0, PRIORITY_NORMAL, true);
 }
@@ -0,0 +1,443 @@
+/*
+ * Submission/completion rings for batched file I/O
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/kassert.h>
+#include <geekos/errno.h>
+#include <geekos/int.h>
+#include <geekos/string.h>
+#include <geekos/malloc.h>
+#include <geekos/kthread.h>
+#include <geekos/vfs.h>
+#include <geekos/user.h>
+#include <geekos/ioring.h>
+
+/*
+ * A process submits a batch with one system call; its ring threads
+ * then run the operations in the process's address space, while the
+ * process carries on computing.  Several reads and writes are in
+ * progress at once, so the disk always has requests queued for it;
+ * their completions are posted in the order they finish.  Opens,
+ * closes and syncs are barriers: they start once everything before
+ * them is complete, and nothing after them starts until they are.
+ * All functions here are called with interrupts disabled, and enable
+ * them around blocking filesystem calls just like the system calls do.
+ */
+
+#define RING_FIELD(ring, field) ((ring)->userAddr + offsetof(struct IO_Ring_Header, field))
+
+/* User addresses of the ring slots for given (free running) index */
+static ulong_t Submission_Addr(struct IO_Ring *ring, ulong_t index)
+{
+    return ring->userAddr + sizeof(struct IO_Ring_Header) +
+        (index & (ring->numEntries - 1)) * sizeof(struct IO_Submission);
+}
+
+static ulong_t Completion_Addr(struct IO_Ring *ring, ulong_t index)
+{
+    return ring->userAddr + sizeof(struct IO_Ring_Header) +
+        ring->numEntries * sizeof(struct IO_Submission) +
+        (index & (ring->numEntries - 1)) * sizeof(struct IO_Completion);
+}
+
+/*
+ * The ring threads quit once the process is exiting,
+ * or they are the only threads left in it.
+ */
+static bool IO_Ring_Closing(struct User_Context *context)
+{
+    struct IO_Ring *ring = context->ioRing;
+
+    if (context->exiting || context->refCount == ring->numThreads)
+        ring->closing = true;
+    return ring->closing;
+}
+
+/* Operations which must not overlap with any other */
+static bool Is_Barrier(int opcode)
+{
+    return opcode == IO_OP_OPEN || opcode == IO_OP_CLOSE || opcode == IO_OP_FSYNC;
+}
+
+/*
+ * Run a read or write.  Several of them may be in progress on the
+ * same file at once, so one with an offset works on a private copy
+ * of the File, leaving the shared file position alone.
+ */
+static int IO_Read_Write(struct User_Context *context, struct IO_Submission *sqe)
+{
+    struct File *file, view, *target;
+    void *buf;
+    int rc;
+
+    /* Nothing to move, and Malloc() does not take a zero size */
+    if (sqe->length == 0)
+        return 0;
+
+    buf = Malloc(sqe->length);
+    if (buf == 0)
+        return ENOMEM;
+
+    if (sqe->opcode == IO_OP_WRITE && !Copy_From_User(buf, sqe->buf, sqe->length)) {
+        rc = EINVALID;
+        goto done;
+    }
+
+    file = Hold_File_Descriptor(context, sqe->fd);
+    if (file == 0) {
+        rc = ENOTFOUND;
+        goto done;
+    }
+
+    target = file;
+    if (sqe->offset != IO_NO_OFFSET) {
+        view = *file;
+        target = &view;
+    }
+
+    Enable_Interrupts();
+    rc = 0;
+    if (target != file)
+        rc = Seek(target, sqe->offset);
+    if (rc == 0) {
+        if (sqe->opcode == IO_OP_READ)
+            rc = Read(target, buf, sqe->length);
+        else
+            rc = Write(target, buf, sqe->length);
+    }
+    Disable_Interrupts();
+
+    /* A write past the end grew the file */
+    if (target != file && view.endPos > file->endPos)
+        file->endPos = view.endPos;
+    Put_File(file);
+
+    if (sqe->opcode == IO_OP_READ && rc > 0 && !Copy_To_User(sqe->buf, buf, rc))
+        rc = EINVALID;
+
+done:
+    Free(buf);
+    return rc;
+}
+
+static int IO_Open(struct User_Context *context, struct IO_Submission *sqe)
+{
+    struct File *file = 0;
+    char *path;
+    int rc;
+
+    if (sqe->length == 0 || sqe->length > VFS_MAX_PATH_LEN)
+        return EINVALID;
+
+    path = Malloc(sqe->length + 1);
+    if (path == 0)
+        return ENOMEM;
+    if (!Copy_From_User(path, sqe->buf, sqe->length)) {
+        Free(path);
+        return EINVALID;
+    }
+    path[sqe->length] = 0;
+
+    Enable_Interrupts();
+    rc = Open(path, sqe->fd, &file);
+    Disable_Interrupts();
+    Free(path);
+    if (rc != 0)
+        return rc;
+
+    rc = Alloc_File_Descriptor(context, file);
+    if (rc < 0) {
+        Enable_Interrupts();
+        Close(file);
+        Disable_Interrupts();
+    }
+    return rc;
+}
+
+static int IO_Fsync(struct User_Context *context, struct IO_Submission *sqe)
+{
+    struct File *file = Hold_File_Descriptor(context, sqe->fd);
+    int rc;
+
+    if (file == 0)
+        return ENOTFOUND;
+
+    Sync_Mapped_File(context, file);
+    Enable_Interrupts();
+    rc = Fsync(file);
+    Disable_Interrupts();
+    Put_File(file);
+    return rc;
+}
+
+static int IO_Run_Submission(struct User_Context *context, struct IO_Submission *sqe)
+{
+    switch (sqe->opcode) {
+    case IO_OP_NOP:
+        return 0;
+    case IO_OP_READ:
+    case IO_OP_WRITE:
+        return IO_Read_Write(context, sqe);
+    case IO_OP_OPEN:
+        return IO_Open(context, sqe);
+    case IO_OP_CLOSE:
+        return Close_File_Descriptor(context, sqe->fd);
+    case IO_OP_FSYNC:
+        return IO_Fsync(context, sqe);
+    default:
+        return EUNSUPPORTED;
+    }
+}
+
+/*
+ * Take the next submission off the ring, if there is one and a
+ * completion slot to go with it.  Only one ring thread at a time
+ * may call this (see ring->fetching).
+ * Returns 1 if a submission was taken, 0 if there is nothing to do,
+ * or -1 if the ring isn't readable.
+ */
+static int Fetch_Submission(struct IO_Ring *ring, struct IO_Submission *sqe)
+{
+    struct IO_Ring_Header header;
+
+    if (!Copy_From_User(&header, ring->userAddr, sizeof(header)))
+        return -1;
+
+    /* Every submission in progress has a completion slot set aside */
+    if (header.sqHead == header.sqTail ||
+        header.cqTail + ring->numInFlight - header.cqHead >= ring->numEntries)
+        return 0;
+
+    if (!Copy_From_User(sqe, Submission_Addr(ring, header.sqHead), sizeof(*sqe)))
+        return -1;
+    ++header.sqHead;
+    if (!Copy_To_User(RING_FIELD(ring, sqHead), (void*) &header.sqHead, sizeof(ulong_t)))
+        return -1;
+    return 1;
+}
+
+/*
+ * Post a completion, then publish it by advancing cqTail.
+ * Only one ring thread at a time may call this (see ring->posting).
+ */
+static bool Post_Completion(struct IO_Ring *ring, struct IO_Completion *cqe)
+{
+    ulong_t cqTail;
+
+    if (!Copy_From_User(&cqTail, RING_FIELD(ring, cqTail), sizeof(ulong_t)) ||
+        !Copy_To_User(Completion_Addr(ring, cqTail), cqe, sizeof(*cqe)))
+        return false;
+    ++cqTail;
+    return Copy_To_User(RING_FIELD(ring, cqTail), &cqTail, sizeof(ulong_t));
+}
+
+/*
+ * Body of a ring thread.  The user context reference was taken
+ * for us by Setup_IO_Ring(); it is dropped when we exit.
+ * Any change in the ring's state wakes submitWaitQueue, and
+ * the threads waiting there look again.
+ */
+static void IO_Ring_Thread(ulong_t arg)
+{
+    struct User_Context *context = (struct User_Context*) arg;
+    struct IO_Ring *ring = context->ioRing;
+    struct IO_Submission sqe;
+    struct IO_Completion cqe;
+    bool barrier, posted;
+    int rc;
+
+    Disable_Interrupts();
+    g_currentThread->userContext = context;
+    Switch_To_Address_Space(context);
+
+    while (!IO_Ring_Closing(context)) {
+        if (ring->fetching || ring->barrier) {
+            Wait(&ring->submitWaitQueue);
+            continue;
+        }
+
+        /*
+         * Reading the ring may fault and block, so a kick that arrives
+         * meanwhile is remembered in ring->kicked rather than lost.
+         */
+        ring->fetching = true;
+        ring->kicked = false;
+        rc = Fetch_Submission(ring, &sqe);
+        ring->fetching = false;
+        if (rc < 0)
+            break;
+        if (rc == 0) {
+            /* Nothing submitted, or no room to post a completion */
+            if (!ring->kicked)
+                Wait(&ring->submitWaitQueue);
+            continue;
+        }
+
+        ++ring->numInFlight;
+        barrier = Is_Barrier(sqe.opcode);
+        if (barrier) {
+            ring->barrier = true;
+            while (ring->numInFlight > 1)
+                Wait(&ring->submitWaitQueue);
+        } else {
+            /* Let another thread pick up the next submission */
+            Wake_Up(&ring->submitWaitQueue);
+        }
+
+        cqe.userData = sqe.userData;
+        cqe.result = IO_Run_Submission(context, &sqe);
+
+        while (ring->posting)
+            Wait(&ring->submitWaitQueue);
+        ring->posting = true;
+        posted = Post_Completion(ring, &cqe);
+        ring->posting = false;
+
+        --ring->numInFlight;
+        if (barrier)
+            ring->barrier = false;
+        ++ring->numCompleted;
+        Wake_Up(&ring->completeWaitQueue);
+        Wake_Up(&ring->submitWaitQueue);
+        if (!posted)
+            break;
+    }
+
+    /* The ring is unusable or going away: stop the other threads too */
+    ring->closing = true;
+    Wake_Up(&ring->submitWaitQueue);
+    Wake_Up(&ring->completeWaitQueue);
+    Enable_Interrupts();
+    Exit(0);
+}
+
+/*
+ * Register the ring at given user address for the process, and start
+ * its ring threads.  A process may have one ring.
+ * Returns 0 if successful, error code (< 0) if unsuccessful.
+ */
+int Setup_IO_Ring(struct User_Context *context, ulong_t ringAddr, ulong_t numEntries)
+{
+    struct IO_Ring *ring;
+    struct IO_Ring_Header header;
+    int i;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (context->ioRing != 0)
+        return EEXIST;
+    if (numEntries == 0 || numEntries > IO_RING_MAX_ENTRIES ||
+        (numEntries & (numEntries - 1)) != 0 || (ringAddr & 3) != 0)
+        return EINVALID;
+
+    ring = (struct IO_Ring*) Malloc(sizeof(*ring));
+    if (ring == 0)
+        return ENOMEM;
+    memset(ring, 0, sizeof(*ring));
+    ring->userAddr = ringAddr;
+    ring->numEntries = numEntries;
+
+    memset(&header, 0, sizeof(header));
+    header.numEntries = numEntries;
+    if (!Copy_To_User(ringAddr, &header, sizeof(header))) {
+        Free(ring);
+        return EINVALID;
+    }
+
+    /*
+     * Take the ring threads' references now, so the context cannot
+     * go away before the threads get to run.
+     */
+    context->ioRing = ring;
+    context->refCount += IO_RING_THREADS;
+    ring->numThreads = IO_RING_THREADS;
+
+    for (i = 0; i < IO_RING_THREADS; ++i) {
+        struct Kernel_Thread *kthread;
+
+        Enable_Interrupts();
+        kthread = Start_Kernel_Thread(IO_Ring_Thread, (ulong_t) context, PRIORITY_USER, true);
+        Disable_Interrupts();
+        if (kthread == 0) {
+            context->refCount -= IO_RING_THREADS - i;
+            ring->numThreads = i;
+            break;
+        }
+    }
+
+    if (ring->numThreads == 0) {
+        context->ioRing = 0;
+        Free(ring);
+        return ENOMEM;
+    }
+    return 0;
+}
+
+/*
+ * Tell the ring threads that new submissions are in the ring,
+ * then wait until at least minComplete completions are waiting
+ * to be looked at.
+ * Returns the number of waiting completions,
+ * or error code (< 0) if unsuccessful.
+ */
+int Enter_IO_Ring(struct User_Context *context, ulong_t minComplete)
+{
+    struct IO_Ring *ring = context->ioRing;
+    struct IO_Ring_Header header;
+    ulong_t numCompleted;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (ring == 0)
+        return ENOTFOUND;
+
+    Kick_IO_Ring(context);
+    while (true) {
+        /* Reading the ring may block; don't miss a completion meanwhile */
+        numCompleted = ring->numCompleted;
+        if (!Copy_From_User(&header, ring->userAddr, sizeof(header)))
+            return EINVALID;
+
+        /* Never wait for more than has been submitted */
+        if (header.cqTail - header.cqHead >= minComplete ||
+            header.sqTail - header.cqHead < minComplete ||
+            IO_Ring_Closing(context))
+            break;
+        if (ring->numCompleted == numCompleted)
+            Wait(&ring->completeWaitQueue);
+    }
+
+    return header.cqTail - header.cqHead;
+}
+
+/*
+ * Wake the process's ring threads, if it has a ring.
+ */
+void Kick_IO_Ring(struct User_Context *context)
+{
+    struct IO_Ring *ring = context->ioRing;
+    bool iflag;
+
+    if (ring == 0)
+        return;
+
+    iflag = Begin_Int_Atomic();
+    ring->kicked = true;
+    Wake_Up(&ring->submitWaitQueue);
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Free the kernel side of the process's ring.
+ * The ring threads are gone by the time the context is destroyed.
+ */
+void Destroy_IO_Ring(struct User_Context *context)
+{
+    if (context->ioRing != 0) {
+        Free(context->ioRing);
+        context->ioRing = 0;
+    }
+}
@@ -34,6 +34,15 @@
 #include <geekos/irq.h>
 #include <geekos/io.h>
 #include <geekos/keyboard.h>
+#include <geekos/softirq.h>
+#include <geekos/trace.h>
+#include <geekos/swapcache.h>
+#include <geekos/paging.h>
+#include <geekos/thrash.h>
+#include <geekos/workqueue.h>
+#include <geekos/errno.h>
+#include <geekos/vfs.h>
+#include <geekos/poll.h>
 
 /* ----------------------------------------------------------------------
  * Private data and functions
@@ -63,11 +72,25 @@ static unsigned s_shiftState = 0;
 static Keycode s_queue[QUEUE_SIZE];
 static int s_queueHead, s_queueTail;
 
+/*
+ * Raw scan codes read by the interrupt handler,
+ * waiting to be decoded by the keyboard tasklet.
+ */
+#define SCAN_QUEUE_SIZE 64
+#define NEXT_SCAN(index) (((index) + 1) & (SCAN_QUEUE_SIZE - 1))
+static uchar_t s_scanQueue[SCAN_QUEUE_SIZE];
+static int s_scanQueueHead, s_scanQueueTail;
+
 /*
  * Wait queue for thread(s) waiting for keyboard events.
  */
 static struct Thread_Queue s_waitQueue;
 
+/*
+ * Pollers of console Files (see Open_Console()).
+ */
+static struct Poll_Entry_List s_pollList;
+
 /*
  * Translate from scan code to key code, when shift is not pressed.
  */
@@ -155,15 +178,167 @@ static __inline__ Keycode Dequeue_Keycode(void)
 }
 
 /*
- * Handler for keyboard interrupts.
+ * Ctrl+Alt+T prints the tracepoint log from a worker thread.
  */
-static void Keyboard_Interrupt_Handler(struct Interrupt_State* state)
+#define TRACE_DUMP_KEY (KEY_CTRL_FLAG | KEY_ALT_FLAG | 't')
+
+static void Dump_Trace_Work(ulong_t arg)
+{
+    Dump_Trace_Log();
+}
+
+static struct Work_Item s_traceDumpWork = WORK_ITEM_INITIALIZER(Dump_Trace_Work, 0);
+
+/*
+ * Ctrl+Alt+S prints the swap cache and paging device counters,
+ * and the paging load of each process.
+ */
+#define SWAP_STATS_KEY (KEY_CTRL_FLAG | KEY_ALT_FLAG | 's')
+
+static void Dump_Swap_Stats_Work(ulong_t arg)
+{
+    Dump_Swap_Cache_Stats();
+    Dump_Paging_Devices();
+    Dump_Thrash_Stats();
+}
+
+static struct Work_Item s_swapStatsWork = WORK_ITEM_INITIALIZER(Dump_Swap_Stats_Work, 0);
+
+/*
+ * Translate a scan code into a keycode, update the shift state,
+ * and queue the keycode for consumers.
+ * Called from the keyboard tasklet with interrupts enabled.
+ */
+static void Process_Scan_Code(uchar_t scanCode)
 {
-    uchar_t status, scanCode;
     unsigned flag = 0;
     bool release = false, shift;
     Keycode keycode;
 
+/*
+ *	Print("code=%x%s\n", scanCode, (scanCode&0x80) ? " [release]" : "");
+ */
+
+    if (scanCode & KB_KEY_RELEASE) {
+	release = true;
+	scanCode &= ~(KB_KEY_RELEASE);
+    }
+
+    if (scanCode >= SCAN_TABLE_SIZE) {
+	Print("Unknown scan code: %x\n", scanCode);
+	return;
+    }
+
+    /* Process the key */
+    shift = ((s_shiftState & SHIFT_MASK) != 0);
+    keycode = shift ? s_scanTableWithShift[scanCode] : s_scanTableNoShift[scanCode];
+
+    /* Update shift, control and alt state */
+    switch (keycode) {
+    case KEY_LSHIFT:
+	flag = LEFT_SHIFT;
+	break;
+    case KEY_RSHIFT:
+	flag = RIGHT_SHIFT;
+	break;
+    case KEY_LCTRL:
+	flag = LEFT_CTRL;
+	break;
+    case KEY_RCTRL:
+	flag = RIGHT_CTRL;
+	break;
+    case KEY_LALT:
+	flag = LEFT_ALT;
+	break;
+    case KEY_RALT:
+	flag = RIGHT_ALT;
+	break;
+    default:
+	goto noflagchange;
+    }
+
+    if (release)
+	s_shiftState &= ~(flag);
+    else
+	s_shiftState |= flag;
+
+    /*
+     * Shift, control and alt keys don't have to be
+     * queued, flags will be set!
+     */
+    return;
+
+noflagchange:
+    /* Format the new keycode */
+    if (shift)
+	keycode |= KEY_SHIFT_FLAG;
+    if ((s_shiftState & CTRL_MASK) != 0)
+	keycode |= KEY_CTRL_FLAG;
+    if ((s_shiftState & ALT_MASK) != 0)
+	keycode |= KEY_ALT_FLAG;
+    if (release)
+	keycode |= KEY_RELEASE_FLAG;
+
+    if (keycode == TRACE_DUMP_KEY) {
+	Queue_Work_Item(&s_traceDumpWork);
+	return;
+    }
+    if (keycode == SWAP_STATS_KEY) {
+	Queue_Work_Item(&s_swapStatsWork);
+	return;
+    }
+
+    Disable_Interrupts();
+
+    /* Put the keycode in the buffer */
+    Enqueue_Keycode(keycode);
+
+    /* Wake up event consumers */
+    Wake_Up(&s_waitQueue);
+    Poll_Wake(&s_pollList);
+
+    /*
+     * Pick a new thread upon return from interrupt
+     * (hopefully the one waiting for the keyboard event)
+     */
+    g_needReschedule = true;
+    Trace_Reschedule_Request();
+
+    Enable_Interrupts();
+}
+
+/*
+ * Keyboard tasklet: decode the scan codes collected
+ * by the interrupt handler.
+ */
+static void Keyboard_Tasklet(ulong_t arg)
+{
+    while (true) {
+	uchar_t scanCode;
+
+	Disable_Interrupts();
+	if (s_scanQueueHead == s_scanQueueTail) {
+	    Enable_Interrupts();
+	    break;
+	}
+	scanCode = s_scanQueue[s_scanQueueHead];
+	s_scanQueueHead = NEXT_SCAN(s_scanQueueHead);
+	Enable_Interrupts();
+
+	Process_Scan_Code(scanCode);
+    }
+}
+
+static struct Tasklet s_keyboardTasklet = TASKLET_INITIALIZER(Keyboard_Tasklet, 0);
+
+/*
+ * Handler for keyboard interrupts.
+ * Only reads the scan code; decoding is left to the keyboard tasklet.
+ */
+static void Keyboard_Interrupt_Handler(struct Interrupt_State* state)
+{
+    uchar_t status, scanCode;
+
     Begin_IRQ(state);
 
     status = In_Byte(KB_CMD);
@@ -173,87 +348,76 @@ static void Keyboard_Interrupt_Handler(struct Interrupt_State* state)
 	/* There is a byte available */
 	scanCode = In_Byte(KB_DATA);
 	IO_Delay();
+
+	if (NEXT_SCAN(s_scanQueueTail) != s_scanQueueHead) {
+	    s_scanQueue[s_scanQueueTail] = scanCode;
+	    s_scanQueueTail = NEXT_SCAN(s_scanQueueTail);
+	}
+	Schedule_Tasklet(&s_keyboardTasklet);
+    }
+
+    End_IRQ(state);
+}
+
 /*
- *	Print("code=%x%s\n", scanCode, (scanCode&0x80) ? " [release]" : "");
+ * Read keycodes from the console: wait for the first one,
+ * then take as many more as are queued and fit.
  */
+static int Console_Read(struct File *file, void *buf, ulong_t numBytes)
+{
+    Keycode *keycodes = buf;
+    ulong_t max = numBytes / sizeof(Keycode), n = 0;
 
-	if (scanCode & KB_KEY_RELEASE) {
-	    release = true;
-	    scanCode &= ~(KB_KEY_RELEASE);
-	}
+    if (max == 0)
+	return EINVALID;
 
-	if (scanCode >= SCAN_TABLE_SIZE) {
-	    Print("Unknown scan code: %x\n", scanCode);
-	    goto done;
-	}
+    keycodes[n++] = Wait_For_Key();
+    if (keycodes[0] == KEY_UNKNOWN && Exit_Requested())
+	return EINTR;
+    while (n < max && Read_Key(&keycodes[n]))
+	++n;
 
-	/* Process the key */
-	shift = ((s_shiftState & SHIFT_MASK) != 0);
-	keycode = shift ? s_scanTableWithShift[scanCode] : s_scanTableNoShift[scanCode];
+    return n * sizeof(Keycode);
+}
 
-	/* Update shift, control and alt state */
-	switch (keycode) {
-	case KEY_LSHIFT:
-	    flag = LEFT_SHIFT;
-	    break;
-	case KEY_RSHIFT:
-	    flag = RIGHT_SHIFT;
-	    break;
-	case KEY_LCTRL:
-	    flag = LEFT_CTRL;
-	    break;
-	case KEY_RCTRL:
-	    flag = RIGHT_CTRL;
-	    break;
-	case KEY_LALT:
-	    flag = LEFT_ALT;
-	    break;
-	case KEY_RALT:
-	    flag = RIGHT_ALT;
-	    break;
-	default:
-	    goto noflagchange;
-	}
+static int Console_Write(struct File *file, void *buf, ulong_t numBytes)
+{
+    Put_Buf(buf, numBytes);
+    return numBytes;
+}
 
-	if (release)
-	    s_shiftState &= ~(flag);
-	else
-	    s_shiftState |= flag;
-			
-	/*
-	 * Shift, control and alt keys don't have to be
-	 * queued, flags will be set!
-	 */
-	goto done;
+static int Console_Close(struct File *file)
+{
+    return 0;
+}
 
-noflagchange:
-	/* Format the new keycode */
-	if (shift)
-	    keycode |= KEY_SHIFT_FLAG;
-	if ((s_shiftState & CTRL_MASK) != 0)
-	    keycode |= KEY_CTRL_FLAG;
-	if ((s_shiftState & ALT_MASK) != 0)
-	    keycode |= KEY_ALT_FLAG;
-	if (release)
-	    keycode |= KEY_RELEASE_FLAG;
-		
-	/* Put the keycode in the buffer */
-	Enqueue_Keycode(keycode);
-
-	/* Wake up event consumers */
-	Wake_Up(&s_waitQueue);
-
-	/*
-	 * Pick a new thread upon return from interrupt
-	 * (hopefully the one waiting for the keyboard event)
-	 */
-	g_needReschedule = true;
-    }
+/*
+ * The console is ready for reading when a keycode is queued,
+ * and always ready for writing.
+ */
+static int Console_Poll(struct File *file, struct Poll_Table *table)
+{
+    int mask = POLL_OUT;
 
-done:
-    End_IRQ(state);
+    KASSERT(!Interrupts_Enabled());
+
+    Poll_Wait(table, &s_pollList);
+    if (!Is_Queue_Empty())
+	mask |= POLL_IN;
+    return mask;
 }
 
+static struct File_Ops s_consoleFileOps = {
+    0,			/* FStat() */
+    &Console_Read,
+    &Console_Write,
+    0,			/* Seek() */
+    &Console_Close,
+    0,			/* Read_Entry() */
+    0, 0, 0,		/* Map_Page(), Unmap_Page(), Dirty_Page() */
+    &Console_Poll,
+};
+
 /* ----------------------------------------------------------------------
  * Public functions
  * ---------------------------------------------------------------------- */
@@ -267,8 +431,9 @@ void Init_Keyboard(void)
     /* Start out with no shift keys enabled. */
     s_shiftState = 0;
 
-    /* Buffer is initially empty. */
+    /* Buffers are initially empty. */
     s_queueHead = s_queueTail = 0;
+    s_scanQueueHead = s_scanQueueTail = 0;
 
     /* Install interrupt handler */
     Install_IRQ(KB_IRQ, Keyboard_Interrupt_Handler);
@@ -318,8 +483,8 @@ Keycode Wait_For_Key(void)
 	gotKey = !Is_Queue_Empty();
 	if (gotKey)
 	    keycode = Dequeue_Keycode();
-	else
-	    Wait(&s_waitQueue);
+	else if (!Wait_Interruptible(&s_waitQueue))
+	    break;	/* process exiting */
     }
     while (!gotKey);
 
@@ -327,3 +492,19 @@ Keycode Wait_For_Key(void)
 
     return keycode;
 }
+
+/*
+ * Open the console as a File.  Reading it returns Keycodes, as
+ * Wait_For_Key() does, and writing it prints to the screen; it
+ * can be polled along with pipes.
+ * Returns 0 if successful, error code (< 0) if not.
+ */
+int Open_Console(struct File **pFile)
+{
+    struct File *file = Allocate_File(&s_consoleFileOps, 0, 0, 0, O_READ | O_WRITE, 0);
+
+    if (file == 0)
+	return ENOMEM;
+    *pFile = file;
+    return 0;
+}
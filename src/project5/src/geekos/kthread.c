@@ -8,6 +8,7 @@
  */
 
 #include <geekos/kassert.h>
+#include <geekos/errno.h>
 #include <geekos/defs.h>
 #include <geekos/screen.h>
 #include <geekos/int.h>
@@ -18,6 +19,9 @@
 #include <geekos/malloc.h>
 #include <geekos/user.h>
 #include <geekos/synch.h>
+#include <geekos/workqueue.h>
+#include <geekos/trace.h>
+#include <geekos/timer.h>
 
 /* ----------------------------------------------------------------------
  * Private data
@@ -33,6 +37,22 @@ static struct All_Thread_List s_allThreadList;
  */
 static struct Thread_Queue s_runQueue[MAX_QUEUE_LEVEL];
 
+/*
+ * Runnable threads under SCHEDULING_STRIDE, as a binary min-heap
+ * ordered by pass.  The idle thread stays on the last run queue.
+ * The array always has room for every thread in the system, so
+ * Make_Runnable() never needs to allocate.
+ */
+static struct Kernel_Thread **s_strideHeap;
+static int s_strideHeapSize, s_strideHeapCapacity;
+static int s_numThreads;
+
+/*
+ * Pass of the thread most recently picked; threads that have been
+ * sleeping start from here, so they can't save up CPU time.
+ */
+static ulong_t s_globalPass;
+
 /*
  * Current thread.
  */
@@ -46,11 +66,16 @@ struct Kernel_Thread* g_currentThread;
 int g_needReschedule;
 
 /*
- * Boolean flag indicating that preemption is disabled.
- * When set, external interrupts (such as the timer tick)
+ * Nesting count of Disable_Preemption() calls.
+ * While non-zero, external interrupts (such as the timer tick)
  * will not cause a new thread to be selected.
  */
-volatile int g_preemptionDisabled;
+volatile int g_preemptCount;
+
+/*
+ * Time stamp at which preemption was last disabled.
+ */
+static ulong_t s_preemptOffTime;
 
 /*
  * Queue of finished threads needing disposal,
@@ -74,6 +99,105 @@ volatile int g_schedulingPolicy = DEFAULT_SCHEDULING_POLICY;
  * Private functions
  * ---------------------------------------------------------------------- */
 
+/*
+ * Make sure the stride heap can hold given number of threads.
+ * Returns false if there isn't enough memory.
+ */
+static bool Reserve_Stride_Heap(int numThreads)
+{
+    struct Kernel_Thread **heap, **old;
+    int capacity;
+    bool iflag;
+
+    if (numThreads <= s_strideHeapCapacity)
+        return true;
+
+    capacity = s_strideHeapCapacity == 0 ? 32 : s_strideHeapCapacity * 2;
+    heap = Malloc(capacity * sizeof(struct Kernel_Thread*));
+    if (heap == 0)
+        return false;
+
+    iflag = Begin_Int_Atomic();
+    old = s_strideHeap;
+    if (s_strideHeapSize > 0)
+        memcpy(heap, old, s_strideHeapSize * sizeof(struct Kernel_Thread*));
+    s_strideHeap = heap;
+    s_strideHeapCapacity = capacity;
+    End_Int_Atomic(iflag);
+
+    if (old != 0)
+        Free(old);
+    return true;
+}
+
+/*
+ * Passes wrap around, but runnable threads are never far apart,
+ * so compare them by their difference.
+ */
+static __inline__ bool Pass_Before(ulong_t a, ulong_t b)
+{
+    return (long) (a - b) < 0;
+}
+
+/*
+ * Add given thread to the stride heap.
+ * Must be called with interrupts disabled!
+ */
+static void Stride_Heap_Insert(struct Kernel_Thread* kthread)
+{
+    int i = s_strideHeapSize++;
+
+    KASSERT(!Interrupts_Enabled());
+    KASSERT(s_strideHeapSize <= s_strideHeapCapacity);
+
+    /* Sift up */
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!Pass_Before(kthread->pass, s_strideHeap[parent]->pass))
+            break;
+        s_strideHeap[i] = s_strideHeap[parent];
+        i = parent;
+    }
+    s_strideHeap[i] = kthread;
+}
+
+/*
+ * Remove and return the thread with the smallest pass,
+ * or null if the heap is empty.
+ * Must be called with interrupts disabled!
+ */
+static struct Kernel_Thread* Stride_Heap_Remove_Min(void)
+{
+    struct Kernel_Thread *min, *last;
+    int i = 0;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (s_strideHeapSize == 0)
+        return 0;
+
+    min = s_strideHeap[0];
+    last = s_strideHeap[--s_strideHeapSize];
+
+    /* Sift the last thread down from the root */
+    while (true) {
+        int child = 2 * i + 1;
+        if (child >= s_strideHeapSize)
+            break;
+        if (child + 1 < s_strideHeapSize &&
+            Pass_Before(s_strideHeap[child + 1]->pass, s_strideHeap[child]->pass))
+            ++child;
+        if (!Pass_Before(s_strideHeap[child]->pass, last->pass))
+            break;
+        s_strideHeap[i] = s_strideHeap[child];
+        i = child;
+    }
+    if (s_strideHeapSize > 0)
+        s_strideHeap[i] = last;
+
+    return min;
+}
+
 /*
  * Initialize a new Kernel_Thread.
  */
@@ -106,6 +230,10 @@ static void Init_Thread(struct Kernel_Thread* kthread, void* stackPage,
     kthread->currentReadyQueue = 0;
     kthread->blocked = false;
 
+    /* Children get their parent's share */
+    Set_Thread_Weight(kthread, g_currentThread != 0 && g_currentThread->weight != 0
+        ? g_currentThread->weight : DEFAULT_WEIGHT);
+
     kthread->registeredSemaphores = 0;
     for (int i = 0; i < MAX_SEMAPHORES_REFS; ++i) {
         *((int*) (kthread->semaphores + i)) = REF_TO_NO_SEMAPHORE;
@@ -120,6 +248,7 @@ static struct Kernel_Thread* Create_Thread(int priority, bool detached)
 {
     struct Kernel_Thread* kthread;
     void* stackPage = 0;
+    bool iflag;
 
     /*
      * For now, just allocate one page each for the thread context
@@ -132,7 +261,9 @@ static struct Kernel_Thread* Create_Thread(int priority, bool detached)
     /* Make sure that the memory allocations succeeded. */
     if (kthread == 0)
         return 0;
-    if (stackPage == 0) {
+    if (stackPage == 0 || !Reserve_Stride_Heap(s_numThreads + 1)) {
+        if (stackPage != 0)
+            Free_Page(stackPage);
         Free_Page(kthread);
         return 0;
     }
@@ -146,7 +277,10 @@ static struct Kernel_Thread* Create_Thread(int priority, bool detached)
     Init_Thread(kthread, stackPage, priority, detached);
 
     /* Add to the list of all threads in the system. */
+    iflag = Begin_Int_Atomic();
     Add_To_Back_Of_All_Thread_List(&s_allThreadList, kthread);
+    ++s_numThreads;
+    End_Int_Atomic(iflag);
 
     return kthread;
 }
@@ -178,6 +312,7 @@ static void Destroy_Thread(struct Kernel_Thread* kthread)
 
     /* Remove from list of all threads */
     Remove_From_All_Thread_List(&s_allThreadList, kthread);
+    --s_numThreads;
 
     Enable_Interrupts();
 
@@ -308,10 +443,12 @@ static void Setup_Kernel_Thread(
 }
 
 /*
- * Set up the a user mode thread.
+ * Set up the a user mode thread, starting at given entry point
+ * with given user stack pointer.  The esi register gets given value.
  */
 /*static*/ void Setup_User_Thread(
-    struct Kernel_Thread* kthread, struct User_Context* userContext)
+    struct Kernel_Thread* kthread, struct User_Context* userContext,
+    ulong_t entryAddr, ulong_t stackPointerAddr, ulong_t esi)
 {
     /*
      * Hints:
@@ -330,10 +467,10 @@ static void Setup_Kernel_Thread(
     Attach_User_Context(kthread, userContext);
 
     Push(kthread, userContext->dsSelector);
-    Push(kthread, userContext->stackPointerAddr);
+    Push(kthread, stackPointerAddr);
     Push(kthread, EFLAGS_IF);
     Push(kthread, userContext->csSelector);
-    Push(kthread, userContext->entryAddr);
+    Push(kthread, entryAddr);
 
     Push(kthread, 0);
     Push(kthread, 0);
@@ -342,7 +479,7 @@ static void Setup_Kernel_Thread(
     Push(kthread, 0);
     Push(kthread, 0);
     Push(kthread, 0);
-    Push(kthread, userContext->argBlockAddr);
+    Push(kthread, esi);
     Push(kthread, 0);
     Push(kthread, 0);
 
@@ -367,6 +504,9 @@ static void Idle(ulong_t arg)
 /*
  * The reaper thread.  Its job is to de-allocate memory
  * used by threads which have finished.
+ * Tearing down a process can write back its mapped files, so this
+ * stays out of the worker pool: it may wait on block requests
+ * that the workers carry out.
  */
 static void Reaper(ulong_t arg)
 {
@@ -375,39 +515,28 @@ static void Reaper(ulong_t arg)
     Disable_Interrupts();
 
     while (true) {
-	/* See if there are any threads needing disposal. */
-        if ((kthread = s_graveyardQueue.head) == 0) {
-            /* Graveyard is empty, so wait for a thread to die. */
-            Wait(&s_reaperWaitQueue);
-        }
-        else {
-            /* Make the graveyard queue empty. */
-            Clear_Thread_Queue(&s_graveyardQueue);
-
-            /*
-            * Now we can re-enable interrupts, since we
-            * have removed all the threads needing disposal.
-            */
-            Enable_Interrupts();
-            Yield();   /* allow other threads to run? */
-
-            /* Dispose of the dead threads. */
-            while (kthread != 0) {
-            struct Kernel_Thread* next = Get_Next_In_Thread_Queue(kthread);
+	/* Graveyard is empty, so wait for a thread to die. */
+	if ((kthread = s_graveyardQueue.head) == 0) {
+	    Wait(&s_reaperWaitQueue);
+	    continue;
+	}
+
+	/* Make the graveyard queue empty. */
+	Clear_Thread_Queue(&s_graveyardQueue);
+	Enable_Interrupts();
+
+	/* Dispose of the dead threads. */
+	while (kthread != 0) {
+	    struct Kernel_Thread* next = Get_Next_In_Thread_Queue(kthread);
 #if 0
-            Print("Reaper: disposing of thread @ %x, stack @ %x\n",
-                kthread, kthread->stackPage);
+	    Print("Reaper: disposing of thread @ %x, stack @ %x\n",
+		kthread, kthread->stackPage);
 #endif
-            Destroy_Thread(kthread);
-            kthread = next;
-            }
+	    Destroy_Thread(kthread);
+	    kthread = next;
+	}
 
-            /*
-            * Disable interrupts again, since we're going to
-            * do another iteration.
-            */
-            Disable_Interrupts();
-        }
+	Disable_Interrupts();
     }
 }
 
@@ -488,6 +617,7 @@ void Init_Scheduler(void)
     Init_Thread(mainThread, (void *) KERN_STACK, PRIORITY_NORMAL, true);
     g_currentThread = mainThread;
     Add_To_Back_Of_All_Thread_List(&s_allThreadList, mainThread);
+    ++s_numThreads;
 
     /*
      * Create the idle thread.
@@ -498,8 +628,12 @@ void Init_Scheduler(void)
     /*
      * Create the reaper thread.
      */
-    /*Print("starting reaper thread\n");*/
     Start_Kernel_Thread(Reaper, 0, PRIORITY_NORMAL, true);
+
+    /*
+     * Create the worker threads.
+     */
+    Init_Work_Queue();
 }
 
 /*
@@ -560,7 +694,32 @@ Start_User_Thread(struct User_Context* userContext, bool detached)
     if (!(kthread = Create_Thread(PRIORITY_USER, detached))) {
         return NULL;
     }
-    Setup_User_Thread(kthread, userContext);
+    Setup_User_Thread(kthread, userContext, userContext->entryAddr,
+        userContext->stackPointerAddr, userContext->argBlockAddr);
+    Make_Runnable_Atomic(kthread);
+
+    return kthread;
+}
+
+/*
+ * Start another thread in an existing user context, so that it
+ * shares the address space and open files of the threads already
+ * running there.  The thread begins at given entry point with
+ * given user stack pointer (both user addresses).
+ * Returns pointer to the new thread if successful, null otherwise.
+ */
+struct Kernel_Thread*
+Start_User_Thread_At(struct User_Context* userContext,
+    ulong_t entryAddr, ulong_t stackPointerAddr, bool detached)
+{
+    struct Kernel_Thread *kthread;
+
+    KASSERT(userContext != 0);
+
+    if (!(kthread = Create_Thread(PRIORITY_USER, detached))) {
+        return NULL;
+    }
+    Setup_User_Thread(kthread, userContext, entryAddr, stackPointerAddr, 0);
     Make_Runnable_Atomic(kthread);
 
     return kthread;
@@ -574,6 +733,15 @@ void Make_Runnable(struct Kernel_Thread* kthread)
 {
     KASSERT(!Interrupts_Enabled());
 
+    if (g_schedulingPolicy == SCHEDULING_STRIDE && kthread->priority != PRIORITY_IDLE) {
+        /* A thread that slept catches up with everybody else */
+        if (Pass_Before(kthread->pass, s_globalPass))
+            kthread->pass = s_globalPass;
+        kthread->blocked = false;
+        Stride_Heap_Insert(kthread);
+        return;
+    }
+
     {
         int currentQ = kthread->currentReadyQueue;
         KASSERT(currentQ >= 0 && currentQ < MAX_QUEUE_LEVEL);
@@ -609,6 +777,18 @@ struct Kernel_Thread* Get_Next_Runnable(void)
 {
     struct Kernel_Thread* best = 0;
 
+    Trace_Thread_Switch();
+
+    /* Under stride scheduling, the thread with the least pass goes next */
+    if (g_schedulingPolicy == SCHEDULING_STRIDE) {
+        best = Stride_Heap_Remove_Min();
+        if (best != 0) {
+            s_globalPass = best->pass;
+            return best;
+        }
+        /* Nothing but the idle thread */
+    }
+
     /* Find the best thread from the highest-priority run queue */
     // TODO("Find a runnable thread from run queues");
 
@@ -680,6 +860,94 @@ void Move_Threads_To_0_Except_Idle(void) {
     }
 }
 
+/*
+ * Switch to given scheduling policy, moving the runnable threads
+ * between the run queues and the stride heap as needed.
+ * Must be called with interrupts disabled!
+ */
+void Change_Scheduling_Policy(int policy)
+{
+    struct Kernel_Thread *kthread;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (policy == g_schedulingPolicy)
+        return;
+
+    while ((kthread = Stride_Heap_Remove_Min()) != 0)
+        Enqueue_Thread(&s_runQueue[0], kthread);
+    Move_Threads_To_0_Except_Idle();
+
+    g_schedulingPolicy = policy;
+
+    if (policy == SCHEDULING_STRIDE) {
+        /* Everybody starts even */
+        while ((kthread = Get_Front_Of_Thread_Queue(&s_runQueue[0])) != 0) {
+            Remove_From_Thread_Queue(&s_runQueue[0], kthread);
+            kthread->pass = s_globalPass;
+            Stride_Heap_Insert(kthread);
+        }
+        g_currentThread->pass = s_globalPass;
+    }
+}
+
+/*
+ * Set the share of the CPU given thread gets under stride scheduling,
+ * relative to the weights of the other runnable threads.  For a thread
+ * of a user process, this sets the weight of the whole process.
+ * Returns 0 if successful, error code (< 0) if the weight is out of range.
+ */
+int Set_Thread_Weight(struct Kernel_Thread* kthread, int weight)
+{
+    struct User_Context* userContext = kthread->userContext;
+    bool iflag;
+
+    if (weight < MIN_WEIGHT || weight > MAX_WEIGHT)
+        return EINVALID;
+
+    /* The heap is ordered by pass, so it doesn't mind */
+    if (userContext == 0) {
+        kthread->weight = weight;
+        kthread->stride = STRIDE_ONE / weight;
+        return 0;
+    }
+
+    iflag = Begin_Int_Atomic();
+    userContext->weight = weight;
+    Update_Process_Strides(userContext);
+    End_Int_Atomic(iflag);
+    return 0;
+}
+
+/*
+ * Share the weight of a process out among its threads: each runs
+ * with a stride as many times longer as there are threads, so that
+ * together they get what one thread of that weight would.
+ * Called when the weight or the number of threads changes.
+ * Must be called with interrupts disabled!
+ */
+void Update_Process_Strides(struct User_Context* userContext)
+{
+    struct Kernel_Thread* kthread;
+    int numThreads = 0;
+
+    KASSERT(!Interrupts_Enabled());
+
+    for (kthread = Get_Front_Of_All_Thread_List(&s_allThreadList); kthread != 0;
+         kthread = Get_Next_In_All_Thread_List(kthread)) {
+        if (kthread->userContext == userContext)
+            ++numThreads;
+    }
+
+    for (kthread = Get_Front_Of_All_Thread_List(&s_allThreadList); kthread != 0;
+         kthread = Get_Next_In_All_Thread_List(kthread)) {
+        if (kthread->userContext == userContext) {
+            kthread->weight = userContext->weight;
+            kthread->stride = STRIDE_ONE / userContext->weight * numThreads;
+        }
+    }
+}
+
 /*
  * Schedule a thread that is waiting to run.
  * Must be called with interrupts off!
@@ -696,7 +964,7 @@ void Schedule(void)
     KASSERT(!Interrupts_Enabled());
 
     /* Preemption should not be disabled. */
-    KASSERT(!g_preemptionDisabled);
+    KASSERT(g_preemptCount == 0);
 
     /* Get next thread to run from the run queue */
     runnable = Get_Next_Runnable();
@@ -710,6 +978,41 @@ void Schedule(void)
     Switch_To_Thread(runnable);
 }
 
+/*
+ * Keep the current thread running until the matching
+ * Enable_Preemption(), while still taking interrupts.
+ * Use this instead of disabling interrupts to protect
+ * data that interrupt handlers and tasklets do not touch.
+ * Calls nest.
+ */
+void Disable_Preemption(void)
+{
+    if (g_preemptCount++ == 0)
+        s_preemptOffTime = Read_TSC();
+}
+
+/*
+ * Undo a Disable_Preemption().  If this makes the current
+ * thread preemptible and a reschedule was requested meanwhile,
+ * yield to the chosen thread now rather than at the next interrupt.
+ */
+void Enable_Preemption(void)
+{
+    KASSERT(g_preemptCount > 0);
+
+    if (--g_preemptCount == 0) {
+        ulong_t span = Read_TSC() - s_preemptOffTime;
+
+        /* Only log new worst cases, most sections are short. */
+        if (span > g_traceMax[TRACE_PREEMPT_OFF])
+            Trace(TRACE_PREEMPT_OFF, span);
+        if (g_needReschedule && Interrupts_Enabled()) {
+            g_needReschedule = false;
+            Yield();
+        }
+    }
+}
+
 /*
  * Voluntarily give up the CPU to another thread.
  * Does nothing if no other threads are ready to run.
@@ -776,12 +1079,14 @@ void Exit(int exitCode)
 
     /* Shouldn't get here */
     KASSERT(false);
+    STOP();
 }
 
 /*
  * Wait for given thread to die.
  * Interrupts must be enabled.
- * Returns the thread exit code.
+ * Returns the thread exit code, or EINTR if the caller's
+ * process exits meanwhile.
  */
 int Join(struct Kernel_Thread* kthread)
 {
@@ -794,9 +1099,15 @@ int Join(struct Kernel_Thread* kthread)
 
     Disable_Interrupts();
 
-    /* Wait for it to die */
+    /* Wait for it to die, unless our own process is exiting */
     while (kthread->alive) {
-        Wait(&kthread->joinQueue);
+        if (!Wait_Interruptible(&kthread->joinQueue)) {
+            /* We won't be back for it */
+            kthread->owner = 0;
+            Detach_Thread(kthread);
+            Enable_Interrupts();
+            return EINTR;
+        }
     }
 
     /* Get thread exit code. */
@@ -810,6 +1121,44 @@ int Join(struct Kernel_Thread* kthread)
     return exitCode;
 }
 
+/*
+ * Like Join(), but give up after given number of timer ticks
+ * (negative waits forever).  If the thread exited, stores its exit
+ * code in *pExitCode, releases our reference and returns true.
+ * Returns false on timeout; the thread can still be joined later.
+ */
+bool Join_Timeout(struct Kernel_Thread* kthread, int ticks, int *pExitCode)
+{
+    ulong_t deadline = g_numTicks + ticks;
+
+    KASSERT(Interrupts_Enabled());
+
+    /* It is only legal for the owner to join */
+    KASSERT(kthread->owner == g_currentThread);
+
+    Disable_Interrupts();
+
+    while (kthread->alive && !Exit_Requested()) {
+        int remaining = (int) (deadline - g_numTicks);
+
+        if (ticks >= 0 && remaining <= 0)
+            break;
+        Wait_Timeout(&kthread->joinQueue, ticks < 0 ? -1 : remaining);
+    }
+
+    if (kthread->alive) {
+        Enable_Interrupts();
+        return false;
+    }
+
+    *pExitCode = kthread->exitCode;
+    Detach_Thread(kthread);
+
+    Enable_Interrupts();
+
+    return true;
+}
+
 /*
  * Look up a thread by its process id.
  * The caller must be the thread's owner.
@@ -841,6 +1190,83 @@ struct Kernel_Thread* Lookup_Thread(int pid)
     return result;
 }
 
+/*
+ * Wait for a thread started by Sys_CreateThread in the current
+ * process to exit, and return its exit code.  Any thread of the
+ * process may join it, but only once.
+ * Must be called with interrupts disabled!
+ * Returns EINVALID if there is no such thread, or EINTR if the
+ * process exits meanwhile.
+ */
+int Join_User_Thread(int tid)
+{
+    struct User_Context *userContext = g_currentThread->userContext;
+    struct Kernel_Thread *kthread;
+    int exitCode;
+
+    KASSERT(!Interrupts_Enabled());
+
+    for (kthread = Get_Front_Of_All_Thread_List(&s_allThreadList); kthread != 0;
+         kthread = Get_Next_In_All_Thread_List(kthread)) {
+        if (kthread->pid == tid)
+            break;
+    }
+    if (kthread == 0 || kthread == g_currentThread || userContext == 0 ||
+        kthread->joinContext != userContext)
+        return EINVALID;
+
+    /* Claim it, so no other thread joins it too */
+    kthread->joinContext = 0;
+
+    while (kthread->alive) {
+        if (!Wait_Interruptible(&kthread->joinQueue)) {
+            /* Leave it for Reap_Unjoined_Threads() */
+            kthread->joinContext = userContext;
+            return EINTR;
+        }
+    }
+
+    exitCode = kthread->exitCode;
+    Detach_Thread(kthread);
+    return exitCode;
+}
+
+/*
+ * Release the process's reference on threads of given user context
+ * that nobody joined.  Called when the last thread of the process
+ * lets go of the context, so all of them have exited.
+ */
+void Reap_Unjoined_Threads(struct User_Context* userContext)
+{
+    struct Kernel_Thread *kthread, *next;
+    bool iflag = Begin_Int_Atomic();
+
+    for (kthread = Get_Front_Of_All_Thread_List(&s_allThreadList); kthread != 0; kthread = next) {
+        next = Get_Next_In_All_Thread_List(kthread);
+        if (kthread->joinContext == userContext) {
+            KASSERT(!kthread->alive);
+            kthread->joinContext = 0;
+            Detach_Thread(kthread);
+        }
+    }
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Walk the list of all threads: get the thread after given one,
+ * or the first thread if kthread is null.
+ * Interrupts must be disabled for the whole walk.
+ */
+struct Kernel_Thread* Get_Next_Thread(struct Kernel_Thread* kthread)
+{
+    KASSERT(!Interrupts_Enabled());
+
+    if (kthread == 0)
+        return Get_Front_Of_All_Thread_List(&s_allThreadList);
+    return Get_Next_In_All_Thread_List(kthread);
+}
+
 
 /*
  * Wait on given wait queue.
@@ -866,6 +1292,123 @@ void Wait(struct Thread_Queue* waitQueue)
     Schedule();
 }
 
+/*
+ * Timer callback for Wait_Timeout(): if the thread that started
+ * the timer is still in its wait queue, take it out and run it.
+ * If it was woken up in the meantime, it cancels the timer itself.
+ * Either way the timer event is no longer pending.
+ */
+static void Wait_Timer_Expired(int id)
+{
+    struct Kernel_Thread* kthread;
+
+    Disable_Interrupts();
+    for (kthread = Get_Front_Of_All_Thread_List(&s_allThreadList); kthread != 0;
+         kthread = Get_Next_In_All_Thread_List(kthread)) {
+        if (kthread->timedWaitQueue != 0 && kthread->waitTimerId == id) {
+            if (Is_Member_Of_Thread_Queue(kthread->timedWaitQueue, kthread)) {
+                Remove_Thread(kthread->timedWaitQueue, kthread);
+                kthread->waitTimedOut = true;
+                Make_Runnable(kthread);
+            }
+            break;
+        }
+    }
+    Enable_Interrupts();
+}
+
+/*
+ * Like Wait(), but give up after given number of timer ticks.
+ * A negative number of ticks waits forever.
+ * Must be called with interrupts disabled!
+ * Returns true if woken up, false if the time ran out.
+ */
+bool Wait_Timeout(struct Thread_Queue* waitQueue, int ticks)
+{
+    struct Kernel_Thread* current = g_currentThread;
+    bool timedOut;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (ticks < 0) {
+        Wait(waitQueue);
+        return true;
+    }
+    if (ticks == 0)
+        return false;
+
+    /* The thread's own timer event, so there is always one to wait with */
+    current->waitTimerId = Start_Timer_Event(&current->waitTimer, ticks, Wait_Timer_Expired);
+    current->timedWaitQueue = waitQueue;
+    current->waitTimedOut = false;
+
+    Wait(waitQueue);
+
+    timedOut = current->waitTimedOut;
+    if (!timedOut)
+        Cancel_Timer_Event(&current->waitTimer);
+    current->timedWaitQueue = 0;
+    return !timedOut;
+}
+
+/*
+ * Like Wait(), for a thread of a user process which may wait
+ * indefinitely: the wait also ends when another thread of the
+ * process calls Exit().  Callers must give up when it returns false.
+ * Must be called with interrupts disabled!
+ * Returns false (without waiting) if the process is exiting.
+ */
+bool Wait_Interruptible(struct Thread_Queue* waitQueue)
+{
+    struct Kernel_Thread* current = g_currentThread;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (Exit_Requested())
+        return false;
+    current->interruptibleQueue = waitQueue;
+    Wait(waitQueue);
+    current->interruptibleQueue = 0;
+    return !Exit_Requested();
+}
+
+/*
+ * Is the current thread's process exiting?  If so, the thread
+ * should stop waiting and return to user mode, where it exits.
+ */
+bool Exit_Requested(void)
+{
+    struct User_Context* userContext = g_currentThread->userContext;
+
+    return userContext != 0 && userContext->exiting;
+}
+
+/*
+ * Wake the threads of an exiting process that are sleeping in
+ * Wait_Interruptible() or Wait_Timeout(), so they notice.
+ * Must be called with interrupts disabled!
+ */
+void Interrupt_Process_Threads(struct User_Context* userContext)
+{
+    struct Kernel_Thread* kthread;
+
+    KASSERT(!Interrupts_Enabled());
+
+    for (kthread = Get_Front_Of_All_Thread_List(&s_allThreadList); kthread != 0;
+         kthread = Get_Next_In_All_Thread_List(kthread)) {
+        struct Thread_Queue* waitQueue = kthread->interruptibleQueue;
+
+        if (kthread->userContext != userContext || kthread == g_currentThread)
+            continue;
+        if (waitQueue == 0)
+            waitQueue = kthread->timedWaitQueue;
+        if (waitQueue != 0 && Is_Member_Of_Thread_Queue(waitQueue, kthread)) {
+            Remove_Thread(waitQueue, kthread);
+            Make_Runnable(kthread);
+        }
+    }
+}
+
 /*
  * Wake up all threads waiting on given wait queue.
  * Must be called with interrupts disabled!
@@ -874,22 +1417,15 @@ void Wait(struct Thread_Queue* waitQueue)
  */
 void Wake_Up(struct Thread_Queue* waitQueue)
 {
-    struct Kernel_Thread *kthread = waitQueue->head, *next;
-
     KASSERT(!Interrupts_Enabled());
 
     /*
-     * Walk throught the list of threads in the wait queue,
-     * transferring each one to the run queue.
+     * Transfer each thread in the wait queue to the run queue.
+     * A thread must leave the wait queue before it can join
+     * another queue.
      */
-    while (kthread != 0) {
-        next = Get_Next_In_Thread_Queue(kthread);
-        Make_Runnable(kthread);
-        kthread = next;
-    }
-
-    /* The wait queue is now empty. */
-    Clear_Thread_Queue(waitQueue);
+    while (!Is_Thread_Queue_Empty(waitQueue))
+        Make_Runnable(Remove_From_Front_Of_Thread_Queue(waitQueue));
 }
 
 /*
@@ -111,8 +111,8 @@ IMPORT g_currentThread
 ; in the interrupt return code.
 IMPORT g_needReschedule
 
-; Set to non-zero when preemption is disabled.
-IMPORT g_preemptionDisabled
+; Non-zero while preemption is disabled (nesting count).
+IMPORT g_preemptCount
 
 ; This is the function that returns the next runnable thread.
 IMPORT Get_Next_Runnable
@@ -123,6 +123,9 @@ IMPORT Make_Runnable
 ; Function to activate a new user context (if needed).
 IMPORT Switch_To_User_Context
 
+; Function to run deferred interrupt work (tasklets).
+IMPORT Run_Softirqs
+
 ; Sizes of interrupt handler entry points for interrupts with
 ; and without error codes.  The code in idt.c uses this
 ; information to infer the layout of the table of interrupt
@@ -264,9 +267,14 @@ Handle_Interrupt:
 	call	ebx
 	add	esp, 4			; clear 1 argument
 
+	; Run tasklets scheduled by the handler, with interrupts enabled.
+	push	esp
+	call	Run_Softirqs
+	add	esp, 4			; clear 1 argument
+
 	; If preemption is disabled, then the current thread
 	; keeps running.
-	cmp	[g_preemptionDisabled], dword 0
+	cmp	[g_preemptCount], dword 0
 	jne	.restore
 
 	; See if we need to choose a new thread to run.
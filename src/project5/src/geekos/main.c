@@ -22,12 +22,16 @@
 #include <geekos/keyboard.h>
 #include <geekos/dma.h>
 #include <geekos/ide.h>
+#include <geekos/ramdisk.h>
 #include <geekos/floppy.h>
 #include <geekos/pfat.h>
 #include <geekos/vfs.h>
 #include <geekos/user.h>
 #include <geekos/paging.h>
 #include <geekos/gosfs.h>
+#include <geekos/tmpfs.h>
+#include <geekos/thrash.h>
+#include <geekos/trace.h>
 
 
 /*
@@ -49,6 +53,7 @@
 
 
 
+static void Print_Boot_Time(struct Boot_Info *bootInfo, ulong_t mainTSC);
 static void Mount_Root_Filesystem(void);
 static void Spawn_Init_Process(void);
 
@@ -59,6 +64,8 @@ static void Spawn_Init_Process(void);
  */
 void Main(struct Boot_Info* bootInfo)
 {
+    ulong_t mainTSC = Read_TSC();
+
     Init_BSS();
     Init_Screen();
     Init_Mem(bootInfo);
@@ -70,12 +77,16 @@ void Main(struct Boot_Info* bootInfo)
     Init_Scheduler();
     Init_Traps();
     Init_Timer();
+    Print_Boot_Time(bootInfo, mainTSC);
+    Init_Kernel_Log();
     Init_Keyboard();
     Init_DMA();
     Init_Floppy();
     Init_IDE();
+    Init_Ram_Disk();
     Init_PFAT();
     Init_GOSFS();
+    Init_TMPFS();
 
     Mount_Root_Filesystem();
 
@@ -109,6 +120,23 @@ void Say_Hello(void) {
     }
 }
 
+/*
+ * Report how long booting took, up to entering Main() at TSC value
+ * mainTSC.  The BIOS clock stops when setup disables interrupts, so
+ * the last stretch is timed with the TSC, which can only be turned
+ * into milliseconds once Init_Timer() has measured it.
+ */
+static void Print_Boot_Time(struct Boot_Info *bootInfo, ulong_t mainTSC)
+{
+    ulong_t cyclesPerMs = g_tscPerTick / 55;	/* a tick is 54.9 ms */
+    int bootMs = BIOS_TICKS_TO_MS(bootInfo->bootTicks);
+
+    if (cyclesPerMs > 0)
+	bootMs += (mainTSC - bootInfo->setupTSC) / cyclesPerMs;
+    Print("Boot: kernel loaded in %d ms, Main reached %d ms after boot sector\n",
+	BIOS_TICKS_TO_MS(bootInfo->loadTicks), bootMs);
+}
+
 static void Mount_Root_Filesystem(void)
 {
     Print("Mounting /" ROOT_PREFIX " filesystem...\n");
@@ -118,6 +146,14 @@ static void Mount_Root_Filesystem(void)
 	Print("Mounted /" ROOT_PREFIX " filesystem!\n");
 
     Init_Paging();
+    Init_Thrash_Control();
+
+    /* Fill ram0 from the boot disk, if there's an image for it */
+    Preload_Ram_Disk("/" ROOT_PREFIX "/ramdisk.img");
+
+    /* Scratch space in memory */
+    if (Mount("none", "t", "tmpfs") != 0)
+	Print("Failed to mount /t tmpfs\n");
 }
 
 
@@ -11,6 +11,7 @@
 #include <geekos/int.h>
 #include <geekos/bget.h>
 #include <geekos/kassert.h>
+#include <geekos/kthread.h>
 #include <geekos/malloc.h>
 
 /*
@@ -27,17 +28,18 @@ void Init_Heap(ulong_t start, ulong_t size)
  * Dynamically allocate a buffer of given size.
  * Returns null if there is not enough memory to satisfy the
  * allocation.
+ * The heap is only protected against other threads, not against
+ * interrupt handlers or tasklets, which must not call Malloc() or Free().
  */
 void* Malloc(ulong_t size)
 {
     void *result;
-    bool iflag;
 
     KASSERT(size > 0);
 
-    iflag = Begin_Int_Atomic();
+    Disable_Preemption();
     result = bget(size);
-    End_Int_Atomic(iflag);
+    Enable_Preemption();
 
     return result;
 }
@@ -47,9 +49,7 @@ void* Malloc(ulong_t size)
  */
 void Free(void* buf)
 {
-    bool iflag;
-
-    iflag = Begin_Int_Atomic();
+    Disable_Preemption();
     brel(buf);
-    End_Int_Atomic(iflag);
+    Enable_Preemption();
 }
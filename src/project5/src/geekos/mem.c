@@ -15,10 +15,14 @@
 #include <geekos/gdt.h>
 #include <geekos/screen.h>
 #include <geekos/int.h>
+#include <geekos/kthread.h>
 #include <geekos/malloc.h>
 #include <geekos/string.h>
 #include <geekos/paging.h>
 #include <geekos/mem.h>
+#include <geekos/bufcache.h>
+#include <geekos/swapcache.h>
+#include <geekos/user.h>
 
 /* ----------------------------------------------------------------------
  * Global data
@@ -34,6 +38,12 @@ struct Page* g_pageList;
  */
 uint_t g_freePageCount = 0;
 
+/*
+ * Number of entries in g_pageList: one per page of the
+ * physical address space, up to the end of the last RAM region.
+ */
+uint_t g_numPages;
+
 /* ----------------------------------------------------------------------
  * Private data and functions
  * ---------------------------------------------------------------------- */
@@ -50,12 +60,45 @@ extern int debugFaults;
 static struct Page_List s_freeList;
 
 /*
- * Total number of physical pages.
+ * Hand of the CLOCK page replacement algorithm (index into g_pageList).
+ * Buffer cache pages and pageable user pages share one clock,
+ * so a single policy decides what to reclaim.
+ */
+static uint_t s_clockHand;
+
+/*
+ * Most pages the clock looks at in one go.  A search for a page
+ * to reclaim may go round the clock twice; it lets interrupts
+ * or other threads in after every batch.
  */
-int unsigned s_numPages;
+#define CLOCK_BATCH 64
+
+/*
+ * Number of pages currently holding buffer cache data.
+ */
+static uint_t s_numFilePages;
+
+/*
+ * The linker defines this symbol to indicate the end of
+ * the executable image.
+ */
+extern char end;
+
+/*
+ * Usable RAM, and reserved regions, from the boot memory map.
+ * RAM ranges are rounded inwards to whole pages, reserved ones outwards.
+ */
+struct Mem_Range {
+    ulong_t start, end;
+};
+static struct Mem_Range s_ramRanges[MAX_BOOT_MEM_REGIONS];
+static int s_numRamRanges;
+static struct Mem_Range s_reservedRanges[MAX_BOOT_MEM_REGIONS];
+static int s_numReservedRanges;
 
 /*
  * Add a range of pages to the inventory of physical memory.
+ * Pages flagged PAGE_AVAIL go on the freelist.
  */
 static void Add_Page_Range(ulong_t start, ulong_t end, int flags)
 {
@@ -68,6 +111,7 @@ static void Add_Page_Range(ulong_t start, ulong_t end, int flags)
     for (addr = start; addr < end; addr += PAGE_SIZE) {
 	struct Page *page = Get_Page(addr);
 
+	memset(page, '\0', sizeof(*page));
 	page->flags = flags;
 
 	if (flags == PAGE_AVAIL) {
@@ -76,26 +120,143 @@ static void Add_Page_Range(ulong_t start, ulong_t end, int flags)
 
 	    /* Update free page count */
 	    ++g_freePageCount;
-	} else {
-	    Set_Next_In_Page_List(page, 0);
-	    Set_Prev_In_Page_List(page, 0);
 	}
+    }
+}
 
-	page->clock = 0;
-	page->vaddr = 0;
-	page->entry = 0;
+/*
+ * Copy the RAM and reserved ranges out of the boot memory map.
+ * If the BIOS gave no map, all memory up to memSizeKB is taken to be RAM.
+ * Memory at or above MAX_PHYS_MEM is ignored.
+ */
+static void Find_RAM_Ranges(struct Boot_Info *bootInfo)
+{
+    int i;
+
+    if (bootInfo->bootInfoSize < sizeof(struct Boot_Info) || bootInfo->numMemRegions == 0) {
+	s_ramRanges[0].start = 0;
+	s_ramRanges[0].end = (ulong_t) bootInfo->memSizeKB << 10;
+	s_numRamRanges = 1;
+	return;
+    }
+
+    for (i = 0; i < bootInfo->numMemRegions && i < MAX_BOOT_MEM_REGIONS; ++i) {
+	struct Boot_Memory_Region *region = &bootInfo->memRegions[i];
+	ulong_t start = region->baseLow, end;
+
+	if (region->baseHigh != 0 || start >= MAX_PHYS_MEM)
+	    continue;
+	if (region->lengthHigh != 0 || region->lengthLow > MAX_PHYS_MEM - start)
+	    end = MAX_PHYS_MEM;
+	else
+	    end = start + region->lengthLow;
+
+	if (region->type != BOOT_MEM_USABLE) {
+	    s_reservedRanges[s_numReservedRanges].start = Round_Down_To_Page(start);
+	    s_reservedRanges[s_numReservedRanges].end = Round_Up_To_Page(end);
+	    ++s_numReservedRanges;
+	} else if (Round_Up_To_Page(start) < Round_Down_To_Page(end)) {
+	    s_ramRanges[s_numRamRanges].start = Round_Up_To_Page(start);
+	    s_ramRanges[s_numRamRanges].end = Round_Down_To_Page(end);
+	    ++s_numRamRanges;
+	}
     }
 }
 
-/* ----------------------------------------------------------------------
- * Public functions
- * ---------------------------------------------------------------------- */
+/*
+ * Set the flags of the pages in given range that currently have
+ * flags "from" to "to".  The range may extend past g_numPages.
+ */
+static void Change_Page_Flags(ulong_t start, ulong_t end, int from, int to)
+{
+    ulong_t addr;
+
+    for (addr = start; addr < end && Page_Index(addr) < g_numPages; addr += PAGE_SIZE) {
+	struct Page *page = Get_Page(addr);
+	if (page->flags == from)
+	    page->flags = to;
+    }
+}
 
 /*
- * The linker defines this symbol to indicate the end of
- * the executable image.
+ * Find room for the Page array.  It goes right after the kernel
+ * image if it fits below the ISA hole, otherwise in the first RAM
+ * range above the kernel heap with space for it.
  */
-extern char end;
+static ulong_t Find_Page_List_Space(ulong_t numPageListBytes)
+{
+    ulong_t kernEnd = Round_Up_To_Page((ulong_t) &end);
+    int i;
+
+    if (kernEnd + numPageListBytes <= ISA_HOLE_START)
+	return kernEnd;
+
+    for (i = 0; i < s_numRamRanges; ++i) {
+	ulong_t start = s_ramRanges[i].start;
+	if (start < HIGHMEM_START + KERNEL_HEAP_SIZE)
+	    start = HIGHMEM_START + KERNEL_HEAP_SIZE;
+	if (start < s_ramRanges[i].end && s_ramRanges[i].end - start >= numPageListBytes)
+	    return start;
+    }
+
+    KASSERT(false);
+    return 0;
+}
+
+/*
+ * Return the page under the clock hand, and advance the hand.
+ */
+static struct Page *Advance_Clock(void)
+{
+    struct Page *page = &g_pageList[s_clockHand];
+
+    if (++s_clockHand == g_numPages)
+	s_clockHand = 0;
+    return page;
+}
+
+/*
+ * Find a clean buffer cache page that was not referenced since
+ * the clock hand last passed it, and take it away from its cache.
+ * Dropping such a page costs no I/O, so this is always tried
+ * before swapping out a user page.  Looks at one batch of pages,
+ * and adds the number looked at to *pScanned.
+ * Interrupts must be disabled.
+ * Returns the page, still marked allocated, or null if
+ * no file page was reclaimed.
+ */
+static struct Page *Reclaim_File_Page(uint_t *pScanned)
+{
+    uint_t i;
+
+    KASSERT(!Interrupts_Enabled());
+
+    for (i = 0; i < CLOCK_BATCH && s_numFilePages > 0; ++i) {
+	struct Page *page = Advance_Clock();
+
+	++*pScanned;
+
+	if ((page->flags & PAGE_FILE) == 0)
+	    continue;
+	if (page->flags & PAGE_REFERENCED) {
+	    page->flags &= ~(PAGE_REFERENCED);
+	    continue;
+	}
+	if (Reclaim_FS_Buffer(page->buffer)) {
+	    page->flags &= ~(PAGE_FILE);
+	    page->buffer = 0;
+	    --s_numFilePages;
+	    Debug("Reclaimed file page at addr %lx\n", Get_Page_Address(page));
+	    return page;
+	}
+    }
+
+    return 0;
+}
+
+/* ----------------------------------------------------------------------
+ * Public functions
+ * ---------------------------------------------------------------------- */
 
 /*
  * Initialize memory management data structures.
@@ -103,13 +264,12 @@ extern char end;
  */
 void Init_Mem(struct Boot_Info* bootInfo)
 {
-    ulong_t numPages = bootInfo->memSizeKB >> 2;
-    ulong_t endOfMem = numPages * PAGE_SIZE;
-    unsigned numPageListBytes = sizeof(struct Page) * numPages;
+    ulong_t endOfMem = 0, ramKB = 0;
+    unsigned numPageListBytes;
     ulong_t pageListAddr;
-    ulong_t kernEnd;
-
-    KASSERT(bootInfo->memSizeKB > 0);
+    ulong_t kernEnd = Round_Up_To_Page((ulong_t) &end);
+    ulong_t addr;
+    int i;
 
     /*
      * Before we do anything, switch from setup.asm's temporary GDT
@@ -118,15 +278,27 @@ void Init_Mem(struct Boot_Info* bootInfo)
     Init_GDT();
 
     /*
-     * We'll put the list of Page objects right after the end
-     * of the kernel, and mark it as "kernel".  This will bootstrap
-     * us sufficiently that we can start allocating pages and
-     * keeping track of them.
+     * Copy the memory map before anything is put in memory;
+     * setup.asm left it where the Page array may go.
+     */
+    Find_RAM_Ranges(bootInfo);
+    for (i = 0; i < s_numRamRanges; ++i) {
+	if (s_ramRanges[i].end > endOfMem)
+	    endOfMem = s_ramRanges[i].end;
+	ramKB += (s_ramRanges[i].end - s_ramRanges[i].start) >> 10;
+    }
+    KASSERT(endOfMem > HIGHMEM_START + KERNEL_HEAP_SIZE);
+
+    /*
+     * The Page array covers the physical address space up to the end
+     * of the last RAM range, holes included, so Get_Page() stays a
+     * simple index.  This will bootstrap us sufficiently that we can
+     * start allocating pages and keeping track of them.
      */
-    pageListAddr = Round_Up_To_Page((ulong_t) &end);
+    g_numPages = endOfMem >> PAGE_POWER;
+    numPageListBytes = sizeof(struct Page) * g_numPages;
+    pageListAddr = Find_Page_List_Space(numPageListBytes);
     g_pageList = (struct Page*) pageListAddr;
-    kernEnd = Round_Up_To_Page(pageListAddr + numPageListBytes);
-    s_numPages = numPages;
 
     /*
      * The initial kernel thread and its stack are placed
@@ -138,29 +310,46 @@ void Init_Mem(struct Boot_Info* bootInfo)
     /*
      * Memory looks like this:
      * 0 - start: available (might want to preserve BIOS data area)
-     * start - end: kernel
+     * start - end: kernel (and the Page array, if it fits below the ISA hole)
      * end - ISA_HOLE_START: available
      * ISA_HOLE_START - ISA_HOLE_END: used by hardware (and ROM BIOS?)
      * ISA_HOLE_END - HIGHMEM_START: used by initial kernel thread
      * HIGHMEM_START - end of memory: available
-     *    (the kernel heap is located at HIGHMEM_START; any unused memory
-     *    beyond that is added to the freelist)
+     *    (the kernel heap is located at HIGHMEM_START, followed by
+     *    the Page array if it didn't fit lower down; any other RAM
+     *    is added to the freelist)
+     *
+     * Pages that aren't RAM stay PAGE_UNUSED.  RAM pages are marked
+     * PAGE_AVAIL first, then those in any non-RAM region of the map
+     * are taken back, since overlapping reserved regions win.
      */
-
-    Add_Page_Range(0, PAGE_SIZE, PAGE_UNUSED);
-    Add_Page_Range(PAGE_SIZE, KERNEL_START_ADDR, PAGE_AVAIL);
+    Add_Page_Range(0, g_numPages << PAGE_POWER, PAGE_UNUSED);
     Add_Page_Range(KERNEL_START_ADDR, kernEnd, PAGE_KERN);
-    Add_Page_Range(kernEnd, ISA_HOLE_START, PAGE_AVAIL);
     Add_Page_Range(ISA_HOLE_START, ISA_HOLE_END, PAGE_HW);
     Add_Page_Range(ISA_HOLE_END, HIGHMEM_START, PAGE_ALLOCATED);
     Add_Page_Range(HIGHMEM_START, HIGHMEM_START + KERNEL_HEAP_SIZE, PAGE_HEAP);
-    Add_Page_Range(HIGHMEM_START + KERNEL_HEAP_SIZE, endOfMem, PAGE_AVAIL);
+    Add_Page_Range(pageListAddr, Round_Up_To_Page(pageListAddr + numPageListBytes), PAGE_KERN);
+
+    for (i = 0; i < s_numRamRanges; ++i)
+	Change_Page_Flags(s_ramRanges[i].start, s_ramRanges[i].end, PAGE_UNUSED, PAGE_AVAIL);
+    for (i = 0; i < s_numReservedRanges; ++i)
+	Change_Page_Flags(s_reservedRanges[i].start, s_reservedRanges[i].end, PAGE_AVAIL, PAGE_UNUSED);
+    /* Page 0 stays unused, to catch null pointers */
+    Get_Page(0)->flags = PAGE_UNUSED;
+
+    for (addr = PAGE_SIZE; addr < endOfMem; addr += PAGE_SIZE) {
+	struct Page *page = Get_Page(addr);
+	if (page->flags == PAGE_AVAIL) {
+	    Add_To_Back_Of_Page_List(&s_freeList, page);
+	    ++g_freePageCount;
+	}
+    }
 
     /* Initialize the kernel heap */
     Init_Heap(HIGHMEM_START, KERNEL_HEAP_SIZE);
 
-    Print("%uKB memory detected, %u pages in freelist, %d bytes in kernel heap\n",
-	bootInfo->memSizeKB, g_freePageCount, KERNEL_HEAP_SIZE);
+    Print("%luKB memory detected in %d ranges, %u pages in freelist, %d bytes in kernel heap\n",
+	ramKB, s_numRamRanges, g_freePageCount, KERNEL_HEAP_SIZE);
 }
 
 /*
@@ -181,20 +370,38 @@ void* Alloc_Page(void)
 {
     struct Page* page;
     void *result = 0;
+    uint_t scanned = 0;
 
     bool iflag = Begin_Int_Atomic();
 
-    /* See if we have a free page */
-    if (!Is_Page_List_Empty(&s_freeList)) {
-        /* Remove the first page on the freelist. */
-        page = Get_Front_Of_Page_List(&s_freeList);
-        KASSERT((page->flags & PAGE_ALLOCATED) == 0);
-        Remove_From_Front_Of_Page_List(&s_freeList);
-
-        /* Mark page as having been allocated. */
-        page->flags |= PAGE_ALLOCATED;
-        g_freePageCount--;
-        result = (void*) Get_Page_Address(page);
+    while (true) {
+        /* See if we have a free page */
+        if (!Is_Page_List_Empty(&s_freeList)) {
+            /* Remove the first page on the freelist. */
+            page = Get_Front_Of_Page_List(&s_freeList);
+            KASSERT((page->flags & PAGE_ALLOCATED) == 0);
+            Remove_From_Front_Of_Page_List(&s_freeList);
+
+            /* Mark page as having been allocated. */
+            page->flags |= PAGE_ALLOCATED;
+            g_freePageCount--;
+            result = (void*) Get_Page_Address(page);
+            break;
+        }
+
+        if (s_numFilePages == 0 || scanned >= 2 * g_numPages)
+            break;
+        if ((page = Reclaim_File_Page(&scanned)) != 0) {
+            /* Reuse a page dropped from the buffer cache. */
+            result = (void*) Get_Page_Address(page);
+            break;
+        }
+
+        /* Let interrupts in between batches, if the caller had them on */
+        if (iflag) {
+            Enable_Interrupts();
+            Disable_Interrupts();
+        }
     }
 
     End_Int_Atomic(iflag);
@@ -203,44 +410,129 @@ void* Alloc_Page(void)
 }
 
 /*
- * Choose a page to evict.
- * Returns null if no pages are available.
+ * Choose a page to evict, using the CLOCK algorithm on the
+ * accessed bits of the page table entries.  Looks at one batch
+ * of pages, and adds the number looked at to *pScanned.
+ * Preemption must be disabled.
+ * Returns null if no page was found.
  */
-static struct Page *Find_Page_To_Page_Out()
+static struct Page *Find_Page_To_Page_Out(uint_t *pScanned)
 {
-    int i;
-    struct Page *curr, *best;
-
-    best = NULL;
-
-    for (i=0; i < s_numPages; i++) {
-	if ((g_pageList[i].flags & PAGE_PAGEABLE) &&
-	    (g_pageList[i].flags & PAGE_ALLOCATED)) {
-	    if (!best) best = &g_pageList[i];
-	    curr = &g_pageList[i];
-	    if ((curr->clock < best->clock) && (curr->flags & PAGE_PAGEABLE)) {
-		best = curr;
-	    }
+    uint_t i;
+    struct Page *best = NULL;
+    bool cleared = false;
+
+    for (i = 0; i < CLOCK_BATCH; i++) {
+	struct Page *curr = Advance_Clock();
+
+	++*pScanned;
+
+	if ((curr->flags & (PAGE_PAGEABLE | PAGE_ALLOCATED)) != (PAGE_PAGEABLE | PAGE_ALLOCATED))
+	    continue;
+	if (curr->entry->accesed) {
+	    /* Give it a second chance. */
+	    curr->entry->accesed = 0;
+	    cleared = true;
+	    continue;
 	}
+	best = curr;
+	break;
     }
 
+    /* The CPU only sets accessed bits again for entries it reloads. */
+    if (cleared)
+	Flush_TLB();
+
     return best;
 }
 
+/*
+ * Write a pageable page to the paging file, and mark its page
+ * table entry as being on disk.  Interrupts must be disabled;
+ * they are enabled while the page is written.
+ * On success the frame is left allocated but not pageable,
+ * for the caller to reuse or free.
+ * Returns false if there is no room in the paging file.
+ */
+bool Page_Out(struct Page *page)
+{
+    void* paddr = (void*) Get_Page_Address(page);
+    int pagefileIndex;
+
+    KASSERT(!Interrupts_Enabled());
+    KASSERT(page->flags & PAGE_PAGEABLE);
+
+    /* Find a place on disk for it */
+    pagefileIndex = Find_Space_On_Paging_File();
+    if (pagefileIndex < 0)
+        /* No space available in paging file. */
+        return false;
+    Debug("Free disk page at index %d\n", pagefileIndex);
+
+    /* Make the page temporarily unpageable (can't let another process steal it) */
+    page->flags &= ~(PAGE_PAGEABLE);
+
+    /* Lock the page so it cannot be freed while we're writing */
+    page->flags |= PAGE_LOCKED;
+
+    /*
+     * Compress the page into the swap cache, or failing that write it
+     * to disk. Interrupts are enabled, since the I/O may block.
+     */
+    Debug("Writing physical frame %p to paging file at %d\n", paddr, pagefileIndex);
+    Enable_Interrupts();
+    if (!Swap_Cache_Store(paddr, pagefileIndex))
+        Write_To_Paging_File(paddr, page->vaddr, pagefileIndex);
+    Disable_Interrupts();
+
+    /* While we were writing got notification this page isn't even needed anymore */
+    if (page->flags & PAGE_ALLOCATED)
+    {
+       /* The page is still in use update its bookeping info */
+       /* Update page table to reflect the page being on disk */
+       page->entry->present = 0;
+       page->entry->kernelInfo = KINFO_PAGE_ON_DISK;
+       page->entry->pageBaseAddr = pagefileIndex; /* Remember where it is located! */
+
+       /* No longer part of the process's resident set */
+       if (page->context != 0)
+           --page->context->residentPages;
+       page->context = 0;
+    }
+    else
+    {
+       /* The page got freed, don't need bookeeping or it on disk */
+       Free_Space_On_Paging_File(pagefileIndex);
+
+       /* Its still allocated though to us now */
+       page->flags |= PAGE_ALLOCATED;
+    }
+
+    /* Unlock the page */
+    page->flags &= ~(PAGE_LOCKED);
+
+    /* XXX - flush TLB should only flush the one page */
+    Flush_TLB();
+    return true;
+}
+
 /**
  * Allocate a page of pageable physical memory, to be mapped
  * into a user address space.
  *
+ * @param context the process the page belongs to, whose
+ *   resident set it is counted in (may be null)
  * @param entry pointer to user page table entry which will
  *   refer to the allocated page
  * @param vaddr virtual address where page will be mapped
  *   in user address space
  */
-void* Alloc_Pageable_Page(pte_t *entry, ulong_t vaddr)
+void* Alloc_Pageable_Page(struct User_Context *context, pte_t *entry, ulong_t vaddr)
 {
     bool iflag;
     void* paddr = 0;
     struct Page* page = 0;
+    uint_t scanned = 0;
 
     iflag = Begin_Int_Atomic();
 
@@ -252,57 +544,32 @@ void* Alloc_Pageable_Page(pte_t *entry, ulong_t vaddr)
         page = Get_Page((ulong_t) paddr);
         KASSERT((page->flags & PAGE_PAGEABLE) == 0);
     } else {
-        int pagefileIndex;
-
-        /* Select a page to steal from another process */
+        /*
+         * Select a page to steal from another process.
+         * The scan may visit every page twice, so only other threads
+         * are held off, and only for a batch at a time: interrupt
+         * handlers do not touch user pages.
+         */
         Debug("About to hunt for a page to page out\n");
-        page = Find_Page_To_Page_Out();
-        KASSERT(page->flags & PAGE_PAGEABLE);
-        paddr = (void*) Get_Page_Address(page);
-        Debug("Selected page at addr %p (age = %d)\n", paddr, page->clock);
-
-        /* Find a place on disk for it */
-        pagefileIndex = Find_Space_On_Paging_File();
-        if (pagefileIndex < 0)
-            /* No space available in paging file. */
-            goto done;
-        Debug("Free disk page at index %d\n", pagefileIndex);
-
-        /* Make the page temporarily unpageable (can't let another process steal it) */
-        page->flags &= ~(PAGE_PAGEABLE);
-
-        /* Lock the page so it cannot be freed while we're writing */
-        page->flags |= PAGE_LOCKED;
-
-        /* Write the page to disk. Interrupts are enabled, since the I/O may block. */
-        Debug("Writing physical frame %p to paging file at %d\n", paddr, pagefileIndex);
+        Disable_Preemption();
         Enable_Interrupts();
-        Write_To_Paging_File(paddr, page->vaddr, pagefileIndex);
-        Disable_Interrupts();
-
-        /* While we were writing got notification this page isn't even needed anymore */
-        if (page->flags & PAGE_ALLOCATED)
-        {
-           /* The page is still in use update its bookeping info */
-           /* Update page table to reflect the page being on disk */
-           page->entry->present = 0;
-           page->entry->kernelInfo = KINFO_PAGE_ON_DISK;
-           page->entry->pageBaseAddr = pagefileIndex; /* Remember where it is located! */
-        }
-        else
-        {
-           /* The page got freed, don't need bookeeping or it on disk */
-           Free_Space_On_Paging_File(pagefileIndex);
-
-           /* Its still allocated though to us now */
-           page->flags |= PAGE_ALLOCATED;
+        while (page == 0 && scanned < 2 * g_numPages) {
+            page = Find_Page_To_Page_Out(&scanned);
+            if (page == 0) {
+                /* Let other threads run between batches */
+                Enable_Preemption();
+                Disable_Preemption();
+            }
         }
+        Disable_Interrupts();
+        Enable_Preemption();
+        if (page == 0)
+            goto done;
+        Debug("Selected page at addr %lx\n", Get_Page_Address(page));
 
-        /* Unlock the page */
-        page->flags &= ~(PAGE_LOCKED);
-
-        /* XXX - flush TLB should only flush the one page */
-        Flush_TLB();
+        if (!Page_Out(page))
+            goto done;
+        paddr = (void*) Get_Page_Address(page);
     }
 
     /* Fill in accounting information for page */
@@ -310,6 +577,9 @@ void* Alloc_Pageable_Page(pte_t *entry, ulong_t vaddr)
     page->entry = entry;
     page->entry->kernelInfo = 0;
     page->vaddr = vaddr;
+    page->context = context;
+    if (context != 0)
+        ++context->residentPages;
     KASSERT(page->flags & PAGE_ALLOCATED);
 
 done:
@@ -337,9 +607,19 @@ void Free_Page(void* pageAddr)
     /* Clear the allocation bit */
     page->flags &= ~(PAGE_ALLOCATED);
 
+    KASSERT((page->flags & PAGE_FILE) == 0);
+
+    /* Take it out of its process's resident set */
+    if (page->context != 0) {
+        --page->context->residentPages;
+        page->context = 0;
+    }
+
     /* When a page is locked, don't free it just let other thread know its not needed */
-    if (page->flags & PAGE_LOCKED)
+    if (page->flags & PAGE_LOCKED) {
+      End_Int_Atomic(iflag);
       return;
+    }
 
     /* Clear the pageable bit */
     page->flags &= ~(PAGE_PAGEABLE);
@@ -350,3 +630,51 @@ void Free_Page(void* pageAddr)
 
     End_Int_Atomic(iflag);
 }
+
+/*
+ * Record that an allocated page holds the data of given
+ * buffer cache buffer, so that the page can be reclaimed
+ * (see Reclaim_FS_Buffer()) when memory runs short.
+ */
+void Add_File_Page(void* pageAddr, struct FS_Buffer *buf)
+{
+    struct Page* page = Get_Page((ulong_t) pageAddr);
+    bool iflag = Begin_Int_Atomic();
+
+    KASSERT(page->flags & PAGE_ALLOCATED);
+    KASSERT((page->flags & (PAGE_FILE | PAGE_PAGEABLE)) == 0);
+    page->flags |= PAGE_FILE | PAGE_REFERENCED;
+    page->buffer = buf;
+    ++s_numFilePages;
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Stop treating a page as a buffer cache page, before it is freed.
+ */
+void Remove_File_Page(void* pageAddr)
+{
+    struct Page* page = Get_Page((ulong_t) pageAddr);
+    bool iflag = Begin_Int_Atomic();
+
+    KASSERT(page->flags & PAGE_FILE);
+    page->flags &= ~(PAGE_FILE | PAGE_REFERENCED);
+    page->buffer = 0;
+    --s_numFilePages;
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Mark a buffer cache page as recently used.
+ */
+void Touch_File_Page(void* pageAddr)
+{
+    struct Page* page = Get_Page((ulong_t) pageAddr);
+    bool iflag = Begin_Int_Atomic();
+
+    page->flags |= PAGE_REFERENCED;
+
+    End_Int_Atomic(iflag);
+}
@@ -8,6 +8,7 @@
  * redistribute, and modify it as specified in the file "COPYING".
  */
 
+#include <geekos/errno.h>
 #include <geekos/string.h>
 #include <geekos/int.h>
 #include <geekos/idt.h>
@@ -23,6 +24,8 @@
 #include <geekos/crc32.h>
 #include <geekos/paging.h>
 #include <geekos/bitset.h>
+#include <geekos/swapcache.h>
+#include <geekos/thrash.h>
 
 /* ----------------------------------------------------------------------
  * Public data
@@ -32,11 +35,21 @@
  * Private functions/data
  * ---------------------------------------------------------------------- */
 
-static void *s_pagingDevMap;
-static struct Page **s_evictedPageList;
-
 #define SECTORS_PER_PAGE (PAGE_SIZE / SECTOR_SIZE)
 
+/*
+ * Paging file indices run over all the paging devices: each device
+ * gets the next range of them when it is registered.  They are kept
+ * in the 20 bit page frame field of page table entries.
+ */
+#define MAX_PAGING_SLOTS (1 << 20)
+
+/* Total number of page slots on all paging devices */
+static int s_numPagingSlots;
+
+/* Where round robin allocation continues within a priority level */
+static int s_stripeRotor;
+
 /*
  * flag to indicate if debugging paging code
  */
@@ -86,6 +99,7 @@ static void Print_Fault_Info(uint_t address, faultcode_t faultCode)
     faultcode_t faultCode;
     pde_t *dir = 0, *dirEntry = 0;
     pte_t *table = 0, *tableEntry = 0;
+    struct User_Context *context = g_currentThread->userContext;
 
     KASSERT(!Interrupts_Enabled());
 
@@ -96,6 +110,10 @@ static void Print_Fault_Info(uint_t address, faultcode_t faultCode)
     /* Get the fault code */
     faultCode = *((faultcode_t *) &(state->errorCode));
 
+    /* A process swapped out to stop thrashing doesn't get to run */
+    if (faultCode.userModeFault && context != 0)
+        Wait_While_Suspended(context);
+
     /* rest of your handling code here */
     if (address < PAGE_SIZE) {
         Print("Null pointer operation\n");
@@ -114,11 +132,16 @@ static void Print_Fault_Info(uint_t address, faultcode_t faultCode)
 
         // Acceptable stack overflow
         if (address >= STACK_BOTTOM && address < STACK_BOTTOM + PAGE_SIZE) {
-            void *page = Alloc_Pageable_Page(tableEntry , STACK_BOTTOM);
+            void *page = Alloc_Pageable_Page(context, tableEntry, STACK_BOTTOM);
             if (page == 0) {
                 Print("Cannot do a stack grow\n");
                 Exit(-1);
             }
+            /* Another thread may have grown it while we were allocating */
+            if (tableEntry->present) {
+                Free_Page(page);
+                return;
+            }
 
             tableEntry->present = 1;
             tableEntry->flags = VM_READ | VM_WRITE | VM_EXEC | VM_USER;
@@ -126,24 +149,51 @@ static void Print_Fault_Info(uint_t address, faultcode_t faultCode)
             return;
         }
 
-        // Swap
+        // Swap: bring the page back into a newly allocated frame
         if (tableEntry->present == 0 && tableEntry->kernelInfo == KINFO_PAGE_ON_DISK) {
-            struct Page* page = s_evictedPageList[tableEntry->pageBaseAddr];
-            if (page == 0 || (page != 0 && page->vaddr != address)) {
-                Print("The page in paging file is lost\n");
+            int pagefileIndex = tableEntry->pageBaseAddr;
+            ulong_t vaddr = Round_Down_To_Page(address);
+            void *paddr = Alloc_Pageable_Page(context, tableEntry, vaddr);
+            struct Page *page;
+
+            if (paddr == 0) {
+                Print("Cannot page in the required page\n");
                 Exit(-1);
             }
+
+            /* Keep the frame from being stolen while it is read */
+            page = Get_Page((ulong_t) paddr);
             page->flags &= ~(PAGE_PAGEABLE);
             page->flags |= PAGE_LOCKED;
-            Read_From_Paging_File((void*) Get_Page_Address(page), address, tableEntry->pageBaseAddr);
+            Enable_Interrupts();
+            if (!Swap_Cache_Load(paddr, pagefileIndex))
+                Read_From_Paging_File(paddr, vaddr, pagefileIndex);
+            Disable_Interrupts();
             page->flags &= ~(PAGE_LOCKED);
             page->flags |= PAGE_PAGEABLE;
-            ++page->clock;
 
+            /*
+             * Another thread of the process faulted on the same page
+             * and brought it in first; it already freed the slot.
+             */
+            if (tableEntry->present) {
+                Free_Page(paddr);
+                return;
+            }
+            Free_Space_On_Paging_File(pagefileIndex);
+            Note_Page_In(context);
+
+            tableEntry->present = 1;
+            tableEntry->flags = VM_READ | VM_WRITE | VM_EXEC | VM_USER;
+            tableEntry->kernelInfo = 0;
+            tableEntry->pageBaseAddr = (uint_t) paddr >> PAGE_POWER;
             return;
         }
     }
-    
+
+    // Heap, memory mapped file or anonymous region
+    if (context != 0 && Handle_User_Memory_Fault(context, address, faultCode))
+        return;
 
     Print ("Unexpected Page Fault received\n");
     Print_Fault_Info(address, faultCode);
@@ -176,7 +226,8 @@ void Init_VM(struct Boot_Info *bootInfo)
      */
     // TODO("Build initial kernel page directory and page tables");
 
-    int numPages = bootInfo->memSizeKB >> 2;
+    /* Map all of the physical address space Init_Mem() found */
+    int numPages = g_numPages;
     pde_t *kPageDir = 0;
 
     kPageDir = Alloc_Page();
@@ -214,44 +265,132 @@ void Init_VM(struct Boot_Info *bootInfo)
 /**
  * Initialize paging file data structures.
  * All filesystems should be mounted before this function
- * is called, to ensure that the paging file is available.
+ * is called, to ensure that the paging files are available.
  */
 void Init_Paging(void)
 {
-    // TODO("Initialize paging file data structures");
+    KASSERT(Get_Paging_Device(0) != 0);
+
+    /* Devices registered later grow it, see Init_Paging_Device() */
+    Init_Swap_Cache(s_numPagingSlots);
+}
+
+/**
+ * Set up the slot bookkeeping of a paging device,
+ * and give it the next range of paging file indices.
+ * Called by Register_Paging_Device().
+ * @return 0 if successful, error code (< 0) if not
+ */
+int Init_Paging_Device(struct Paging_Device *pagingDev)
+{
+    int numSlots = pagingDev->numSectors / SECTORS_PER_PAGE;
+
+    if (numSlots > MAX_PAGING_SLOTS - s_numPagingSlots)
+        numSlots = MAX_PAGING_SLOTS - s_numPagingSlots;
+    if (numSlots <= 0)
+        return ENOSPACE;
+
+    pagingDev->slotMap = Create_Bit_Set(numSlots);
+    if (pagingDev->slotMap == 0)
+        return ENOMEM;
+    pagingDev->numSlots = numSlots;
+    pagingDev->usedSlots = 0;
+    pagingDev->nextSlot = 0;
+    pagingDev->pageIns = pagingDev->pageOuts = 0;
+
+    pagingDev->firstSlot = s_numPagingSlots;
+    s_numPagingSlots += numSlots;
+
+    /* No-op until Init_Paging() has set up the swap cache */
+    Grow_Swap_Cache(s_numPagingSlots);
+    return 0;
+}
+
+/*
+ * Find the paging device holding given paging file index,
+ * and the slot number on that device.
+ */
+static struct Paging_Device *Find_Paging_Device(int pagefileIndex, int *pSlot)
+{
+    struct Paging_Device *pagingDev;
+    int i;
+
+    for (i = 0; (pagingDev = Get_Paging_Device(i)) != 0; ++i) {
+        if (pagefileIndex >= pagingDev->firstSlot &&
+            pagefileIndex < pagingDev->firstSlot + pagingDev->numSlots) {
+            *pSlot = pagefileIndex - pagingDev->firstSlot;
+            return pagingDev;
+        }
+    }
+
+    KASSERT(false);
+    return 0;
+}
+
+/*
+ * Reserve a free slot on given paging device.
+ * Returns the slot number, or -1 if the device is full.
+ */
+static int Alloc_Paging_Slot(struct Paging_Device *pagingDev)
+{
+    int i;
+
+    if (pagingDev->usedSlots == pagingDev->numSlots)
+        return -1;
 
-    struct Paging_Device *pagingDev = 0;
-    int numPages, numListBytes;
+    for (i = 0; i < pagingDev->numSlots; ++i) {
+        int slot = (pagingDev->nextSlot + i) % pagingDev->numSlots;
 
-    pagingDev = Get_Paging_Device();
-    KASSERT(pagingDev != 0);
-    numPages = pagingDev->numSectors / SECTORS_PER_PAGE;
-    numListBytes = numPages * sizeof(struct Page*);
+        if (!Is_Bit_Set(pagingDev->slotMap, slot)) {
+            Set_Bit(pagingDev->slotMap, slot);
+            ++pagingDev->usedSlots;
+            pagingDev->nextSlot = slot + 1;
+            return slot;
+        }
+    }
 
-    s_pagingDevMap = Create_Bit_Set(numPages);
-    KASSERT(s_pagingDevMap != 0);
-    s_evictedPageList = Malloc(numListBytes);
-    KASSERT(s_evictedPageList != 0);
-    memset(s_evictedPageList, 0, numListBytes);
+    KASSERT(false);		/* usedSlots was wrong */
+    return -1;
 }
 
 /**
  * Find a free bit of disk on the paging file for this page.
+ * The space is reserved immediately, so that another thread
+ * evicting a page while this one is writing can't pick it.
+ * Devices are tried a priority level at a time; within a level,
+ * successive pages go round robin to the devices, which spreads
+ * the paging file over them.  It doesn't make their I/O overlap:
+ * ide0 and ide1 share one request queue, so the disks still
+ * take turns.
  * Interrupts must be disabled.
  * @return index of free page sized chunk of disk space in
  *   the paging file, or -1 if the paging file is full
  */
 int Find_Space_On_Paging_File(void)
 {
+    struct Paging_Device *pagingDev;
+    int first = 0;
+
     KASSERT(!Interrupts_Enabled());
-    // TODO("Find free page in paging file");
 
-    struct Paging_Device *pagingDev = Get_Paging_Device();
-    int numPages = pagingDev->numSectors / SECTORS_PER_PAGE;
+    while ((pagingDev = Get_Paging_Device(first)) != 0) {
+        int numDevs = 1, i;
+
+        while (Get_Paging_Device(first + numDevs) != 0 &&
+               Get_Paging_Device(first + numDevs)->priority == pagingDev->priority)
+            ++numDevs;
+
+        for (i = 0; i < numDevs; ++i) {
+            struct Paging_Device *dev = Get_Paging_Device(first + (s_stripeRotor + i) % numDevs);
+            int slot = Alloc_Paging_Slot(dev);
+
+            if (slot >= 0) {
+                s_stripeRotor += i + 1;
+                return dev->firstSlot + slot;
+            }
+        }
 
-    for (int i = 0; i < numPages; ++i) {
-        if (!Is_Bit_Set(s_pagingDevMap, i))
-            return i;
+        first += numDevs;
     }
 
     return -1;
@@ -264,11 +403,16 @@ int Find_Space_On_Paging_File(void)
  */
 void Free_Space_On_Paging_File(int pagefileIndex)
 {
+    struct Paging_Device *pagingDev;
+    int slot;
+
     KASSERT(!Interrupts_Enabled());
-    // TODO("Free page in paging file");
 
-    KASSERT(Is_Bit_Set(s_pagingDevMap, pagefileIndex));
-    Clear_Bit(s_pagingDevMap, pagefileIndex);
+    pagingDev = Find_Paging_Device(pagefileIndex, &slot);
+    KASSERT(Is_Bit_Set(pagingDev->slotMap, slot));
+    Clear_Bit(pagingDev->slotMap, slot);
+    --pagingDev->usedSlots;
+    Swap_Cache_Drop(pagefileIndex);
 }
 
 /**
@@ -281,24 +425,28 @@ void Free_Space_On_Paging_File(int pagefileIndex)
  */
 void Write_To_Paging_File(void *paddr, ulong_t vaddr, int pagefileIndex)
 {
-    struct Page *page = Get_Page((ulong_t) paddr);
-    KASSERT(!(page->flags & PAGE_PAGEABLE)); /* Page must be locked! */
-    // TODO("Write page data to paging file");
+    struct Paging_Device *pagingDev;
+    bool iflag;
+    int slot, rc;
+
+    KASSERT(!(Get_Page((ulong_t) paddr)->flags & PAGE_PAGEABLE)); /* Page must be locked! */
 
-    struct Paging_Device *pagingDev = Get_Paging_Device();
-    KASSERT(!Is_Bit_Set(s_pagingDevMap, pagefileIndex));
-    int rc = Block_Write(
+    iflag = Begin_Int_Atomic();
+    pagingDev = Find_Paging_Device(pagefileIndex, &slot);
+    KASSERT(Is_Bit_Set(pagingDev->slotMap, slot));
+    ++pagingDev->pageOuts;
+    End_Int_Atomic(iflag);
+
+    rc = Block_Write_Multiple(
         pagingDev->dev,
-        pagingDev->startSector + pagefileIndex * SECTORS_PER_PAGE,
+        pagingDev->startSector + slot * SECTORS_PER_PAGE,
+        SECTORS_PER_PAGE,
         paddr
     );
     if (rc != 0) {
         Print("Cannot swap the required page to disk\n");
         Exit(-1);
     }
-
-    Set_Bit(s_pagingDevMap, pagefileIndex);
-    s_evictedPageList[pagefileIndex] = page;
 }
 
 /**
@@ -308,27 +456,48 @@ void Write_To_Paging_File(void *paddr, ulong_t vaddr, int pagefileIndex)
  * @param vaddr virtual address where page will be re-mapped in
  *   user memory
  * @param pagefileIndex the index of the page sized chunk of space
- *   in the paging file
+ *   in the paging file; the caller frees it once the page is mapped
  */
 void Read_From_Paging_File(void *paddr, ulong_t vaddr, int pagefileIndex)
 {
-    struct Page *page = Get_Page((ulong_t) paddr);
-    KASSERT(!(page->flags & PAGE_PAGEABLE)); /* Page must be locked! */
-    // TODO("Read page data from paging file");
+    struct Paging_Device *pagingDev;
+    bool iflag;
+    int slot, rc;
 
-    struct Paging_Device *pagingDev = Get_Paging_Device();
-    KASSERT(Is_Bit_Set(s_pagingDevMap, pagefileIndex));
-    int rc = Block_Read(
+    KASSERT(!(Get_Page((ulong_t) paddr)->flags & PAGE_PAGEABLE)); /* Page must be locked! */
+
+    iflag = Begin_Int_Atomic();
+    pagingDev = Find_Paging_Device(pagefileIndex, &slot);
+    KASSERT(Is_Bit_Set(pagingDev->slotMap, slot));
+    ++pagingDev->pageIns;
+    End_Int_Atomic(iflag);
+
+    rc = Block_Read_Multiple(
         pagingDev->dev,
-        pagingDev->startSector + pagefileIndex * SECTORS_PER_PAGE,
+        pagingDev->startSector + slot * SECTORS_PER_PAGE,
+        SECTORS_PER_PAGE,
         paddr
     );
     if (rc != 0) {
         Print("Cannot swap the required page back\n");
         Exit(-1);
     }
+}
 
-    Clear_Bit(s_pagingDevMap, pagefileIndex);
+/**
+ * Print slot usage and I/O counts of the paging devices.
+ */
+void Dump_Paging_Devices(void)
+{
+    struct Paging_Device *pagingDev;
+    int i;
+
+    for (i = 0; (pagingDev = Get_Paging_Device(i)) != 0; ++i) {
+        Print("%s on %s: priority %d, %d/%d slots used, %lu pages in, %lu out\n",
+            pagingDev->fileName, pagingDev->dev->name, pagingDev->priority,
+            pagingDev->usedSlots, pagingDev->numSlots,
+            pagingDev->pageIns, pagingDev->pageOuts);
+    }
 }
 
 // struct Page* Get_Evicted_Page(int pagefileIndex) {
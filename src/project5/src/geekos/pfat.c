@@ -13,8 +13,10 @@
 #include <geekos/screen.h>
 #include <geekos/string.h>
 #include <geekos/malloc.h>
+#include <geekos/mem.h>
 #include <geekos/ide.h>
 #include <geekos/blockdev.h>
+#include <geekos/bufcache.h>
 #include <geekos/bitset.h>
 #include <geekos/vfs.h>
 #include <geekos/list.h>
@@ -27,6 +29,8 @@
  * 17-Dec-2003: Rewrite to conform to new VFS layer
  * 19-Feb-2004: Cache and share PFAT_File objects, instead of
  *   allocating them repeatedly
+ * File data is cached in the shared filesystem buffer cache rather
+ *   than in per-file buffers, so it is reclaimed like other file pages
  */
 
 /*
@@ -40,6 +44,12 @@
 
 #define PAGEFILE_FILENAME "/pagefile.bin"
 
+/*
+ * PFAT blocks are single sectors.  The cache holds them a page at a
+ * time, so that a cached sector doesn't use a whole page of memory.
+ */
+#define PFAT_BLOCKS_PER_PAGE (PAGE_SIZE / SECTOR_SIZE)
+
 int debugPFAT = 0;
 #define Debug(args...) if (debugPFAT) Print("PFAT: " args)
 
@@ -57,20 +67,16 @@ struct PFAT_Instance {
     directoryEntry rootDirEntry;
     struct Mutex lock;
     struct PFAT_File_List fileList;
+    struct FS_Buffer_Cache *cache;	 /* Cache of file data blocks */
 };
 
 /*
  * In-memory information for a particular open file.
- * In particular, this object contains a cache of the contents
- * of the file.
  * Kept in fsInfo field of File.
  */
 struct PFAT_File {
     directoryEntry *entry;		 /* Directory entry of the file */
     ulong_t numBlocks;			 /* Number of blocks used by file */
-    char *fileDataCache;		 /* File data cache */
-    struct Bit_Set *validBlockSet;	 /* Which data blocks of cache are valid */
-    struct Mutex lock;			 /* Synchronize concurrent accesses */
     DEFINE_LINK(PFAT_File_List, PFAT_File);
 };
 IMPLEMENT_LIST(PFAT_File_List, PFAT_File);
@@ -82,6 +88,7 @@ IMPLEMENT_LIST(PFAT_File_List, PFAT_File);
 static void Copy_Stat(struct VFS_File_Stat *stat, directoryEntry *entry)
 {
     stat->size = entry->fileSize;
+    stat->numBlocks = Round_Up_To_Block(entry->fileSize) / SECTOR_SIZE;
     stat->isDirectory = entry->directory;
 
     stat->isSetuid = 0;
@@ -126,17 +133,13 @@ static int PFAT_Read(struct File *file, void *buf, ulong_t numBytes)
     }
 
     /*
-     * Now the complicated part; ensure that all blocks containing the
-     * data we need are in the file data cache.
+     * Traverse the FAT finding the blocks of the file,
+     * and copy the requested part of each block out
+     * of the buffer cache.
      */
-    startBlock = (start % SECTOR_SIZE) / SECTOR_SIZE;
+    startBlock = start / SECTOR_SIZE;
     endBlock = Round_Up_To_Block(end) / SECTOR_SIZE;
 
-    /*
-     * Traverse the FAT finding the blocks of the file.
-     * As we encounter requested blocks that aren't in the
-     * file data cache, we issue requests to read them.
-     */
     curBlock = pfatFile->entry->firstBlock;
     for (i = 0; i < endBlock; ++i) {
 	/* Are we at a valid block? */
@@ -145,41 +148,26 @@ static int PFAT_Read(struct File *file, void *buf, ulong_t numBytes)
 	    return EIO;  /* probable filesystem corruption */
 	}
 
-	/* Do we need to read this block? */
 	if (i >= startBlock) {
-	    int rc = 0;
-
-	    /* Only allow one thread at a time to read this block. */
-	    Mutex_Lock(&pfatFile->lock);
-
-	    if (!Is_Bit_Set(pfatFile->validBlockSet, i)) {
-		/* Read block into the file data cache */
-		Debug("Reading file block %lu (device block %lu)\n", i, curBlock);
-		rc = Block_Read(file->mountPoint->dev, curBlock, pfatFile->fileDataCache + i*SECTOR_SIZE);
-
-		if (rc == 0)
-		    /* Mark as having read this block */
-		    Set_Bit(pfatFile->validBlockSet, i);
-	    }
-
-	    /* Done attempting to fetch the block */
-	    Mutex_Unlock(&pfatFile->lock);
-
-	    if (rc != 0)
+	    struct FS_Buffer *fsBuf;
+	    ulong_t blockStart = i * SECTOR_SIZE;
+	    ulong_t from = start > blockStart ? start : blockStart;
+	    ulong_t to = end < blockStart + SECTOR_SIZE ? end : blockStart + SECTOR_SIZE;
+	    ulong_t pageOffset = (curBlock % PFAT_BLOCKS_PER_PAGE) * SECTOR_SIZE;
+	    int rc;
+
+	    Debug("Reading file block %lu (device block %lu)\n", i, curBlock);
+	    if ((rc = Get_FS_Buffer(instance->cache, curBlock / PFAT_BLOCKS_PER_PAGE, &fsBuf)) != 0)
 		return rc;
+	    memcpy((char*) buf + (from - start),
+		(char*) fsBuf->data + pageOffset + (from - blockStart), to - from);
+	    Release_FS_Buffer(instance->cache, fsBuf);
 	}
 
 	/* Continue to next block */
-	ulong_t nextBlock = instance->fat[curBlock];
-	curBlock = nextBlock;
+	curBlock = instance->fat[curBlock];
     }
 
-    /*
-     * All cached data we need is up to date,
-     * so just copy it into the caller's buffer.
-     */
-    memcpy(buf, pfatFile->fileDataCache + start, numBytes);
-
     Debug("Read satisfied!\n");
 
     return numBytes;
@@ -329,8 +317,6 @@ static struct PFAT_File *Get_PFAT_File(struct PFAT_Instance *instance, directory
 {
     ulong_t numBlocks;
     struct PFAT_File *pfatFile = 0;
-    char *fileDataCache = 0;
-    struct Bit_Set *validBlockSet = 0;
 
     KASSERT(entry != 0);
     KASSERT(instance != 0);
@@ -349,42 +335,23 @@ static struct PFAT_File *Get_PFAT_File(struct PFAT_Instance *instance, directory
     }
 
     if (pfatFile == 0) {
-	/* Determine size of data block cache for file. */
+	/* Determine number of blocks in file. */
 	numBlocks = Round_Up_To_Block(entry->fileSize) / SECTOR_SIZE;
 
-	/*
-	 * Allocate File object, PFAT_File object, file block data cache,
-	 * and valid cache block bitset
-	 */
-	if ((pfatFile = (struct PFAT_File *) Malloc(sizeof(*pfatFile))) == 0 ||
-	    (fileDataCache = Malloc(numBlocks * SECTOR_SIZE)) == 0 ||
-	    (validBlockSet = Create_Bit_Set(numBlocks)) == 0) {
-	    goto memfail;
-	}
+	/* Allocate PFAT_File object */
+	if ((pfatFile = (struct PFAT_File *) Malloc(sizeof(*pfatFile))) == 0)
+	    goto done;
+	memset(pfatFile, '\0', sizeof(*pfatFile));
 
 	/* Populate PFAT_File */
 	pfatFile->entry = entry;
 	pfatFile->numBlocks = numBlocks;
-	pfatFile->fileDataCache = fileDataCache;
-	pfatFile->validBlockSet = validBlockSet;
-	Mutex_Init(&pfatFile->lock);
 
 	/* Add to instance's list of PFAT_File objects. */
 	Add_To_Back_Of_PFAT_File_List(&instance->fileList, pfatFile);
 	KASSERT(pfatFile->nextPFAT_File_List == 0);
     }
 
-    /* Success! */
-    goto done;
-
-memfail:
-    if (pfatFile != 0)
-	Free(pfatFile);
-    if (fileDataCache != 0)
-	Free(fileDataCache);
-    if (validBlockSet != 0)
-	Free(validBlockSet);
-
 done:
     Mutex_Unlock(&instance->lock);
     return pfatFile;
@@ -507,8 +474,7 @@ struct Mount_Point_Ops s_pfatMountPointOps = {
 
 /*
  * If the given PFAT instance has a paging file,
- * register it as the paging device, unless a paging device
- * has already been registered.
+ * register it as a paging device.
  */
 static void PFAT_Register_Paging_File(struct Mount_Point *mountPoint, struct PFAT_Instance *instance)
 {
@@ -517,9 +483,6 @@ static void PFAT_Register_Paging_File(struct Mount_Point *mountPoint, struct PFA
     size_t nameLen;
     char *fileName = 0;
 
-    if (Get_Paging_Device() != 0)
-	return;  /* A paging device is already registered */
-
     pagefileEntry = PFAT_Lookup(instance, PAGEFILE_FILENAME);
     if (pagefileEntry == 0)
 	return;  /* No paging file in this filesystem */
@@ -543,9 +506,13 @@ static void PFAT_Register_Paging_File(struct Mount_Point *mountPoint, struct PFA
     pagedev->dev = mountPoint->dev;
     pagedev->startSector = pagefileEntry->firstBlock;
     pagedev->numSectors = pagefileEntry->fileSize / SECTOR_SIZE;
+    pagedev->priority = PAGING_PRIORITY_DISK;
 
     /* Register it */
-    Register_Paging_Device(pagedev);
+    if (Register_Paging_Device(pagedev) == 0)
+	return;
+    Free(fileName);
+    Free(pagedev);
     return;
 
 memfail:
@@ -645,6 +612,11 @@ static int PFAT_Mount(struct Mount_Point *mountPoint)
     instance->rootDirEntry.fileSize =
 	instance->fsinfo.rootDirectoryCount * sizeof(directoryEntry);
 
+    /* Create the cache for file data blocks. */
+    instance->cache = Create_FS_Buffer_Cache(mountPoint->dev, PAGE_SIZE);
+    if (instance->cache == 0)
+	goto memfail;
+
     /* Initialize instance lock and PFAT_File list. */
     Mutex_Init(&instance->lock);
     Clear_PFAT_File_List(&instance->fileList);
@@ -671,6 +643,8 @@ fail:
 	    Free(instance->fat);
 	if (instance->rootDir != 0)
 	    Free(instance->rootDir);
+	if (instance->cache != 0)
+	    Destroy_FS_Buffer_Cache(instance->cache);
 	Free(instance);
     }
     if (bootSect != 0)
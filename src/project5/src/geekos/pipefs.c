@@ -0,0 +1,230 @@
+/*
+ * Pipe pseudo-filesystem
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/kassert.h>
+#include <geekos/errno.h>
+#include <geekos/int.h>
+#include <geekos/vfs.h>
+#include <geekos/malloc.h>
+#include <geekos/string.h>
+#include <geekos/kthread.h>
+#include <geekos/poll.h>
+#include <geekos/pipefs.h>
+
+/* The amount of storage to allocate for a pipe. */
+#define PIPE_BUF_SIZE 4096
+
+/*
+ * A pipe is shared by its read and write File objects.
+ * All fields are protected by disabling interrupts.
+ */
+struct Pipe {
+    char *buf;
+    ulong_t head;		/* index of oldest byte */
+    ulong_t count;		/* bytes in buffer */
+    int readers, writers;	/* open File objects for each end */
+    struct Thread_Queue readWaitQueue;
+    struct Thread_Queue writeWaitQueue;
+    struct Poll_Entry_List pollList;
+};
+
+/* ----------------------------------------------------------------------
+ * Private data and functions
+ * ---------------------------------------------------------------------- */
+
+/* Wake everybody who might be waiting for a change in the pipe */
+static void Pipe_Changed(struct Pipe *pipe)
+{
+    Wake_Up(&pipe->readWaitQueue);
+    Wake_Up(&pipe->writeWaitQueue);
+    Poll_Wake(&pipe->pollList);
+}
+
+/*
+ * Read data from a pipe.
+ * Blocks until there is some data.
+ * Returns number of bytes read, or 0 if end-of-file
+ * has been reached.
+ */
+static int Pipe_Read(struct File *file, void *buf, ulong_t numBytes)
+{
+    struct Pipe *pipe = file->fsData;
+    ulong_t n = 0;
+
+    Disable_Interrupts();
+    while (pipe->count == 0 && pipe->writers > 0) {
+        if (!Wait_Interruptible(&pipe->readWaitQueue)) {
+            Enable_Interrupts();
+            return EINTR;
+        }
+    }
+
+    while (n < numBytes && pipe->count > 0) {
+        ((char*) buf)[n++] = pipe->buf[pipe->head];
+        pipe->head = (pipe->head + 1) % PIPE_BUF_SIZE;
+        --pipe->count;
+    }
+    if (n > 0)
+        Pipe_Changed(pipe);
+    Enable_Interrupts();
+
+    return n;
+}
+
+/*
+ * Write data to pipe.
+ * Blocks until all of it has gone into the pipe.
+ * Returns number of bytes written, or EPIPE if nobody will read them.
+ */
+static int Pipe_Write(struct File *file, void *buf, ulong_t numBytes)
+{
+    struct Pipe *pipe = file->fsData;
+    ulong_t n = 0;
+
+    Disable_Interrupts();
+    while (n < numBytes) {
+        if (pipe->readers == 0)
+            break;
+        if (pipe->count == PIPE_BUF_SIZE) {
+            if (!Wait_Interruptible(&pipe->writeWaitQueue))
+                break;
+            continue;
+        }
+
+        while (n < numBytes && pipe->count < PIPE_BUF_SIZE) {
+            pipe->buf[(pipe->head + pipe->count) % PIPE_BUF_SIZE] = ((char*) buf)[n++];
+            ++pipe->count;
+        }
+        Pipe_Changed(pipe);
+    }
+    Enable_Interrupts();
+
+    return n > 0 ? (int) n : (numBytes == 0 ? 0 : EPIPE);
+}
+
+/*
+ * Close pipe.
+ * The pipe goes away with the last File connected to it.
+ */
+static int Pipe_Close(struct File *file)
+{
+    struct Pipe *pipe = file->fsData;
+    bool destroy;
+
+    Disable_Interrupts();
+    if (file->mode & O_READ)
+        --pipe->readers;
+    else
+        --pipe->writers;
+    Pipe_Changed(pipe);
+    destroy = pipe->readers == 0 && pipe->writers == 0;
+    Enable_Interrupts();
+
+    if (destroy) {
+        Free(pipe->buf);
+        Free(pipe);
+    }
+    return 0;
+}
+
+/*
+ * Report readiness of either end of a pipe.
+ */
+static int Pipe_Poll(struct File *file, struct Poll_Table *table)
+{
+    struct Pipe *pipe = file->fsData;
+    int mask = 0;
+
+    KASSERT(!Interrupts_Enabled());
+
+    Poll_Wait(table, &pipe->pollList);
+    if (file->mode & O_READ) {
+        if (pipe->count > 0)
+            mask |= POLL_IN;
+        if (pipe->writers == 0)
+            mask |= POLL_IN | POLL_HUP;
+    } else {
+        if (pipe->count < PIPE_BUF_SIZE)
+            mask |= POLL_OUT;
+        if (pipe->readers == 0)
+            mask |= POLL_OUT | POLL_HUP;
+    }
+    return mask;
+}
+
+static struct File_Ops s_readPipeFileOps = {
+    0,			/* FStat() */
+    &Pipe_Read,
+    0,			/* Write() */
+    0,			/* Seek() */
+    &Pipe_Close,
+    0,			/* Read_Entry() */
+    0, 0, 0,		/* Map_Page(), Unmap_Page(), Dirty_Page() */
+    &Pipe_Poll,
+};
+
+static struct File_Ops s_writePipeFileOps = {
+    0,			/* FStat() */
+    0,			/* Read() */
+    &Pipe_Write,
+    0,			/* Seek() */
+    &Pipe_Close,
+    0,			/* Read_Entry() */
+    0, 0, 0,		/* Map_Page(), Unmap_Page(), Dirty_Page() */
+    &Pipe_Poll,
+};
+
+/* ----------------------------------------------------------------------
+ * Public functions
+ * ---------------------------------------------------------------------- */
+
+/*
+ * Create a pipe, returning File objects for its read and write ends.
+ * Returns 0 if successful, error code (< 0) if not.
+ */
+int Create_Pipe(struct File **pRead, struct File **pWrite)
+{
+    int rc = 0;
+    struct Pipe *pipe = 0;
+    struct File *read = 0, *write = 0;
+
+    if ((pipe = Malloc(sizeof(struct Pipe))) == 0) {
+        rc = ENOMEM;
+        goto done;
+    }
+    memset(pipe, 0, sizeof(struct Pipe));
+    if ((pipe->buf = Malloc(PIPE_BUF_SIZE)) == 0) {
+        rc = ENOMEM;
+        goto done;
+    }
+    pipe->readers = pipe->writers = 1;
+
+    /* Allocate File objects */
+    if ((read = Allocate_File(&s_readPipeFileOps, 0, 0, pipe, O_READ, 0)) == 0 ||
+        (write = Allocate_File(&s_writePipeFileOps, 0, 0, pipe, O_WRITE, 0)) == 0) {
+        rc = ENOMEM;
+        goto done;
+    }
+
+    *pRead = read;
+    *pWrite = write;
+    KASSERT(rc == 0);
+
+done:
+    if (rc != 0) {
+        if (read != 0)
+            Free(read);
+        if (write != 0)
+            Free(write);
+        if (pipe != 0) {
+            if (pipe->buf != 0)
+                Free(pipe->buf);
+            Free(pipe);
+        }
+    }
+    return rc;
+}
@@ -0,0 +1,167 @@
+/*
+ * Waiting for readiness on several files at once
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/kassert.h>
+#include <geekos/errno.h>
+#include <geekos/int.h>
+#include <geekos/string.h>
+#include <geekos/malloc.h>
+#include <geekos/kthread.h>
+#include <geekos/timer.h>
+#include <geekos/vfs.h>
+#include <geekos/user.h>
+#include <geekos/poll.h>
+
+/*
+ * A thread can only sleep on one Thread_Queue, so Poll() gives the
+ * polling thread a private queue, and hangs a Poll_Entry pointing at
+ * it on the wait list of every file it looks at.  Waking any of those
+ * lists wakes the poller, which then asks all the files again.
+ */
+
+/*
+ * Register the poll on given wait list.  Called from a file's Poll()
+ * operation, with interrupts disabled.  A null table means the caller
+ * only wants to know the current readiness.
+ */
+void Poll_Wait(struct Poll_Table *table, struct Poll_Entry_List *list)
+{
+    struct Poll_Entry *entry;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (table == 0 || table->numEntries == table->maxEntries)
+        return;
+
+    entry = &table->entries[table->numEntries++];
+    entry->table = table;
+    entry->list = list;
+    Add_To_Back_Of_Poll_Entry_List(list, entry);
+}
+
+/*
+ * Wake every poller registered on given wait list.
+ * May be called from interrupt handlers and tasklets.
+ */
+void Poll_Wake(struct Poll_Entry_List *list)
+{
+    struct Poll_Entry *entry;
+    bool iflag = Begin_Int_Atomic();
+
+    for (entry = Get_Front_Of_Poll_Entry_List(list); entry != 0;
+         entry = Get_Next_In_Poll_Entry_List(entry)) {
+        entry->table->triggered = true;
+        Wake_Up(&entry->table->waitQueue);
+    }
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Ask a file which events it is ready for.
+ * Files without a Poll() operation (regular files and directories)
+ * never block, so they are always ready in the directions they
+ * were opened for.
+ */
+static int Poll_File(struct File *file, struct Poll_Table *table)
+{
+    int mask = 0;
+
+    if (file->ops->Poll != 0)
+        return file->ops->Poll(file, table);
+
+    if (file->mode & O_READ)
+        mask |= POLL_IN;
+    if (file->mode & O_WRITE)
+        mask |= POLL_OUT;
+    return mask;
+}
+
+/*
+ * Wait until one of the given file descriptors is ready, or
+ * timeoutTicks timer ticks pass.  A negative timeout waits forever;
+ * zero just checks.  Called with interrupts disabled.
+ * Returns the number of descriptors with a non-zero revents field,
+ * or error code (< 0) if unsuccessful.
+ */
+int Poll_Files(struct User_Context *context, struct Poll_Fd *fds, int numFds, int timeoutTicks)
+{
+    struct Poll_Table table;
+    struct File **files = 0;
+    ulong_t deadline = g_numTicks + timeoutTicks;
+    int i, numReady = 0;
+    bool first = true;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (numFds < 0 || numFds > POLL_MAX_FDS)
+        return EINVALID;
+
+    memset(&table, 0, sizeof(table));
+    table.maxEntries = numFds;
+    if (numFds > 0) {
+        files = Malloc(numFds * sizeof(struct File*));
+        table.entries = Malloc(numFds * sizeof(struct Poll_Entry));
+        if (files == 0 || table.entries == 0) {
+            numReady = ENOMEM;
+            goto done;
+        }
+        memset(table.entries, 0, numFds * sizeof(struct Poll_Entry));
+    }
+
+    /* Keep the files open while we sleep on them */
+    for (i = 0; i < numFds; ++i)
+        files[i] = Hold_File_Descriptor(context, fds[i].fd);
+
+    while (true) {
+        table.triggered = false;
+        numReady = 0;
+
+        for (i = 0; i < numFds; ++i) {
+            int mask = POLL_NVAL;
+
+            /* Register with each file the first time round only */
+            if (files[i] != 0)
+                mask = Poll_File(files[i], first ? &table : 0);
+            fds[i].revents = mask & (fds[i].events | POLL_HUP | POLL_NVAL);
+            if (fds[i].revents != 0)
+                ++numReady;
+        }
+        first = false;
+
+        if (numReady > 0)
+            break;
+
+        if (Exit_Requested()) {
+            numReady = EINTR;
+            break;
+        }
+
+        /* Files' Poll() operations don't block, so no wake up was missed */
+        if (!table.triggered) {
+            int remaining = (int) (deadline - g_numTicks);
+
+            if (timeoutTicks >= 0 && remaining <= 0)
+                break;
+            Wait_Timeout(&table.waitQueue, timeoutTicks < 0 ? -1 : remaining);
+        }
+    }
+
+    for (i = 0; i < table.numEntries; ++i)
+        Remove_From_Poll_Entry_List(table.entries[i].list, &table.entries[i]);
+    for (i = 0; i < numFds; ++i) {
+        if (files[i] != 0)
+            Put_File(files[i]);
+    }
+
+done:
+    if (files != 0)
+        Free(files);
+    if (table.entries != 0)
+        Free(table.entries);
+    return numReady;
+}
@@ -0,0 +1,173 @@
+/*
+ * RAM disk driver
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/errno.h>
+#include <geekos/screen.h>
+#include <geekos/string.h>
+#include <geekos/mem.h>
+#include <geekos/malloc.h>
+#include <geekos/kassert.h>
+#include <geekos/blockdev.h>
+#include <geekos/vfs.h>
+#include <geekos/ramdisk.h>
+
+/*
+ * The disk is an array of kernel pages, allocated when the
+ * device is created so that it can't run out of memory later
+ * (for instance, when used for paging).
+ */
+#define BLOCKS_PER_PAGE (PAGE_SIZE / SECTOR_SIZE)
+
+static char **s_ramDiskPages;
+static int s_numRamDiskBlocks;
+
+static struct Block_Request_Queue s_ramDiskRequestQueue;
+
+static struct Paging_Device s_ramDiskPagingDevice;
+
+/*
+ * Get the address of given block.
+ */
+static __inline__ char *Ram_Disk_Block(int blockNum)
+{
+    return s_ramDiskPages[blockNum / BLOCKS_PER_PAGE] + (blockNum % BLOCKS_PER_PAGE) * SECTOR_SIZE;
+}
+
+static int Ram_Disk_Open(struct Block_Device *dev)
+{
+    KASSERT(!dev->inUse);
+    return 0;
+}
+
+static int Ram_Disk_Close(struct Block_Device *dev)
+{
+    KASSERT(dev->inUse);
+    return 0;
+}
+
+static int Ram_Disk_Get_Num_Blocks(struct Block_Device *dev)
+{
+    return s_numRamDiskBlocks;
+}
+
+static struct Block_Device_Ops s_ramDiskDeviceOps = {
+    Ram_Disk_Open,
+    Ram_Disk_Close,
+    Ram_Disk_Get_Num_Blocks,
+};
+
+/*
+ * Perform a RAM disk I/O request.
+ * This is a plain copy, so it runs in the requesting thread.
+ */
+static int Ram_Disk_Handle_Request(struct Block_Request *request)
+{
+    char *buf = request->buf;
+    int i;
+
+    if (request->type == BLOCK_FLUSH)
+	return 0;
+    if (request->blockNum < 0 || request->numBlocks > s_numRamDiskBlocks - request->blockNum)
+	return EINVALID;
+
+    for (i = 0; i < request->numBlocks; ++i, buf += SECTOR_SIZE) {
+	char *block = Ram_Disk_Block(request->blockNum + i);
+	if (request->type == BLOCK_READ)
+	    memcpy(buf, block, SECTOR_SIZE);
+	else
+	    memcpy(block, buf, SECTOR_SIZE);
+    }
+    return 0;
+}
+
+/*
+ * Create the ram0 device.
+ */
+void Init_Ram_Disk(void)
+{
+    int numPages = RAMDISK_SIZE_KB / (PAGE_SIZE / 1024);
+    int i = 0, rc;
+
+    if (numPages == 0)
+	return;
+
+    s_ramDiskPages = Malloc(numPages * sizeof(char*));
+    if (s_ramDiskPages == 0)
+	goto memfail;
+    for (i = 0; i < numPages; ++i) {
+	if ((s_ramDiskPages[i] = Alloc_Page()) == 0)
+	    goto memfail;
+	memset(s_ramDiskPages[i], '\0', PAGE_SIZE);
+    }
+    s_numRamDiskBlocks = numPages * BLOCKS_PER_PAGE;
+
+    Init_Block_Request_Queue(&s_ramDiskRequestQueue, &Ram_Disk_Handle_Request);
+    s_ramDiskRequestQueue.direct = true;
+
+    rc = Register_Block_Device("ram0", &s_ramDiskDeviceOps, 0, 0, &s_ramDiskRequestQueue);
+    if (rc != 0) {
+	Print("  Error: could not create block device for ram0\n");
+	return;
+    }
+    Print("    ram0: %d KB\n", RAMDISK_SIZE_KB);
+
+    if (RAMDISK_PAGING) {
+	/* Keep the device open, so nobody mounts it */
+	if (Open_Block_Device("ram0", &s_ramDiskPagingDevice.dev) == 0) {
+	    s_ramDiskPagingDevice.fileName = "ram0";
+	    s_ramDiskPagingDevice.startSector = 0;
+	    s_ramDiskPagingDevice.numSectors = s_numRamDiskBlocks;
+	    s_ramDiskPagingDevice.priority = PAGING_PRIORITY_RAM;
+	    if (Register_Paging_Device(&s_ramDiskPagingDevice) < 0)
+		Close_Block_Device(s_ramDiskPagingDevice.dev);
+	}
+    }
+    return;
+
+memfail:
+    Print("  Error: no memory for ram0\n");
+    if (s_ramDiskPages != 0) {
+	while (--i >= 0)
+	    Free_Page(s_ramDiskPages[i]);
+	Free(s_ramDiskPages);
+	s_ramDiskPages = 0;
+    }
+}
+
+/*
+ * Fill the RAM disk with the contents of a disk image file,
+ * if it exists.  Data beyond the size of the disk is ignored.
+ * Returns the number of bytes loaded, or error code (< 0).
+ */
+int Preload_Ram_Disk(const char *path)
+{
+    struct File *file = 0;
+    int rc, page, numBytes = 0;
+
+    if (s_numRamDiskBlocks == 0)
+	return ENODEV;
+    if (RAMDISK_PAGING)
+	return EBUSY;
+    if ((rc = Open(path, O_READ, &file)) < 0)
+	return rc;
+
+    for (page = 0; page < s_numRamDiskBlocks / BLOCKS_PER_PAGE; ++page) {
+	int n = 0;
+
+	while (n < PAGE_SIZE && (rc = Read(file, s_ramDiskPages[page] + n, PAGE_SIZE - n)) > 0)
+	    n += rc;
+	numBytes += n;
+	if (rc <= 0)
+	    break;
+    }
+    Close(file);
+
+    if (rc < 0)
+	return rc;
+    Print("Loaded %d bytes from %s into ram0\n", numBytes, path);
+    return numBytes;
+}
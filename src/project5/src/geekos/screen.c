@@ -12,7 +12,10 @@
 #include <geekos/ktypes.h>
 #include <geekos/io.h>
 #include <geekos/int.h>
+#include <geekos/string.h>
 #include <geekos/fmtout.h>
+#include <geekos/kthread.h>
+#include <geekos/serial.h>
 #include <geekos/screen.h>
 
 /*
@@ -386,6 +389,103 @@ static void Update_Cursor(void)
     Out_Byte(CRT_ADDR_REG, origAddr);
 }
 
+/*
+ * Kernel log.  Print() only formats its output into the log ring;
+ * the log thread copies the ring to the screen and the serial port
+ * later, so that printing from drivers and other places that run
+ * with interrupts disabled doesn't hold them up.  Anything else
+ * that touches the screen first catches it up with the log, by at
+ * most CATCH_UP_LIMIT bytes so that it doesn't hold them up either;
+ * this keeps the order of output and the attribute of printed text
+ * unless the log thread has fallen further behind than that.
+ * The most recent KLOG_SIZE bytes stay in the ring for dmesg.
+ */
+#define CATCH_UP_LIMIT KLOG_FLUSH_CHUNK
+
+static char s_klog[KLOG_SIZE];
+static ulong_t s_klogHead;		/* bytes ever logged; ring position is s_klogHead % KLOG_SIZE */
+static ulong_t s_klogScreenTail;	/* bytes shown on the screen */
+static ulong_t s_klogSerialTail;	/* bytes sent to the serial port */
+static struct Thread_Queue s_klogWaitQueue;
+static bool s_klogThreadRunning;
+
+/*
+ * Put up to limit bytes of the log that aren't on the screen yet
+ * there.  Interrupts must be disabled.
+ */
+static void Catch_Up_Screen(ulong_t limit)
+{
+    ulong_t end = s_klogHead;
+
+    if (s_klogScreenTail == end)
+	return;
+    if (end - s_klogScreenTail > limit)
+	end = s_klogScreenTail + limit;
+    while (s_klogScreenTail != end)
+	Put_Char_Imp(s_klog[s_klogScreenTail++ % KLOG_SIZE]);
+    Update_Cursor();
+}
+
+/*
+ * Add text to the log.  Interrupts must be disabled.
+ */
+static void Append_To_Log(const char *buf, ulong_t length)
+{
+    /* What the screen hasn't shown by the time it is overwritten is lost to it */
+    if (s_klogHead + length - s_klogScreenTail > KLOG_SIZE)
+	s_klogScreenTail = s_klogHead + length - KLOG_SIZE;
+
+    while (length > 0) {
+	ulong_t pos = s_klogHead % KLOG_SIZE;
+	ulong_t n = KLOG_SIZE - pos;
+
+	if (n > length)
+	    n = length;
+	memcpy(&s_klog[pos], buf, n);
+	s_klogHead += n;
+	buf += n;
+	length -= n;
+    }
+
+    /* The serial port may lose some, though */
+    if (s_klogHead - s_klogSerialTail > KLOG_SIZE)
+	s_klogSerialTail = s_klogHead - KLOG_SIZE;
+
+    /* Until the log thread runs, output goes straight to the screen */
+    if (!s_klogThreadRunning)
+	Catch_Up_Screen(CATCH_UP_LIMIT);
+}
+
+/*
+ * Copy the log out to the screen and the serial port.
+ */
+static void Kernel_Log_Thread(ulong_t arg)
+{
+    char buf[KLOG_FLUSH_CHUNK];
+
+    Disable_Interrupts();
+    while (true) {
+	ulong_t n, i;
+
+	if (s_klogScreenTail == s_klogHead && s_klogSerialTail == s_klogHead)
+	    Wait_Timeout(&s_klogWaitQueue, KLOG_FLUSH_TICKS);
+
+	/* A chunk at a time, so that interrupts aren't held off for long */
+	Catch_Up_Screen(KLOG_FLUSH_CHUNK);
+
+	n = s_klogHead - s_klogSerialTail;
+	if (n > KLOG_FLUSH_CHUNK)
+	    n = KLOG_FLUSH_CHUNK;
+	for (i = 0; i < n; ++i)
+	    buf[i] = s_klog[(s_klogSerialTail + i) % KLOG_SIZE];
+	s_klogSerialTail += n;
+
+	Enable_Interrupts();
+	Serial_Put_Buf(buf, n);
+	Disable_Interrupts();
+    }
+}
+
 /* ----------------------------------------------------------------------
  * Public functions
  * ---------------------------------------------------------------------- */
@@ -415,6 +515,7 @@ void Clear_Screen(void)
 
     bool iflag = Begin_Int_Atomic();
 
+    Catch_Up_Screen(CATCH_UP_LIMIT);
     for (i = 0; i < NUM_SCREEN_DWORDS; ++i)
 	*v++ = fill;
 
@@ -427,6 +528,7 @@ void Clear_Screen(void)
 void Get_Cursor(int* row, int* col)
 {
     bool iflag = Begin_Int_Atomic();
+    Catch_Up_Screen(CATCH_UP_LIMIT);
     *row = s_cons.row;
     *col = s_cons.col;
     End_Int_Atomic(iflag);
@@ -445,6 +547,7 @@ bool Put_Cursor(int row, int col)
         return false;
 
     iflag = Begin_Int_Atomic();
+    Catch_Up_Screen(CATCH_UP_LIMIT);
     s_cons.row = row;
     s_cons.col = col;
     Update_Cursor();
@@ -467,6 +570,7 @@ uchar_t Get_Current_Attr(void)
 void Set_Current_Attr(uchar_t attrib)
 {
     bool iflag = Begin_Int_Atomic();
+    Catch_Up_Screen(CATCH_UP_LIMIT);
     s_cons.currentAttr = attrib;
     End_Int_Atomic(iflag);
 }
@@ -478,6 +582,7 @@ void Set_Current_Attr(uchar_t attrib)
 void Put_Char(int c)
 {
     bool iflag = Begin_Int_Atomic();
+    Catch_Up_Screen(CATCH_UP_LIMIT);
     Put_Char_Imp(c);
     Update_Cursor();
     End_Int_Atomic(iflag);
@@ -490,6 +595,7 @@ void Put_Char(int c)
 void Put_String(const char* s)
 {
     bool iflag = Begin_Int_Atomic();
+    Catch_Up_Screen(CATCH_UP_LIMIT);
     while (*s != '\0')
 	Put_Char_Imp(*s++);
     Update_Cursor();
@@ -503,6 +609,7 @@ void Put_String(const char* s)
 void Put_Buf(const char* buf, ulong_t length)
 {
     bool iflag = Begin_Int_Atomic();
+    Catch_Up_Screen(CATCH_UP_LIMIT);
     while (length > 0) {
 	Put_Char_Imp(*buf++);
 	--length;
@@ -511,25 +618,128 @@ void Put_Buf(const char* buf, ulong_t length)
     End_Int_Atomic(iflag);
 }
 
-/* Support for Print(). */
-static void Print_Emit(struct Output_Sink *o, int ch) { Put_Char_Imp(ch); }
-static void Print_Finish(struct Output_Sink *o) { Update_Cursor(); }
-static struct Output_Sink s_outputSink = { &Print_Emit, &Print_Finish };
+/*
+ * Support for Print().  One caller at a time formats into
+ * s_printBuf, with interrupts as it found them, and adds the text
+ * to the log a buffer at a time.  Anybody printing meanwhile (an
+ * interrupt handler, or a thread that preempted it) formats straight
+ * into the log with interrupts disabled.
+ */
+struct Log_Sink {
+    struct Output_Sink o;
+    char *buf;			/* null: add each character to the log directly */
+    ulong_t length;
+};
+
+static char s_printBuf[KLOG_FLUSH_CHUNK];
+static bool s_printBufBusy;
+
+static void Log_Flush(struct Log_Sink *sink)
+{
+    bool iflag = Begin_Int_Atomic();
+    Append_To_Log(sink->buf, sink->length);
+    End_Int_Atomic(iflag);
+    sink->length = 0;
+}
+
+static void Log_Emit(struct Output_Sink *o, int ch)
+{
+    struct Log_Sink *sink = (struct Log_Sink*) o;
+    char c = ch;
+
+    if (sink->buf == 0) {
+	Append_To_Log(&c, 1);
+	return;
+    }
+    sink->buf[sink->length++] = c;
+    if (sink->length == sizeof(s_printBuf))
+	Log_Flush(sink);
+}
+
+static void Log_Finish(struct Output_Sink *o)
+{
+    struct Log_Sink *sink = (struct Log_Sink*) o;
+
+    if (sink->buf != 0 && sink->length > 0)
+	Log_Flush(sink);
+}
 
 /*
- * Print to console using printf()-style formatting.
+ * Print to the kernel log using printf()-style formatting.
  * Calls into Format_Output in common library.
+ * The text reaches the screen when the log thread gets to it,
+ * or when something else is written to the screen.
  */
 void Print(const char *fmt, ...)
 {
+    struct Log_Sink sink = { { &Log_Emit, &Log_Finish }, 0, 0 };
     va_list args;
 
     bool iflag = Begin_Int_Atomic();
 
+    if (!s_printBufBusy) {
+	s_printBufBusy = true;
+	sink.buf = s_printBuf;
+	End_Int_Atomic(iflag);
+    }
+
     va_start(args, fmt);
-    Format_Output(&s_outputSink, fmt, args);
+    Format_Output(&sink.o, fmt, args);
     va_end(args);
 
+    if (sink.buf != 0) {
+	iflag = Begin_Int_Atomic();
+	s_printBufBusy = false;
+    }
+
+    /*
+     * With interrupts disabled we may be in the middle of
+     * the scheduler; the log thread will find the text soon anyway.
+     */
+    if (iflag && s_klogThreadRunning)
+	Wake_Up(&s_klogWaitQueue);
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Start the kernel log thread.  Until then, Print() writes
+ * to the screen directly.
+ */
+void Init_Kernel_Log(void)
+{
+    Init_Serial();
+    Start_Kernel_Thread(Kernel_Log_Thread, 0, PRIORITY_LOW, true);
+    s_klogThreadRunning = true;
+}
+
+/*
+ * Put everything in the log on the screen right away,
+ * for instance before the system stops on a failed assertion.
+ */
+void Flush_Kernel_Log(void)
+{
+    bool iflag = Begin_Int_Atomic();
+    Catch_Up_Screen(KLOG_SIZE);
     End_Int_Atomic(iflag);
 }
 
+/*
+ * Copy the most recent part of the log, up to bufSize bytes,
+ * into buf.  Returns the number of bytes copied.
+ */
+ulong_t Read_Kernel_Log(char *buf, ulong_t bufSize)
+{
+    ulong_t start, n, i;
+    bool iflag = Begin_Int_Atomic();
+
+    n = s_klogHead < KLOG_SIZE ? s_klogHead : KLOG_SIZE;
+    if (n > bufSize)
+	n = bufSize;
+    start = s_klogHead - n;
+    for (i = 0; i < n; ++i)
+	buf[i] = s_klog[(start + i) % KLOG_SIZE];
+
+    End_Int_Atomic(iflag);
+    return n;
+}
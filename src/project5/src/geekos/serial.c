@@ -0,0 +1,100 @@
+/*
+ * Serial port output
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/io.h>
+#include <geekos/serial.h>
+
+/*
+ * Just enough of a 16550 UART driver to copy the kernel log out:
+ * output only, polled, 115200 baud 8N1.
+ */
+
+/* Register offsets from SERIAL_BASE_PORT */
+#define UART_DATA	0	/* transmit holding (DLAB = 0) */
+#define UART_IER	1	/* interrupt enable (DLAB = 0) */
+#define UART_DLL	0	/* divisor latch low (DLAB = 1) */
+#define UART_DLH	1	/* divisor latch high (DLAB = 1) */
+#define UART_FCR	2	/* FIFO control */
+#define UART_LCR	3	/* line control */
+#define UART_MCR	4	/* modem control */
+#define UART_LSR	5	/* line status */
+#define UART_SCRATCH	7
+
+#define UART_LCR_8N1	0x03
+#define UART_LCR_DLAB	0x80
+#define UART_FCR_ENABLE	0xC7	/* enable and clear FIFOs, 14 byte threshold */
+#define UART_MCR_READY	0x03	/* DTR and RTS */
+#define UART_LSR_THRE	0x20	/* transmit holding register empty */
+
+/* 115200 / divisor */
+#define UART_DIVISOR	1
+
+/* Give up on a character if the port doesn't take it in this many polls */
+#define UART_MAX_POLLS	100000
+
+static bool s_serialPresent;
+
+/*
+ * Wait until the UART can take another character.
+ */
+static void Wait_For_Transmitter(void)
+{
+    int polls;
+
+    for (polls = 0; polls < UART_MAX_POLLS; ++polls)
+	if (In_Byte(SERIAL_BASE_PORT + UART_LSR) & UART_LSR_THRE)
+	    break;
+}
+
+/*
+ * Set up COM1, if there is one.
+ */
+void Init_Serial(void)
+{
+    ushort_t port = SERIAL_BASE_PORT;
+
+    /* No UART: the scratch register doesn't hold what we write */
+    Out_Byte(port + UART_SCRATCH, 0x5A);
+    if (In_Byte(port + UART_SCRATCH) != 0x5A)
+	return;
+
+    Out_Byte(port + UART_IER, 0);
+    Out_Byte(port + UART_LCR, UART_LCR_DLAB);
+    Out_Byte(port + UART_DLL, UART_DIVISOR & 0xFF);
+    Out_Byte(port + UART_DLH, UART_DIVISOR >> 8);
+    Out_Byte(port + UART_LCR, UART_LCR_8N1);
+    Out_Byte(port + UART_FCR, UART_FCR_ENABLE);
+    Out_Byte(port + UART_MCR, UART_MCR_READY);
+    s_serialPresent = true;
+}
+
+bool Serial_Present(void)
+{
+    return s_serialPresent;
+}
+
+/*
+ * Send characters out the serial port, turning newlines into CR LF.
+ * Busy-waits on the port, so better called with interrupts enabled.
+ */
+void Serial_Put_Buf(const char *buf, ulong_t length)
+{
+    if (!s_serialPresent)
+	return;
+
+    while (length > 0) {
+	int ch = *buf++;
+
+	--length;
+	if (ch == '\n') {
+	    Wait_For_Transmitter();
+	    Out_Byte(SERIAL_BASE_PORT + UART_DATA, '\r');
+	}
+	Wait_For_Transmitter();
+	Out_Byte(SERIAL_BASE_PORT + UART_DATA, ch);
+    }
+}
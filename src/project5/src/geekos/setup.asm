@@ -25,6 +25,11 @@ start_setup:
 	mov	ax, SETUPSEG
 	mov	ds, ax
 
+	; The boot sector passes the BIOS tick count when it started
+	; in si, and the number of ticks it spent loading in di.
+	mov	[start_ticks], si
+	mov	[load_ticks], di
+
 	; Use int 15h to find out size of extended memory in KB.
 	; Extended memory is the memory above 1MB.  So by
 	; adding 1MB to this amount, we get the total amount
@@ -35,9 +40,44 @@ start_setup:
 	add	ax, 1024	; 1024 KB == 1 MB
 	mov	[mem_size_kbytes], ax
 
+	; Now ask for a proper map of physical memory, with int 15h, E820h.
+	; It returns one region per call, and a continuation value in ebx,
+	; which is 0 after the last region.  If the BIOS doesn't know the
+	; call, the kernel makes do with mem_size_kbytes.
+	push	ds
+	pop	es
+	mov	di, mem_map
+	xor	ebx, ebx
+.next_region:
+	mov	eax, 0xe820
+	mov	edx, SMAP_SIGNATURE
+	mov	ecx, MEM_REGION_SIZE
+	int	0x15
+	jc	.map_done		; not supported, or past the end
+	cmp	eax, SMAP_SIGNATURE
+	jne	.map_done
+	add	di, MEM_REGION_SIZE
+	inc	word [mem_map_count]
+	cmp	word [mem_map_count], MAX_MEM_REGIONS
+	jae	.map_done
+	test	ebx, ebx
+	jnz	.next_region
+.map_done:
+
 	; Kill the floppy motor.
 	call	Kill_Motor
 
+	; This is the last we hear from the BIOS clock, so work
+	; out how long it's been since the boot sector started.
+	; The kernel times the rest of the way to Main() from the
+	; TSC read here.
+	xor	ah, ah
+	int	0x1a
+	rdtsc
+	mov	[setup_tsc], eax
+	sub	dx, [start_ticks]
+	mov	[boot_ticks], dx
+
 	; Block interrupts, since we can't meaningfully handle them yet
 	; and we no longer need BIOS services.
 	cli
@@ -75,10 +115,18 @@ setup_32:
 	; Build Boot_Info struct on stack.
 	; Note that we push the fields on in reverse order,
 	; since the stack grows downwards.
+	push	dword [(SETUPSEG<<4)+setup_tsc]	; setupTSC
+	push	dword (SETUPSEG<<4)+mem_map	; memRegions
 	xor	eax, eax
+	mov	ax, [(SETUPSEG<<4)+mem_map_count]
+	push	eax		; numMemRegions
+	mov	ax, [(SETUPSEG<<4)+boot_ticks]
+	push	eax		; bootTicks
+	mov	ax, [(SETUPSEG<<4)+load_ticks]
+	push	eax		; loadTicks
 	mov	ax, [(SETUPSEG<<4)+mem_size_kbytes]
 	push	eax		; memSizeKB
-	push	dword 8		; bootInfoSize
+	push	dword 28	; bootInfoSize
 
 	; Pass pointer to Boot_Info struct as argument to kernel
 	; entry point.
@@ -162,6 +210,21 @@ Enable_A20:
 
 mem_size_kbytes: dw 0
 
+; Memory map from int 15h, E820h.
+; Keep up to date with struct Boot_Memory_Region in <geekos/bootinfo.h>.
+SMAP_SIGNATURE equ 0x534d4150	; 'SMAP'
+MEM_REGION_SIZE equ 20
+MAX_MEM_REGIONS equ 32
+
+mem_map_count: dw 0
+mem_map: times MAX_MEM_REGIONS*MEM_REGION_SIZE db 0
+
+; Boot timing, in BIOS timer ticks
+start_ticks: dw 0
+load_ticks: dw 0
+boot_ticks: dw 0
+setup_tsc: dd 0
+
 
 ; ----------------------------------------------------------------------
 ; The GDT.  Creates flat 32-bit address space for the kernel
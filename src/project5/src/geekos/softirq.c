@@ -0,0 +1,61 @@
+/*
+ * Deferred interrupt work (tasklets)
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/kassert.h>
+#include <geekos/int.h>
+#include <geekos/kthread.h>
+#include <geekos/softirq.h>
+
+/*
+ * Tasklets waiting to run.
+ */
+static struct Tasklet_List s_pendingTasklets;
+
+/*
+ * Schedule a tasklet to run when the current interrupt handler
+ * returns (or on the next interrupt if called outside of one).
+ * Does nothing if the tasklet is already pending.
+ */
+void Schedule_Tasklet(struct Tasklet *tasklet)
+{
+    bool iflag = Begin_Int_Atomic();
+
+    if (!Is_Member_Of_Tasklet_List(&s_pendingTasklets, tasklet))
+	Add_To_Back_Of_Tasklet_List(&s_pendingTasklets, tasklet);
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Run pending tasklets.
+ * Called by the interrupt return code with interrupts disabled.
+ * Tasklets only run if the interrupted code had interrupts and
+ * preemption enabled; otherwise they wait for a later interrupt.
+ * Code running with preemption disabled (including tasklets
+ * themselves) is therefore never interrupted by a tasklet.
+ */
+void Run_Softirqs(struct Interrupt_State *state)
+{
+    KASSERT(!Interrupts_Enabled());
+
+    if (g_preemptCount != 0 || (state->eflags & EFLAGS_IF) == 0 ||
+	Is_Tasklet_List_Empty(&s_pendingTasklets))
+	return;
+
+    /* Tasklets run on the interrupted thread's stack, so it must not be switched out. */
+    ++g_preemptCount;
+
+    while (!Is_Tasklet_List_Empty(&s_pendingTasklets)) {
+	struct Tasklet *tasklet = Remove_From_Front_Of_Tasklet_List(&s_pendingTasklets);
+
+	Enable_Interrupts();
+	tasklet->func(tasklet->arg);
+	Disable_Interrupts();
+    }
+
+    --g_preemptCount;
+}
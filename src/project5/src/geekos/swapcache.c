@@ -0,0 +1,411 @@
+/*
+ * Compressed in-memory cache in front of the paging file
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/kassert.h>
+#include <geekos/screen.h>
+#include <geekos/string.h>
+#include <geekos/malloc.h>
+#include <geekos/mem.h>
+#include <geekos/kthread.h>
+#include <geekos/swapcache.h>
+
+/*
+ * An evicted page keeps its slot in the paging file either way, and
+ * the slot number is the key here: Write_To_Paging_File() is only
+ * called for pages that don't fit in the pool, and
+ * Read_From_Paging_File() only for pages that aren't in it.
+ *
+ * The pool is a set of kernel pages, each cut into 32 chunks.
+ * A compressed page takes a run of chunks within one pool page.
+ *
+ * The pool and the slot table are only touched by threads,
+ * so disabling preemption protects them.
+ */
+
+#define CHUNK_SIZE	(PAGE_SIZE / 32)
+#define NO_POOL_PAGE	0xffff
+
+/* Don't bother keeping pages that shrink less than this */
+#define MAX_COMPRESSED	(PAGE_SIZE * 3 / 4)
+
+struct Swap_Cache_Slot {
+    ushort_t poolPage;		/* NO_POOL_PAGE if the page is on disk */
+    uchar_t firstChunk;
+    uchar_t numChunks;
+    ushort_t length;		/* compressed bytes */
+};
+
+struct Swap_Cache_Stats g_swapCacheStats;
+
+static struct Swap_Cache_Slot *s_slots;
+static int s_numSlots;
+
+static uchar_t *s_poolPages[SWAP_CACHE_PAGES];
+static ulong_t s_poolMap[SWAP_CACHE_PAGES];	/* one bit per used chunk */
+static int s_numPoolPages;
+
+/* ----------------------------------------------------------------------
+ * LZ compression
+ *
+ * The output is a series of sequences, each a token byte, literals,
+ * and a match copied from earlier output.  The high nibble of the
+ * token is the number of literals, the low nibble the match length
+ * minus LZ_MIN_MATCH; 15 means more length bytes follow, added up
+ * until one is less than 255.  A match is given as a 16 bit offset
+ * back from the current position, and its length.  The last sequence
+ * has no match: decoding stops once a whole page has been produced.
+ * ---------------------------------------------------------------------- */
+
+#define LZ_MIN_MATCH	4
+#define LZ_HASH_BITS	10
+
+/* Positions + 1 of the last place each hashed 4 bytes were seen */
+static ushort_t s_lzHash[1 << LZ_HASH_BITS];
+static uchar_t s_lzBuffer[PAGE_SIZE];
+
+static __inline__ ulong_t Read32(const uchar_t *p)
+{
+    ulong_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static int LZ_Put_Length(uchar_t *out, int op, ulong_t n)
+{
+    while (n >= 255) {
+        out[op++] = 255;
+        n -= 255;
+    }
+    out[op++] = n;
+    return op;
+}
+
+static bool LZ_Get_Length(const uchar_t *in, int *pIp, int inLen, ulong_t *pN)
+{
+    uchar_t b;
+
+    do {
+        if (*pIp >= inLen)
+            return false;
+        b = in[(*pIp)++];
+        *pN += b;
+    } while (b == 255);
+    return true;
+}
+
+/*
+ * Append a sequence to the output.  A matchLen of 0 ends the data.
+ * Returns new output length, or -1 if it would exceed outMax.
+ */
+static int LZ_Emit(const uchar_t *lit, ulong_t numLit, ulong_t offset, ulong_t matchLen,
+    uchar_t *out, int op, int outMax)
+{
+    ulong_t m = matchLen ? matchLen - LZ_MIN_MATCH : 0;
+    int need = 1 + numLit / 255 + 1 + numLit + (matchLen ? 2 + m / 255 + 1 : 0);
+
+    if (op + need > outMax)
+        return -1;
+
+    out[op++] = (MIN(numLit, 15UL) << 4) | MIN(m, 15UL);
+    if (numLit >= 15)
+        op = LZ_Put_Length(out, op, numLit - 15);
+    memcpy(out + op, lit, numLit);
+    op += numLit;
+
+    if (matchLen) {
+        out[op++] = offset & 0xff;
+        out[op++] = offset >> 8;
+        if (m >= 15)
+            op = LZ_Put_Length(out, op, m - 15);
+    }
+    return op;
+}
+
+/*
+ * Compress a page.
+ * Returns the compressed length, or -1 if it is more than outMax.
+ */
+static int LZ_Compress(const uchar_t *in, uchar_t *out, int outMax)
+{
+    int ip = 0, anchor = 0, op = 0;
+
+    memset(s_lzHash, 0, sizeof(s_lzHash));
+
+    while (ip <= PAGE_SIZE - LZ_MIN_MATCH) {
+        ulong_t v = Read32(in + ip);
+        ulong_t h = (v * 2654435761UL) >> (32 - LZ_HASH_BITS);
+        int ref = (int) s_lzHash[h] - 1;
+        int len = LZ_MIN_MATCH;
+
+        s_lzHash[h] = ip + 1;
+        if (ref < 0 || Read32(in + ref) != v) {
+            ++ip;
+            continue;
+        }
+
+        while (ip + len < PAGE_SIZE && in[ref + len] == in[ip + len])
+            ++len;
+        op = LZ_Emit(in + anchor, ip - anchor, ip - ref, len, out, op, outMax);
+        if (op < 0)
+            return -1;
+        ip += len;
+        anchor = ip;
+    }
+
+    return LZ_Emit(in + anchor, PAGE_SIZE - anchor, 0, 0, out, op, outMax);
+}
+
+/*
+ * Decompress a page.
+ * Returns false if the data is damaged.
+ */
+static bool LZ_Decompress(const uchar_t *in, int inLen, uchar_t *out)
+{
+    int ip = 0, op = 0;
+
+    while (op < PAGE_SIZE) {
+        ulong_t token, n, offset;
+
+        if (ip >= inLen)
+            return false;
+        token = in[ip++];
+
+        /* Literals */
+        n = token >> 4;
+        if (n == 15 && !LZ_Get_Length(in, &ip, inLen, &n))
+            return false;
+        if (ip + n > inLen || op + n > PAGE_SIZE)
+            return false;
+        memcpy(out + op, in + ip, n);
+        ip += n;
+        op += n;
+        if (op == PAGE_SIZE)
+            break;
+
+        /* Match; it may overlap what it produces, so copy bytewise */
+        if (ip + 2 > inLen)
+            return false;
+        offset = in[ip] | (in[ip + 1] << 8);
+        ip += 2;
+        n = token & 15;
+        if (n == 15 && !LZ_Get_Length(in, &ip, inLen, &n))
+            return false;
+        n += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || op + n > PAGE_SIZE)
+            return false;
+        while (n-- > 0) {
+            out[op] = out[op - offset];
+            ++op;
+        }
+    }
+
+    return true;
+}
+
+/* ----------------------------------------------------------------------
+ * Pool management
+ * ---------------------------------------------------------------------- */
+
+static __inline__ ulong_t Chunk_Mask(int first, int numChunks)
+{
+    return (numChunks == 32 ? ~0UL : ((1UL << numChunks) - 1)) << first;
+}
+
+/*
+ * Find a run of free chunks in the pool and mark it used.
+ * Returns false if the pool is too full.
+ */
+static bool Alloc_Chunks(int numChunks, struct Swap_Cache_Slot *slot)
+{
+    int page, first;
+
+    for (page = 0; page < s_numPoolPages; ++page) {
+        if (s_poolMap[page] == ~0UL)
+            continue;
+        for (first = 0; first + numChunks <= 32; ++first) {
+            ulong_t mask = Chunk_Mask(first, numChunks);
+            if ((s_poolMap[page] & mask) == 0) {
+                s_poolMap[page] |= mask;
+                slot->poolPage = page;
+                slot->firstChunk = first;
+                slot->numChunks = numChunks;
+                g_swapCacheStats.chunksUsed += numChunks;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void Free_Chunks(struct Swap_Cache_Slot *slot)
+{
+    s_poolMap[slot->poolPage] &= ~Chunk_Mask(slot->firstChunk, slot->numChunks);
+    g_swapCacheStats.chunksUsed -= slot->numChunks;
+    slot->poolPage = NO_POOL_PAGE;
+}
+
+/* ----------------------------------------------------------------------
+ * Public functions
+ * ---------------------------------------------------------------------- */
+
+/*
+ * Set up the pool for a paging file with given number of page slots.
+ * Memory is taken now, since the pool is needed exactly when
+ * there are no free pages left.
+ */
+void Init_Swap_Cache(int numSlots)
+{
+    int i;
+
+    if (SWAP_CACHE_PAGES == 0)
+        return;
+
+    s_slots = Malloc(numSlots * sizeof(struct Swap_Cache_Slot));
+    if (s_slots == 0) {
+        Print("No memory for the swap cache\n");
+        return;
+    }
+    for (i = 0; i < numSlots; ++i)
+        s_slots[i].poolPage = NO_POOL_PAGE;
+    s_numSlots = numSlots;
+
+    while (s_numPoolPages < SWAP_CACHE_PAGES &&
+           (s_poolPages[s_numPoolPages] = Alloc_Page()) != 0)
+        ++s_numPoolPages;
+
+    Print("Swap cache: %d pages\n", s_numPoolPages);
+}
+
+/*
+ * Extend the slot table to cover a paging device registered after
+ * Init_Swap_Cache().  Without memory for the bigger table, the new
+ * device's slots just aren't cached.
+ */
+void Grow_Swap_Cache(int numSlots)
+{
+    struct Swap_Cache_Slot *slots, *oldSlots;
+    int i;
+
+    if (s_slots == 0 || numSlots <= s_numSlots)
+        return;
+
+    slots = Malloc(numSlots * sizeof(struct Swap_Cache_Slot));
+    if (slots == 0) {
+        Print("No memory to grow the swap cache\n");
+        return;
+    }
+
+    Disable_Preemption();
+    oldSlots = s_slots;
+    memcpy(slots, oldSlots, s_numSlots * sizeof(struct Swap_Cache_Slot));
+    for (i = s_numSlots; i < numSlots; ++i)
+        slots[i].poolPage = NO_POOL_PAGE;
+    s_slots = slots;
+    s_numSlots = numSlots;
+    Enable_Preemption();
+
+    Free(oldSlots);
+}
+
+/*
+ * Try to keep an evicted page in the pool, instead of writing it
+ * to given slot of the paging file.  The page must be locked.
+ * Returns true if the page was stored.
+ */
+bool Swap_Cache_Store(void *paddr, int pagefileIndex)
+{
+    struct Swap_Cache_Slot *slot;
+    int length;
+    bool stored = false;
+
+    /* Grow_Swap_Cache() may move the table, so look the slot up inside */
+    Disable_Preemption();
+
+    if (pagefileIndex >= s_numSlots) {
+        Enable_Preemption();
+        return false;
+    }
+    slot = &s_slots[pagefileIndex];
+    KASSERT(slot->poolPage == NO_POOL_PAGE);
+
+    length = LZ_Compress(paddr, s_lzBuffer, MAX_COMPRESSED);
+    if (length > 0 && Alloc_Chunks((length + CHUNK_SIZE - 1) / CHUNK_SIZE, slot)) {
+        memcpy(s_poolPages[slot->poolPage] + slot->firstChunk * CHUNK_SIZE, s_lzBuffer, length);
+        slot->length = length;
+        ++g_swapCacheStats.stores;
+        g_swapCacheStats.bytesIn += PAGE_SIZE;
+        g_swapCacheStats.bytesOut += length;
+        stored = true;
+    } else {
+        ++g_swapCacheStats.rejects;
+    }
+
+    Enable_Preemption();
+
+    return stored;
+}
+
+/*
+ * Bring back the page kept for given paging file slot, if it is
+ * in the pool.  It stays there until the slot is freed.
+ * Returns true if the page was found.
+ */
+bool Swap_Cache_Load(void *paddr, int pagefileIndex)
+{
+    struct Swap_Cache_Slot *slot;
+    bool found = false;
+
+    Disable_Preemption();
+
+    slot = pagefileIndex < s_numSlots ? &s_slots[pagefileIndex] : 0;
+    if (slot != 0 && slot->poolPage != NO_POOL_PAGE) {
+        /* The page is nowhere else, so there is no recovering from this */
+        if (!LZ_Decompress(s_poolPages[slot->poolPage] + slot->firstChunk * CHUNK_SIZE,
+                slot->length, paddr))
+            Panic("Swap cache entry %d is corrupt\n", pagefileIndex);
+        ++g_swapCacheStats.hits;
+        found = true;
+    } else {
+        ++g_swapCacheStats.misses;
+    }
+
+    Enable_Preemption();
+
+    return found;
+}
+
+/*
+ * Forget the page kept for given paging file slot, if any.
+ * Called when the slot is freed.
+ */
+void Swap_Cache_Drop(int pagefileIndex)
+{
+    Disable_Preemption();
+    if (pagefileIndex < s_numSlots && s_slots[pagefileIndex].poolPage != NO_POOL_PAGE)
+        Free_Chunks(&s_slots[pagefileIndex]);
+    Enable_Preemption();
+}
+
+/*
+ * Print the counters.
+ */
+void Dump_Swap_Cache_Stats(void)
+{
+    struct Swap_Cache_Stats stats = g_swapCacheStats;
+    ulong_t lookups = stats.hits + stats.misses;
+
+    Print("swap cache: %d pages, %lu/%d chunks used\n", s_numPoolPages,
+        stats.chunksUsed, s_numPoolPages * 32);
+    Print("  stored %lu, rejected %lu", stats.stores, stats.rejects);
+    if (stats.bytesOut > 0)
+        Print(", compression %lu.%02lux", stats.bytesIn / stats.bytesOut,
+            (stats.bytesIn % stats.bytesOut) * 100 / stats.bytesOut);
+    Print("\n  hits %lu, misses %lu", stats.hits, stats.misses);
+    if (lookups > 0)
+        Print(", hit rate %lu%%", stats.hits * 100 / lookups);
+    Print("\n");
+}
@@ -13,6 +13,8 @@
 #include <geekos/screen.h>
 #include <geekos/synch.h>
 #include <geekos/string.h>
+#include <geekos/timer.h>
+#include <geekos/errno.h>
 
 int debugSyn = 1;
 #define Debug(args...) if (debugSyn) Print("Synch:"args)
@@ -37,17 +39,19 @@ struct Semaphore g_allSemaphores[MAX_SEMAPHORE_NUM];
 /*
  * The mutex is currently locked.
  * Atomically reenable preemption and wait in the
- * mutex's wait queue.
+ * mutex's wait queue, for at most given number of ticks
+ * (negative waits forever).
  */
-static void Mutex_Wait(struct Mutex *mutex)
+static void Mutex_Wait(struct Mutex *mutex, int ticks)
 {
     KASSERT(mutex->state == MUTEX_LOCKED);
-    KASSERT(g_preemptionDisabled);
+    /* Sleeping is only allowed with the mutex code's own Disable_Preemption(). */
+    KASSERT(g_preemptCount == 1);
 
     Disable_Interrupts();
-    g_preemptionDisabled = false;
-    Wait(&mutex->waitQueue);
-    g_preemptionDisabled = true;
+    g_preemptCount = 0;
+    Wait_Timeout(&mutex->waitQueue, ticks);
+    Disable_Preemption();
     Enable_Interrupts();
 }
 
@@ -57,7 +61,7 @@ static void Mutex_Wait(struct Mutex *mutex)
  */
 static __inline__ void Mutex_Lock_Imp(struct Mutex* mutex)
 {
-    KASSERT(g_preemptionDisabled);
+    KASSERT(g_preemptCount > 0);
 
     /* Make sure we're not already holding the mutex */
     KASSERT(!IS_HELD(mutex));
@@ -65,7 +69,7 @@ static __inline__ void Mutex_Lock_Imp(struct Mutex* mutex)
     /* Wait until the mutex is in an unlocked state */
     while (mutex->state == MUTEX_LOCKED) {
         Debug("Waiting for mutex\n");
-	    Mutex_Wait(mutex);
+	    Mutex_Wait(mutex, -1);
     }
 
     /* Now it's ours! */
@@ -79,7 +83,7 @@ static __inline__ void Mutex_Lock_Imp(struct Mutex* mutex)
  */
 static __inline__ void Mutex_Unlock_Imp(struct Mutex* mutex)
 {
-    KASSERT(g_preemptionDisabled);
+    KASSERT(g_preemptCount > 0);
 
     /* Make sure mutex was actually acquired by this thread. */
     KASSERT(IS_HELD(mutex));
@@ -118,6 +122,7 @@ static __inline__ int Find_Available_Semaphore(void) {
         }
     }
     KASSERT(false);
+    return -1;
 }
 
 /**
@@ -158,9 +163,41 @@ void Mutex_Init(struct Mutex* mutex)
 void Mutex_Lock(struct Mutex* mutex)
 {
     KASSERT(Interrupts_Enabled());
-    g_preemptionDisabled = true;
+    Disable_Preemption();
     Mutex_Lock_Imp(mutex);
-    g_preemptionDisabled = false;
+    Enable_Preemption();
+}
+
+/*
+ * Lock given mutex, giving up after given number of timer ticks
+ * (negative waits forever).
+ * Returns true if the mutex was locked, false on timeout.
+ */
+bool Mutex_Lock_Timeout(struct Mutex* mutex, int ticks)
+{
+    ulong_t deadline = g_numTicks + ticks;
+    bool locked = true;
+
+    KASSERT(Interrupts_Enabled());
+    Disable_Preemption();
+    KASSERT(!IS_HELD(mutex));
+
+    while (mutex->state == MUTEX_LOCKED) {
+        int remaining = (int) (deadline - g_numTicks);
+
+        if (ticks >= 0 && remaining <= 0) {
+            locked = false;
+            break;
+        }
+        Mutex_Wait(mutex, ticks < 0 ? -1 : remaining);
+    }
+
+    if (locked) {
+        mutex->state = MUTEX_LOCKED;
+        mutex->owner = g_currentThread;
+    }
+    Enable_Preemption();
+    return locked;
 }
 
 /*
@@ -170,9 +207,9 @@ void Mutex_Unlock(struct Mutex* mutex)
 {
     KASSERT(Interrupts_Enabled());
 
-    g_preemptionDisabled = true;
+    Disable_Preemption();
     Mutex_Unlock_Imp(mutex);
-    g_preemptionDisabled = false;
+    Enable_Preemption();
 }
 
 /*
@@ -194,7 +231,7 @@ void Cond_Wait(struct Condition* cond, struct Mutex* mutex)
     KASSERT(IS_HELD(mutex));
 
     /* Turn off scheduling. */
-    g_preemptionDisabled = true;
+    Disable_Preemption();
 
     /*
      * Release the mutex, but leave preemption disabled.
@@ -211,17 +248,48 @@ void Cond_Wait(struct Condition* cond, struct Mutex* mutex)
      * to wake up this thread.
      * On wakeup, disable preemption again.
      */
+    KASSERT(g_preemptCount == 1);
     Disable_Interrupts();
-    g_preemptionDisabled = false;
+    g_preemptCount = 0;
     Wait(&cond->waitQueue);
-    g_preemptionDisabled = true;
+    Disable_Preemption();
     Enable_Interrupts();
 
     /* Reacquire the mutex. */
     Mutex_Lock_Imp(mutex);
 
     /* Turn scheduling back on. */
-    g_preemptionDisabled = false;
+    Enable_Preemption();
+}
+
+/*
+ * Wait on given condition (protected by given mutex), for at most
+ * given number of timer ticks.  The mutex is held again on return
+ * either way.
+ * Returns true if signaled, false on timeout.
+ */
+bool Cond_Timed_Wait(struct Condition* cond, struct Mutex* mutex, int ticks)
+{
+    bool signaled;
+
+    KASSERT(Interrupts_Enabled());
+    KASSERT(IS_HELD(mutex));
+
+    /* Same dance as Cond_Wait() */
+    Disable_Preemption();
+    Mutex_Unlock_Imp(mutex);
+
+    KASSERT(g_preemptCount == 1);
+    Disable_Interrupts();
+    g_preemptCount = 0;
+    signaled = Wait_Timeout(&cond->waitQueue, ticks);
+    Disable_Preemption();
+    Enable_Interrupts();
+
+    Mutex_Lock_Imp(mutex);
+    Enable_Preemption();
+
+    return signaled;
 }
 
 /*
@@ -286,12 +354,22 @@ int Init_Semaphore(char *name, uchar_t nameLen, int resource) {
  * Returns 0 when successed, -1 when no such semaphore
  */
 int Semaphore_Acquire(uint_t id) {
+    return Semaphore_Acquire_Timeout(id, -1);
+}
+
+/**
+ * Like Semaphore_Acquire, but gives up after ticks timer ticks
+ * (negative waits forever).  Returns ETIMEDOUT if it gave up.
+ */
+int Semaphore_Acquire_Timeout(uint_t id, int ticks) {
     if (id >= MAX_SEMAPHORE_NUM) {
         return -1;
     }
 
     struct Semaphore *target = &g_allSemaphores[id];
     bool intEnable = Interrupts_Enabled();
+    ulong_t deadline = g_numTicks + ticks;
+    int rc = 0;
 
     if (!target->available) {
         return -1;
@@ -301,14 +379,26 @@ int Semaphore_Acquire(uint_t id) {
         Disable_Interrupts();
     }
     while (target->resource <= 0) {
-        Wait(&target->waitQueue);
+        int remaining = (int) (deadline - g_numTicks);
+
+        if (Exit_Requested()) {
+            rc = EINTR;
+            break;
+        }
+        if (ticks >= 0 && remaining <= 0) {
+            rc = ETIMEDOUT;
+            break;
+        }
+        Wait_Timeout(&target->waitQueue, ticks < 0 ? -1 : remaining);
+    }
+    if (rc == 0) {
+        --target->resource;
     }
-    --target->resource;
     if (intEnable) {
         Enable_Interrupts();
     }
 
-    return 0;
+    return rc;
 }
 
 /**
@@ -21,6 +21,10 @@
 #include <geekos/timer.h>
 #include <geekos/vfs.h>
 #include <geekos/synch.h>
+#include <geekos/ioring.h>
+#include <geekos/pipefs.h>
+#include <geekos/poll.h>
+#include <geekos/thrash.h>
 
 // Dispatcher for code reusage
 static int Do_Open_File(struct Interrupt_State* state, bool isDir) {
@@ -31,15 +35,13 @@ static int Do_Open_File(struct Interrupt_State* state, bool isDir) {
     struct File *file = 0;
     struct User_Context *context = g_currentThread->userContext;
 
-    if (context->numOpenedFiles >= USER_MAX_FILES) return EMFILE;
-    
     if (pathLen == 0) return EINVALID;
 
     path = Malloc(pathLen + 1);
     if (path == 0) return ENOMEM;
     if (!Copy_From_User(path, pathUserAddr, pathLen)) {
-        rc = -1;
         Free(path);
+        return EINVALID;
     }
     path[pathLen] = 0;
 
@@ -54,15 +56,14 @@ static int Do_Open_File(struct Interrupt_State* state, bool isDir) {
     Free(path);
     if (rc != 0) return rc;
 
-    for (int i = 0; i < USER_MAX_FILES; ++i) {
-        if (context->fdTable[i] == 0) {
-            context->fdTable[i] = file;
-            ++context->numOpenedFiles;
-            break;
-        }
+    rc = Alloc_File_Descriptor(context, file);
+    if (rc < 0) {
+        Enable_Interrupts();
+        Close(file);
+        Disable_Interrupts();
     }
 
-    return 0;
+    return rc;
 }
 
 /*
@@ -92,6 +93,18 @@ static int Sys_Exit(struct Interrupt_State* state)
 {
     // TODO("Exit system call");
 
+    struct User_Context *userContext = g_currentThread->userContext;
+
+    /*
+     * Take the other threads of the process down with us: they exit
+     * on their way back to user mode, and sleeping ones are woken.
+     */
+    userContext->exitCode = state->ebx;
+    userContext->exiting = true;
+    Interrupt_Process_Threads(userContext);
+    if (userContext->suspended)
+        Resume_Process(userContext);
+
     Exit(state->ebx);
 
     KASSERT(false);
@@ -283,14 +296,12 @@ static int Sys_SetSchedulingPolicy(struct Interrupt_State* state)
 
     uint_t policy = state->ebx, quantum = state->ecx;
 
-    if (policy != SCHEDULING_RR && policy != SCHEDULING_MLFQ) {
+    if (policy != SCHEDULING_RR && policy != SCHEDULING_MLFQ &&
+        policy != SCHEDULING_STRIDE) {
         return -1;
     }
 
-    if (policy != g_schedulingPolicy) {
-        Move_Threads_To_0_Except_Idle();
-        g_schedulingPolicy = policy;
-    }
+    Change_Scheduling_Policy(policy);
 
     g_Quantum = quantum;
 
@@ -493,26 +504,7 @@ static int Sys_OpenDirectory(struct Interrupt_State *state)
  */
 static int Sys_Close(struct Interrupt_State *state)
 {
-    int rc = 0;
-    ulong_t fd = state->ebx;
-    struct User_Context *context = g_currentThread->userContext;
-    struct File *file = 0;
-
-    if (fd > USER_MAX_FILES) return ENOTFOUND;
-
-    file = context->fdTable[fd];
-    if (file == 0) return -1;
-
-    Enable_Interrupts();
-    rc = Close(file);
-    Disable_Interrupts();
-
-    if (rc == 0) {
-        context->fdTable[fd] = 0;
-        --context->numOpenedFiles;
-    }
-
-    return rc;
+    return Close_File_Descriptor(g_currentThread->userContext, state->ebx);
 }
 
 /*
@@ -567,17 +559,19 @@ static int Sys_Read(struct Interrupt_State *state)
     void *buf = 0;
     struct File *file = 0;
 
-    if (fd > USER_MAX_FILES) return ENOTFOUND;
-
-    file = g_currentThread->userContext->fdTable[fd];
-    if (file == 0) return -1;
-
     buf = Malloc(numBytes);
     if (buf == 0) return ENOMEM;
 
+    file = Hold_File_Descriptor(g_currentThread->userContext, fd);
+    if (file == 0) {
+        Free(buf);
+        return ENOTFOUND;
+    }
+
     Enable_Interrupts();
     rc = Read(file, buf, numBytes);
     Disable_Interrupts();
+    Put_File(file);
     if (rc < 0) {
         Free(buf);
         return rc;
@@ -606,14 +600,13 @@ static int Sys_ReadEntry(struct Interrupt_State *state)
     struct VFS_Dir_Entry vfsEntry;
     struct File *file = 0;
 
-    if (fd > USER_MAX_FILES) return ENOTFOUND;
-
-    file = g_currentThread->userContext->fdTable[fd];
-    if (file == 0) return -1;
+    file = Hold_File_Descriptor(g_currentThread->userContext, fd);
+    if (file == 0) return ENOTFOUND;
 
     Enable_Interrupts();
     rc = Read_Entry(file, &vfsEntry);
     Disable_Interrupts();
+    Put_File(file);
     if (rc == ENOTFOUND) return 1; // Gives a stop signal
     if (rc != 0) return rc;
 
@@ -641,11 +634,6 @@ static int Sys_Write(struct Interrupt_State *state)
     void *buf = 0;
     struct File *file = 0;
 
-    if (fd > USER_MAX_FILES) return ENOTFOUND;
-
-    file = g_currentThread->userContext->fdTable[fd];
-    if (file == 0) return -1;
-
     buf = Malloc(numBytes);
     if (buf == 0) return ENOMEM;
 
@@ -654,9 +642,16 @@ static int Sys_Write(struct Interrupt_State *state)
         return -1;
     }
 
+    file = Hold_File_Descriptor(g_currentThread->userContext, fd);
+    if (file == 0) {
+        Free(buf);
+        return ENOTFOUND;
+    }
+
     Enable_Interrupts();
     rc = Write(file, buf, numBytes);
     Disable_Interrupts();
+    Put_File(file);
 
     Free(buf);
     return rc;
@@ -713,12 +708,15 @@ static int Sys_FStat(struct Interrupt_State *state)
     int rc = 0;
     ulong_t fd = state->ebx, vfsStatUserAddr = state->ecx;
     struct VFS_File_Stat vfsStat;
+    struct File *file = 0;
 
-    if (fd > USER_MAX_FILES) return ENOTFOUND;
+    file = Hold_File_Descriptor(g_currentThread->userContext, fd);
+    if (file == 0) return ENOTFOUND;
 
     Enable_Interrupts();
-    rc = FStat(g_currentThread->userContext->fdTable[fd], &vfsStat);
+    rc = FStat(file, &vfsStat);
     Disable_Interrupts();
+    Put_File(file);
     if (rc != 0) return rc;
 
     if (!Copy_To_User(vfsStatUserAddr, &vfsStat, sizeof(struct VFS_File_Stat)))
@@ -740,14 +738,13 @@ static int Sys_Seek(struct Interrupt_State *state)
     ulong_t fd = state->ebx, pos = state->ecx;
     struct File *file = 0;
 
-    if (fd > USER_MAX_FILES) return ENOTFOUND;
-
-    file = g_currentThread->userContext->fdTable[fd];
-    if (file == 0) return -1;
+    file = Hold_File_Descriptor(g_currentThread->userContext, fd);
+    if (file == 0) return ENOTFOUND;
 
     Enable_Interrupts();
     rc = Seek(file, pos);
     Disable_Interrupts();
+    Put_File(file);
 
     return rc;
 }
@@ -849,6 +846,432 @@ cleanup:
     return rc;
 }
 
+/*
+ * Duplicate a file descriptor.
+ * Params:
+ *   state->ebx - open file descriptor
+ *   state->ecx - descriptor to make refer to the same file;
+ *     closed first if it is open
+ *
+ * Returns: the new descriptor if successful,
+ *   error code (< 0) if unsuccessful
+ */
+static int Sys_Dup2(struct Interrupt_State *state)
+{
+    return Dup_File_Descriptor(g_currentThread->userContext, state->ebx, state->ecx);
+}
+
+/*
+ * Map part of a file into memory.
+ * Params:
+ *   state->ebx - open file descriptor
+ *   state->ecx - file offset, page aligned
+ *   state->edx - number of bytes to map
+ *   state->esi - protection flags (PROT_READ, PROT_WRITE)
+ *
+ * Returns: user address of the mapping if successful,
+ *   error code (< 0) if unsuccessful
+ */
+static int Sys_Mmap(struct Interrupt_State *state)
+{
+    struct File *file = Get_File_Descriptor(g_currentThread->userContext, state->ebx);
+
+    if (file == 0)
+        return ENOTFOUND;
+    return Mmap_File(g_currentThread->userContext, file, state->ecx, state->edx, state->esi);
+}
+
+/*
+ * Remove a memory mapping, writing back modified pages.
+ * Params:
+ *   state->ebx - address of the mapping
+ *   state->ecx - length of the mapping
+ *
+ * Returns: 0 if successful, error code (< 0) if unsuccessful
+ */
+static int Sys_Munmap(struct Interrupt_State *state)
+{
+    return Munmap_File(g_currentThread->userContext, state->ebx, state->ecx);
+}
+
+/*
+ * Write back buffered data of a file, including changes
+ * made through writable memory mappings.
+ * Params:
+ *   state->ebx - open file descriptor
+ *
+ * Returns: 0 if successful, error code (< 0) if unsuccessful
+ */
+static int Sys_Fsync(struct Interrupt_State *state)
+{
+    int rc;
+    struct File *file = Hold_File_Descriptor(g_currentThread->userContext, state->ebx);
+
+    if (file == 0)
+        return ENOTFOUND;
+
+    Sync_Mapped_File(g_currentThread->userContext, file);
+
+    Enable_Interrupts();
+    rc = Fsync(file);
+    Disable_Interrupts();
+    Put_File(file);
+
+    return rc;
+}
+
+/*
+ * Grow or shrink the heap of the current process.
+ * Params:
+ *   state->ebx - number of bytes to add to the heap (negative to shrink it)
+ *
+ * Returns: the previous end of the heap if successful,
+ *   error code (< 0) if unsuccessful
+ */
+static int Sys_Sbrk(struct Interrupt_State *state)
+{
+    return Change_Heap_Break(g_currentThread->userContext, (int) state->ebx);
+}
+
+/*
+ * Map zero-filled memory.  Remove it with Sys_Munmap.
+ * Params:
+ *   state->ebx - number of bytes to map
+ *
+ * Returns: user address of the mapping if successful,
+ *   error code (< 0) if unsuccessful
+ */
+static int Sys_MapAnonymous(struct Interrupt_State *state)
+{
+    return Map_Anonymous_Region(g_currentThread->userContext, state->ebx);
+}
+
+/*
+ * Start another thread in the current process.
+ * It shares the address space and open files of the caller,
+ * and starts running entry(arg) on the given stack.
+ * Params:
+ *   state->ebx - user address of the thread's entry function
+ *   state->ecx - user address of the top of the thread's stack
+ *   state->edx - argument passed to the entry function
+ *
+ * Returns: the thread id (a pid) of the new thread if successful,
+ *   error code (< 0) if unsuccessful
+ */
+static int Sys_CreateThread(struct Interrupt_State *state)
+{
+    struct User_Context *userContext = g_currentThread->userContext;
+    struct Kernel_Thread *kthread;
+    ulong_t stackTop = state->ecx & ~3UL;
+    ulong_t frame[2];
+
+    if (stackTop < PAGE_SIZE || stackTop > userContext->stackPointerAddr)
+        return EINVALID;
+
+    /*
+     * Make it look like entry was called with arg;
+     * the return address is null, so returning from entry
+     * faults.  The C library starts threads through a function
+     * that calls Exit_Thread() when entry returns.
+     */
+    frame[0] = 0;
+    frame[1] = state->edx;
+    stackTop -= sizeof(frame);
+    if (!Copy_To_User(stackTop, frame, sizeof(frame)))
+        return EINVALID;
+
+    kthread = Start_User_Thread_At(userContext, state->ebx, stackTop, false);
+    if (kthread == 0)
+        return ENOMEM;
+
+    /* The join reference belongs to the process, not to the creator */
+    kthread->owner = 0;
+    kthread->joinContext = userContext;
+
+    return kthread->pid;
+}
+
+/*
+ * Wait for a thread created with Sys_CreateThread to exit.
+ * Any thread of the process may join it, once.  Threads nobody
+ * joins are cleaned up when the process goes away.
+ * Params:
+ *   state->ebx - id of the thread to wait for
+ *
+ * Returns: the exit code of the thread,
+ *   or error code (< 0) on error
+ */
+static int Sys_JoinThread(struct Interrupt_State *state)
+{
+    return Join_User_Thread(state->ebx);
+}
+
+/*
+ * Terminate the calling thread only; the rest of the process
+ * keeps running.
+ * Params:
+ *   state->ebx - thread exit code
+ * Returns:
+ *   Never returns to user mode!
+ */
+static int Sys_ExitThread(struct Interrupt_State *state)
+{
+    Exit(state->ebx);
+
+    KASSERT(false);
+}
+
+/*
+ * Register a submission/completion ring for batched file I/O.
+ * Params:
+ *   state->ebx - user address of the ring (see <geekos/ioring.h>)
+ *   state->ecx - number of entries in each half of the ring
+ *
+ * Returns: 0 if successful, error code (< 0) if unsuccessful
+ */
+static int Sys_IORingSetup(struct Interrupt_State *state)
+{
+    return Setup_IO_Ring(g_currentThread->userContext, state->ebx, state->ecx);
+}
+
+/*
+ * Submit the operations queued in the I/O ring, and optionally
+ * wait for completions.
+ * Params:
+ *   state->ebx - number of completions to wait for
+ *
+ * Returns: number of completions waiting to be looked at,
+ *   or error code (< 0) if unsuccessful
+ */
+static int Sys_IORingEnter(struct Interrupt_State *state)
+{
+    return Enter_IO_Ring(g_currentThread->userContext, state->ebx);
+}
+
+/*
+ * Create a pipe.
+ * Params:
+ *   state->ebx - user address of int to store the read end's descriptor in
+ *   state->ecx - user address of int to store the write end's descriptor in
+ *
+ * Returns: 0 if successful, error code (< 0) if unsuccessful
+ */
+static int Sys_CreatePipe(struct Interrupt_State *state)
+{
+    struct User_Context *context = g_currentThread->userContext;
+    struct File *read = 0, *write = 0;
+    int readFd = -1, writeFd = -1;
+    int rc;
+
+    Enable_Interrupts();
+    rc = Create_Pipe(&read, &write);
+    Disable_Interrupts();
+    if (rc != 0)
+        return rc;
+
+    if ((readFd = Alloc_File_Descriptor(context, read)) < 0) {
+        rc = readFd;
+        goto fail;
+    }
+    read = 0;
+    if ((writeFd = Alloc_File_Descriptor(context, write)) < 0) {
+        rc = writeFd;
+        goto fail;
+    }
+    write = 0;
+
+    if (!Copy_To_User(state->ebx, &readFd, sizeof(int)) ||
+        !Copy_To_User(state->ecx, &writeFd, sizeof(int))) {
+        rc = EINVALID;
+        goto fail;
+    }
+    return 0;
+
+fail:
+    if (readFd >= 0)
+        Close_File_Descriptor(context, readFd);
+    if (writeFd >= 0)
+        Close_File_Descriptor(context, writeFd);
+    Enable_Interrupts();
+    if (read != 0)
+        Close(read);
+    if (write != 0)
+        Close(write);
+    Disable_Interrupts();
+    return rc;
+}
+
+/*
+ * Wait until one of several file descriptors is ready for I/O.
+ * Params:
+ *   state->ebx - user address of array of struct Poll_Fd
+ *   state->ecx - number of elements in the array
+ *   state->edx - timeout in timer ticks; negative waits forever
+ *
+ * Returns: number of descriptors with events reported in their
+ *   revents field (0 on timeout), or error code (< 0) if unsuccessful
+ */
+static int Sys_Poll(struct Interrupt_State *state)
+{
+    struct Poll_Fd *fds = 0;
+    int numFds = state->ecx;
+    int rc;
+
+    if (numFds < 0 || numFds > POLL_MAX_FDS)
+        return EINVALID;
+
+    /* With no descriptors, Poll just sleeps for the timeout */
+    if (numFds > 0) {
+        fds = Malloc(numFds * sizeof(struct Poll_Fd));
+        if (fds == 0)
+            return ENOMEM;
+        if (!Copy_From_User(fds, state->ebx, numFds * sizeof(struct Poll_Fd))) {
+            Free(fds);
+            return EINVALID;
+        }
+    }
+
+    rc = Poll_Files(g_currentThread->userContext, fds, numFds, (int) state->edx);
+    if (rc >= 0 && numFds > 0 &&
+        !Copy_To_User(state->ebx, fds, numFds * sizeof(struct Poll_Fd)))
+        rc = EINVALID;
+
+    if (fds != 0)
+        Free(fds);
+    return rc;
+}
+
+/*
+ * Acquire a semaphore, giving up after a while.
+ * Params:
+ *   state->ebx - the semaphore id
+ *   state->ecx - timeout in timer ticks; negative waits forever
+ *
+ * Returns: 0 if successful, ETIMEDOUT if the time ran out,
+ *   or other error code (< 0) if unsuccessful
+ */
+static int Sys_PTimeout(struct Interrupt_State* state)
+{
+    return Semaphore_Acquire_Timeout(state->ebx, (int) state->ecx);
+}
+
+/*
+ * Wait for another process to exit, giving up after a while.
+ * Params:
+ *   state->ebx - pid of process to wait for
+ *   state->ecx - timeout in timer ticks; negative waits forever
+ *
+ * Returns: the exit code of the process, ETIMEDOUT if it is
+ *   still running, or other error code (< 0) on error
+ */
+static int Sys_WaitTimeout(struct Interrupt_State* state)
+{
+    struct Kernel_Thread *kthread = Lookup_Thread(state->ebx);
+    int exitCode = 0;
+    bool exited;
+
+    if (kthread == 0)
+        return EUNSPECIFIED;
+
+    Enable_Interrupts();
+    exited = Join_Timeout(kthread, (int) state->ecx, &exitCode);
+    Disable_Interrupts();
+
+    return exited ? exitCode : ETIMEDOUT;
+}
+
+/*
+ * Set the CPU share of a process under stride scheduling.
+ * The weight is shared out among the threads of the process.
+ * Params:
+ *   state->ebx - pid of process (0 for the calling process);
+ *     other than the caller, it must be a child of the caller
+ *   state->ecx - weight, from MIN_WEIGHT to MAX_WEIGHT
+ *
+ * Returns: 0 if successful, error code (< 0) otherwise
+ */
+static int Sys_SetWeight(struct Interrupt_State* state)
+{
+    struct Kernel_Thread *kthread = g_currentThread;
+
+    if (state->ebx != 0 && (int) state->ebx != g_currentThread->pid) {
+        kthread = Lookup_Thread(state->ebx);
+        if (kthread == 0)
+            return EUNSPECIFIED;
+    }
+
+    return Set_Thread_Weight(kthread, (int) state->ecx);
+}
+
+/*
+ * Read the kernel log.
+ * Params:
+ *   state->ebx - user buffer
+ *   state->ecx - size of buffer; the log holds at most KLOG_SIZE bytes
+ *
+ * Returns: number of bytes read (the most recent part of the log),
+ *   or error code (< 0)
+ */
+static int Sys_ReadKLog(struct Interrupt_State* state)
+{
+    ulong_t size = state->ecx < KLOG_SIZE ? state->ecx : KLOG_SIZE;
+    char *buf;
+    int numBytes;
+
+    if (size == 0)
+        return 0;
+    buf = Malloc(size);
+    if (buf == 0)
+        return ENOMEM;
+
+    numBytes = Read_Kernel_Log(buf, size);
+    if (!Copy_To_User(state->ebx, buf, numBytes))
+        numBytes = EINVALID;
+    Free(buf);
+    return numBytes;
+}
+
+/*
+ * Open the console as a file, which can be polled.
+ * Reading it returns Keycodes; writing it prints.
+ * Params: none
+ *
+ * Returns: file descriptor, or error code (< 0) if unsuccessful
+ */
+static int Sys_OpenConsole(struct Interrupt_State* state)
+{
+    struct User_Context *context = g_currentThread->userContext;
+    struct File *file;
+    int rc;
+
+    Enable_Interrupts();
+    rc = Open_Console(&file);
+    Disable_Interrupts();
+    if (rc != 0)
+        return rc;
+
+    rc = Alloc_File_Descriptor(context, file);
+    if (rc < 0) {
+        Enable_Interrupts();
+        Close(file);
+        Disable_Interrupts();
+    }
+    return rc;
+}
+
+/*
+ * Give up the CPU to another runnable thread, if there is one.
+ * Params: none
+ *
+ * Returns: 0
+ */
+static int Sys_Yield(struct Interrupt_State* state)
+{
+    Enable_Interrupts();
+    Yield();
+    Disable_Interrupts();
+    return 0;
+}
 
 /*
  * Global table of system call handler functions.
@@ -886,6 +1309,25 @@ const Syscall g_syscallTable[] = {
     Sys_CreateDir,
     Sys_Sync,
     Sys_Format,
+    Sys_Dup2,
+    Sys_Mmap,
+    Sys_Munmap,
+    Sys_Fsync,
+    Sys_Sbrk,
+    Sys_MapAnonymous,
+    Sys_CreateThread,
+    Sys_JoinThread,
+    Sys_ExitThread,
+    Sys_IORingSetup,
+    Sys_IORingEnter,
+    Sys_CreatePipe,
+    Sys_Poll,
+    Sys_PTimeout,
+    Sys_WaitTimeout,
+    Sys_SetWeight,
+    Sys_ReadKLog,
+    Sys_OpenConsole,
+    Sys_Yield,
 };
 
 /*
@@ -0,0 +1,252 @@
+/*
+ * Thrashing control
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+/*
+ * Load control by page fault frequency.  Every process counts its
+ * page-ins (faults that had to bring a page back from the paging
+ * file) and the pageable pages it has in memory.  Once per window
+ * a daemon thread looks at the page-in rate of the whole system:
+ *  - above PFF_HIGH_RATE the processes are stealing each other's
+ *    pages faster than they get work done, so the process with the
+ *    lowest priority is suspended and all of its pages are pushed
+ *    out, leaving its memory to the others;
+ *  - at or below PFF_LOW_RATE, once there is as much free memory
+ *    as it had in use, the process suspended longest is resumed.
+ * Threads of a suspended process stop at their next system call,
+ * user page fault, or return to user mode from an interrupt.  A thread
+ * blocked in the kernel keeps going until it gets to one of those
+ * points.
+ */
+
+#include <geekos/kassert.h>
+#include <geekos/int.h>
+#include <geekos/screen.h>
+#include <geekos/kthread.h>
+#include <geekos/timer.h>
+#include <geekos/user.h>
+#include <geekos/ioring.h>
+#include <geekos/thrash.h>
+
+extern uint_t g_freePageCount;
+
+/* Threads of suspended processes */
+static struct Thread_Queue s_suspendedQueue;
+
+/* The daemon sleeps here between samples */
+static struct Thread_Queue s_pffSleepQueue;
+
+/* Page-ins in the current window, and in the last complete one */
+static int s_windowPageIns;
+static int s_faultRate;
+
+static ulong_t s_numSuspends;
+static ulong_t s_numResumes;
+
+/*
+ * Every walk over the list of all threads gets a new stamp, and
+ * marks the user contexts it has seen with it, so that it looks at
+ * each process once without searching the list again.
+ */
+static ulong_t s_visitStamp;
+
+/*
+ * Is this the first thread of its process in the current walk?
+ */
+static bool First_Visit(struct User_Context *context)
+{
+    if (context->visitStamp == s_visitStamp)
+	return false;
+    context->visitStamp = s_visitStamp;
+    return true;
+}
+
+/*
+ * Suspend a process and swap all of its pages out.
+ * Called with interrupts disabled.
+ */
+static void Suspend_Process(struct User_Context *context)
+{
+    int numFreed;
+
+    context->suspended = true;
+    context->suspendTick = g_numTicks;
+    context->suspendedPages = context->residentPages;
+    ++s_numSuspends;
+
+    /* Keep the context around while its pages are written */
+    ++context->refCount;
+    Enable_Interrupts();
+    numFreed = Swap_Out_User_Context(context);
+    Disable_Interrupts();
+
+    /* Nothing could be written out, so suspending it didn't help */
+    if (numFreed == 0 && !context->exiting)
+	Resume_Process(context);
+
+    --context->refCount;
+    if (context->refCount > 0) {
+	/* I/O ring threads quit once they are the only threads left */
+	Kick_IO_Ring(context);
+    } else {
+	Enable_Interrupts();
+	Destroy_User_Context(context);
+	Disable_Interrupts();
+    }
+}
+
+/*
+ * Close a sampling window: work out the fault rates, then
+ * suspend or resume a process if the load calls for it.
+ * Called with interrupts disabled.
+ */
+static void Check_Paging_Load(void)
+{
+    struct Kernel_Thread *kthread;
+    struct User_Context *victim = 0, *oldest = 0;
+    int victimPriority = 0, numActive = 0;
+
+    s_faultRate = s_windowPageIns;
+    s_windowPageIns = 0;
+
+    /*
+     * The priority of a process is that of its most important
+     * thread, by priority level and then by stride weight.
+     */
+    ++s_visitStamp;
+    for (kthread = Get_Next_Thread(0); kthread != 0; kthread = Get_Next_Thread(kthread)) {
+	struct User_Context *context = kthread->userContext;
+	int priority;
+
+	if (context == 0)
+	    continue;
+	if (First_Visit(context))
+	    context->pffPriority = -1;
+	priority = kthread->priority * (MAX_WEIGHT + 1) + kthread->weight;
+	if (priority > context->pffPriority)
+	    context->pffPriority = priority;
+    }
+
+    ++s_visitStamp;
+    for (kthread = Get_Next_Thread(0); kthread != 0; kthread = Get_Next_Thread(kthread)) {
+	struct User_Context *context = kthread->userContext;
+
+	if (context == 0 || context->exiting || !First_Visit(context))
+	    continue;
+	context->faultRate = context->windowPageIns;
+	context->windowPageIns = 0;
+
+	if (context->suspended) {
+	    if (oldest == 0 || context->suspendTick < oldest->suspendTick)
+		oldest = context;
+	} else if (context->residentPages > 0) {
+	    /* Lowest priority first, then the largest resident set */
+	    int priority = context->pffPriority;
+
+	    ++numActive;
+	    if (victim == 0 || priority < victimPriority ||
+		(priority == victimPriority && context->residentPages > victim->residentPages)) {
+		victim = context;
+		victimPriority = priority;
+	    }
+	}
+    }
+
+    /* Always leave one process running */
+    if (s_faultRate > PFF_HIGH_RATE && numActive >= 2)
+	Suspend_Process(victim);
+    else if (oldest != 0 && (numActive == 0 ||
+	     (s_faultRate <= PFF_LOW_RATE && g_freePageCount >= (uint_t) oldest->suspendedPages)))
+	Resume_Process(oldest);
+}
+
+/*
+ * Body of the thrashing control daemon.
+ */
+static void PFF_Daemon(ulong_t arg)
+{
+    Disable_Interrupts();
+    while (true) {
+	Wait_Timeout(&s_pffSleepQueue, PFF_WINDOW_TICKS);
+	Check_Paging_Load();
+    }
+}
+
+/*
+ * Start the thrashing control daemon.
+ */
+void Init_Thrash_Control(void)
+{
+    Start_Kernel_Thread(PFF_Daemon, 0, PRIORITY_HIGH, true);
+}
+
+/*
+ * Count a page brought back in from the paging file.
+ * Called with interrupts disabled.
+ */
+void Note_Page_In(struct User_Context *context)
+{
+    KASSERT(!Interrupts_Enabled());
+
+    ++s_windowPageIns;
+    if (context != 0) {
+	++context->pageIns;
+	++context->windowPageIns;
+    }
+}
+
+/*
+ * Block the current thread for as long as its process is suspended.
+ * Must only be called where the thread holds no locks: on entry to
+ * a system call or a user mode page fault, or on return to user mode.
+ * Called with interrupts disabled.
+ */
+void Wait_While_Suspended(struct User_Context *context)
+{
+    KASSERT(!Interrupts_Enabled());
+
+    while (context->suspended && !context->exiting)
+	Wait(&s_suspendedQueue);
+}
+
+/*
+ * Let a suspended process run again.  Its pages come back in
+ * as it faults on them.
+ * Called with interrupts disabled.
+ */
+void Resume_Process(struct User_Context *context)
+{
+    KASSERT(!Interrupts_Enabled());
+
+    context->suspended = false;
+    ++s_numResumes;
+    Wake_Up(&s_suspendedQueue);
+}
+
+/*
+ * Print the paging load and the resident set and fault rate
+ * of each process.
+ */
+void Dump_Thrash_Stats(void)
+{
+    struct Kernel_Thread *kthread;
+    bool iflag = Begin_Int_Atomic();
+
+    Print("Paging load: %d page-ins/window (high %d, low %d), %lu suspends, %lu resumes\n",
+	s_faultRate, PFF_HIGH_RATE, PFF_LOW_RATE, s_numSuspends, s_numResumes);
+    ++s_visitStamp;
+    for (kthread = Get_Next_Thread(0); kthread != 0; kthread = Get_Next_Thread(kthread)) {
+	struct User_Context *context = kthread->userContext;
+
+	if (context == 0 || !First_Visit(context))
+	    continue;
+	Print("  pid %d: %d pages resident, %d page-ins/window, %lu total%s\n",
+	    kthread->pid, context->residentPages, context->faultRate, context->pageIns,
+	    context->suspended ? ", suspended" : "");
+    }
+
+    End_Int_Atomic(iflag);
+}
@@ -13,14 +13,18 @@
 #include <geekos/int.h>
 #include <geekos/irq.h>
 #include <geekos/kthread.h>
+#include <geekos/softirq.h>
+#include <geekos/trace.h>
 #include <geekos/timer.h>
 
 #define MAX_TIMER_EVENTS	100
 
 static int timerDebug = 0;
-static int timeEventCount;
 static int nextEventID;
-timerEvent pendingTimerEvents[MAX_TIMER_EVENTS];
+
+/* Events waiting to expire, and the pool used by Start_Timer() */
+static struct Timer_Event_List s_pendingTimerEvents;
+static timerEvent s_timerEventPool[MAX_TIMER_EVENTS];
 
 /*
  * Global tick counter
@@ -32,6 +36,13 @@ volatile ulong_t g_numTicks;
  */
 static int s_spinCountPerTick;
 
+/*
+ * TSC cycles per timer tick, taken over the same tick as
+ * s_spinCountPerTick, and the TSC when that tick started.
+ */
+ulong_t g_tscPerTick;
+static ulong_t s_calibrateTSC;
+
 /*
  * Number of ticks to wait before calibrating the delay loop.
  */
@@ -65,9 +76,48 @@ int g_Quantum = DEFAULT_MAX_TICKS;
  * Private functions
  * ---------------------------------------------------------------------- */
 
+/*
+ * Call the callbacks of expired timer events.
+ * Runs as a tasklet, with interrupts enabled; callbacks must
+ * disable interrupts to call Start_Timer() or Cancel_Timer().
+ */
+static void Run_Timer_Callbacks(ulong_t arg)
+{
+    timerEvent *event;
+
+    Disable_Interrupts();
+    event = Get_Front_Of_Timer_Event_List(&s_pendingTimerEvents);
+    while (event != 0) {
+	if (event->ticks == 0) {
+	    int id = event->id;
+	    timerCallback callBack = event->callBack;
+
+	    /*
+	     * Events are one-shot: take it off the list before the
+	     * callback runs, as its storage may be reused from then on.
+	     */
+	    Remove_From_Timer_Event_List(&s_pendingTimerEvents, event);
+	    if (timerDebug) Print("timer: event %d expired (%d ticks)\n",
+	        id, event->origTicks);
+	    Enable_Interrupts();
+	    callBack(id);
+	    Disable_Interrupts();
+
+	    /* The list may have changed meanwhile */
+	    event = Get_Front_Of_Timer_Event_List(&s_pendingTimerEvents);
+	} else {
+	    event = Get_Next_In_Timer_Event_List(event);
+	}
+    }
+    Enable_Interrupts();
+}
+
+static struct Tasklet s_timerTasklet = TASKLET_INITIALIZER(Run_Timer_Callbacks, 0);
+
 static void Timer_Interrupt_Handler(struct Interrupt_State* state)
 {
-    int i;
+    timerEvent *event;
+    bool expired = false;
     struct Kernel_Thread* current = g_currentThread;
 
     Begin_IRQ(state);
@@ -76,16 +126,21 @@ static void Timer_Interrupt_Handler(struct Interrupt_State* state)
     ++g_numTicks;
     ++current->numTicks;
 
-    /* update timer events */
-    for (i=0; i < timeEventCount; i++) {
-	if (pendingTimerEvents[i].ticks == 0) {
-	    if (timerDebug) Print("timer: event %d expired (%d ticks)\n", 
-	        pendingTimerEvents[i].id, pendingTimerEvents[i].origTicks);
-            (pendingTimerEvents[i].callBack)(pendingTimerEvents[i].id);
+    /* Charge the tick to the thread's virtual time */
+    if (g_schedulingPolicy == SCHEDULING_STRIDE)
+        current->pass += current->stride;
+
+    /* update timer events; expired ones are handled by the timer tasklet */
+    for (event = Get_Front_Of_Timer_Event_List(&s_pendingTimerEvents); event != 0;
+         event = Get_Next_In_Timer_Event_List(event)) {
+	if (event->ticks == 0) {
+	    expired = true;
         } else {
-            pendingTimerEvents[i].ticks--;
+            event->ticks--;
         }
     }
+    if (expired)
+	Schedule_Tasklet(&s_timerTasklet);
 
     /*
      * If thread has been running for an entire quantum,
@@ -94,6 +149,7 @@ static void Timer_Interrupt_Handler(struct Interrupt_State* state)
      */
     if (current->numTicks >= g_Quantum) {
         g_needReschedule = true;
+        Trace_Reschedule_Request();
         
         // Simply disable moving between queues :>
         // As this project gives me the ability to add
@@ -124,15 +180,17 @@ static void Timer_Interrupt_Handler(struct Interrupt_State* state)
 static void Timer_Calibrate(struct Interrupt_State* state)
 {
     Begin_IRQ(state);
-    if (g_numTicks < CALIBRATE_NUM_TICKS)
-        ++g_numTicks;
-    else {
+    if (g_numTicks < CALIBRATE_NUM_TICKS) {
+        if (++g_numTicks == CALIBRATE_NUM_TICKS)
+            s_calibrateTSC = Read_TSC();
+    } else {
         /*
         * Now we can look at EAX, which reflects how many times
         * the loop has executed
         */
         /*Print("Timer_Calibrate: eax==%d\n", state->eax);*/
         s_spinCountPerTick = INT_MAX  - state->eax;
+        g_tscPerTick = Read_TSC() - s_calibrateTSC;
         state->eax = 0;  /* make the loop terminate */
     }
     End_IRQ(state);
@@ -226,56 +284,89 @@ void Init_Timer(void)
     Enable_IRQ(TIMER_IRQ);
 }
 
+/*
+ * Start a timer event from the pool.
+ * Returns the event's id, or -1 if all of the pool is in use.
+ */
 int Start_Timer(int ticks, timerCallback cb)
 {
-    int ret;
+    int i;
 
     KASSERT(!Interrupts_Enabled());
 
-    if (timeEventCount == MAX_TIMER_EVENTS) {
-	return -1;
-    } else {
-	ret = nextEventID++;
-	pendingTimerEvents[timeEventCount].id = ret;
-	pendingTimerEvents[timeEventCount].callBack = cb;
-	pendingTimerEvents[timeEventCount].ticks = ticks;
-	pendingTimerEvents[timeEventCount].origTicks = ticks;
-	timeEventCount++;
-
-	return ret;
+    for (i = 0; i < MAX_TIMER_EVENTS; i++) {
+	if (!Is_Member_Of_Timer_Event_List(&s_pendingTimerEvents, &s_timerEventPool[i]))
+	    return Start_Timer_Event(&s_timerEventPool[i], ticks, cb);
     }
+    return -1;
 }
 
-int Get_Remaing_Timer_Ticks(int id)
+/*
+ * Start a timer event using storage provided by the caller, which
+ * must stay put until the event expires or is cancelled.
+ * Returns the event's id.
+ */
+int Start_Timer_Event(timerEvent *event, int ticks, timerCallback cb)
 {
-    int i;
-
     KASSERT(!Interrupts_Enabled());
-    for (i=0; i < timeEventCount; i++) {
-	if (pendingTimerEvents[i].id == id) {
-	    return pendingTimerEvents[i].ticks;
-	}
+    KASSERT(!Is_Member_Of_Timer_Event_List(&s_pendingTimerEvents, event));
+
+    event->id = nextEventID++;
+    event->callBack = cb;
+    event->ticks = ticks;
+    event->origTicks = ticks;
+    Add_To_Back_Of_Timer_Event_List(&s_pendingTimerEvents, event);
+
+    return event->id;
+}
+
+static timerEvent *Find_Timer_Event(int id)
+{
+    timerEvent *event;
+
+    for (event = Get_Front_Of_Timer_Event_List(&s_pendingTimerEvents); event != 0;
+         event = Get_Next_In_Timer_Event_List(event)) {
+	if (event->id == id)
+	    return event;
     }
+    return 0;
+}
 
-    return -1;
+int Get_Remaing_Timer_Ticks(int id)
+{
+    timerEvent *event;
+
+    KASSERT(!Interrupts_Enabled());
+    event = Find_Timer_Event(id);
+    return event != 0 ? event->ticks : -1;
 }
 
 int Cancel_Timer(int id)
 {
-    int i;
+    timerEvent *event;
+
     KASSERT(!Interrupts_Enabled());
-    for (i=0; i < timeEventCount; i++) {
-	if (pendingTimerEvents[i].id == id) {
-	    pendingTimerEvents[i] = pendingTimerEvents[timeEventCount-1];
-	    timeEventCount--;
-	    return 0;
-	}
+    event = Find_Timer_Event(id);
+    if (event != 0) {
+	Remove_From_Timer_Event_List(&s_pendingTimerEvents, event);
+	return 0;
     }
 
     Print("timer: unable to find timer id %d to cancel it\n", id);
     return -1;
 }
 
+/*
+ * Cancel an event started with Start_Timer_Event(),
+ * if it hasn't expired yet.
+ */
+void Cancel_Timer_Event(timerEvent *event)
+{
+    KASSERT(!Interrupts_Enabled());
+    if (Is_Member_Of_Timer_Event_List(&s_pendingTimerEvents, event))
+	Remove_From_Timer_Event_List(&s_pendingTimerEvents, event);
+}
+
 #define US_PER_TICK (TICKS_PER_SEC * 1000000)
 
 /*
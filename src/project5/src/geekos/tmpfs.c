@@ -0,0 +1,782 @@
+/*
+ * Memory-resident filesystem
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/kassert.h>
+#include <geekos/errno.h>
+#include <geekos/string.h>
+#include <geekos/malloc.h>
+#include <geekos/mem.h>
+#include <geekos/synch.h>
+#include <geekos/vfs.h>
+#include <geekos/tmpfs.h>
+
+/*
+ * Files are arrays of pointers to kernel pages; a null pointer is a
+ * hole, which reads as zeroes and gets a page when first written.
+ * Directories are hash tables of name -> node, with chaining.
+ *
+ * A node is freed once it has no name and nobody has it open
+ * (or mapped), so a file can be deleted while it is in use.
+ *
+ * Each mounted instance has a single mutex protecting all of it.
+ */
+
+struct TMPFS_Node;
+
+struct TMPFS_Dir_Entry {
+    char name[TMPFS_NAME_MAX + 1];
+    struct TMPFS_Node *node;
+    struct TMPFS_Dir_Entry *next;	/* next in hash chain */
+};
+
+struct TMPFS_Node {
+    bool isDirectory;
+    bool linked;		/* still has a name */
+    int refCount;		/* open files and mapped pages */
+
+    /* Files */
+    ulong_t size;
+    void **pages;
+    ulong_t maxPages;		/* length of pages array */
+    ulong_t numPages;		/* non-null entries */
+
+    /* Directories */
+    struct TMPFS_Dir_Entry **buckets;
+    ulong_t numBuckets;
+    ulong_t numEntries;
+};
+
+struct TMPFS_Instance {
+    struct Mutex lock;
+    struct TMPFS_Node *root;
+};
+
+/*
+ * An open directory.  Read_Entry() goes through the names the
+ * directory had when it was opened, skipping ones deleted since.
+ */
+struct TMPFS_Dir_Handle {
+    struct TMPFS_Node *node;
+    char (*names)[TMPFS_NAME_MAX + 1];
+    ulong_t numNames;
+};
+
+/* ----------------------------------------------------------------------
+ * Private functions
+ * ---------------------------------------------------------------------- */
+
+static ulong_t Hash_Name(const char *name)
+{
+    ulong_t h = 5381;
+
+    while (*name != '\0')
+        h = h * 33 + (uchar_t) *name++;
+    return h;
+}
+
+static struct TMPFS_Node *Create_Node(bool isDirectory)
+{
+    struct TMPFS_Node *node = Malloc(sizeof(*node));
+
+    if (node == 0)
+        return 0;
+    memset(node, '\0', sizeof(*node));
+    node->isDirectory = isDirectory;
+    node->linked = true;
+
+    if (isDirectory) {
+        node->buckets = Malloc(TMPFS_MIN_BUCKETS * sizeof(struct TMPFS_Dir_Entry*));
+        if (node->buckets == 0) {
+            Free(node);
+            return 0;
+        }
+        memset(node->buckets, '\0', TMPFS_MIN_BUCKETS * sizeof(struct TMPFS_Dir_Entry*));
+        node->numBuckets = TMPFS_MIN_BUCKETS;
+    }
+
+    return node;
+}
+
+static void Free_Node(struct TMPFS_Node *node)
+{
+    ulong_t i;
+
+    KASSERT(node->numEntries == 0);
+
+    for (i = 0; i < node->maxPages; ++i) {
+        if (node->pages[i] != 0)
+            Free_Page(node->pages[i]);
+    }
+    if (node->pages != 0)
+        Free(node->pages);
+    if (node->buckets != 0)
+        Free(node->buckets);
+    Free(node);
+}
+
+/* Drop a reference, freeing the node if it was the last use */
+static void Release_Node(struct TMPFS_Node *node)
+{
+    KASSERT(node->refCount > 0);
+    if (--node->refCount == 0 && !node->linked)
+        Free_Node(node);
+}
+
+/*
+ * Find the link pointing to named entry of a directory:
+ * either the bucket head or the previous entry's next field.
+ * If there is no such entry, the link found points to null,
+ * and a new entry can be stored through it.
+ */
+static struct TMPFS_Dir_Entry **Find_Entry(struct TMPFS_Node *dir, const char *name)
+{
+    struct TMPFS_Dir_Entry **link = &dir->buckets[Hash_Name(name) % dir->numBuckets];
+
+    while (*link != 0 && strcmp((*link)->name, name) != 0)
+        link = &(*link)->next;
+    return link;
+}
+
+/*
+ * Double the number of buckets of a directory.
+ * If there is no memory for it, the chains just get longer.
+ */
+static void Grow_Buckets(struct TMPFS_Node *dir)
+{
+    ulong_t numBuckets = dir->numBuckets * 2, i;
+    struct TMPFS_Dir_Entry **buckets = Malloc(numBuckets * sizeof(struct TMPFS_Dir_Entry*));
+
+    if (buckets == 0)
+        return;
+    memset(buckets, '\0', numBuckets * sizeof(struct TMPFS_Dir_Entry*));
+
+    for (i = 0; i < dir->numBuckets; ++i) {
+        while (dir->buckets[i] != 0) {
+            struct TMPFS_Dir_Entry *entry = dir->buckets[i];
+            ulong_t h = Hash_Name(entry->name) % numBuckets;
+
+            dir->buckets[i] = entry->next;
+            entry->next = buckets[h];
+            buckets[h] = entry;
+        }
+    }
+
+    Free(dir->buckets);
+    dir->buckets = buckets;
+    dir->numBuckets = numBuckets;
+}
+
+static int Add_Entry(struct TMPFS_Node *dir, const char *name, struct TMPFS_Node *node)
+{
+    struct TMPFS_Dir_Entry *entry, **link;
+
+    if (dir->numEntries >= dir->numBuckets * 2)
+        Grow_Buckets(dir);
+
+    entry = Malloc(sizeof(*entry));
+    if (entry == 0)
+        return ENOMEM;
+    strcpy(entry->name, name);
+    entry->node = node;
+
+    link = &dir->buckets[Hash_Name(name) % dir->numBuckets];
+    entry->next = *link;
+    *link = entry;
+    ++dir->numEntries;
+
+    return 0;
+}
+
+/*
+ * Look up the node named by the first len characters of path.
+ */
+static int Walk_Path(struct TMPFS_Instance *instance, const char *path, size_t len,
+    struct TMPFS_Node **pNode)
+{
+    struct TMPFS_Node *node = instance->root;
+    const char *end = path + len;
+    char name[TMPFS_NAME_MAX + 1];
+
+    while (path < end) {
+        const char *start;
+        struct TMPFS_Dir_Entry *entry;
+
+        while (path < end && *path == '/')
+            ++path;
+        if (path == end)
+            break;
+        start = path;
+        while (path < end && *path != '/')
+            ++path;
+
+        if (path - start > TMPFS_NAME_MAX)
+            return ENAMETOOLONG;
+        if (!node->isDirectory)
+            return ENOTDIR;
+        memcpy(name, start, path - start);
+        name[path - start] = '\0';
+
+        entry = *Find_Entry(node, name);
+        if (entry == 0)
+            return ENOTFOUND;
+        node = entry->node;
+    }
+
+    *pNode = node;
+    return 0;
+}
+
+/*
+ * Split path into the directory it is in and the last name.
+ * The directory must exist; the name need not.
+ */
+static int Split_Path(struct TMPFS_Instance *instance, const char *path,
+    struct TMPFS_Node **pDir, char *name)
+{
+    size_t len = strlen(path);
+    const char *last;
+    int rc;
+
+    while (len > 0 && path[len - 1] == '/')
+        --len;
+    if (len == 0)
+        return EINVALID;	/* the root has no name */
+
+    last = path + len;
+    while (last > path && last[-1] != '/')
+        --last;
+    if (path + len - last > TMPFS_NAME_MAX)
+        return ENAMETOOLONG;
+    memcpy(name, last, path + len - last);
+    name[path + len - last] = '\0';
+
+    if ((rc = Walk_Path(instance, path, last - path, pDir)) < 0)
+        return rc;
+    if (!(*pDir)->isDirectory)
+        return ENOTDIR;
+    return 0;
+}
+
+/*
+ * Get page at given index of a file.  If the page is a hole and
+ * alloc is true, fill it with a zeroed page, else return null.
+ */
+static int Get_File_Page(struct TMPFS_Node *node, ulong_t index, bool alloc, void **pPage)
+{
+    if (index < node->maxPages && node->pages[index] != 0) {
+        *pPage = node->pages[index];
+        return 0;
+    }
+
+    *pPage = 0;
+    if (!alloc)
+        return 0;
+
+    if (index >= node->maxPages) {
+        ulong_t maxPages = node->maxPages ? node->maxPages : 8;
+        void **pages;
+
+        while (maxPages <= index)
+            maxPages *= 2;
+        pages = Malloc(maxPages * sizeof(void*));
+        if (pages == 0)
+            return ENOMEM;
+        memset(pages, '\0', maxPages * sizeof(void*));
+        if (node->pages != 0) {
+            memcpy(pages, node->pages, node->maxPages * sizeof(void*));
+            Free(node->pages);
+        }
+        node->pages = pages;
+        node->maxPages = maxPages;
+    }
+
+    node->pages[index] = Alloc_Page();
+    if (node->pages[index] == 0)
+        return ENOSPACE;
+    memset(node->pages[index], '\0', PAGE_SIZE);
+    ++node->numPages;
+
+    *pPage = node->pages[index];
+    return 0;
+}
+
+static void Fill_Stat(struct TMPFS_Node *node, struct VFS_File_Stat *stat)
+{
+    memset(stat, '\0', sizeof(*stat));
+    if (node->isDirectory) {
+        stat->size = node->numEntries;
+        stat->isDirectory = 1;
+    } else {
+        stat->size = node->size;
+        stat->numBlocks = node->numPages * (PAGE_SIZE / SECTOR_SIZE);
+    }
+}
+
+/* ----------------------------------------------------------------------
+ * Implementation of VFS operations
+ * ---------------------------------------------------------------------- */
+
+static int TMPFS_FStat(struct File *file, struct VFS_File_Stat *stat)
+{
+    struct TMPFS_Instance *instance = file->mountPoint->fsData;
+
+    Mutex_Lock(&instance->lock);
+    Fill_Stat(file->fsData, stat);
+    Mutex_Unlock(&instance->lock);
+    return 0;
+}
+
+static int TMPFS_Read(struct File *file, void *buf, ulong_t numBytes)
+{
+    struct TMPFS_Instance *instance = file->mountPoint->fsData;
+    struct TMPFS_Node *node = file->fsData;
+    ulong_t done = 0;
+
+    if (!(file->mode & O_READ))
+        return EACCESS;
+
+    Mutex_Lock(&instance->lock);
+
+    if (file->filePos < node->size)
+        numBytes = MIN(numBytes, node->size - file->filePos);
+    else
+        numBytes = 0;
+
+    while (done < numBytes) {
+        ulong_t offset = file->filePos % PAGE_SIZE;
+        ulong_t n = MIN(numBytes - done, PAGE_SIZE - offset);
+        void *page;
+
+        Get_File_Page(node, file->filePos / PAGE_SIZE, false, &page);
+        if (page != 0)
+            memcpy((char*) buf + done, (char*) page + offset, n);
+        else
+            memset((char*) buf + done, '\0', n);
+
+        done += n;
+        file->filePos += n;
+    }
+
+    Mutex_Unlock(&instance->lock);
+    return done;
+}
+
+/*
+ * Write at the current position, extending the file if needed.
+ * Returns number of bytes written; if memory ran out, that may be
+ * less than asked for.
+ */
+static int TMPFS_Write(struct File *file, void *buf, ulong_t numBytes)
+{
+    struct TMPFS_Instance *instance = file->mountPoint->fsData;
+    struct TMPFS_Node *node = file->fsData;
+    ulong_t done = 0;
+    int rc = 0;
+
+    if (!(file->mode & O_WRITE))
+        return EACCESS;
+    if (file->filePos + numBytes < file->filePos)
+        return EINVALID;
+
+    Mutex_Lock(&instance->lock);
+
+    while (done < numBytes) {
+        ulong_t offset = file->filePos % PAGE_SIZE;
+        ulong_t n = MIN(numBytes - done, PAGE_SIZE - offset);
+        void *page;
+
+        if ((rc = Get_File_Page(node, file->filePos / PAGE_SIZE, true, &page)) < 0)
+            break;
+        memcpy((char*) page + offset, (char*) buf + done, n);
+
+        done += n;
+        file->filePos += n;
+        if (file->filePos > node->size)
+            node->size = file->filePos;
+    }
+    file->endPos = node->size;
+
+    Mutex_Unlock(&instance->lock);
+    return done > 0 ? (int) done : rc;
+}
+
+/*
+ * Seeking past the end is allowed; writing there leaves a hole.
+ */
+static int TMPFS_Seek(struct File *file, ulong_t pos)
+{
+    file->filePos = pos;
+    return 0;
+}
+
+static int TMPFS_Close(struct File *file)
+{
+    struct TMPFS_Instance *instance = file->mountPoint->fsData;
+
+    Mutex_Lock(&instance->lock);
+    Release_Node(file->fsData);
+    Mutex_Unlock(&instance->lock);
+    return 0;
+}
+
+/*
+ * The file's own pages are mapped, so there is nothing to
+ * write back; the node is held until the page is unmapped.
+ */
+static int TMPFS_Map_Page(struct File *file, ulong_t offset, bool forWrite,
+    void **pPage, void **pCookie)
+{
+    struct TMPFS_Instance *instance = file->mountPoint->fsData;
+    struct TMPFS_Node *node = file->fsData;
+    void *page;
+    int rc;
+
+    Mutex_Lock(&instance->lock);
+
+    rc = Get_File_Page(node, offset / PAGE_SIZE, forWrite, &page);
+    if (rc == 0 && page == 0)
+        rc = ENOTFOUND;		/* hole in a read-only mapping */
+    if (rc == 0) {
+        ++node->refCount;
+        *pPage = page;
+        *pCookie = node;
+    }
+
+    Mutex_Unlock(&instance->lock);
+    return rc;
+}
+
+static void TMPFS_Unmap_Page(struct File *file, void *cookie, bool dirty)
+{
+    struct TMPFS_Instance *instance = file->mountPoint->fsData;
+
+    Mutex_Lock(&instance->lock);
+    Release_Node(cookie);
+    Mutex_Unlock(&instance->lock);
+}
+
+static void TMPFS_Dirty_Page(struct File *file, void *cookie)
+{
+}
+
+static struct File_Ops s_tmpfsFileOps = {
+    &TMPFS_FStat,
+    &TMPFS_Read,
+    &TMPFS_Write,
+    &TMPFS_Seek,
+    &TMPFS_Close,
+    0, /* Read_Entry */
+    &TMPFS_Map_Page,
+    &TMPFS_Unmap_Page,
+    &TMPFS_Dirty_Page,
+};
+
+static int TMPFS_FStat_Directory(struct File *dir, struct VFS_File_Stat *stat)
+{
+    struct TMPFS_Instance *instance = dir->mountPoint->fsData;
+    struct TMPFS_Dir_Handle *handle = dir->fsData;
+
+    Mutex_Lock(&instance->lock);
+    Fill_Stat(handle->node, stat);
+    Mutex_Unlock(&instance->lock);
+    return 0;
+}
+
+static int TMPFS_Close_Directory(struct File *dir)
+{
+    struct TMPFS_Instance *instance = dir->mountPoint->fsData;
+    struct TMPFS_Dir_Handle *handle = dir->fsData;
+
+    Mutex_Lock(&instance->lock);
+    Release_Node(handle->node);
+    Mutex_Unlock(&instance->lock);
+
+    if (handle->names != 0)
+        Free(handle->names);
+    Free(handle);
+    return 0;
+}
+
+static int TMPFS_Read_Entry(struct File *dir, struct VFS_Dir_Entry *entry)
+{
+    struct TMPFS_Instance *instance = dir->mountPoint->fsData;
+    struct TMPFS_Dir_Handle *handle = dir->fsData;
+    int rc = VFS_NO_MORE_DIR_ENTRIES;
+
+    Mutex_Lock(&instance->lock);
+
+    while (dir->filePos < handle->numNames) {
+        const char *name = handle->names[dir->filePos++];
+        struct TMPFS_Dir_Entry *dirEntry = *Find_Entry(handle->node, name);
+
+        if (dirEntry != 0) {
+            strcpy(entry->name, name);
+            Fill_Stat(dirEntry->node, &entry->stats);
+            rc = 0;
+            break;
+        }
+    }
+
+    Mutex_Unlock(&instance->lock);
+    return rc;
+}
+
+static struct File_Ops s_tmpfsDirOps = {
+    &TMPFS_FStat_Directory,
+    0, /* Read */
+    0, /* Write */
+    &TMPFS_Seek,
+    &TMPFS_Close_Directory,
+    &TMPFS_Read_Entry,
+};
+
+static int TMPFS_Open(struct Mount_Point *mountPoint, const char *path, int mode,
+    struct File **pFile)
+{
+    struct TMPFS_Instance *instance = mountPoint->fsData;
+    struct TMPFS_Node *dir, *node = 0;
+    struct TMPFS_Dir_Entry *entry;
+    char name[TMPFS_NAME_MAX + 1];
+    struct File *file;
+    int rc;
+
+    Mutex_Lock(&instance->lock);
+
+    if ((rc = Split_Path(instance, path, &dir, name)) < 0)
+        goto done;
+
+    entry = *Find_Entry(dir, name);
+    if (entry != 0) {
+        if ((mode & O_CREATE) && (mode & O_EXCL)) {
+            rc = EEXIST;
+            goto done;
+        }
+        node = entry->node;
+        if (node->isDirectory) {
+            rc = EINVALID;
+            goto done;
+        }
+    } else {
+        if (!(mode & O_CREATE)) {
+            rc = ENOTFOUND;
+            goto done;
+        }
+        node = Create_Node(false);
+        if (node == 0) {
+            rc = ENOMEM;
+            goto done;
+        }
+        if ((rc = Add_Entry(dir, name, node)) < 0) {
+            Free_Node(node);
+            goto done;
+        }
+    }
+
+    /* If this fails, a newly created file stays, empty, like on a disk */
+    file = Allocate_File(&s_tmpfsFileOps, 0, node->size, node, mode, mountPoint);
+    if (file == 0) {
+        rc = ENOMEM;
+        goto done;
+    }
+    ++node->refCount;
+    *pFile = file;
+
+done:
+    Mutex_Unlock(&instance->lock);
+    return rc;
+}
+
+static int TMPFS_Create_Directory(struct Mount_Point *mountPoint, const char *path)
+{
+    struct TMPFS_Instance *instance = mountPoint->fsData;
+    struct TMPFS_Node *dir, *node;
+    char name[TMPFS_NAME_MAX + 1];
+    int rc;
+
+    Mutex_Lock(&instance->lock);
+
+    if ((rc = Split_Path(instance, path, &dir, name)) < 0)
+        goto done;
+    if (*Find_Entry(dir, name) != 0) {
+        rc = EEXIST;
+        goto done;
+    }
+
+    node = Create_Node(true);
+    if (node == 0) {
+        rc = ENOMEM;
+        goto done;
+    }
+    if ((rc = Add_Entry(dir, name, node)) < 0)
+        Free_Node(node);
+
+done:
+    Mutex_Unlock(&instance->lock);
+    return rc;
+}
+
+static int TMPFS_Open_Directory(struct Mount_Point *mountPoint, const char *path,
+    struct File **pDir)
+{
+    struct TMPFS_Instance *instance = mountPoint->fsData;
+    struct TMPFS_Dir_Handle *handle = 0;
+    struct TMPFS_Node *node;
+    struct File *dir;
+    ulong_t i;
+    int rc;
+
+    Mutex_Lock(&instance->lock);
+
+    if ((rc = Walk_Path(instance, path, strlen(path), &node)) < 0)
+        goto done;
+    if (!node->isDirectory) {
+        rc = ENOTDIR;
+        goto done;
+    }
+
+    handle = Malloc(sizeof(*handle));
+    if (handle == 0)
+        goto memfail;
+    handle->node = node;
+    handle->numNames = 0;
+    handle->names = 0;
+    if (node->numEntries > 0) {
+        handle->names = Malloc(node->numEntries * sizeof(handle->names[0]));
+        if (handle->names == 0)
+            goto memfail;
+    }
+
+    for (i = 0; i < node->numBuckets; ++i) {
+        struct TMPFS_Dir_Entry *entry;
+
+        for (entry = node->buckets[i]; entry != 0; entry = entry->next)
+            strcpy(handle->names[handle->numNames++], entry->name);
+    }
+    KASSERT(handle->numNames == node->numEntries);
+
+    dir = Allocate_File(&s_tmpfsDirOps, 0, handle->numNames, handle, 0, mountPoint);
+    if (dir == 0)
+        goto memfail;
+    ++node->refCount;
+    *pDir = dir;
+    handle = 0;
+    goto done;
+
+memfail:
+    rc = ENOMEM;
+done:
+    if (handle != 0) {
+        if (handle->names != 0)
+            Free(handle->names);
+        Free(handle);
+    }
+    Mutex_Unlock(&instance->lock);
+    return rc;
+}
+
+static int TMPFS_Stat(struct Mount_Point *mountPoint, const char *path, struct VFS_File_Stat *stat)
+{
+    struct TMPFS_Instance *instance = mountPoint->fsData;
+    struct TMPFS_Node *node;
+    int rc;
+
+    Mutex_Lock(&instance->lock);
+    rc = Walk_Path(instance, path, strlen(path), &node);
+    if (rc == 0)
+        Fill_Stat(node, stat);
+    Mutex_Unlock(&instance->lock);
+    return rc;
+}
+
+/* Nothing is ever out of date */
+static int TMPFS_Sync(struct Mount_Point *mountPoint)
+{
+    return 0;
+}
+
+/*
+ * Remove a file or an empty directory.  If it is still open,
+ * its memory is freed when it is closed.
+ */
+static int TMPFS_Delete(struct Mount_Point *mountPoint, const char *path)
+{
+    struct TMPFS_Instance *instance = mountPoint->fsData;
+    struct TMPFS_Node *dir, *node;
+    struct TMPFS_Dir_Entry *entry, **link;
+    char name[TMPFS_NAME_MAX + 1];
+    int rc;
+
+    Mutex_Lock(&instance->lock);
+
+    if ((rc = Split_Path(instance, path, &dir, name)) < 0)
+        goto done;
+    link = Find_Entry(dir, name);
+    entry = *link;
+    if (entry == 0) {
+        rc = ENOTFOUND;
+        goto done;
+    }
+    node = entry->node;
+    if (node->isDirectory && node->numEntries > 0) {
+        rc = EBUSY;
+        goto done;
+    }
+
+    *link = entry->next;
+    Free(entry);
+    --dir->numEntries;
+
+    node->linked = false;
+    if (node->refCount == 0)
+        Free_Node(node);
+
+done:
+    Mutex_Unlock(&instance->lock);
+    return rc;
+}
+
+static struct Mount_Point_Ops s_tmpfsMountPointOps = {
+    &TMPFS_Open,
+    &TMPFS_Create_Directory,
+    &TMPFS_Open_Directory,
+    &TMPFS_Stat,
+    &TMPFS_Sync,
+    &TMPFS_Delete,
+};
+
+static int TMPFS_Mount(struct Mount_Point *mountPoint)
+{
+    struct TMPFS_Instance *instance;
+
+    instance = Malloc(sizeof(*instance));
+    if (instance == 0)
+        return ENOMEM;
+    Mutex_Init(&instance->lock);
+    instance->root = Create_Node(true);
+    if (instance->root == 0) {
+        Free(instance);
+        return ENOMEM;
+    }
+
+    mountPoint->ops = &s_tmpfsMountPointOps;
+    mountPoint->fsData = instance;
+    return 0;
+}
+
+static struct Filesystem_Ops s_tmpfsFilesystemOps = {
+    0, /* Format */
+    &TMPFS_Mount,
+};
+
+/* ----------------------------------------------------------------------
+ * Public functions
+ * ---------------------------------------------------------------------- */
+
+void Init_TMPFS(void)
+{
+    Register_Filesystem("tmpfs", &s_tmpfsFilesystemOps);
+}
@@ -0,0 +1,97 @@
+/*
+ * Kernel tracepoint log
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/int.h>
+#include <geekos/screen.h>
+#include <geekos/trace.h>
+
+/*
+ * Number of records kept; older records are overwritten.
+ */
+#define TRACE_LOG_SIZE 128
+
+/*
+ * Number of recent records printed by Dump_Trace_Log().
+ */
+#define TRACE_DUMP_SIZE 16
+
+static struct Trace_Record s_traceLog[TRACE_LOG_SIZE];
+static ulong_t s_traceCount;
+
+ulong_t g_traceMax[TRACE_NUM_EVENTS];
+
+/*
+ * Time of the oldest reschedule request not yet acted on, 0 if none.
+ */
+static ulong_t s_rescheduleRequestTime;
+
+static const char *s_traceEventNames[TRACE_NUM_EVENTS] = {
+    "sched-latency",
+    "preempt-off",
+};
+
+/*
+ * Add a record to the trace log.
+ */
+void Trace(enum Trace_Event event, ulong_t arg)
+{
+    bool iflag = Begin_Int_Atomic();
+    struct Trace_Record *record = &s_traceLog[s_traceCount++ % TRACE_LOG_SIZE];
+
+    record->time = Read_TSC();
+    record->event = event;
+    record->arg = arg;
+    if (arg > g_traceMax[event])
+	g_traceMax[event] = arg;
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Note that a new thread should be chosen as soon as possible.
+ * Called wherever g_needReschedule is set.
+ */
+void Trace_Reschedule_Request(void)
+{
+    if (s_rescheduleRequestTime == 0)
+	s_rescheduleRequestTime = Read_TSC() | 1;
+}
+
+/*
+ * Note that the scheduler is choosing a new thread,
+ * recording how long the pending reschedule request waited.
+ * Interrupts must be disabled.
+ */
+void Trace_Thread_Switch(void)
+{
+    if (s_rescheduleRequestTime != 0) {
+	ulong_t latency = Read_TSC() - s_rescheduleRequestTime;
+	s_rescheduleRequestTime = 0;
+	Trace(TRACE_SCHED_LATENCY, latency);
+    }
+}
+
+/*
+ * Print the worst values seen and the most recent records.
+ */
+void Dump_Trace_Log(void)
+{
+    ulong_t i, first;
+    int event;
+    bool iflag = Begin_Int_Atomic();
+
+    for (event = 0; event < TRACE_NUM_EVENTS; ++event)
+	Print("trace: max %s = %lu cycles\n", s_traceEventNames[event], g_traceMax[event]);
+
+    first = s_traceCount > TRACE_DUMP_SIZE ? s_traceCount - TRACE_DUMP_SIZE : 0;
+    for (i = first; i < s_traceCount; ++i) {
+	struct Trace_Record *record = &s_traceLog[i % TRACE_LOG_SIZE];
+	Print("  %lx %s %lu\n", record->time, s_traceEventNames[record->event], record->arg);
+    }
+
+    End_Int_Atomic(iflag);
+}
@@ -12,6 +12,8 @@
 #include <geekos/defs.h>
 #include <geekos/syscall.h>
 #include <geekos/trap.h>
+#include <geekos/user.h>
+#include <geekos/thrash.h>
 
 /*
  * TODO: need to add handlers for other exceptions (such as bounds
@@ -42,6 +44,15 @@ static void Syscall_Handler(struct Interrupt_State* state)
 {
     /* The system call number is specified in the eax register. */
     uint_t syscallNum = state->eax;
+    struct User_Context *userContext = g_currentThread->userContext;
+
+    /* Hold the process here while it is suspended for thrashing */
+    if (userContext != 0)
+        Wait_While_Suspended(userContext);
+
+    /* Another thread of the process called Exit() */
+    if (userContext != 0 && userContext->exiting)
+        Exit(userContext->exitCode);
 
     /* Make sure the the system call number refers to a legal value. */
     if (syscallNum < 0 || syscallNum >= g_numSyscalls) {
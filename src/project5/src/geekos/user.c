@@ -16,7 +16,10 @@
 #include <geekos/kthread.h>
 #include <geekos/vfs.h>
 #include <geekos/tss.h>
+#include <geekos/string.h>
 #include <geekos/user.h>
+#include <geekos/ioring.h>
+#include <geekos/thrash.h>
 
 /*
  * This module contains common functions for implementation of user
@@ -33,14 +36,11 @@ void Attach_User_Context(struct Kernel_Thread* kthread, struct User_Context* con
     kthread->userContext = context;
 
     Disable_Interrupts();
-
-    /*
-     * We don't actually allow multiple threads
-     * to share a user context (yet)
-     */
-    KASSERT(context->refCount == 0);
-
     ++context->refCount;
+    /* A new process gets the weight of the thread that spawned it */
+    if (context->weight == 0)
+        context->weight = kthread->weight;
+    Update_Process_Strides(context);
     Enable_Interrupts();
 }
 
@@ -61,12 +61,255 @@ void Detach_User_Context(struct Kernel_Thread* kthread)
         Disable_Interrupts();
         --old->refCount;
         refCount = old->refCount;
+        /* I/O ring threads quit once they are the only threads left */
+        if (refCount > 0) {
+            Kick_IO_Ring(old);
+            Update_Process_Strides(old);
+        }
         Enable_Interrupts();
 
         /*Print("User context refcount == %d\n", refCount);*/
-        if (refCount == 0)
+        if (refCount == 0) {
+            Reap_Unjoined_Threads(old);
             Destroy_User_Context(old);
+        }
+    }
+}
+
+/* ----------------------------------------------------------------------
+ * File descriptor table
+ *
+ * Each process has a table of File pointers indexed by descriptor,
+ * plus a bitmap of used slots.  Allocation scans the bitmap a word
+ * at a time starting from fdFirstFree, so finding the lowest free
+ * descriptor doesn't require looking at every slot.  The table
+ * starts at USER_INITIAL_FILES entries and is doubled when full.
+ *
+ * These functions must be called with interrupts disabled
+ * (as they are from system calls), except Close_All_File_Descriptors,
+ * which is only used on a context that is being destroyed.
+ * ---------------------------------------------------------------------- */
+
+#define FD_BITS_PER_WORD	(sizeof(ulong_t) * 8)
+#define FD_BITMAP_WORDS(n)	(((n) + FD_BITS_PER_WORD - 1) / FD_BITS_PER_WORD)
+
+static __inline__ bool Is_Fd_Used(struct User_Context* context, ulong_t fd)
+{
+    return (context->fdBitmap[fd / FD_BITS_PER_WORD] & (1UL << (fd % FD_BITS_PER_WORD))) != 0;
+}
+
+/*
+ * Make sure the descriptor table has at least minSize slots.
+ */
+static int Grow_File_Table(struct User_Context* context, int minSize)
+{
+    int newSize = context->fdTableSize == 0 ? USER_INITIAL_FILES : context->fdTableSize;
+    struct File **newTable;
+    ulong_t *newBitmap;
+
+    if (minSize <= context->fdTableSize)
+        return 0;
+    if (minSize > USER_MAX_FILES)
+        return EMFILE;
+
+    while (newSize < minSize)
+        newSize *= 2;
+    if (newSize > USER_MAX_FILES)
+        newSize = USER_MAX_FILES;
+
+    newTable = (struct File**) Malloc(newSize * sizeof(struct File*));
+    newBitmap = (ulong_t*) Malloc(FD_BITMAP_WORDS(newSize) * sizeof(ulong_t));
+    if (newTable == 0 || newBitmap == 0) {
+        if (newTable != 0) Free(newTable);
+        if (newBitmap != 0) Free(newBitmap);
+        return ENOMEM;
+    }
+
+    memset(newTable, '\0', newSize * sizeof(struct File*));
+    memset(newBitmap, '\0', FD_BITMAP_WORDS(newSize) * sizeof(ulong_t));
+    if (context->fdTable != 0) {
+        memcpy(newTable, context->fdTable, context->fdTableSize * sizeof(struct File*));
+        memcpy(newBitmap, context->fdBitmap,
+            FD_BITMAP_WORDS(context->fdTableSize) * sizeof(ulong_t));
+        Free(context->fdTable);
+        Free(context->fdBitmap);
+    }
+
+    context->fdTable = newTable;
+    context->fdBitmap = newBitmap;
+    context->fdTableSize = newSize;
+    return 0;
+}
+
+/*
+ * Store file in descriptor slot fd, which must be free.
+ */
+static void Install_File_Descriptor(struct User_Context* context, ulong_t fd, struct File* file)
+{
+    KASSERT(fd < context->fdTableSize && !Is_Fd_Used(context, fd));
+    context->fdTable[fd] = file;
+    context->fdBitmap[fd / FD_BITS_PER_WORD] |= 1UL << (fd % FD_BITS_PER_WORD);
+    ++context->numOpenedFiles;
+    if (fd == context->fdFirstFree)
+        ++context->fdFirstFree;
+}
+
+/*
+ * Allocate the lowest free descriptor for given file.
+ * Returns the descriptor (>= 0), or an error code.
+ */
+int Alloc_File_Descriptor(struct User_Context* context, struct File* file)
+{
+    ulong_t w, numWords;
+    int rc;
+
+    numWords = FD_BITMAP_WORDS(context->fdTableSize);
+    for (w = context->fdFirstFree / FD_BITS_PER_WORD; w < numWords; ++w) {
+        if (context->fdBitmap[w] != ~0UL) {
+            ulong_t fd = w * FD_BITS_PER_WORD + __builtin_ctzl(~context->fdBitmap[w]);
+            if (fd < context->fdTableSize) {
+                Install_File_Descriptor(context, fd, file);
+                return fd;
+            }
+            break;
+        }
+    }
+
+    /* Table is full: grow it and use the first new slot. */
+    w = context->fdTableSize;
+    if ((rc = Grow_File_Table(context, w + 1)) != 0)
+        return rc;
+    Install_File_Descriptor(context, w, file);
+    return w;
+}
+
+/*
+ * Look up the file referred to by given descriptor.
+ * Returns 0 if the descriptor is not open.
+ */
+struct File* Get_File_Descriptor(struct User_Context* context, ulong_t fd)
+{
+    if (fd >= context->fdTableSize || !Is_Fd_Used(context, fd))
+        return 0;
+    return context->fdTable[fd];
+}
+
+/*
+ * Get the file referred to by given descriptor and take a reference
+ * to it, so that it stays open while the caller blocks even if another
+ * thread of the process closes the descriptor.
+ * Release the reference with Put_File().
+ * Returns null if the descriptor is not open.
+ */
+struct File* Hold_File_Descriptor(struct User_Context* context, ulong_t fd)
+{
+    struct File *file;
+
+    KASSERT(!Interrupts_Enabled());
+
+    file = Get_File_Descriptor(context, fd);
+    if (file != 0)
+        ++file->refCount;
+    return file;
+}
+
+/*
+ * Release a reference taken by Hold_File_Descriptor().
+ * Must be called with interrupts disabled; the file is closed
+ * (with interrupts enabled) if this was the last reference.
+ */
+void Put_File(struct File* file)
+{
+    KASSERT(!Interrupts_Enabled());
+
+    if (file->refCount > 1) {
+        --file->refCount;
+        return;
+    }
+
+    Enable_Interrupts();
+    Release_File(file);
+    Disable_Interrupts();
+}
+
+/*
+ * Close given descriptor.
+ * Returns 0 if successful, error code otherwise.
+ */
+int Close_File_Descriptor(struct User_Context* context, ulong_t fd)
+{
+    struct File *file = Get_File_Descriptor(context, fd);
+    int rc;
+
+    KASSERT(!Interrupts_Enabled());
+
+    if (file == 0)
+        return ENOTFOUND;
+
+    context->fdTable[fd] = 0;
+    context->fdBitmap[fd / FD_BITS_PER_WORD] &= ~(1UL << (fd % FD_BITS_PER_WORD));
+    --context->numOpenedFiles;
+    if (fd < context->fdFirstFree)
+        context->fdFirstFree = fd;
+
+    Enable_Interrupts();
+    rc = Release_File(file);
+    Disable_Interrupts();
+
+    return rc;
+}
+
+/*
+ * Make newFd refer to the same file as oldFd,
+ * closing newFd first if it is open.
+ * Returns newFd if successful, error code otherwise.
+ */
+int Dup_File_Descriptor(struct User_Context* context, ulong_t oldFd, ulong_t newFd)
+{
+    struct File *file = Get_File_Descriptor(context, oldFd);
+    int rc;
+
+    if (file == 0)
+        return ENOTFOUND;
+    if (newFd >= USER_MAX_FILES)
+        return EINVALID;
+    if (oldFd == newFd)
+        return newFd;
+
+    if ((rc = Grow_File_Table(context, newFd + 1)) != 0)
+        return rc;
+    if (Is_Fd_Used(context, newFd) && (rc = Close_File_Descriptor(context, newFd)) != 0)
+        return rc;
+
+    /* Close may have blocked; make sure oldFd is still the same file. */
+    if (Get_File_Descriptor(context, oldFd) != file)
+        return ENOTFOUND;
+
+    ++file->refCount;
+    Install_File_Descriptor(context, newFd, file);
+    return newFd;
+}
+
+/*
+ * Close every open descriptor and free the table.
+ * Called when the user context is destroyed.
+ */
+void Close_All_File_Descriptors(struct User_Context* context)
+{
+    ulong_t fd;
+
+    for (fd = 0; fd < context->fdTableSize; ++fd) {
+        if (Is_Fd_Used(context, fd))
+            Release_File(context->fdTable[fd]);
     }
+
+    if (context->fdTable != 0) Free(context->fdTable);
+    if (context->fdBitmap != 0) Free(context->fdBitmap);
+    context->fdTable = 0;
+    context->fdBitmap = 0;
+    context->fdTableSize = 0;
+    context->fdFirstFree = 0;
+    context->numOpenedFiles = 0;
 }
 
 /*
@@ -172,6 +415,18 @@ void Switch_To_User_Context(struct Kernel_Thread* kthread, struct Interrupt_Stat
         // bring us there
         Set_Kernel_Stack_Pointer((ulong_t) kthread->stackPage + PAGE_SIZE - 1);
         Switch_To_Address_Space(kthread->userContext);
+
+        /*
+         * A thread of a suspended or exiting process stops when it
+         * would return to user mode, so that even one which never
+         * makes another system call or page fault is held or taken down.
+         */
+        if (Is_User_Interrupt(state) && g_preemptCount == 0) {
+            KASSERT(kthread == g_currentThread);
+            Wait_While_Suspended(kthread->userContext);
+            if (kthread->userContext->exiting)
+                Exit(kthread->userContext->exitCode);
+        }
     }
 }
 
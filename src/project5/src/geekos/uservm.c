@@ -19,11 +19,28 @@
 #include <geekos/user.h>
 #include <geekos/gdt.h>
 #include <geekos/errno.h>
+#include <geekos/ioring.h>
 
 /* ----------------------------------------------------------------------
  * Private functions
  * ---------------------------------------------------------------------- */
 
+/*
+ * Release the memory behind a page table entry, whether
+ * the page is resident or in the paging file, and clear the entry.
+ */
+static void Free_User_Page(pte_t *entry) {
+    bool iflag = Begin_Int_Atomic();
+
+    if (entry->present == 1)
+        Free_Page((void*) (entry->pageBaseAddr << PAGE_POWER));
+    else if (entry->kernelInfo == KINFO_PAGE_ON_DISK)
+        Free_Space_On_Paging_File(entry->pageBaseAddr);
+    memset(entry, 0, sizeof(pte_t));
+
+    End_Int_Atomic(iflag);
+}
+
 static void Free_Page_Directory(pde_t* pageDir) {
     if (pageDir == 0)
         return;
@@ -32,11 +49,8 @@ static void Free_Page_Directory(pde_t* pageDir) {
         pde_t *dirEntry = &pageDir[i];
         if (dirEntry->present) {
             pte_t *table = (pte_t*) (dirEntry->pageTableBaseAddr << PAGE_POWER);
-            for (int j = 0; j < NUM_PAGE_TABLE_ENTRIES; ++j) {
-                pte_t *tableEntry = &table[j];
-                if (tableEntry->present == 1)
-                    Free_Page((void*) (tableEntry->pageBaseAddr << PAGE_POWER));
-            }
+            for (int j = 0; j < NUM_PAGE_TABLE_ENTRIES; ++j)
+                Free_User_Page(&table[j]);
             Free_Page((void*) (dirEntry->pageTableBaseAddr << PAGE_POWER));
         }
     }
@@ -62,7 +76,8 @@ static pte_t* Get_Or_Insert_Page_Table(pde_t *dirEntry, uint_t flags) {
     return table;
 }
 
-static int Load_Data_Into_Pageable_Pages(pde_t *pageDir, ulong_t start, void *src, int size) {
+static int Load_Data_Into_Pageable_Pages(struct User_Context *context, ulong_t start, void *src, int size) {
+    pde_t *pageDir = context->pageDir;
     ulong_t end = start + size;
     int numPages = (PAGE_ADDR(end) - PAGE_ADDR(start)) / PAGE_SIZE + 1;
 
@@ -88,7 +103,7 @@ static int Load_Data_Into_Pageable_Pages(pde_t *pageDir, ulong_t start, void *sr
             return ENOMEM;
         tableEntry = &table[PAGE_TABLE_INDEX(vaddr)];
         
-        page = Alloc_Pageable_Page(tableEntry, vaddr);
+        page = Alloc_Pageable_Page(context, tableEntry, vaddr);
         if (page == 0)
             return ENOMEM;
             
@@ -110,6 +125,174 @@ static int Load_Data_Into_Pageable_Pages(pde_t *pageDir, ulong_t start, void *sr
     return 0;
 }
 
+/*
+ * Find the page table entry for given address, without
+ * creating a page table if there is none.
+ */
+static pte_t* Find_Page_Table_Entry(pde_t *pageDir, ulong_t vaddr) {
+    pde_t *dirEntry = &pageDir[PAGE_DIRECTORY_INDEX(vaddr)];
+    pte_t *table;
+
+    if (dirEntry->present == 0)
+        return 0;
+    table = (pte_t*) (dirEntry->pageTableBaseAddr << PAGE_POWER);
+    return &table[PAGE_TABLE_INDEX(vaddr)];
+}
+
+/*
+ * Find the mapped region containing given user address.
+ */
+static struct Mmap_Region* Find_Mmap_Region(struct User_Context *context, ulong_t userAddr) {
+    struct Mmap_Region *region;
+
+    for (region = Get_Front_Of_Mmap_Region_List(&context->mmapList);
+         region != 0;
+         region = Get_Next_In_Mmap_Region_List(region)) {
+        if (userAddr >= region->start && userAddr - region->start < region->numPages * PAGE_SIZE)
+            return region;
+    }
+    return 0;
+}
+
+/*
+ * Find a free range of size bytes in the mmap area (first fit).
+ * Returns the user address of the range, or 0 if there is none.
+ */
+static ulong_t Find_Free_Mmap_Range(struct User_Context *context, ulong_t size) {
+    ulong_t start = USER_MMAP_START;
+    struct Mmap_Region *region = Get_Front_Of_Mmap_Region_List(&context->mmapList);
+
+    while (region != 0) {
+        ulong_t regionEnd = region->start + region->numPages * PAGE_SIZE;
+        if (start < regionEnd && region->start < start + size) {
+            /* Overlap: retry right after this region. */
+            start = regionEnd;
+            region = Get_Front_Of_Mmap_Region_List(&context->mmapList);
+            continue;
+        }
+        region = Get_Next_In_Mmap_Region_List(region);
+    }
+
+    if (start + size > USER_MMAP_END || start + size < start)
+        return 0;
+    return start;
+}
+
+/*
+ * Add a region of given size to the address space.
+ * Returns the region, or null if there is no room or no memory.
+ */
+static struct Mmap_Region* Create_Region(struct User_Context *context, ulong_t size,
+    struct File *file, ulong_t offset, int prot) {
+    struct Mmap_Region *region;
+    ulong_t start = Find_Free_Mmap_Range(context, size);
+
+    if (start == 0)
+        return 0;
+
+    region = (struct Mmap_Region*) Malloc(sizeof(*region));
+    if (region == 0)
+        return 0;
+    memset(region, '\0', sizeof(*region));
+
+    if (file != 0) {
+        region->pageCookies = (void**) Malloc((size / PAGE_SIZE) * sizeof(void*));
+        if (region->pageCookies == 0) {
+            Free(region);
+            return 0;
+        }
+        memset(region->pageCookies, 0, (size / PAGE_SIZE) * sizeof(void*));
+        ++file->refCount;
+    }
+
+    region->start = start;
+    region->numPages = size / PAGE_SIZE;
+    region->file = file;
+    region->offset = offset;
+    region->prot = prot;
+    Add_To_Back_Of_Mmap_Region_List(&context->mmapList, region);
+
+    return region;
+}
+
+/*
+ * Map a zero-filled page at given address: the first touch
+ * of a heap or anonymous page.
+ * Returns false if there is no memory.
+ */
+static bool Map_Zero_Page(struct User_Context *context, pte_t *entry, ulong_t vaddr) {
+    void *page = Alloc_Pageable_Page(context, entry, vaddr);
+
+    if (page == 0)
+        return false;
+    /* Another thread may have mapped it while we were allocating */
+    if (entry->present) {
+        Free_Page(page);
+        return true;
+    }
+    memset(page, '\0', PAGE_SIZE);
+
+    entry->present = 1;
+    entry->flags = VM_READ | VM_WRITE | VM_EXEC | VM_USER;
+    entry->pageBaseAddr = (uint_t) page >> PAGE_POWER;
+    return true;
+}
+
+/*
+ * Remove a mapping from the address space, handing each mapped page
+ * back to the filesystem and writing back pages modified through it.
+ * Called with interrupts disabled; enables them around file operations.
+ */
+static int Unmap_Region(struct User_Context *context, struct Mmap_Region *region) {
+    struct File *file = region->file;
+    bool writable = (region->prot & PROT_WRITE) != 0;
+    bool anyDirty = false;
+    int rc = 0;
+
+    Remove_From_Mmap_Region_List(&context->mmapList, region);
+    ++context->mmapGeneration;
+
+    for (ulong_t i = 0; i < region->numPages; ++i) {
+        ulong_t vaddr = USER_BASE_VADDR + region->start + i * PAGE_SIZE;
+        pte_t *entry = Find_Page_Table_Entry(context->pageDir, vaddr);
+        void *cookie = file != 0 ? region->pageCookies[i] : 0;
+        bool dirty;
+
+        if (entry == 0)
+            continue;
+        if (cookie == 0) {
+            /* Anonymous memory, or a zero-filled hole of a file */
+            Free_User_Page(entry);
+            if (context->pageDir == Get_PDBR())
+                Flush_TLB();
+            continue;
+        }
+
+        dirty = writable && entry->dirty;
+        memset(entry, 0, sizeof(pte_t));
+        /* The page must not be reachable through a stale TLB entry once it is given back. */
+        if (context->pageDir == Get_PDBR())
+            Flush_TLB();
+
+        Enable_Interrupts();
+        file->ops->Unmap_Page(file, cookie, dirty);
+        Disable_Interrupts();
+        anyDirty = anyDirty || dirty;
+    }
+
+    if (file != 0) {
+        Enable_Interrupts();
+        if (anyDirty)
+            rc = Fsync(file);
+        Release_File(file);
+        Disable_Interrupts();
+        Free(region->pageCookies);
+    }
+
+    Free(region);
+    return rc;
+}
+
 // TODO: Add private functions
 /* ----------------------------------------------------------------------
  * Public functions
@@ -134,6 +317,14 @@ void Destroy_User_Context(struct User_Context* context)
     if (context == 0)
         return;
     
+    /* Mappings hold file references and pin filesystem buffers. */
+    Disable_Interrupts();
+    while (!Is_Mmap_Region_List_Empty(&context->mmapList))
+        Unmap_Region(context, Get_Front_Of_Mmap_Region_List(&context->mmapList));
+    Enable_Interrupts();
+
+    Destroy_IO_Ring(context);
+    Close_All_File_Descriptors(context);
     if (context->ldtDescriptor != 0)
         Free_Segment_Descriptor(context->ldtDescriptor);
     if (context->pageDir != 0)
@@ -195,6 +386,7 @@ int Load_User_Program(char *exeFileData, ulong_t exeFileLength,
     *pUserContext = Malloc(sizeof(struct User_Context));
     if (*pUserContext == 0)
         return ENOMEM;
+    memset(*pUserContext, 0, sizeof(struct User_Context));
     (*pUserContext)->pageDir = pageDir;
 
     // "Useless" segment registers
@@ -229,7 +421,7 @@ int Load_User_Program(char *exeFileData, ulong_t exeFileLength,
             vaddrTop = segVaddrTop;
         
         rc = Load_Data_Into_Pageable_Pages(
-            pageDir,
+            *pUserContext,
             USER_BASE_VADDR + this->startAddress,
             (void*) (exeFileData + this->offsetInFile),
             this->lengthInFile
@@ -249,7 +441,7 @@ int Load_User_Program(char *exeFileData, ulong_t exeFileLength,
         return ENOMEM;
     }
     Format_Argument_Block(argBlockBuf, numArgs, argBlockVaddr - USER_BASE_VADDR, command);
-    rc = Load_Data_Into_Pageable_Pages(pageDir, argBlockVaddr, argBlockBuf, argBlockSize);
+    rc = Load_Data_Into_Pageable_Pages(*pUserContext, argBlockVaddr, argBlockBuf, argBlockSize);
     if (rc != 0) {
         Destroy_User_Context(*pUserContext);
         Free(argBlockBuf);
@@ -267,7 +459,7 @@ int Load_User_Program(char *exeFileData, ulong_t exeFileLength,
     }
     tableEntry = &table[PAGE_TABLE_INDEX(initialStackBaseVaddr)];
 
-    page = Alloc_Pageable_Page(tableEntry, initialStackBaseVaddr);
+    page = Alloc_Pageable_Page(*pUserContext, tableEntry, initialStackBaseVaddr);
     if (page == 0) {
         Destroy_User_Context(*pUserContext);
         return ENOMEM;
@@ -276,7 +468,9 @@ int Load_User_Program(char *exeFileData, ulong_t exeFileLength,
     tableEntry->flags = VM_READ | VM_WRITE | VM_EXEC | VM_USER;
     tableEntry->pageBaseAddr = (uint_t) page >> PAGE_POWER;
 
-    // Heap support?
+    // Heap: grows from the end of the argument block, see Change_Heap_Break()
+    (*pUserContext)->heapStart = Round_Up_To_Page(argBlockVaddr + argBlockSize) - USER_BASE_VADDR;
+    (*pUserContext)->heapBreak = (*pUserContext)->heapStart;
 
     // Fill other fields
     (*pUserContext)->pageDir = pageDir;
@@ -287,8 +481,6 @@ int Load_User_Program(char *exeFileData, ulong_t exeFileLength,
     (*pUserContext)->argBlockAddr = argBlockVaddr - USER_BASE_VADDR;
     (*pUserContext)->stackPointerAddr = VA_END - USER_BASE_VADDR;
     (*pUserContext)->refCount = 0;
-    memset((*pUserContext)->fdTable, 0, sizeof(struct File*) * USER_MAX_FILES);
-    (*pUserContext)->numOpenedFiles = 0;
 
     return 0;
 }
@@ -372,4 +564,278 @@ void Switch_To_Address_Space(struct User_Context *userContext)
     Load_LDTR(userContext->ldtSelector);
 }
 
+/*
+ * Map part of a file into the user address space.
+ * Pages are not read until they are first accessed
+ * (see Handle_User_Memory_Fault()).  With PROT_WRITE, changes made
+ * through the mapping are written back to the file by
+ * Munmap_File() and Sync_Mapped_File().
+ * Must be called with interrupts disabled.
+ * Params:
+ *   context - the user context
+ *   file - the file to map; the mapping keeps its own reference
+ *   offset - file offset of the mapping, page aligned
+ *   length - number of bytes to map
+ *   prot - PROT_READ and/or PROT_WRITE
+ * Returns: user address of the mapping, or error code (< 0)
+ */
+int Mmap_File(struct User_Context *context, struct File *file, ulong_t offset,
+    ulong_t length, int prot)
+{
+    struct Mmap_Region *region;
+    ulong_t size = Round_Up_To_Page(length);
+
+    if (length == 0 || size < length || PAGE_OFFSET(offset) != 0)
+        return EINVALID;
+    if (prot == 0 || (prot & ~(PROT_READ | PROT_WRITE)) != 0)
+        return EINVALID;
+    if (file->ops->Map_Page == 0)
+        return EUNSUPPORTED;
+    if (((prot & PROT_READ) && !(file->mode & O_READ)) ||
+        ((prot & PROT_WRITE) && !(file->mode & O_WRITE)))
+        return EACCESS;
+    /* Mappings may not extend past the page containing end of file. */
+    if (offset + size < offset || offset + size > Round_Up_To_Page(file->endPos))
+        return EINVALID;
+
+    region = Create_Region(context, size, file, offset, prot);
+    if (region == 0)
+        return ENOMEM;
+
+    return region->start;
+}
+
+/*
+ * Map a range of zero-filled memory into the user address space.
+ * Pages are allocated when first touched.
+ * Must be called with interrupts disabled.
+ * Returns: user address of the mapping, or error code (< 0)
+ */
+int Map_Anonymous_Region(struct User_Context *context, ulong_t length)
+{
+    struct Mmap_Region *region;
+    ulong_t size = Round_Up_To_Page(length);
+
+    if (length == 0 || size < length)
+        return EINVALID;
+
+    region = Create_Region(context, size, 0, 0, PROT_READ | PROT_WRITE);
+    if (region == 0)
+        return ENOMEM;
+
+    return region->start;
+}
+
+/*
+ * Move the end of the heap by increment bytes.
+ * Pages added to the heap are zero-filled on first touch;
+ * whole pages dropped from it are freed.
+ * Must be called with interrupts disabled.
+ * Returns: the previous end of the heap, or error code (< 0)
+ */
+int Change_Heap_Break(struct User_Context *context, int increment)
+{
+    ulong_t oldBreak = context->heapBreak;
+    ulong_t newBreak = oldBreak + increment;
+
+    if (increment > 0 && (newBreak < oldBreak || newBreak > USER_MMAP_START))
+        return ENOMEM;
+    if (increment < 0 && (newBreak > oldBreak || newBreak < context->heapStart))
+        return EINVALID;
+
+    if (increment < 0) {
+        ulong_t addr;
+
+        for (addr = Round_Up_To_Page(newBreak); addr < Round_Up_To_Page(oldBreak); addr += PAGE_SIZE) {
+            pte_t *entry = Find_Page_Table_Entry(context->pageDir, USER_BASE_VADDR + addr);
+            if (entry != 0)
+                Free_User_Page(entry);
+        }
+        if (context->pageDir == Get_PDBR())
+            Flush_TLB();
+    }
+
+    context->heapBreak = newBreak;
+    return oldBreak;
+}
+
+/*
+ * Remove a mapping created by Mmap_File() or Map_Anonymous_Region().
+ * Only whole mappings can be removed: addr must be the start
+ * of a mapping and length must not exceed it.
+ * Must be called with interrupts disabled.
+ * Returns: 0 if successful, error code (< 0) if not
+ */
+int Munmap_File(struct User_Context *context, ulong_t addr, ulong_t length)
+{
+    struct Mmap_Region *region = Find_Mmap_Region(context, addr);
+
+    if (region == 0 || region->start != addr)
+        return EINVALID;
+    if (length == 0 || Round_Up_To_Page(length) > region->numPages * PAGE_SIZE)
+        return EINVALID;
+
+    return Unmap_Region(context, region);
+}
+
+/*
+ * Propagate writes made through writable mappings of given file
+ * to the filesystem, so that a following Fsync() writes them to disk.
+ * Must be called with interrupts disabled.
+ */
+void Sync_Mapped_File(struct User_Context *context, struct File *file)
+{
+    struct Mmap_Region *region;
+
+    for (region = Get_Front_Of_Mmap_Region_List(&context->mmapList);
+         region != 0;
+         region = Get_Next_In_Mmap_Region_List(region)) {
+        if (region->file != file || !(region->prot & PROT_WRITE))
+            continue;
+
+        for (ulong_t i = 0; i < region->numPages; ++i) {
+            ulong_t vaddr = USER_BASE_VADDR + region->start + i * PAGE_SIZE;
+            pte_t *entry = Find_Page_Table_Entry(context->pageDir, vaddr);
+
+            if (entry == 0 || entry->present == 0 || entry->dirty == 0)
+                continue;
+            entry->dirty = 0;
+            if (context->pageDir == Get_PDBR())
+                Flush_TLB();
+            Enable_Interrupts();
+            file->ops->Dirty_Page(file, region->pageCookies[i]);
+            Disable_Interrupts();
+        }
+    }
+}
+
+/*
+ * Push every resident pageable page of a process out to the
+ * paging file and free the frames.  The caller must hold a
+ * reference to the context, so it isn't destroyed meanwhile.
+ * Stops early if the paging file fills up.
+ * Returns the number of pages freed.
+ */
+int Swap_Out_User_Context(struct User_Context *context)
+{
+    int numFreed = 0;
+
+    Disable_Interrupts();
+    for (int i = NUM_PAGE_DIR_ENTRIES / 2; i < NUM_PAGE_DIR_ENTRIES; ++i) {
+        pde_t *dirEntry = &context->pageDir[i];
+        pte_t *table;
+
+        if (!dirEntry->present)
+            continue;
+        table = (pte_t*) (dirEntry->pageTableBaseAddr << PAGE_POWER);
+        for (int j = 0; j < NUM_PAGE_TABLE_ENTRIES; ++j) {
+            pte_t *entry = &table[j];
+            struct Page *page;
+
+            if (!entry->present)
+                continue;
+            /* Skip mapped file pages, and pages being paged in or out */
+            page = Get_Page(entry->pageBaseAddr << PAGE_POWER);
+            if ((page->flags & (PAGE_PAGEABLE | PAGE_ALLOCATED)) != (PAGE_PAGEABLE | PAGE_ALLOCATED) ||
+                page->entry != entry)
+                continue;
+            if (!Page_Out(page))
+                goto done;
+            Free_Page((void*) Get_Page_Address(page));
+            ++numFreed;
+        }
+    }
+
+done:
+    Enable_Interrupts();
+    return numFreed;
+}
+
+/*
+ * Handle a page fault on the heap, a memory mapped file
+ * or an anonymous region.
+ * Called from the page fault handler with interrupts disabled.
+ * Returns true if the fault was resolved, false if the address
+ * is not part of a mapping or the access is not permitted.
+ */
+bool Handle_User_Memory_Fault(struct User_Context *context, ulong_t address, faultcode_t faultCode)
+{
+    struct Mmap_Region *region;
+    struct File *file;
+    pte_t *table, *entry;
+    ulong_t userAddr, index, generation;
+    void *page = 0, *cookie = 0;
+    bool writable;
+    int rc;
+
+    if (address < USER_BASE_VADDR || faultCode.protectionViolation)
+        return false;
+    userAddr = address - USER_BASE_VADDR;
+
+    if (userAddr >= context->heapStart && userAddr < Round_Up_To_Page(context->heapBreak)) {
+        region = 0;
+        writable = true;
+    } else {
+        region = Find_Mmap_Region(context, userAddr);
+        if (region == 0)
+            return false;
+        writable = (region->prot & PROT_WRITE) != 0;
+        if (faultCode.writeFault && !writable)
+            return false;
+    }
+
+    table = Get_Or_Insert_Page_Table(&context->pageDir[PAGE_DIRECTORY_INDEX(address)],
+        VM_READ | VM_WRITE | VM_EXEC | VM_USER);
+    if (table == 0)
+        return false;
+    entry = &table[PAGE_TABLE_INDEX(address)];
+
+    /* Heap or anonymous region */
+    if (region == 0 || region->file == 0)
+        return Map_Zero_Page(context, entry, Round_Down_To_Page(address));
+
+    index = (Round_Down_To_Page(userAddr) - region->start) / PAGE_SIZE;
+
+    /*
+     * Other threads of the process run while we wait for the file,
+     * and may unmap the region or fault the same page in themselves.
+     * Hold the file open so that we can undo our mapping in that case.
+     */
+    file = region->file;
+    ++file->refCount;
+    generation = context->mmapGeneration;
+
+    Enable_Interrupts();
+    rc = file->ops->Map_Page(file, region->offset + index * PAGE_SIZE,
+        writable, &page, &cookie);
+    Disable_Interrupts();
+
+    if (context->mmapGeneration != generation || entry->present) {
+        if (rc == 0) {
+            Enable_Interrupts();
+            file->ops->Unmap_Page(file, cookie, false);
+            Disable_Interrupts();
+        }
+        Put_File(file);
+        /* Retry the access; it faults again if the region is gone */
+        return true;
+    }
+    Put_File(file);
+
+    if (rc == ENOTFOUND && !writable) {
+        /* Hole in a read-only mapping: use a private zero-filled page. */
+        page = Alloc_Page();
+        if (page == 0)
+            return false;
+        memset(page, '\0', PAGE_SIZE);
+        cookie = 0;
+    } else if (rc != 0)
+        return false;
+
+    entry->present = 1;
+    entry->flags = VM_READ | VM_EXEC | VM_USER | (writable ? VM_WRITE : 0);
+    entry->pageBaseAddr = (uint_t) page >> PAGE_POWER;
+    region->pageCookies[index] = cookie;
 
+    return true;
+}
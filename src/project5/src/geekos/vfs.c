@@ -14,7 +14,9 @@
 #include <geekos/screen.h>
 #include <geekos/malloc.h>
 #include <geekos/synch.h>
+#include <geekos/int.h>
 #include <geekos/vfs.h>
+#include <geekos/paging.h>
 
 /*
  * Notes:
@@ -60,8 +62,9 @@ IMPLEMENT_LIST(Filesystem_List, Filesystem);
 /* List of registered filesystem types. */
 static struct Filesystem_List s_filesystemList;
 
-/* Registered paging device. */
-static struct Paging_Device *s_pagingDevice;
+/* Registered paging devices, in order of decreasing priority. */
+static struct Paging_Device *s_pagingDevices[MAX_PAGING_DEVICES];
+static int s_numPagingDevices;
 
 #define MAX_PREFIX_LEN 16
 
@@ -252,6 +255,7 @@ bool Register_Filesystem(const char *fsName, struct Filesystem_Ops *fsOps)
     fs = (struct Filesystem*) Malloc(sizeof(*fs));
     if (fs == 0)
 	return false;
+    memset(fs, '\0', sizeof(*fs));
 
     /* Copy filesystem name and vtable. */
     fs->ops = fsOps;
@@ -340,8 +344,11 @@ int Mount(const char *devname, const char *pathPrefix, const char *fstype)
     }
     KASSERT(fs->ops->Mount != 0); /* All filesystems must implement Mount(). */
 
-    /* Attempt to open the block device */
-    if ((rc = Open_Block_Device(devname, &dev)) < 0)
+    /*
+     * Attempt to open the block device.
+     * Filesystems that live in memory are mounted on "none".
+     */
+    if (strcmp(devname, "none") != 0 && (rc = Open_Block_Device(devname, &dev)) < 0)
 	return rc;
 
     /* Create Mount_Point structure. */
@@ -426,6 +433,21 @@ int Close(struct File *file)
     return rc;
 }
 
+/*
+ * Drop one reference to a file (see File::refCount), closing it
+ * when the last reference goes away.
+ * Params:
+ *   file - the File
+ * Returns: 0 if successful, error code (< 0) if not
+ */
+int Release_File(struct File *file)
+{
+    KASSERT(file->refCount > 0);
+    if (--file->refCount > 0)
+	return 0;
+    return Close(file);
+}
+
 /*
  * Get metadata for file specified by given path.
  * Params:
@@ -470,6 +492,9 @@ int Sync(void)
 	 mountPoint = Get_Next_In_Mount_Point_List(mountPoint)) {
 	KASSERT(mountPoint->ops->Sync != 0);/* All filesystems must implement Sync */
 	rc = mountPoint->ops->Sync(mountPoint);
+	/* Then get it out of the drive's write cache */
+	if (rc == 0 && mountPoint->dev != 0)
+	    rc = Block_Flush(mountPoint->dev);
 	if (rc != 0)
 	    break;
     }
@@ -478,6 +503,24 @@ int Sync(void)
     return rc;
 }
 
+/*
+ * Write back all buffered data of the filesystem a file belongs to.
+ * Params:
+ *   file - the File
+ * Returns: 0 if successful, error code (< 0) if not
+ */
+int Fsync(struct File *file)
+{
+    struct Mount_Point *mountPoint = file->mountPoint;
+    int rc;
+
+    KASSERT(mountPoint->ops->Sync != 0);/* All filesystems must implement Sync */
+    rc = mountPoint->ops->Sync(mountPoint);
+    if (rc == 0 && mountPoint->dev != 0)
+	rc = Block_Flush(mountPoint->dev);
+    return rc;
+}
+
 /*
  * Allocate a new File object.
  * Params:
@@ -503,6 +546,7 @@ struct File *Allocate_File(struct File_Ops *ops, int filePos, int endPos, void *
         file->fsData = fsData;
         file->mode = mode;
         file->mountPoint = mountPoint;
+        file->refCount = 1;
     }
     return file;
 }
@@ -719,21 +763,46 @@ int Read_Entry(struct File *file, struct VFS_Dir_Entry *entry)
 
 /*
  * Register a paging device.
+ * It is put after the devices with the same or higher priority.
+ * Returns 0 if successful, error code (< 0) if not; the caller
+ * still owns the Paging_Device then.
  */
-void Register_Paging_Device(struct Paging_Device *pagingDevice)
+int Register_Paging_Device(struct Paging_Device *pagingDevice)
 {
-    KASSERT(s_pagingDevice == 0);
+    bool iflag;
+    int i, rc;
+
     KASSERT(pagingDevice != 0);
-    Print("Registering paging device: %s on %s\n", pagingDevice->fileName, pagingDevice->dev->name);
-    s_pagingDevice = pagingDevice;
+
+    if (s_numPagingDevices == MAX_PAGING_DEVICES) {
+	Print("Too many paging devices, not using %s\n", pagingDevice->fileName);
+	return ENOSPACE;
+    }
+    rc = Init_Paging_Device(pagingDevice);
+    if (rc < 0) {
+	Print("Could not set up paging device %s\n", pagingDevice->fileName);
+	return rc;
+    }
+    Print("Registering paging device: %s on %s, priority %d\n", pagingDevice->fileName,
+	pagingDevice->dev->name, pagingDevice->priority);
+
+    /* The paging code looks at the devices with interrupts disabled */
+    iflag = Begin_Int_Atomic();
+    for (i = s_numPagingDevices; i > 0 && s_pagingDevices[i - 1]->priority < pagingDevice->priority; --i)
+	s_pagingDevices[i] = s_pagingDevices[i - 1];
+    s_pagingDevices[i] = pagingDevice;
+    ++s_numPagingDevices;
+    End_Int_Atomic(iflag);
+
+    return 0;
 }
 
 /*
- * Get the paging device.
- * Returns null if no paging device has been registered.
+ * Get the n'th paging device, counting from the highest priority.
+ * Returns null if there are no more paging devices.
  */
-struct Paging_Device *Get_Paging_Device(void)
+struct Paging_Device *Get_Paging_Device(int n)
 {
-    return s_pagingDevice;
+    return n < s_numPagingDevices ? s_pagingDevices[n] : 0;
 }
 
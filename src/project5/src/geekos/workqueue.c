@@ -0,0 +1,99 @@
+/*
+ * Kernel worker thread pool
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/kassert.h>
+#include <geekos/errno.h>
+#include <geekos/int.h>
+#include <geekos/string.h>
+#include <geekos/malloc.h>
+#include <geekos/kthread.h>
+#include <geekos/workqueue.h>
+
+/*
+ * Number of worker threads shared by all subsystems.
+ */
+#define NUM_WORKER_THREADS 2
+
+static struct Work_Item_List s_workList;
+static struct Thread_Queue s_workerWaitQueue;
+
+/*
+ * Body of a worker thread: run queued work items forever.
+ */
+static void Worker_Thread(ulong_t arg)
+{
+    Disable_Interrupts();
+
+    while (true) {
+	struct Work_Item *item;
+	void (*func)(ulong_t);
+	ulong_t itemArg;
+
+	while (Is_Work_Item_List_Empty(&s_workList))
+	    Wait(&s_workerWaitQueue);
+	item = Remove_From_Front_Of_Work_Item_List(&s_workList);
+
+	/* The item may be queued again (or freed) as soon as it is off the list. */
+	func = item->func;
+	itemArg = item->arg;
+	if (item->dynamic)
+	    Free(item);
+
+	Enable_Interrupts();
+	func(itemArg);
+	Disable_Interrupts();
+    }
+}
+
+/*
+ * Start the worker threads.
+ */
+void Init_Work_Queue(void)
+{
+    int i;
+
+    for (i = 0; i < NUM_WORKER_THREADS; ++i)
+	Start_Kernel_Thread(Worker_Thread, i, PRIORITY_NORMAL, true);
+}
+
+/*
+ * Queue a statically allocated work item.
+ * Does nothing if the item is already queued and has not started yet.
+ * May be called from interrupt handlers.
+ */
+void Queue_Work_Item(struct Work_Item *item)
+{
+    bool iflag = Begin_Int_Atomic();
+
+    if (!Is_Member_Of_Work_Item_List(&s_workList, item)) {
+	Add_To_Back_Of_Work_Item_List(&s_workList, item);
+	Wake_Up_One(&s_workerWaitQueue);
+    }
+
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Call func(arg) in a worker thread.
+ * Allocates memory, so interrupt handlers and tasklets
+ * must use Queue_Work_Item() instead.
+ * Returns 0 if successful, ENOMEM if the work could not be queued.
+ */
+int Queue_Work(void (*func)(ulong_t arg), ulong_t arg)
+{
+    struct Work_Item *item = (struct Work_Item*) Malloc(sizeof(*item));
+
+    if (item == 0)
+	return ENOMEM;
+    memset(item, '\0', sizeof(*item));
+    item->func = func;
+    item->arg = arg;
+    item->dynamic = true;
+
+    Queue_Work_Item(item);
+    return 0;
+}
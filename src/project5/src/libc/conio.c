@@ -21,6 +21,9 @@ DEF_SYSCALL(Get_Key,SYS_GETKEY,Keycode,(void),,SYSCALL_REGS_0)
 DEF_SYSCALL(Set_Attr,SYS_SETATTR,int,(int attr),int arg0 = attr;,SYSCALL_REGS_1)
 DEF_SYSCALL(Get_Cursor,SYS_GETCURSOR,int,(int *row, int *col),
     int *arg0 = row; int *arg1 = col;,SYSCALL_REGS_2)
+DEF_SYSCALL(Read_Kernel_Log,SYS_READKLOG,int,(char *buf, size_t bufSize),
+    char *arg0 = buf; size_t arg1 = bufSize;,SYSCALL_REGS_2)
+DEF_SYSCALL(Open_Console,SYS_OPENCONSOLE,int,(void),,SYSCALL_REGS_0)
 
 
 int Put_Cursor(int row, int col)
@@ -51,6 +51,63 @@ DEF_SYSCALL(Seek,SYS_SEEK,int,(int fd, int pos),
 DEF_SYSCALL(Delete,SYS_DELETE,int,(const char *path),
     const char *arg0 = path; size_t arg1 = strlen(path);,
     SYSCALL_REGS_2)
+DEF_SYSCALL(Dup2,SYS_DUP2,int,(int oldfd, int newfd),
+    int arg0 = oldfd; int arg1 = newfd;,
+    SYSCALL_REGS_2)
+DEF_SYSCALL(Mmap,SYS_MMAP,int,(int fd, ulong_t offset, ulong_t length, int prot),
+    int arg0 = fd; ulong_t arg1 = offset; ulong_t arg2 = length; int arg3 = prot;,
+    SYSCALL_REGS_4)
+DEF_SYSCALL(Munmap,SYS_MUNMAP,int,(void *addr, ulong_t length),
+    void *arg0 = addr; ulong_t arg1 = length;,
+    SYSCALL_REGS_2)
+DEF_SYSCALL(Fsync,SYS_FSYNC,int,(int fd), int arg0 = fd;, SYSCALL_REGS_1)
+DEF_SYSCALL(Create_Pipe,SYS_CREATEPIPE,int,(int *readFd, int *writeFd),
+    int *arg0 = readFd; int *arg1 = writeFd;,
+    SYSCALL_REGS_2)
+DEF_SYSCALL(Poll,SYS_POLL,int,(struct Poll_Fd *fds, int numFds, int timeoutTicks),
+    struct Poll_Fd *arg0 = fds; int arg1 = numFds; int arg2 = timeoutTicks;,
+    SYSCALL_REGS_3)
+DEF_SYSCALL(IO_Ring_Setup,SYS_IORINGSETUP,int,(struct IO_Ring_Header *ring, ulong_t numEntries),
+    struct IO_Ring_Header *arg0 = ring; ulong_t arg1 = numEntries;,
+    SYSCALL_REGS_2)
+DEF_SYSCALL(IO_Ring_Enter,SYS_IORINGENTER,int,(ulong_t minComplete),
+    ulong_t arg0 = minComplete;,
+    SYSCALL_REGS_1)
+
+/*
+ * Get the next free submission slot of an I/O ring, or null if the
+ * ring is full.  Fill it in, then call IO_Ring_Queue() to queue it;
+ * queued submissions are started by IO_Ring_Enter().
+ */
+struct IO_Submission *IO_Ring_Get_Submission(struct IO_Ring_Header *ring)
+{
+    if (ring->sqTail - ring->sqHead == ring->numEntries)
+	return 0;
+    return &IO_RING_SUBMISSIONS(ring)[ring->sqTail & (ring->numEntries - 1)];
+}
+
+void IO_Ring_Queue(struct IO_Ring_Header *ring)
+{
+    __sync_synchronize();
+    ++ring->sqTail;
+}
+
+/*
+ * Get the oldest completion not looked at yet, or null if there is none.
+ * Call IO_Ring_Completion_Seen() when done with it.
+ */
+struct IO_Completion *IO_Ring_Get_Completion(struct IO_Ring_Header *ring)
+{
+    if (ring->cqHead == ring->cqTail)
+	return 0;
+    __sync_synchronize();
+    return &IO_RING_COMPLETIONS(ring)[ring->cqHead & (ring->numEntries - 1)];
+}
+
+void IO_Ring_Completion_Seen(struct IO_Ring_Header *ring)
+{
+    ++ring->cqHead;
+}
 
 
 
@@ -0,0 +1,222 @@
+/*
+ * User heap allocator
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <stddef.h>
+#include <geekos/ktypes.h>
+#include <string.h>
+#include <process.h>
+#include <fileio.h>
+#include <sched.h>
+#include <malloc.h>
+
+/*
+ * Small blocks come from size classes 16, 32, ..., 2048 bytes
+ * (header included).  Each class keeps a LIFO free list which is
+ * refilled by carving up a page obtained with Sbrk().
+ * Larger blocks get their own Map_Anonymous() region, which Free()
+ * gives straight back to the kernel.
+ */
+#define HEAP_PAGE_SIZE		4096
+#define MIN_CLASS_SHIFT		4
+#define NUM_SIZE_CLASSES	8
+#define MAX_SMALL_SIZE		(1 << (MIN_CLASS_SHIFT + NUM_SIZE_CLASSES - 1))
+
+#define SMALL_BLOCK_MAGIC	0x5A11B10C
+#define LARGE_BLOCK_MAGIC	0x1A46EB1C
+
+/* Header in front of every block; keeps the payload 8-byte aligned. */
+struct Block_Header {
+    ulong_t size;	/* size class index, or mapped length for a large block */
+    ulong_t magic;
+};
+
+struct Free_Block {
+    struct Free_Block *next;
+};
+
+/*
+ * Free lists of the small size classes.
+ * All threads of a process share one cache, guarded by a lock which
+ * is only held for a few instructions (or one Sbrk()).  A thread that
+ * finds it taken gives the CPU away, so that the holder gets to
+ * finish rather than waiting out the spinner's time slice.
+ */
+struct Heap_Cache {
+    volatile int lock;
+    struct Free_Block *freeList[NUM_SIZE_CLASSES];
+};
+
+static struct Heap_Cache s_heapCache;
+
+static void Lock_Heap(struct Heap_Cache *cache)
+{
+    while (__sync_lock_test_and_set(&cache->lock, 1))
+	Yield();
+}
+
+static void Unlock_Heap(struct Heap_Cache *cache)
+{
+    __sync_lock_release(&cache->lock);
+}
+
+static int Size_Class(size_t total)
+{
+    int sizeClass = 0;
+
+    while ((1UL << (MIN_CLASS_SHIFT + sizeClass)) < total)
+	++sizeClass;
+    return sizeClass;
+}
+
+static size_t Class_Size(int sizeClass)
+{
+    return 1UL << (MIN_CLASS_SHIFT + sizeClass);
+}
+
+/*
+ * Carve a fresh heap page into blocks of given class.
+ * Returns false if the heap cannot grow.
+ */
+static bool Refill_Free_List(struct Heap_Cache *cache, int sizeClass)
+{
+    size_t blockSize = Class_Size(sizeClass);
+    char *page;
+    size_t off;
+    int rc;
+
+    rc = Sbrk(HEAP_PAGE_SIZE);
+    if (rc < 0)
+	return false;
+    page = (char*) rc;
+
+    for (off = 0; off + blockSize <= HEAP_PAGE_SIZE; off += blockSize) {
+	struct Free_Block *block = (struct Free_Block*) (page + off);
+	block->next = cache->freeList[sizeClass];
+	cache->freeList[sizeClass] = block;
+    }
+    return true;
+}
+
+static void *Alloc_Large(size_t total)
+{
+    struct Block_Header *header;
+    size_t length = (total + HEAP_PAGE_SIZE - 1) & ~(HEAP_PAGE_SIZE - 1);
+    int rc;
+
+    if (length < total)
+	return 0;
+    rc = Map_Anonymous(length);
+    if (rc < 0)
+	return 0;
+
+    header = (struct Block_Header*) rc;
+    header->size = length;
+    header->magic = LARGE_BLOCK_MAGIC;
+    return header + 1;
+}
+
+/*
+ * Allocate a block of at least given size.
+ * Returns null if out of memory.
+ */
+void *Malloc(size_t size)
+{
+    struct Heap_Cache *cache = &s_heapCache;
+    struct Block_Header *header;
+    struct Free_Block *block;
+    size_t total = size + sizeof(struct Block_Header);
+    int sizeClass;
+
+    if (total < size)
+	return 0;
+    if (total > MAX_SMALL_SIZE)
+	return Alloc_Large(total);
+
+    sizeClass = Size_Class(total);
+    Lock_Heap(cache);
+    if (cache->freeList[sizeClass] == 0 && !Refill_Free_List(cache, sizeClass)) {
+	Unlock_Heap(cache);
+	return 0;
+    }
+
+    block = cache->freeList[sizeClass];
+    cache->freeList[sizeClass] = block->next;
+    Unlock_Heap(cache);
+
+    header = (struct Block_Header*) block;
+    header->size = sizeClass;
+    header->magic = SMALL_BLOCK_MAGIC;
+    return header + 1;
+}
+
+/*
+ * Return a block obtained from Malloc() or Realloc().
+ */
+void Free(void *ptr)
+{
+    struct Heap_Cache *cache = &s_heapCache;
+    struct Block_Header *header;
+    struct Free_Block *block;
+    int sizeClass;
+
+    if (ptr == 0)
+	return;
+    header = ((struct Block_Header*) ptr) - 1;
+
+    if (header->magic == LARGE_BLOCK_MAGIC) {
+	header->magic = 0;
+	Munmap(header, header->size);
+	return;
+    }
+    if (header->magic != SMALL_BLOCK_MAGIC)
+	return;
+
+    sizeClass = header->size;
+    header->magic = 0;
+    block = (struct Free_Block*) header;
+    Lock_Heap(cache);
+    block->next = cache->freeList[sizeClass];
+    cache->freeList[sizeClass] = block;
+    Unlock_Heap(cache);
+}
+
+/*
+ * Resize a block, moving it if it does not fit in place.
+ * Returns the (possibly moved) block, or null if out of memory,
+ * in which case the original block is left alone.
+ */
+void *Realloc(void *ptr, size_t size)
+{
+    struct Block_Header *header;
+    size_t capacity;
+    void *newPtr;
+
+    if (ptr == 0)
+	return Malloc(size);
+    if (size == 0) {
+	Free(ptr);
+	return 0;
+    }
+
+    header = ((struct Block_Header*) ptr) - 1;
+    if (header->magic == LARGE_BLOCK_MAGIC)
+	capacity = header->size - sizeof(struct Block_Header);
+    else if (header->magic == SMALL_BLOCK_MAGIC)
+	capacity = Class_Size(header->size) - sizeof(struct Block_Header);
+    else
+	return 0;
+
+    if (size <= capacity)
+	return ptr;
+
+    newPtr = Malloc(size);
+    if (newPtr == 0)
+	return 0;
+    memcpy(newPtr, ptr, capacity);
+    Free(ptr);
+    return newPtr;
+}
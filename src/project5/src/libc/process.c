@@ -23,10 +23,54 @@ DEF_SYSCALL(Spawn_Program,SYS_SPAWN,int,
     const char *arg0 = program; size_t arg1 = strlen(program); const char *arg2 = command; size_t arg3 = strlen(command);,
     SYSCALL_REGS_4)
 DEF_SYSCALL(Wait,SYS_WAIT,int,(int pid),int arg0 = pid;,SYSCALL_REGS_1)
+DEF_SYSCALL(Wait_Timeout,SYS_WAITTIMEOUT,int,(int pid, int ticks),int arg0 = pid; int arg1 = ticks;,SYSCALL_REGS_2)
 DEF_SYSCALL(Get_PID,SYS_GETPID,int,(void),,SYSCALL_REGS_0)
+DEF_SYSCALL(Sbrk,SYS_SBRK,int,(int increment),int arg0 = increment;,SYSCALL_REGS_1)
+DEF_SYSCALL(Map_Anonymous,SYS_MAPANONYMOUS,int,(ulong_t length),ulong_t arg0 = length;,SYSCALL_REGS_1)
+static DEF_SYSCALL(Create_Thread,SYS_CREATETHREAD,int,
+    (void (*entry)(void *arg), void *stackTop, void *arg),
+    void (*arg0)(void *) = entry; void *arg1 = stackTop; void *arg2 = arg;,
+    SYSCALL_REGS_3)
+DEF_SYSCALL(Join_Thread,SYS_JOINTHREAD,int,(int tid),int arg0 = tid;,SYSCALL_REGS_1)
+DEF_SYSCALL(Exit_Thread,SYS_EXITTHREAD,int,(int exitCode),int arg0 = exitCode;,SYSCALL_REGS_1)
 
 #define CMDLEN 79
 
+/*
+ * What a new thread should run; kept at the top of its own stack.
+ */
+struct Thread_Start {
+    int (*entry)(void *arg);
+    void *arg;
+};
+
+/*
+ * Every thread starts here, so that returning from the
+ * entry function ends the thread rather than faulting.
+ */
+static void Thread_Start(void *arg)
+{
+    struct Thread_Start *start = arg;
+
+    Exit_Thread(start->entry(start->arg));
+}
+
+/*
+ * Start a thread running entry(arg) on the given stack.
+ * The thread ends when entry returns, with its return
+ * value as exit code, or when it calls Exit_Thread().
+ */
+int Create_User_Thread(int (*entry)(void *arg), void *stackTop, void *arg)
+{
+    struct Thread_Start *start;
+
+    start = (struct Thread_Start *) (((ulong_t) stackTop - sizeof(*start)) & ~3UL);
+    start->entry = entry;
+    start->arg = arg;
+
+    return Create_Thread(Thread_Start, start, start);
+}
+
 static bool Ends_With(const char *name, const char *suffix)
 {
     size_t nameLen = strlen(name);
@@ -15,4 +15,8 @@ DEF_SYSCALL(Set_Scheduling_Policy,SYS_SETSCHEDULINGPOLICY,int, (int policy, int
     int arg0 = policy; int arg1 = quantum;,
     SYSCALL_REGS_2)
 DEF_SYSCALL(Get_Time_Of_Day,SYS_GETTIMEOFDAY,int,(void),,SYSCALL_REGS_0)
+DEF_SYSCALL(Set_Weight,SYS_SETWEIGHT,int,(int pid, int weight),
+    int arg0 = pid; int arg1 = weight;,
+    SYSCALL_REGS_2)
+DEF_SYSCALL(Yield,SYS_YIELD,int,(void),,SYSCALL_REGS_0)
 
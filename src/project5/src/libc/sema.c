@@ -16,6 +16,7 @@ DEF_SYSCALL(Create_Semaphore,SYS_CREATESEMAPHORE,int,(const char *name, int ival
     const char *arg0 = name; size_t arg1 = strlen(name); int arg2 = ival;,
     SYSCALL_REGS_3)
 DEF_SYSCALL(P,SYS_P,int,(int s),int arg0 = s;,SYSCALL_REGS_1)
+DEF_SYSCALL(P_Timeout,SYS_PTIMEOUT,int,(int s, int ticks),int arg0 = s; int arg1 = ticks;,SYSCALL_REGS_2)
 DEF_SYSCALL(V,SYS_V,int,(int s),int arg0 = s;,SYSCALL_REGS_1)
 DEF_SYSCALL(Destroy_Semaphore,SYS_DESTROYSEMAPHORE,int,(int s),int arg0 = s;,SYSCALL_REGS_1)
 
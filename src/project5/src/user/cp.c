@@ -12,15 +12,60 @@
 #include <conio.h>
 #include <process.h>
 #include <fileio.h>
+#include <malloc.h>
+
+/*
+ * The copy goes through an I/O ring: reads of the next few
+ * chunks are in flight while the previous chunk is written.
+ * Writes go out one at a time, in file order.
+ */
+#define NUM_CHUNKS 4
+#define CHUNK_SIZE (16 * 1024)
+#define RING_ENTRIES 4		/* at most one op per chunk in flight */
+
+/* What a chunk buffer is doing */
+#define CHUNK_FREE	0
+#define CHUNK_READING	1
+#define CHUNK_FULL	2	/* read, waiting for its turn to be written */
+#define CHUNK_WRITING	3
+
+struct Chunk {
+    char *buf;
+    int state;
+    ulong_t offset;		/* file offset of the data */
+    ulong_t length;
+    ulong_t done;		/* bytes read or written so far */
+};
+
+static char s_ring[IO_RING_SIZE(RING_ENTRIES)] __attribute__ ((aligned (4)));
+static struct Chunk s_chunks[NUM_CHUNKS];
+
+/* Queue the rest of a chunk's read or write */
+static void Submit(struct IO_Ring_Header *ring, int opcode, int fd, struct Chunk *chunk)
+{
+    struct IO_Submission *sqe = IO_Ring_Get_Submission(ring);
+
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->buf = (ulong_t) (chunk->buf + chunk->done);
+    sqe->length = chunk->length - chunk->done;
+    sqe->offset = chunk->offset + chunk->done;
+    sqe->userData = chunk - s_chunks;
+    IO_Ring_Queue(ring);
+}
 
 int main(int argc, char *argv[])
 {
     int ret;
-    int read;
     int inFd;
     int outFd;
     struct VFS_File_Stat stat;
-    char buffer[1024];
+    struct IO_Ring_Header *ring = (struct IO_Ring_Header*) s_ring;
+    struct IO_Completion *cqe;
+    ulong_t nextRead = 0, nextWrite = 0;
+    int numInFlight = 0;
+    bool writing = false;
+    int i;
 
     if (argc != 3) {
         Print("usage: cp <file1> <file2>\n");
@@ -43,6 +88,20 @@ int main(int argc, char *argv[])
 	Exit(1);
     }
 
+    for (i = 0; i < NUM_CHUNKS; i++) {
+        s_chunks[i].buf = (char*) Malloc(CHUNK_SIZE);
+        if (s_chunks[i].buf == 0) {
+            Print ("Error: out of memory\n");
+	    Exit(1);
+        }
+    }
+
+    ret = IO_Ring_Setup(ring, RING_ENTRIES);
+    if (ret != 0) {
+        Print ("Error: could not set up I/O ring: %s\n", Get_Error_String(ret));
+	Exit(1);
+    }
+
     /* now open destination file */
     outFd = Open(argv[2], O_WRITE|O_CREATE);
     if (outFd < 0) {
@@ -50,20 +109,84 @@ int main(int argc, char *argv[])
 	Exit(1);
     }
 
-    for (read =0; read < stat.size; read += ret) {
-        ret = Read(inFd, buffer, sizeof(buffer));
-	if (ret < 0) {
-	    Print("Error reading file for copy: %s\n", Get_Error_String(ret));
-	    Exit(1);
-	}
+    while (true) {
+        /* Read ahead into every free chunk */
+        for (i = 0; i < NUM_CHUNKS && nextRead < (ulong_t) stat.size; i++) {
+            struct Chunk *chunk = &s_chunks[i];
 
-	ret = Write(outFd, buffer, ret);
-	if (ret < 0) {
-	    Print("Error writing file for copy: %s\n", Get_Error_String(ret));
-	    Exit(1);
-	}
+            if (chunk->state != CHUNK_FREE)
+                continue;
+            chunk->state = CHUNK_READING;
+            chunk->offset = nextRead;
+            chunk->length = stat.size - nextRead < CHUNK_SIZE ? stat.size - nextRead : CHUNK_SIZE;
+            chunk->done = 0;
+            nextRead += chunk->length;
+            Submit(ring, IO_OP_READ, inFd, chunk);
+            ++numInFlight;
+        }
+
+        /* Write the next part of the file, once it is in */
+        for (i = 0; i < NUM_CHUNKS && !writing; i++) {
+            struct Chunk *chunk = &s_chunks[i];
+
+            if (chunk->state != CHUNK_FULL || chunk->offset != nextWrite)
+                continue;
+            chunk->state = CHUNK_WRITING;
+            chunk->done = 0;
+            Submit(ring, IO_OP_WRITE, outFd, chunk);
+            ++numInFlight;
+            writing = true;
+        }
+
+        if (numInFlight == 0)
+            break;
+
+        ret = IO_Ring_Enter(1);
+        if (ret < 0) {
+            Print("Error waiting for copy: %s\n", Get_Error_String(ret));
+            Exit(1);
+        }
+
+        while ((cqe = IO_Ring_Get_Completion(ring)) != 0) {
+            struct Chunk *chunk = &s_chunks[cqe->userData];
+
+            ret = cqe->result;
+            IO_Ring_Completion_Seen(ring);
+            --numInFlight;
+
+            if (chunk->state == CHUNK_READING) {
+                if (ret <= 0) {
+                    Print("Error reading file for copy: %s\n",
+                        ret == 0 ? "file got shorter" : Get_Error_String(ret));
+                    Exit(1);
+                }
+                chunk->done += ret;
+                if (chunk->done < chunk->length) {
+                    Submit(ring, IO_OP_READ, inFd, chunk);
+                    ++numInFlight;
+                } else
+                    chunk->state = CHUNK_FULL;
+            } else {
+                if (ret <= 0) {
+                    Print("Error writing file for copy: %s\n",
+                        ret == 0 ? "nothing written" : Get_Error_String(ret));
+                    Exit(1);
+                }
+                chunk->done += ret;
+                if (chunk->done < chunk->length) {
+                    Submit(ring, IO_OP_WRITE, outFd, chunk);
+                    ++numInFlight;
+                } else {
+                    chunk->state = CHUNK_FREE;
+                    nextWrite += chunk->length;
+                    writing = false;
+                }
+            }
+        }
     }
 
+    for (i = 0; i < NUM_CHUNKS; i++)
+        Free(s_chunks[i].buf);
     Close(inFd);
     Close(outFd);
 
@@ -0,0 +1,27 @@
+/*
+ * dmesg - print the kernel log
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <fileio.h>
+
+/* Same as KLOG_SIZE, the most the kernel keeps */
+static char s_log[16384];
+
+int main(int argc, char **argv)
+{
+    int n;
+
+    n = Read_Kernel_Log(s_log, sizeof(s_log));
+    if (n < 0) {
+	Print("Could not read kernel log: %s\n", Get_Error_String(n));
+	return 1;
+    }
+
+    Write(1, s_log, n);
+    return 0;
+}
@@ -16,12 +16,13 @@ static void List_File(const char *filename, struct VFS_File_Stat *stat)
     struct VFS_ACL_Entry owner = stat->acls[0];
     bool isDir = stat->isDirectory;
 
-    Print("%c%c%c  % 6d  % 10d  %s%s%s\n",
+    Print("%c%c%c  % 6d  % 10d  % 6d  %s%s%s\n",
 	isDir ? 'd' : '-',
 	owner.permission & O_READ ? 'r' : '-',
 	owner.permission & O_WRITE ? 'w' : '-',
 	owner.uid,
 	stat->size,
+	stat->numBlocks,
 	isDir ? "[" : "",
 	filename,
 	isDir ? "]" : "");
@@ -0,0 +1,86 @@
+/*
+ * Check that Poll() waits on pipes and the console together.
+ *
+ *   polltest		run the tests; asks for a key press
+ *
+ * A second thread writes to the pipe while the main thread sleeps
+ * in Poll(), then the user's key press wakes it from the console.
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <fileio.h>
+#include <string.h>
+
+#define STACK_SIZE 4096
+#define WRITER_DELAY 20		/* ticks before the writer thread writes */
+#define KEY_TIMEOUT 2000	/* ticks to wait for a key press */
+
+static char s_stack[STACK_SIZE];
+
+/* Write one byte to the pipe, once the main thread is asleep */
+static int Writer(void *arg)
+{
+  int fd = (int) arg;
+
+  Poll(0, 0, WRITER_DELAY);
+  return Write(fd, "x", 1);
+}
+
+static int Check(const char *what, int got, int expected)
+{
+  if (got == expected) {
+    Print("%-40s ok\n", what);
+    return 0;
+  }
+  Print("%-40s got %d, expected %d  <-- FAILED\n", what, got, expected);
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  struct Poll_Fd fds[2];
+  int readFd, writeFd, console, writer;
+  int failed = 0;
+  Keycode key;
+  char c;
+
+  if (Create_Pipe(&readFd, &writeFd) < 0 || (console = Open_Console()) < 0) {
+    Print("could not open pipe or console\n");
+    Exit(1);
+  }
+
+  fds[0].fd = readFd;
+  fds[0].events = POLL_IN;
+  fds[1].fd = console;
+  fds[1].events = POLL_IN;
+
+  /* Throw away keys typed ahead */
+  while (Poll(&fds[1], 1, 0) > 0)
+    Read(console, &key, sizeof(key));
+
+  failed += Check("nothing ready", Poll(fds, 2, 0), 0);
+
+  writer = Create_User_Thread(Writer, &s_stack[STACK_SIZE], (void *) writeFd);
+  failed += Check("woken by pipe", Poll(fds, 2, -1), 1);
+  failed += Check("  pipe ready", fds[0].revents, POLL_IN);
+  failed += Check("  console not ready", fds[1].revents, 0);
+  failed += Check("  read pipe", Read(readFd, &c, 1), 1);
+  failed += Check("  writer done", Join_Thread(writer), 1);
+
+  Print("press a key...\n");
+  failed += Check("woken by console", Poll(fds, 2, KEY_TIMEOUT), 1);
+  failed += Check("  pipe not ready", fds[0].revents, 0);
+  failed += Check("  console ready", fds[1].revents, POLL_IN);
+  failed += Check("  read console", Read(console, &key, sizeof(key)) >= (int) sizeof(key), 1);
+
+  Close(writeFd);
+  failed += Check("hang up", Poll(fds, 1, 0), 1);
+  failed += Check("  pipe hung up", fds[0].revents, POLL_IN | POLL_HUP);
+
+  Close(readFd);
+  Close(console);
+
+  Print(failed ? "FAILED\n" : "PASSED\n");
+  return failed;
+}
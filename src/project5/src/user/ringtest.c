@@ -0,0 +1,120 @@
+/*
+ * Check the I/O ring: batched, positioned reads and writes, and
+ * opens, syncs and closes going through the ring.
+ *
+ *   ringtest [file]	scratch file defaults to /d/ringtest.dat
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <fileio.h>
+#include <string.h>
+
+#define RING_ENTRIES 8
+#define NUM_BLOCKS 4
+#define BLOCK_SIZE 1024
+
+static char s_ring[IO_RING_SIZE(RING_ENTRIES)] __attribute__ ((aligned (4)));
+static char s_blocks[NUM_BLOCKS][BLOCK_SIZE];
+static int s_results[RING_ENTRIES];
+
+static struct IO_Ring_Header *s_header = (struct IO_Ring_Header*) s_ring;
+
+static void Queue(int opcode, int fd, void *buf, ulong_t length, ulong_t offset, int slot)
+{
+  struct IO_Submission *sqe = IO_Ring_Get_Submission(s_header);
+
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->buf = (ulong_t) buf;
+  sqe->length = length;
+  sqe->offset = offset;
+  sqe->userData = slot;
+  IO_Ring_Queue(s_header);
+}
+
+/* Start the queued submissions and collect n results, by slot */
+static int Run(int n)
+{
+  struct IO_Completion *cqe;
+  int rc;
+
+  while (n > 0) {
+    rc = IO_Ring_Enter(1);
+    if (rc < 0)
+      return rc;
+    while ((cqe = IO_Ring_Get_Completion(s_header)) != 0) {
+      s_results[cqe->userData] = cqe->result;
+      IO_Ring_Completion_Seen(s_header);
+      --n;
+    }
+  }
+  return 0;
+}
+
+static int Check(const char *what, int got, int expected)
+{
+  if (got == expected) {
+    Print("%-32s ok\n", what);
+    return 0;
+  }
+  Print("%-32s got %d, expected %d  <-- FAILED\n", what, got, expected);
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  const char *path = argc > 1 ? argv[1] : "/d/ringtest.dat";
+  int failed = 0;
+  int fd, i, same;
+
+  failed += Check("setup", IO_Ring_Setup(s_header, RING_ENTRIES), 0);
+  failed += Check("setup twice", IO_Ring_Setup(s_header, RING_ENTRIES) < 0, 1);
+
+  Queue(IO_OP_NOP, 0, 0, 0, 0, 0);
+  Queue(IO_OP_OPEN, O_CREATE | O_READ | O_WRITE, (void *) path, strlen(path), 0, 1);
+  Run(2);
+  failed += Check("nop", s_results[0], 0);
+  failed += Check("open", s_results[1] >= 0, 1);
+  fd = s_results[1];
+
+  /* One batch of writes, each at its own offset */
+  for (i = 0; i < NUM_BLOCKS; i++) {
+    memset(s_blocks[i], 'a' + i, BLOCK_SIZE);
+    Queue(IO_OP_WRITE, fd, s_blocks[i], BLOCK_SIZE, i * BLOCK_SIZE, i);
+  }
+  Run(NUM_BLOCKS);
+  for (i = 0; i < NUM_BLOCKS; i++)
+    failed += Check("write block", s_results[i], BLOCK_SIZE);
+
+  Queue(IO_OP_READ, fd, s_blocks[0], 0, 0, 0);
+  Queue(IO_OP_FSYNC, fd, 0, 0, 0, 1);
+  Queue(IO_OP_READ, fd + 100, s_blocks[0], BLOCK_SIZE, 0, 2);
+  Run(3);
+  failed += Check("zero length read", s_results[0], 0);
+  failed += Check("fsync", s_results[1], 0);
+  failed += Check("bad descriptor", s_results[2] < 0, 1);
+
+  /* Read the blocks back into each other's buffers */
+  memset(s_blocks, 0, sizeof(s_blocks));
+  for (i = 0; i < NUM_BLOCKS; i++)
+    Queue(IO_OP_READ, fd, s_blocks[NUM_BLOCKS - 1 - i], BLOCK_SIZE, i * BLOCK_SIZE, i);
+  Run(NUM_BLOCKS);
+  for (i = 0; i < NUM_BLOCKS; i++) {
+    char *block = s_blocks[NUM_BLOCKS - 1 - i];
+    int j;
+
+    failed += Check("read block", s_results[i], BLOCK_SIZE);
+    for (j = 0, same = 1; j < BLOCK_SIZE; j++)
+      same &= block[j] == 'a' + i;
+    failed += Check("  contents", same, 1);
+  }
+
+  Queue(IO_OP_CLOSE, fd, 0, 0, 0, 0);
+  Run(1);
+  failed += Check("close", s_results[0], 0);
+
+  Delete(path);
+  Print(failed ? "FAILED\n" : "PASSED\n");
+  return failed;
+}
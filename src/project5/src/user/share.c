@@ -0,0 +1,101 @@
+/*
+ * Check that stride scheduling hands out the CPU in proportion
+ * to the weights of the runnable processes.
+ *
+ *   share <quantum> <weight>...	run one spinner per weight
+ *
+ * The spinners are this same program, started as
+ *   share -spin <start tick> <end tick>
+ * They busy-loop from the start tick to the end tick, and return
+ * the amount of work they got done as their exit code.
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <sched.h>
+#include <string.h>
+
+#define MAX_SPINNERS 8
+#define WINDOW_TICKS 500	/* length of the measurement */
+#define SETTLE_TICKS 20		/* time for everybody to get going */
+#define TOLERANCE 5		/* allowed error, in percentage points */
+
+static int Spin(int start, int end)
+{
+  int work = 0;
+  volatile int j;
+
+  /* Compete for the CPU all along, but only count inside the window */
+  while (Get_Time_Of_Day() < start)
+    for (j = 0; j < 1000; j++);
+
+  while (Get_Time_Of_Day() < end) {
+    for (j = 0; j < 1000; j++);
+    ++work;
+  }
+
+  return work;
+}
+
+int main(int argc, char **argv)
+{
+  int weights[MAX_SPINNERS], pids[MAX_SPINNERS], work[MAX_SPINNERS];
+  int numSpinners, totalWeight = 0, totalWork = 0;
+  int start, end, i, failed = 0;
+  char command[64];
+
+  if (argc == 4 && !strcmp(argv[1], "-spin"))
+    return Spin(atoi(argv[2]), atoi(argv[3]));
+
+  if (argc < 4 || argc - 2 > MAX_SPINNERS) {
+    Print("usage: %s <quantum> <weight> <weight>...\n", argv[0]);
+    Exit(1);
+  }
+
+  if (Set_Scheduling_Policy(2, atoi(argv[1])) < 0) {
+    Print("could not switch to stride scheduling\n");
+    Exit(1);
+  }
+
+  numSpinners = argc - 2;
+  start = Get_Time_Of_Day() + SETTLE_TICKS;
+  end = start + WINDOW_TICKS;
+
+  for (i = 0; i < numSpinners; i++) {
+    weights[i] = atoi(argv[i + 2]);
+    totalWeight += weights[i];
+
+    snprintf(command, sizeof(command), "/c/share.exe -spin %d %d", start, end);
+    pids[i] = Spawn_Program("/c/share.exe", command);
+    if (pids[i] < 0 || Set_Weight(pids[i], weights[i]) < 0) {
+      Print("could not start spinner with weight %d\n", weights[i]);
+      Exit(1);
+    }
+  }
+
+  /* We sleep in Wait(), so the spinners have the CPU to themselves */
+  for (i = 0; i < numSpinners; i++) {
+    work[i] = Wait(pids[i]);
+    totalWork += work[i];
+  }
+
+  if (totalWork <= 0) {
+    Print("no work done\n");
+    Exit(1);
+  }
+
+  Print("weight  expected  achieved\n");
+  for (i = 0; i < numSpinners; i++) {
+    int expected = weights[i] * 100 / totalWeight;
+    int achieved = work[i] * 100 / totalWork;
+    int error = achieved > expected ? achieved - expected : expected - achieved;
+
+    Print("%6d  %7d%%  %7d%%%s\n", weights[i], expected, achieved,
+          error > TOLERANCE ? "  <-- off" : "");
+    if (error > TOLERANCE)
+      failed = 1;
+  }
+
+  Print(failed ? "FAILED\n" : "PASSED\n");
+  return failed;
+}
@@ -0,0 +1,109 @@
+/*
+ * Check creating, joining and ending user threads.
+ *
+ *   threads		run the tests
+ *
+ * The last test runs this same program as
+ *   threads -exit
+ * which leaves one thread spinning and one asleep, and exits
+ * from under them.
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <string.h>
+
+#define STACK_SIZE 4096
+#define NUM_STACKS 4
+#define EXIT_CODE 42
+
+static char s_stacks[NUM_STACKS][STACK_SIZE];
+
+static void *Stack_Top(int i)
+{
+  return &s_stacks[i][STACK_SIZE];
+}
+
+static int Return_Arg(void *arg)
+{
+  return (int) arg;
+}
+
+static int Call_Exit_Thread(void *arg)
+{
+  Exit_Thread((int) arg);
+  return -1;
+}
+
+/* Join a sibling, and hand its exit code on */
+static int Join_Sibling(void *arg)
+{
+  int rc = Join_Thread((int) arg);
+
+  return rc < 0 ? rc : rc + 1;
+}
+
+static int Spin(void *arg)
+{
+  volatile int j;
+
+  (void) arg;
+  for (;;)
+    for (j = 0; j < 1000; j++);
+  return 0;
+}
+
+static int Check(const char *what, int got, int expected)
+{
+  if (got == expected) {
+    Print("%-32s ok\n", what);
+    return 0;
+  }
+  Print("%-32s got %d, expected %d  <-- FAILED\n", what, got, expected);
+  return 1;
+}
+
+/* Run as "threads -exit": leave threads busy, and exit */
+static int Exit_Under_Threads(void)
+{
+  int spinner = Create_User_Thread(Spin, Stack_Top(0), 0);
+
+  if (spinner < 0)
+    return -1;
+  /* Sleeps in the kernel until the spinner ends */
+  if (Create_User_Thread(Join_Sibling, Stack_Top(1), (void *) spinner) < 0)
+    return -1;
+
+  Exit(EXIT_CODE);
+  return -1;
+}
+
+int main(int argc, char **argv)
+{
+  int failed = 0;
+  int tid, sibling, pid;
+
+  if (argc == 2 && !strcmp(argv[1], "-exit"))
+    return Exit_Under_Threads();
+
+  tid = Create_User_Thread(Return_Arg, Stack_Top(0), (void *) 5);
+  failed += Check("return from entry", Join_Thread(tid), 5);
+  failed += Check("join twice", Join_Thread(tid) < 0, 1);
+
+  tid = Create_User_Thread(Call_Exit_Thread, Stack_Top(0), (void *) 7);
+  failed += Check("Exit_Thread", Join_Thread(tid), 7);
+
+  tid = Create_User_Thread(Return_Arg, Stack_Top(0), (void *) 10);
+  sibling = Create_User_Thread(Join_Sibling, Stack_Top(1), (void *) tid);
+  failed += Check("join from sibling", Join_Thread(sibling), 11);
+  failed += Check("join sibling's thread", Join_Thread(tid) < 0, 1);
+
+  /* Never joined: cleaned up with the process */
+  Create_User_Thread(Return_Arg, Stack_Top(2), 0);
+
+  pid = Spawn_Program("/c/threads.exe", "/c/threads.exe -exit");
+  failed += Check("Exit with threads running", Wait(pid), EXIT_CODE);
+
+  Print(failed ? "FAILED\n" : "PASSED\n");
+  return failed;
+}
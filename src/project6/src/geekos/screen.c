@@ -44,6 +44,9 @@ struct Console_State {
     int saveRow, saveCol;
     uchar_t currentAttr;
 
+    /* Scrolling region (see ESC[r), first and last line */
+    int scrollTop, scrollBottom;
+
     /* Working variables for processing escape sequences. */
     enum State state;
     int argList[MAXARGS];
@@ -53,31 +56,60 @@ struct Console_State {
 static struct Console_State s_cons;
 
 #define NUM_SCREEN_DWORDS ((NUMROWS * NUMCOLS * 2) / 4)
-#define NUM_SCROLL_DWORDS (((NUMROWS-1) * NUMCOLS * 2) / 4)
 #define NUM_DWORDS_PER_LINE ((NUMCOLS*2)/4)
 #define FILL_DWORD (0x00200020 | (s_cons.currentAttr<<24) | (s_cons.currentAttr<<8))
 
 /*
- * Scroll the display one line.
+ * Scroll lines top..bottom of the display up n lines,
+ * clearing the lines that open up at the bottom.
  * We speed things up by copying 4 bytes at a time.
  */
-static void Scroll(void)
+static void Scroll_Up(int top, int bottom, int n)
 {
-    uint_t* v;
-    int i, n = NUM_SCROLL_DWORDS;
+    uint_t* v = (uint_t*)VIDMEM + top * NUM_DWORDS_PER_LINE;
+    int i, count;
     uint_t fill = FILL_DWORD;
 
-    /* Move lines 1..NUMROWS-1 up one position. */
-    for (v = (uint_t*)VIDMEM, i = 0; i < n; ++i) {
-	*v = *(v + NUM_DWORDS_PER_LINE);
+    if (n > bottom - top + 1)
+	n = bottom - top + 1;
+
+    /* Move lines top+n..bottom up n positions. */
+    count = (bottom - top + 1 - n) * NUM_DWORDS_PER_LINE;
+    for (i = 0; i < count; ++i) {
+	*v = *(v + n * NUM_DWORDS_PER_LINE);
 	++v;
     }
 
-    /* Clear out last line. */
-    for (v = (uint_t*)VIDMEM + n, i = 0; i < NUM_DWORDS_PER_LINE; ++i)
+    /* Clear out the last n lines. */
+    for (i = 0; i < n * NUM_DWORDS_PER_LINE; ++i)
 	*v++ = fill;
 }
 
+/*
+ * Scroll lines top..bottom of the display down n lines,
+ * clearing the lines that open up at the top.
+ */
+static void Scroll_Down(int top, int bottom, int n)
+{
+    uint_t* v = (uint_t*)VIDMEM + (bottom + 1) * NUM_DWORDS_PER_LINE;
+    int i, count;
+    uint_t fill = FILL_DWORD;
+
+    if (n > bottom - top + 1)
+	n = bottom - top + 1;
+
+    /* Move lines top..bottom-n down n positions, starting from the end. */
+    count = (bottom - top + 1 - n) * NUM_DWORDS_PER_LINE;
+    for (i = 0; i < count; ++i) {
+	--v;
+	*v = *(v - n * NUM_DWORDS_PER_LINE);
+    }
+
+    /* Clear out the first n lines. */
+    for (i = 0; i < n * NUM_DWORDS_PER_LINE; ++i)
+	*--v = fill;
+}
+
 /*
  * Clear current cursor position to end of line using
  * current attribute.
@@ -94,16 +126,16 @@ static void Clear_To_EOL(void)
 
 /*
  * Move to the beginning of the next line, scrolling
- * if necessary.
+ * if necessary.  Only the scrolling region scrolls; below it,
+ * the cursor stops at the last line.
  */
 static void Newline(void)
 {
-    ++s_cons.row;
     s_cons.col = 0;
-    if (s_cons.row == NUMROWS) {
-	Scroll();
-	s_cons.row = NUMROWS - 1;
-    }
+    if (s_cons.row == s_cons.scrollBottom)
+	Scroll_Up(s_cons.scrollTop, s_cons.scrollBottom, 1);
+    else if (s_cons.row < NUMROWS - 1)
+	++s_cons.row;
 }
 
 /*
@@ -269,6 +301,58 @@ static int Get_Arg(int argNum)
     return argNum < s_cons.numArgs ? s_cons.argList[argNum] : 0;
 }
 
+/*
+ * Get a count argument, which is 1 if not specified.
+ */
+static int Get_Count(void)
+{
+    int count = Get_Arg(0);
+    return count > 0 ? count : 1;
+}
+
+/*
+ * Set the scrolling region (DECSTBM, ESC[top;bottomr) from
+ * 1-based line numbers, by default the whole screen.
+ * Like a VT100, moves the cursor home.
+ */
+static void Set_Scroll_Region(void)
+{
+    int top = Get_Arg(0) > 0 ? Get_Arg(0) - 1 : 0;
+    int bottom = Get_Arg(1) > 0 ? Get_Arg(1) - 1 : NUMROWS - 1;
+
+    if (bottom >= NUMROWS)
+	bottom = NUMROWS - 1;
+    if (top < bottom) {
+	s_cons.scrollTop = top;
+	s_cons.scrollBottom = bottom;
+    }
+    Move_Cursor(0, 0);
+}
+
+/*
+ * Insert n blank lines at the cursor line (ESC[nL), pushing the
+ * lines below it down within the scrolling region.
+ */
+static void Insert_Lines(int n)
+{
+    if (s_cons.row < s_cons.scrollTop || s_cons.row > s_cons.scrollBottom)
+	return;
+    Scroll_Down(s_cons.row, s_cons.scrollBottom, n);
+    s_cons.col = 0;
+}
+
+/*
+ * Delete n lines at the cursor line (ESC[nM), pulling the
+ * lines below it up within the scrolling region.
+ */
+static void Delete_Lines(int n)
+{
+    if (s_cons.row < s_cons.scrollTop || s_cons.row > s_cons.scrollBottom)
+	return;
+    Scroll_Up(s_cons.row, s_cons.scrollBottom, n);
+    s_cons.col = 0;
+}
+
 /*
  * The workhorse output function.
  * Depending on the current console output state,
@@ -329,6 +413,9 @@ again:
 	case 'C': Move_Cursor(s_cons.row, s_cons.col + Get_Arg(0)); break;
 	case 'D': Move_Cursor(s_cons.row, s_cons.col - Get_Arg(0)); break;
 	case 'm': Update_Attributes(); break;
+	case 'r': Set_Scroll_Region(); break;
+	case 'L': Insert_Lines(Get_Count()); break;
+	case 'M': Delete_Lines(Get_Count()); break;
 	case 'f': case 'H':
 	    if (s_cons.numArgs == 2) Move_Cursor(Get_Arg(0)-1, Get_Arg(1)-1); break;
 	case 'J':
@@ -395,6 +482,8 @@ void Init_Screen(void)
     bool iflag = Begin_Int_Atomic();
 
     s_cons.row = s_cons.col = 0;
+    s_cons.scrollTop = 0;
+    s_cons.scrollBottom = NUMROWS - 1;
     s_cons.currentAttr = DEFAULT_ATTRIBUTE;
     Clear_Screen();
 
@@ -19,6 +19,9 @@
  *   that haven't been modified, even when the app eagerly redraws
  *   things (the "ae" editor does this)
  * - Scrolling in untested, but should work (I think)
+ * - refresh() looks for lines that moved up or down since the
+ *   last update, and moves them with the console's insert/delete
+ *   line sequences instead of redrawing them
  *
  * TODO:
  * - Buffer the output in refresh(), to avoid making one system
@@ -40,6 +43,7 @@
 struct Line {
     int buf[MAXCOLS];
     bool modified;
+    bool forced;		/* redraw even if the display looks the same */
 };
 
 struct Screen {
@@ -79,6 +83,7 @@ static void Scroll_Screen(struct Screen *s)
 	*(LINE(s, j-1)) = *(LINE(s, j));
     last->buf[0] = EOL;
     last->modified = false;
+    last->forced = false;
 }
 
 static void Scroll_Win(WINDOW *w)
@@ -168,13 +173,133 @@ static void Add_Char(WINDOW *w, int c)
     }
 }
 
+/*
+ * Do two lines have the same contents?
+ */
+static bool Lines_Equal(struct Line *a, struct Line *b)
+{
+    int i;
+
+    for (i = 0; i < COLS; ++i) {
+	if (a->buf[i] != b->buf[i])
+	    return false;
+	if (a->buf[i] == EOL)
+	    break;
+    }
+    return true;
+}
+
+/*
+ * Hash a line, so that candidate scrolls can be checked
+ * without comparing every pair of lines in full.
+ */
+static unsigned Hash_Line(struct Line *line)
+{
+    unsigned h = 0;
+    int i;
+
+    for (i = 0; i < COLS && line->buf[i] != EOL; ++i)
+	h = h * 31 + line->buf[i];
+    return h;
+}
+
+/*
+ * Find how far the text moved between the displayed screen and
+ * the work screen: the shift (positive when lines moved up) under
+ * which the most non-blank work lines j match display line j+shift.
+ * The lines that match span work lines *pTop..*pBottom.
+ * Returns the shift, 0 if scrolling wouldn't save anything.
+ */
+static int Find_Scroll(WINDOW *w, int *pTop, int *pBottom)
+{
+    unsigned workHash[MAXLINES], displayHash[MAXLINES];
+    int bestShift = 0, bestCount = 0;
+    int shift, j;
+
+    for (j = 0; j < LINES; ++j) {
+	workHash[j] = Hash_Line(LINE(WORK(w), j));
+	displayHash[j] = Hash_Line(LINE(DISPLAY(w), j));
+    }
+
+    for (shift = 1 - LINES; shift < LINES; ++shift) {
+	int count = 0, top = -1, bottom = -1;
+
+	if (shift == 0)
+	    continue;
+	for (j = 0; j < LINES; ++j) {
+	    struct Line *workLine = LINE(WORK(w), j);
+	    int k = j + shift;
+
+	    if (k < 0 || k >= LINES || workLine->buf[0] == EOL)
+		continue;
+	    if (workHash[j] != displayHash[k] || !Lines_Equal(workLine, LINE(DISPLAY(w), k)))
+		continue;
+	    /* Already right where it is: nothing to gain */
+	    if (Lines_Equal(workLine, LINE(DISPLAY(w), j)))
+		continue;
+	    ++count;
+	    if (top < 0)
+		top = j;
+	    bottom = j;
+	}
+	/* Moving the lines costs a few escape sequences */
+	if (count > bestCount && count > 1) {
+	    bestCount = count;
+	    bestShift = shift;
+	    *pTop = top;
+	    *pBottom = bottom;
+	}
+    }
+    return bestShift;
+}
+
+/*
+ * Move display lines first..last by shift lines (up if positive),
+ * using a scrolling region so the rest of the screen stays put.
+ * Updates the display image to match.
+ */
+static void Scroll_Display(WINDOW *w, int first, int last, int shift)
+{
+    struct Screen *display = DISPLAY(w);
+    int j;
+
+    /* ESC[r homes the cursor, so position it afterwards */
+    Print("\x1B[%d;%dr", first + 1, last + 1);
+    if (shift > 0) {
+	Put_Cursor(first, 0);
+	Print("\x1B[%dM", shift);
+	for (j = first; j <= last; ++j) {
+	    if (j + shift <= last)
+		*LINE(display, j) = *LINE(display, j + shift);
+	    else
+		LINE(display, j)->buf[0] = EOL;
+	}
+    } else {
+	Put_Cursor(first, 0);
+	Print("\x1B[%dL", -shift);
+	for (j = last; j >= first; --j) {
+	    if (j + shift >= first)
+		*LINE(display, j) = *LINE(display, j + shift);
+	    else
+		LINE(display, j)->buf[0] = EOL;
+	}
+    }
+    Print("\x1B[r");
+
+    /* Redraw whatever in the region still differs */
+    for (j = first; j <= last; ++j)
+	LINE(WORK(w), j)->modified = true;
+}
+
 /* Invalidate entire window. */
 static void Invalidate(WINDOW *w)
 {
     struct Screen *s = WORK(w);
     int j;
-    for (j = 0; j < LINES; ++j)
+    for (j = 0; j < LINES; ++j) {
 	LINE(s,j)->modified = true;
+	LINE(s,j)->forced = true;
+    }
 }
 
 /* ----------------------------------------------------------------------
@@ -185,6 +310,7 @@ WINDOW *stdscr = &s_stdscr;
 int LINES = 25;
 int COLS = 80;
 
+/* Blank the window, and repaint all of it at the next refresh. */
 int clear(void)
 {
     int j;
@@ -193,6 +319,7 @@ int clear(void)
 	clrtoeol();
     }
     move(0,0);
+    Invalidate(stdscr);
     return OK;
 }
 
@@ -243,7 +370,7 @@ int mvaddstr(int y, int x, const char *s)
  */
 int refresh(void)
 {
-    int i, j;
+    int i, j, shift, top = 0, bottom = 0;
     struct Screen *work = WORK(stdscr), *display = DISPLAY(stdscr);
 
     /*
@@ -257,6 +384,15 @@ int refresh(void)
 	}
     }
 
+    /*
+     * Move lines that scrolled, so that they don't need redrawing.
+     * Lines work[top..bottom] come from display[top+shift..bottom+shift].
+     */
+    if ((shift = Find_Scroll(stdscr, &top, &bottom)) > 0)
+	Scroll_Display(stdscr, top, bottom + shift, shift);
+    else if (shift < 0)
+	Scroll_Display(stdscr, top + shift, bottom, shift);
+
     /*
      * Update each modified line
      */
@@ -264,8 +400,15 @@ int refresh(void)
 	struct Line *workLine = LINE(WORK(stdscr), j);
 	struct Line *displayLine = LINE(DISPLAY(stdscr), j);
 
+	if (workLine->modified && !workLine->forced && Lines_Equal(workLine, displayLine))
+	    workLine->modified = false;
+
 	if (workLine->modified) {
-	    bool identical = true;
+	    /* A forced line is rewritten whole: the screen may not match the image */
+	    bool identical = !workLine->forced;
+
+	    if (!identical)
+		Put_Cursor(j, 0);
 	    for (i = 0; i < COLS; ++i) {
 		int ch = workLine->buf[i];
 
@@ -289,6 +432,7 @@ int refresh(void)
 		Put_Cursor(j, i);
 	    Print("\x1B[K");/* Clear to EOL */
 	    workLine->modified = false;
+	    workLine->forced = false;
 	}
     }
 
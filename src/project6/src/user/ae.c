@@ -7,63 +7,90 @@
  */
 
 #include <curses.h>
+#include <string.h>
 #include <unix.h>
 
 #define MODE (O_READ|O_WRITE)
-#define BUF ((32*1024) - 1)
+#define CHUNK 4096		/* bytes of the file read at a time */
+#define NCHUNK 8		/* chunks of the file kept in memory */
+#define ADDBUF ((32*1024) - 1)	/* room for inserted text */
+#define NPIECE 1024
+#define NAMEMAX 256
+#define EOF (-1)
+
+#define ORIG 0
+#define ADD 1
+
+struct piece {
+	int src;		/* ORIG or ADD */
+	int start;		/* offset in the file or the add buffer */
+	int len;
+};
 
 int done;
 int row, col;
 int index_, page, epage;
-char buf[BUF];
-char *ebuf;
-char *gap = buf;
-char *egap;
+int total;
+int origsize;
+struct piece pieces[NPIECE];
+int npieces;
+int lastpiece, lastpos;
+char addbuf[ADDBUF];
+int addlen;
+int origfd = -1;
+char cache[NCHUNK][CHUNK];
+int cachetag[NCHUNK];
 char *filename;
 
 /*
  *	The following assertions must be maintained.
  *
- *	o  buf <= gap <= egap <= ebuf
- *		If gap == egap then the buffer is full.
+ *	o  page <= index_ < epage
  *
- *	o  point = ptr(index_) and point < gap or egap <= point
+ *	o  0 <= index_ <= total
  *
- *	o  page <= index_ < epage
+ *	o  total is the sum of the lengths of pieces[0..npieces)
  *
- *	o  0 <= index_ <= pos(ebuf) <= BUF
+ *	o  lastpos is the offset of the first character of
+ *	   pieces[lastpiece] (or total if lastpiece == npieces)
  *
  *
  *	Memory representation of the file:
  *
- *		low	buf  -->+----------+
- *				|  front   |
- *				| of file  |
- *			gap  -->+----------+<-- character not in file 
- *				|   hole   |
- *			egap -->+----------+<-- character in file
- *				|   back   |
- *				| of file  |
- *		high	ebuf -->+----------+<-- character not in file 
+ *	The text is a sequence of pieces, each a run of characters
+ *	from either the original file or the add buffer.  The original
+ *	file is never changed while editing; it is read CHUNK bytes at
+ *	a time as the text is looked at, so opening a file costs the
+ *	same whatever its size.  Inserted characters are appended to
+ *	the add buffer.
  *
+ *		pieces:	| ORIG 0,120 | ADD 0,5 | ORIG 130,9000 |
+ *		           |             |            |
+ *		file:   [xxxxxxxxxxxx.......xxxxxxxxx...]
+ *		add buffer:           [hello]
  *
- *	point & gap
+ *	Inserting or deleting a character splits or trims at most one
+ *	piece, and shifts the piece table, not the text.  Typing at
+ *	one place just grows the last piece of the add buffer.
  *
- *	The Point is the current cursor position while the Gap is the 
- *	position where the last edit operation took place. The Gap is 
- *	ment to be the cursor but to avoid shuffling characters while 
- *	the cursor moves it is easier to just move a pointer and when 
- *	something serious has to be done then you move the Gap to the 
- *	Point. 
+ *	lastpiece/lastpos remember where the last character was found,
+ *	so that moving through the text a character at a time, as
+ *	the display and motion commands do, doesn't search the table.
  */
 
 int adjust();
+int charat();
+int deletech();
+int findpiece();
+int insertch();
 int nextline();
-int pos();
+int origchar();
 int prevline();
-char *ptr();
+int putpiece();
+int reset();
 
 void bottom();
+void closepiece();
 void delete();
 void display();
 void down();
@@ -72,7 +99,8 @@ void insert();
 void left();
 void lnbegin();
 void lnend();
-void movegap();
+void nop();
+void openpieces();
 void pgdown();
 void pgup();
 void redraw();
@@ -88,23 +116,197 @@ void (*func[])() = {
 	left, down, up, right, 
 	wleft, pgdown, pgup, wright,
 	lnbegin, lnend, top, bottom, 
-	insert, delete, file, redraw, quit, movegap
+	insert, delete, file, redraw, quit, nop
 };
 
-char *
-ptr(offset)
+/*
+ *	Character at offset in the original file, reading its
+ *	chunk in if needed.  EOF if it can't be read; a chunk
+ *	is only kept once all of it has been read.
+ */
+int
+origchar(offset)
 int offset;
 {
-	if (offset < 0)
-		return (buf);
-	return (buf+offset + (buf+offset < gap ? 0 : egap-gap));
+	int chunk = offset / CHUNK;
+	int slot = chunk % NCHUNK;
+	int want = origsize - chunk * CHUNK;
+	int n, i;
+
+	if (offset < 0 || origsize <= offset)
+		return (EOF);
+	if (cachetag[slot] != chunk) {
+		cachetag[slot] = -1;
+		if (CHUNK < want)
+			want = CHUNK;
+		if (Seek(origfd, chunk * CHUNK) < 0)
+			return (EOF);
+		for (i = 0; i < want; i += n)
+			if ((n = read(origfd, cache[slot] + i, want - i)) <= 0)
+				return (EOF);
+		cachetag[slot] = chunk;
+	}
+	return ((unsigned char) cache[slot][offset % CHUNK]);
 }
 
+/*
+ *	Index of the piece holding the character at offset,
+ *	with lastpos set to where that piece starts.
+ */
 int
-pos(pointer)
-char *pointer;
+findpiece(offset)
+int offset;
 {
-	return (pointer-buf - (pointer < egap ? 0 : egap-gap)); 
+	while (offset < lastpos) {
+		--lastpiece;
+		lastpos -= pieces[lastpiece].len;
+	}
+	while (lastpiece < npieces && lastpos + pieces[lastpiece].len <= offset) {
+		lastpos += pieces[lastpiece].len;
+		++lastpiece;
+	}
+	return (lastpiece);
+}
+
+int
+charat(offset)
+int offset;
+{
+	struct piece *pc;
+
+	if (offset < 0 || total <= offset)
+		return (EOF);
+	pc = &pieces[findpiece(offset)];
+	if (pc->src == ADD)
+		return ((unsigned char) addbuf[pc->start + offset - lastpos]);
+	return (origchar(pc->start + offset - lastpos));
+}
+
+/*
+ *	Make room for n pieces at index i.
+ */
+void
+openpieces(i, n)
+int i, n;
+{
+	memmove(&pieces[i+n], &pieces[i], (npieces-i) * sizeof(struct piece));
+	npieces += n;
+}
+
+void
+closepiece(i)
+int i;
+{
+	--npieces;
+	memmove(&pieces[i], &pieces[i+1], (npieces-i) * sizeof(struct piece));
+}
+
+/*
+ *	Insert a character at offset.  Returns 0 if there is no room.
+ */
+int
+insertch(offset, ch)
+int offset, ch;
+{
+	struct piece *pc;
+	int i;
+
+	if (ADDBUF <= addlen)
+		return (0);
+
+	/* Typing on: the piece before ends with the last character added */
+	if (0 < offset) {
+		pc = &pieces[i = findpiece(offset-1)];
+		if (pc->src == ADD && lastpos + pc->len == offset
+		&& pc->start + pc->len == addlen) {
+			addbuf[addlen++] = ch;
+			++pc->len;
+			++total;
+			return (1);
+		}
+	}
+
+	if (NPIECE < npieces + 2)
+		return (0);
+	i = findpiece(offset);
+	if (i < npieces && lastpos < offset) {
+		/* Split the piece around the new one */
+		openpieces(i, 2);
+		pieces[i].len = offset - lastpos;
+		pieces[i+2].start += pieces[i].len;
+		pieces[i+2].len -= pieces[i].len;
+		++i;
+	} else {
+		openpieces(i, 1);
+	}
+	pieces[i].src = ADD;
+	pieces[i].start = addlen;
+	pieces[i].len = 1;
+	addbuf[addlen++] = ch;
+	++total;
+	lastpiece = 0;
+	lastpos = 0;
+	return (1);
+}
+
+/*
+ *	Delete the character at offset.  Returns 0 if it is past the
+ *	end, or the piece would have to be split and there is no room.
+ */
+int
+deletech(offset)
+int offset;
+{
+	struct piece *pc;
+	int i;
+
+	if (offset < 0 || total <= offset)
+		return (0);
+	pc = &pieces[i = findpiece(offset)];
+	if (offset == lastpos) {
+		++pc->start;
+		if (--pc->len == 0)
+			closepiece(i);
+	} else if (offset == lastpos + pc->len - 1) {
+		--pc->len;
+	} else {
+		if (NPIECE <= npieces)
+			return (0);
+		openpieces(i, 1);
+		pieces[i+1].start += offset + 1 - lastpos;
+		pieces[i+1].len -= offset + 1 - lastpos;
+		pieces[i].len = offset - lastpos;
+	}
+	--total;
+	lastpiece = 0;
+	lastpos = 0;
+	return (1);
+}
+
+/*
+ *	Start over with the text being just the file open on origfd.
+ *	Returns -1, with errno set, if its size can't be found.
+ */
+int
+reset()
+{
+	struct VFS_File_Stat stat;
+	int i, rc;
+
+	if ((rc = FStat(origfd, &stat)) < 0) {
+		errno = rc;
+		return (-1);
+	}
+	origsize = total = stat.size;
+	pieces[0].src = ORIG;
+	pieces[0].start = 0;
+	pieces[0].len = total;
+	npieces = 0 < total ? 1 : 0;
+	lastpiece = lastpos = 0;
+	addlen = 0;
+	for (i = 0; i < NCHUNK; ++i)
+		cachetag[i] = -1;
+	return (0);
 }
 
 void
@@ -116,7 +318,7 @@ top()
 void
 bottom()
 {
-	epage = index_ = pos(ebuf);
+	epage = index_ = total;
 }
 
 void
@@ -133,44 +335,37 @@ redraw()
 }
 
 void
-movegap()
-{
-	char *p = ptr(index_);
-	while (p < gap)
-		*--egap = *--gap;
-	while (egap < p)
-		*gap++ = *egap++;
-	index_ = pos(egap);
+nop()
+{
 }
 
 int
 prevline(offset)
 int offset;
 {
-	char *p;
-	while (buf < (p = ptr(--offset)) && *p != '\n')
+	while (0 < --offset && charat(offset) != '\n')
 		;
-	return (buf < p ? ++offset : 0);
+	return (0 < offset ? ++offset : 0);
 }
 
 int
 nextline(offset)
 int offset;
 {
-	char *p;
-	while ((p = ptr(offset++)) < ebuf && *p != '\n')	
+	int c;
+	while ((c = charat(offset++)) != EOF && c != '\n')	
 		;
-	return (p < ebuf ? offset : pos(ebuf));
+	return (c != EOF ? offset : total);
 }
 
 int
 adjust(offset, column)
 int offset, column;
 {
-	char *p;
+	int c;
 	int i = 0;
-	while ((p = ptr(offset)) < ebuf && *p != '\n' && i < column) {
-		i += *p == '\t' ? 8-(i&7) : 1;
+	while ((c = charat(offset)) != EOF && c != '\n' && i < column) {
+		i += c == '\t' ? 8-(i&7) : 1;
 		++offset;
 	}
 	return (offset);
@@ -186,7 +381,7 @@ left()
 void
 right()
 {
-	if (index_ < pos(ebuf))
+	if (index_ < total)
 		++index_;
 }
 
@@ -218,10 +413,9 @@ lnend()
 void
 wleft()
 {
-	char *p;
-	while (!isspace(*(p = ptr(index_))) && buf < p)
+	while (0 < index_ && !isspace(charat(index_)))
 		--index_;
-	while (isspace(*(p = ptr(index_))) && buf < p)
+	while (0 < index_ && isspace(charat(index_)))
 		--index_;
 }
 
@@ -231,7 +425,7 @@ pgdown()
 	page = index_ = prevline(epage-1);
 	while (0 < row--)
 		down();
-	epage = pos(ebuf);
+	epage = total;
 }
 
 void
@@ -247,10 +441,9 @@ pgup()
 void
 wright()
 {
-	char *p;
-	while (!isspace(*(p = ptr(index_))) && p < ebuf)
+	while (index_ < total && !isspace(charat(index_)))
 		++index_;
-	while (isspace(*(p = ptr(index_))) && p < ebuf)
+	while (index_ < total && isspace(charat(index_)))
 		++index_;
 }
 
@@ -258,15 +451,13 @@ void
 insert()
 {
 	int ch;
-	movegap();
 	while ((ch = getch()) != '\f') {
 		if (ch == '\b') {
-			if (buf < gap)
-				--gap;
-		} else if (gap < egap) {
-			*gap++ = ch == '\r' ? '\n' : ch;
+			if (0 < index_ && deletech(index_-1))
+				--index_;
+		} else if (insertch(index_, ch == '\r' ? '\n' : ch)) {
+			++index_;
 		}
-		index_ = pos(egap);
 		display();
 	}
 }
@@ -274,34 +465,102 @@ insert()
 void
 delete()
 {
-	movegap();
-	if (egap < ebuf)
-		index_ = pos(++egap);
+	deletech(index_);
 }
 
+/*
+ *	Write a piece to fd, a chunk at a time.
+ *	Returns 0 if a write fails.
+ */
+int
+putpiece(fd, pc)
+int fd;
+struct piece *pc;
+{
+	int offset = pc->start, end = pc->start + pc->len;
+
+	if (pc->src == ADD)
+		return (write(fd, addbuf + offset, pc->len) == pc->len);
+	while (offset < end) {
+		int n = CHUNK - offset % CHUNK;
+		if (end - offset < n)
+			n = end - offset;
+		if (origchar(offset) == EOF)
+			return (0);
+		if (write(fd, &cache[(offset / CHUNK) % NCHUNK][offset % CHUNK], n) != n)
+			return (0);
+		offset += n;
+	}
+	return (1);
+}
+
+/*
+ *	Save the text.  The original file is still being read from,
+ *	so the pieces go to a scratch file first, which is then copied
+ *	over the original.  The saved file becomes the new original.
+ */
 void
 file()
 {
-	int i;
-	int j = index_;
-	index_ = 0;
-	movegap();
-	write(i = creat(filename, MODE), egap, (int)(ebuf-egap));
-	close(i);
-	index_ = j;
+	char tmp[NAMEMAX];
+	int fd, ofd, i, n = 0, ok = 1;
+
+	if (NAMEMAX <= strlen(filename) + 1)
+		return;
+	strcpy(tmp, filename);
+	strcat(tmp, "~");
+
+	Delete(tmp);
+	if ((fd = creat(tmp, MODE)) < 0)
+		return;
+	for (i = 0; ok && i < npieces; ++i)
+		ok = putpiece(fd, &pieces[i]);
+	close(fd);
+	if (!ok) {
+		Delete(tmp);
+		return;
+	}
+
+	/* Done with the original; the cache is the copy buffer */
+	close(origfd);
+	Delete(filename);
+	fd = open(tmp, O_READ);
+	ofd = creat(filename, MODE);
+	if (fd < 0 || ofd < 0)
+		ok = 0;
+	while (ok && (n = read(fd, cache[0], sizeof(cache))) > 0)
+		ok = write(ofd, cache[0], n) == n;
+	if (n < 0)
+		ok = 0;
+	if (0 <= fd)
+		close(fd);
+	if (0 <= ofd)
+		close(ofd);
+
+	/* If the copy failed, the scratch file holds the text */
+	if (ok)
+		Delete(tmp);
+	origfd = open(ok ? filename : tmp, O_READ);
+
+	/* Carrying on with an empty text would lose the file at the next save */
+	if (origfd < 0 || reset() < 0) {
+		endwin();
+		printf("Could not reopen %s: %s\n", ok ? filename : tmp, strerror(errno));
+		exit(1);
+	}
 }
 
 void
 display()
 {
-	char *p;
+	int c;
 	int i, j;
 
 	if (index_ < page)
 		page = prevline(index_);
 	if (epage <= index_) {
 		page = nextline(index_); 
-		i = page == pos(ebuf) ? LINES-2 : LINES; 
+		i = page == total ? LINES-2 : LINES; 
 		while (0 < i--)
 			page = prevline(page-1);
 	}
@@ -314,14 +573,14 @@ display()
 			row = i;
 			col = j;
 		}
-		p = ptr(epage);
-		if (LINES <= i || ebuf <= p)
+		c = charat(epage);
+		if (LINES <= i || c == EOF)
 			break;
-		if (*p != '\r') {
-			addch(*p);
-			j += *p == '\t' ? 8-(j&7) : 1;
+		if (c != '\r') {
+			addch(c);
+			j += c == '\t' ? 8-(j&7) : 1;
 		}
-		if (*p == '\n' || COLS <= j) {
+		if (c == '\n' || COLS <= j) {
 			++i;
 			j = 0;
 		}
@@ -339,9 +598,7 @@ main(argc, argv)
 int argc;
 char **argv;
 {
-	int fd, ch, i;
-
-	egap = ebuf = buf + BUF;
+	int ch, i;
 
 	if (argc < 2)
 		return (2);
@@ -351,19 +608,8 @@ char **argv;
 	idlok(stdscr, 1);
 
 	filename = argv[1];
-	fd = open(filename, 0);
-
-	if (fd >= 0) {
-		/* FIXME: Don't assume everything can be read at once. */
-		int n = read(fd, buf, BUF);
-		if (n < 0) {
-			printf("Error reading from file: %s\n", strerror(errno));
-			exit(1);
-		}
-		printf("Read returned %d bytes\n", n);
-		gap += n;
-		close(fd);
-	} else {
+	origfd = open(filename, O_READ);
+	if (origfd < 0 || reset() < 0) {
 		printf("Could not open %s: %s\n", filename, strerror(errno));
 		exit(1);
 	}